@@ -60,39 +60,13 @@ flickr_proxy_call_set_property (GObject      *object,
 static gboolean
 _prepare (RestProxyCall *call, GError **error)
 {
-  FlickrProxy *proxy = NULL;
-  FlickrProxyPrivate *priv;
-  RestProxyCallPrivate *call_priv;
-  GHashTable *params;
-  char *s;
+  RestRequestView view;
 
-  g_object_get (call, "proxy", &proxy, NULL);
-  priv = FLICKR_PROXY_GET_PRIVATE (proxy);
-  call_priv = call->priv;
-
-  /* We need to reset the URL because Flickr puts the function in the parameters */
-
-  if (GET_PRIVATE (call)->upload) {
-    call_priv->url = g_strdup ("http://api.flickr.com/services/upload/");
-  } else {
-    call_priv->url = g_strdup ("http://api.flickr.com/services/rest/");
-    rest_proxy_call_add_param (call, "method", call_priv->function);
-  }
-
-  rest_proxy_call_add_param (call, "api_key", priv->api_key);
-
-  if (priv->token)
-    rest_proxy_call_add_param (call, "auth_token", priv->token);
-
-  /* Get the string params as a hash for signing */
-  params = rest_params_as_string_hash_table (call_priv->params);
-  s = flickr_proxy_sign (proxy, params);
-  g_hash_table_unref (params);
-
-  rest_proxy_call_add_param (call, "api_sig", s);
-  g_free (s);
-
-  g_object_unref (proxy);
+  _rest_proxy_call_init_view (call, &view);
+  _flickr_proxy_prepare (FLICKR_PROXY (call->priv->proxy),
+                         GET_PRIVATE (call)->upload,
+                         &view);
+  _rest_proxy_call_finish_view (call, &view);
 
   return TRUE;
 }
@@ -21,6 +21,7 @@
  */
 
 #include "flickr-proxy.h"
+#include "rest/rest-private.h"
 
 #define FLICKR_PROXY_GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), FLICKR_TYPE_PROXY, FlickrProxyPrivate))
@@ -31,3 +32,8 @@ struct _FlickrProxyPrivate {
   char *token;
 };
 
+char *_flickr_proxy_sign_params (FlickrProxy *proxy, RestParams *params);
+
+void _flickr_proxy_prepare (FlickrProxy     *proxy,
+                            gboolean         upload,
+                            RestRequestView *view);
@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <rest/rest-proxy.h>
+#include <rest/rest-private.h>
+#include <rest/rest-text-codec.h>
 #include <libsoup/soup.h>
 #include "flickr-proxy.h"
 #include "flickr-proxy-private.h"
@@ -63,6 +65,17 @@ _new_call (RestProxy *proxy)
   return call;
 }
 
+/* Requests that aren't calls are never uploads */
+static gboolean
+_prepare_request (RestProxy        *proxy,
+                  RestRequestView  *view,
+                  GError          **error)
+{
+  _flickr_proxy_prepare (FLICKR_PROXY (proxy), FALSE, view);
+
+  return TRUE;
+}
+
 static void
 flickr_proxy_get_property (GObject *object, guint property_id,
                               GValue *value, GParamSpec *pspec)
@@ -168,6 +181,8 @@ static void
 flickr_proxy_init (FlickrProxy *self)
 {
   self->priv = FLICKR_PROXY_GET_PRIVATE (self);
+
+  _rest_proxy_set_prepare_func (REST_PROXY (self), _prepare_request);
 }
 
 RestProxy *
@@ -267,8 +282,9 @@ flickr_proxy_sign (FlickrProxy *proxy, GHashTable *params)
 {
   FlickrProxyPrivate *priv;
   GList *keys;
-  char *md5;
   GChecksum *checksum;
+  guint8 digest[16];
+  gsize digest_length = sizeof (digest);
 
   g_return_val_if_fail (FLICKR_IS_PROXY (proxy), NULL);
   g_return_val_if_fail (params, NULL);
@@ -293,10 +309,78 @@ flickr_proxy_sign (FlickrProxy *proxy, GHashTable *params)
     keys = g_list_delete_link (keys, keys);
   }
 
-  md5 = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_get_digest (checksum, digest, &digest_length);
   g_checksum_free (checksum);
 
-  return md5;
+  return _rest_hex_encode_string (digest, digest_length);
+}
+
+/*
+ * As flickr_proxy_sign(), but signs every string parameter in @params,
+ * including the ones with repeated names, which a hash table can't hold.
+ */
+char *
+_flickr_proxy_sign_params (FlickrProxy *proxy, RestParams *params)
+{
+  FlickrProxyPrivate *priv;
+  GPtrArray *strings;
+  GChecksum *checksum;
+  guint8 digest[16];
+  gsize digest_length = sizeof (digest);
+  guint i;
+
+  priv = FLICKR_PROXY_GET_PRIVATE (proxy);
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  g_checksum_update (checksum, (guchar *)priv->shared_secret, -1);
+
+  strings = _rest_params_sorted_strings (params);
+  for (i = 0; i < strings->len; i++) {
+    RestParam *param = g_ptr_array_index (strings, i);
+
+    g_checksum_update (checksum, (guchar *)rest_param_get_name (param), -1);
+    g_checksum_update (checksum, (guchar *)rest_param_get_content (param), -1);
+  }
+  g_ptr_array_free (strings, TRUE);
+
+  g_checksum_get_digest (checksum, digest, &digest_length);
+  g_checksum_free (checksum);
+
+  return _rest_hex_encode_string (digest, digest_length);
+}
+
+/*
+ * Sign the request in @view, sending it to the upload endpoint if @upload.
+ * Both calls and #RestRequest objects are signed here.
+ */
+void
+_flickr_proxy_prepare (FlickrProxy     *proxy,
+                       gboolean         upload,
+                       RestRequestView *view)
+{
+  FlickrProxyPrivate *priv;
+  char *s;
+
+  priv = FLICKR_PROXY_GET_PRIVATE (proxy);
+
+  /* We need to reset the URL because Flickr puts the function in the parameters */
+  g_free (view->url);
+
+  if (upload) {
+    view->url = g_strdup ("http://api.flickr.com/services/upload/");
+  } else {
+    view->url = g_strdup ("http://api.flickr.com/services/rest/");
+    _rest_request_view_set_param (view, "method", view->function);
+  }
+
+  _rest_request_view_set_param (view, "api_key", priv->api_key);
+
+  if (priv->token)
+    _rest_request_view_set_param (view, "auth_token", priv->token);
+
+  s = _flickr_proxy_sign_params (proxy, view->params);
+  _rest_request_view_set_param (view, "api_sig", s);
+  g_free (s);
 }
 
 char *
@@ -400,6 +484,7 @@ flickr_proxy_new_upload (FlickrProxy *proxy)
  * be set as the "photo" parameter for you, avoiding you from having to open the
  * file and determine the MIME type.
  *
+ * The file is read while it is being uploaded rather than loaded into memory.
  * Note that this function can in theory block.
  *
  * See http://www.flickr.com/services/api/upload.api.html for details on
@@ -410,42 +495,58 @@ flickr_proxy_new_upload (FlickrProxy *proxy)
 RestProxyCall *
 flickr_proxy_new_upload_for_file (FlickrProxy *proxy, const char *filename, GError **error)
 {
-  GMappedFile *map;
-  GError *err = NULL;
-  char *basename = NULL, *content_type = NULL;
+  GFile *file;
+  GFileInfo *info;
+  GFileInputStream *stream;
+  char *basename = NULL;
+  char *mime_type = NULL;
+  const char *content_type;
   RestParam *param;
   RestProxyCall *call = NULL;
 
   g_return_val_if_fail (FLICKR_IS_PROXY (proxy), NULL);
   g_return_val_if_fail (filename, NULL);
 
-  /* Open the file */
-  map = g_mapped_file_new (filename, FALSE, &err);
-  if (err) {
-    g_propagate_error (error, err);
+  /* Open the file, which is read as it is uploaded */
+  file = g_file_new_for_path (filename);
+  stream = g_file_read (file, NULL, error);
+  if (stream == NULL) {
+    g_object_unref (file);
     return NULL;
   }
 
   /* Get the file information */
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NONE, NULL, error);
+  if (info == NULL) {
+    g_object_unref (stream);
+    g_object_unref (file);
+    return NULL;
+  }
+
   basename = g_path_get_basename (filename);
-  content_type = g_content_type_guess (filename,
-                                       (const guchar*) g_mapped_file_get_contents (map),
-                                       g_mapped_file_get_length (map),
-                                       NULL);
+
+  /* The content type isn't a MIME type on every platform, and may be unknown */
+  content_type = g_file_info_get_content_type (info);
+  if (content_type)
+    mime_type = g_content_type_get_mime_type (content_type);
 
   /* Make the call */
   call = flickr_proxy_new_upload (proxy);
-  param = rest_param_new_with_owner ("photo",
-                                     g_mapped_file_get_contents (map),
-                                     g_mapped_file_get_length (map),
-                                     content_type,
-                                     basename,
-                                     map,
-                                     (GDestroyNotify)g_mapped_file_unref);
+  param = rest_param_new_with_stream ("photo",
+                                      G_INPUT_STREAM (stream),
+                                      g_file_info_get_size (info),
+                                      mime_type ? mime_type : "application/octet-stream",
+                                      basename);
   rest_proxy_call_add_param_full (call, param);
 
+  g_free (mime_type);
   g_free (basename);
-  g_free (content_type);
+  g_object_unref (info);
+  g_object_unref (stream);
+  g_object_unref (file);
 
   return call;
 }
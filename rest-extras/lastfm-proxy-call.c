@@ -34,36 +34,14 @@ G_DEFINE_TYPE (LastfmProxyCall, lastfm_proxy_call, REST_TYPE_PROXY_CALL)
 static gboolean
 _prepare (RestProxyCall *call, GError **error)
 {
-  LastfmProxy *proxy = NULL;
-  LastfmProxyPrivate *priv;
-  RestProxyCallPrivate *call_priv;
-  GHashTable *params;
-  char *s;
+  RestRequestView view;
+  gboolean result;
 
-  g_object_get (call, "proxy", &proxy, NULL);
-  priv = LASTFM_PROXY_GET_PRIVATE (proxy);
-  call_priv = call->priv;
+  _rest_proxy_call_init_view (call, &view);
+  result = _lastfm_proxy_prepare (call->priv->proxy, &view, error);
+  _rest_proxy_call_finish_view (call, &view);
 
-  /* First reset the URL because Lastfm puts the function in the parameters */
-  call_priv->url = g_strdup (_rest_proxy_get_bound_url (REST_PROXY (proxy)));
-
-  rest_proxy_call_add_params (call,
-                              "method", call_priv->function,
-                              "api_key", priv->api_key,
-                              NULL);
-
-  if (priv->session_key)
-    rest_proxy_call_add_param (call, "sk", priv->session_key);
-
-  params = rest_params_as_string_hash_table (call_priv->params);
-  s = lastfm_proxy_sign (proxy, params);
-  g_hash_table_unref (params);
-  rest_proxy_call_add_param (call, "api_sig", s);
-  g_free (s);
-
-  g_object_unref (proxy);
-
-  return TRUE;
+  return result;
 }
 
 static void
@@ -21,6 +21,7 @@
  */
 
 #include "lastfm-proxy.h"
+#include "rest/rest-private.h"
 
 #define LASTFM_PROXY_GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), LASTFM_TYPE_PROXY, LastfmProxyPrivate))
@@ -31,3 +32,8 @@ struct _LastfmProxyPrivate {
   char *session_key;
 };
 
+char *_lastfm_proxy_sign_params (LastfmProxy *proxy, RestParams *params);
+
+gboolean _lastfm_proxy_prepare (RestProxy        *proxy,
+                                RestRequestView  *view,
+                                GError          **error);
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <rest/rest-proxy.h>
+#include <rest/rest-private.h>
+#include <rest/rest-text-codec.h>
 #include <libsoup/soup.h>
 #include "lastfm-proxy.h"
 #include "lastfm-proxy-private.h"
@@ -161,6 +163,8 @@ static void
 lastfm_proxy_init (LastfmProxy *self)
 {
   self->priv = LASTFM_PROXY_GET_PRIVATE (self);
+
+  _rest_proxy_set_prepare_func (REST_PROXY (self), _lastfm_proxy_prepare);
 }
 
 RestProxy *
@@ -259,16 +263,17 @@ char *
 lastfm_proxy_sign (LastfmProxy *proxy, GHashTable *params)
 {
   LastfmProxyPrivate *priv;
-  GString *s;
+  GChecksum *checksum;
   GList *keys;
-  char *md5;
+  guint8 digest[16];
+  gsize digest_length = sizeof (digest);
 
   g_return_val_if_fail (LASTFM_IS_PROXY (proxy), NULL);
   g_return_val_if_fail (params, NULL);
 
   priv = LASTFM_PROXY_GET_PRIVATE (proxy);
 
-  s = g_string_new (NULL);
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
 
   keys = g_hash_table_get_keys (params);
   keys = g_list_sort (keys, (GCompareFunc)strcmp);
@@ -280,18 +285,84 @@ lastfm_proxy_sign (LastfmProxy *proxy, GHashTable *params)
     key = keys->data;
     value = g_hash_table_lookup (params, key);
 
-    g_string_append_printf (s, "%s%s", key, value);
+    g_checksum_update (checksum, (guchar *)key, -1);
+    g_checksum_update (checksum, (guchar *)value, -1);
 
     keys = g_list_delete_link (keys, keys);
   }
 
-  g_string_append (s, priv->secret);
+  g_checksum_update (checksum, (guchar *)priv->secret, -1);
+
+  g_checksum_get_digest (checksum, digest, &digest_length);
+  g_checksum_free (checksum);
+
+  return _rest_hex_encode_string (digest, digest_length);
+}
+
+/*
+ * As lastfm_proxy_sign(), but signs every string parameter in @params,
+ * including the ones with repeated names, which a hash table can't hold.
+ */
+char *
+_lastfm_proxy_sign_params (LastfmProxy *proxy, RestParams *params)
+{
+  LastfmProxyPrivate *priv;
+  GPtrArray *strings;
+  GChecksum *checksum;
+  guint8 digest[16];
+  gsize digest_length = sizeof (digest);
+  guint i;
+
+  priv = LASTFM_PROXY_GET_PRIVATE (proxy);
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+
+  strings = _rest_params_sorted_strings (params);
+  for (i = 0; i < strings->len; i++) {
+    RestParam *param = g_ptr_array_index (strings, i);
+
+    g_checksum_update (checksum, (guchar *)rest_param_get_name (param), -1);
+    g_checksum_update (checksum, (guchar *)rest_param_get_content (param), -1);
+  }
+  g_ptr_array_free (strings, TRUE);
+
+  g_checksum_update (checksum, (guchar *)priv->secret, -1);
+
+  g_checksum_get_digest (checksum, digest, &digest_length);
+  g_checksum_free (checksum);
+
+  return _rest_hex_encode_string (digest, digest_length);
+}
+
+/*
+ * Sign the request in @view.  Both calls and #RestRequest objects are signed
+ * here.
+ */
+gboolean
+_lastfm_proxy_prepare (RestProxy        *proxy,
+                       RestRequestView  *view,
+                       GError          **error)
+{
+  LastfmProxyPrivate *priv;
+  char *s;
+
+  priv = LASTFM_PROXY_GET_PRIVATE (proxy);
+
+  /* First reset the URL because Lastfm puts the function in the parameters */
+  g_free (view->url);
+  view->url = g_strdup (_rest_proxy_get_bound_url (proxy));
+
+  _rest_request_view_set_param (view, "method", view->function);
+  _rest_request_view_set_param (view, "api_key", priv->api_key);
 
-  md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, s->str, s->len);
+  if (priv->session_key)
+    _rest_request_view_set_param (view, "sk", priv->session_key);
 
-  g_string_free (s, TRUE);
+  s = _lastfm_proxy_sign_params (LASTFM_PROXY (proxy), view->params);
+  _rest_request_view_set_param (view, "api_sig", s);
+  g_free (s);
 
-  return md5;
+  return TRUE;
 }
 
 char *
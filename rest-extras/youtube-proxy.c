@@ -25,16 +25,14 @@
 #include <string.h>
 #include <rest/rest-proxy.h>
 #include <rest/rest-xml-node.h>
-#include <libsoup/soup.h>
 
-#include "rest/rest-private.h"
 #include "youtube-proxy.h"
 #include "youtube-proxy-private.h"
 
 G_DEFINE_TYPE (YoutubeProxy, youtube_proxy, REST_TYPE_PROXY)
 
-#define UPLOAD_URL \
-  "http://uploads.gdata.youtube.com/feeds/api/users/default/uploads"
+#define UPLOAD_URL "http://uploads.gdata.youtube.com/"
+#define UPLOAD_FUNCTION "resumable/feeds/api/users/default/uploads"
 
 enum {
   PROP_0,
@@ -145,6 +143,8 @@ youtube_proxy_new_with_auth (const char *developer_key,
                             const char *user_auth)
 {
   return g_object_new (YOUTUBE_TYPE_PROXY,
+                       "url-format", UPLOAD_URL,
+                       "binding-required", FALSE,
                        "developer-key", developer_key,
                        "user-auth", user_auth,
                        NULL);
@@ -210,130 +210,119 @@ _construct_upload_atom_xml (GHashTable *fields, gboolean incomplete)
   return full_xml;
 }
 
-static void
-_set_upload_headers (YoutubeProxy *self,
-                     SoupMessageHeaders *headers,
-                     const gchar *filename)
-{
-  YoutubeProxyPrivate *priv = self->priv;
-  gchar *user_auth_header;
-  gchar *devkey_header;
-  gchar *basename;
-  const gchar *user_agent;
+/*
+ * The call that starts an upload, which sends the Atom description of the video
+ * instead of form parameters.
+ */
+typedef struct {
+  RestProxyCall parent;
+  gchar *atom_xml;
+} YoutubeUploadCall;
 
-  /* Set the user agent, if one was set in the proxy */
-  user_agent = rest_proxy_get_user_agent (REST_PROXY (self));
-  if (user_agent)
-    soup_message_headers_append (headers, "User-Agent", user_agent);
+typedef struct {
+  RestProxyCallClass parent_class;
+} YoutubeUploadCallClass;
 
-  g_print ("%s\n", priv->user_auth);
+static GType youtube_upload_call_get_type (void);
 
-  user_auth_header = g_strdup_printf ("GoogleLogin auth=%s", priv->user_auth);
-  soup_message_headers_append (headers, "Authorization", user_auth_header);
-  devkey_header = g_strdup_printf ("key=%s", priv->developer_key);
-  soup_message_headers_append (headers, "X-GData-Key", devkey_header);
-  basename = g_path_get_basename (filename);
-  soup_message_headers_append (headers, "Slug", basename);
+G_DEFINE_TYPE (YoutubeUploadCall, youtube_upload_call, REST_TYPE_PROXY_CALL)
 
-  g_free (user_auth_header);
-  g_free (devkey_header);
-}
+static gboolean
+youtube_upload_call_serialize_params (RestProxyCall *call,
+                                      gchar        **content_type,
+                                      gchar        **content,
+                                      gsize         *content_len,
+                                      GError       **error)
+{
+  YoutubeUploadCall *self = (YoutubeUploadCall *) call;
 
-typedef struct {
-  YoutubeProxy *proxy;
-  YoutubeProxyUploadCallback callback;
-  SoupMessage *message;
-  GObject *weak_object;
-  gpointer user_data;
-  gsize uploaded;
-} YoutubeProxyUploadClosure;
+  *content_type = g_strdup ("application/atom+xml; charset=UTF-8");
+  *content = g_strdup (self->atom_xml);
+  *content_len = strlen (self->atom_xml);
+
+  return TRUE;
+}
 
 static void
-_upload_async_weak_notify_cb (gpointer *data,
-                              GObject  *dead_object)
+youtube_upload_call_finalize (GObject *object)
 {
-  YoutubeProxyUploadClosure *closure =
-    (YoutubeProxyUploadClosure *) data;
+  YoutubeUploadCall *self = (YoutubeUploadCall *) object;
+
+  g_free (self->atom_xml);
 
-  _rest_proxy_cancel_message (REST_PROXY (closure->proxy), closure->message);
+  G_OBJECT_CLASS (youtube_upload_call_parent_class)->finalize (object);
 }
 
 static void
-_upload_async_closure_free (YoutubeProxyUploadClosure *closure)
+youtube_upload_call_class_init (YoutubeUploadCallClass *klass)
 {
-  if (closure->weak_object != NULL)
-    g_object_weak_unref (closure->weak_object,
-                         (GWeakNotify) _upload_async_weak_notify_cb,
-                         closure);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  RestProxyCallClass *call_class = REST_PROXY_CALL_CLASS (klass);
 
-  g_object_unref (closure->proxy);
+  object_class->finalize = youtube_upload_call_finalize;
+  call_class->serialize_params = youtube_upload_call_serialize_params;
+}
 
-  g_slice_free (YoutubeProxyUploadClosure, closure);
+static void
+youtube_upload_call_init (YoutubeUploadCall *self)
+{
 }
 
-static YoutubeProxyUploadClosure *
-_upload_async_closure_new (YoutubeProxy *self,
-                           YoutubeProxyUploadCallback callback,
-                           SoupMessage *message,
-                           GObject *weak_object,
-                           gpointer user_data)
+static void
+_set_upload_headers (YoutubeProxy  *self,
+                     RestProxyCall *call,
+                     const gchar   *filename)
 {
-  YoutubeProxyUploadClosure *closure =
-    g_slice_new0 (YoutubeProxyUploadClosure);
+  YoutubeProxyPrivate *priv = self->priv;
+  gchar *user_auth_header;
+  gchar *devkey_header;
+  gchar *basename;
 
-  closure->proxy = g_object_ref (self);
-  closure->callback = callback;
-  closure->message = message;
-  closure->weak_object = weak_object;
-  closure->user_data = user_data;
+  user_auth_header = g_strdup_printf ("GoogleLogin auth=%s", priv->user_auth);
+  rest_proxy_call_add_header (call, "Authorization", user_auth_header);
+  devkey_header = g_strdup_printf ("key=%s", priv->developer_key);
+  rest_proxy_call_add_header (call, "X-GData-Key", devkey_header);
+  rest_proxy_call_add_header (call, "GData-Version", "2");
+  basename = g_path_get_basename (filename);
+  rest_proxy_call_add_header (call, "Slug", basename);
 
-  if (weak_object != NULL)
-    g_object_weak_ref (weak_object,
-                       (GWeakNotify) _upload_async_weak_notify_cb,
-                       closure);
-  return closure;
+  g_free (user_auth_header);
+  g_free (devkey_header);
+  g_free (basename);
 }
 
+typedef struct {
+  YoutubeProxy *proxy;
+  YoutubeProxyUploadCallback callback;
+  gpointer user_data;
+} YoutubeProxyUploadClosure;
+
 static void
-_upload_completed_cb (SoupSession *session,
-                      SoupMessage *message,
-                      gpointer     user_data)
+_upload_cb (RestProxyCall *call,
+            gsize          total,
+            gsize          uploaded,
+            const GError  *error,
+            GObject       *weak_object,
+            gpointer       user_data)
 {
   YoutubeProxyUploadClosure *closure =
     (YoutubeProxyUploadClosure *) user_data;
-  GError *error = NULL;
 
-  if (closure->callback == NULL)
+  /* Progress */
+  if (error == NULL && uploaded < total) {
+    if (closure->callback)
+      closure->callback (closure->proxy, NULL, total, uploaded,
+                         NULL, weak_object, closure->user_data);
     return;
+  }
 
-  if (message->status_code < 200 || message->status_code >= 300)
-    error = g_error_new_literal (REST_PROXY_ERROR,
-                                 message->status_code,
-                                 message->reason_phrase);
-
-  closure->callback (closure->proxy, message->response_body->data,
-                     message->request_body->length,
-                     message->request_body->length,
-                     error, closure->weak_object, closure->user_data);
-
-  _upload_async_closure_free (closure);
-}
-
-static void
-_message_wrote_data_cb (SoupMessage               *msg,
-                        SoupBuffer                *chunk,
-                        YoutubeProxyUploadClosure *closure)
-{
-  closure->uploaded = closure->uploaded + chunk->length;
-
-  if (closure->uploaded < msg->request_body->length)
-    closure->callback (closure->proxy,
-                       NULL,
-                       msg->request_body->length,
-                       closure->uploaded,
-                       NULL,
-                       closure->weak_object,
+  if (closure->callback)
+    closure->callback (closure->proxy, rest_proxy_call_get_payload (call),
+                       total, uploaded, error, weak_object,
                        closure->user_data);
+
+  g_object_unref (closure->proxy);
+  g_slice_free (YoutubeProxyUploadClosure, closure);
 }
 
 /**
@@ -349,6 +338,9 @@ _message_wrote_data_cb (SoupMessage               *msg,
  *
  * Upload a file.
  *
+ * The file is read as it is uploaded, and sent in pieces so that a network
+ * failure only means sending the current piece again.
+ *
  * Returns: %TRUE, or %FALSE if the file could not be opened
  */
 gboolean
@@ -361,76 +353,62 @@ youtube_proxy_upload_async (YoutubeProxy              *self,
                             gpointer                   user_data,
                             GError                   **error)
 {
-  SoupMultipart *mp;
-  SoupMessage *message;
-  SoupMessageHeaders *part_headers;
-  SoupBuffer *sb;
-  gchar *content_type;
-  gchar *atom_xml;
-  GMappedFile *map;
+  GFile *file;
+  GFileInfo *info;
+  GFileInputStream *stream;
+  YoutubeUploadCall *call;
   YoutubeProxyUploadClosure *closure;
+  gboolean ret;
 
-  map = g_mapped_file_new (filename, FALSE, error);
-  if (*error != NULL) {
+  file = g_file_new_for_path (filename);
+  stream = g_file_read (file, NULL, error);
+  if (stream == NULL) {
     g_warning ("Error opening file %s: %s", filename, (*error)->message);
+    g_object_unref (file);
     return FALSE;
   }
 
-  mp = soup_multipart_new ("multipart/related");
-
-  atom_xml = _construct_upload_atom_xml (fields, incomplete);
-
-  sb = soup_buffer_new_with_owner (atom_xml,
-                                   strlen(atom_xml),
-                                   atom_xml,
-                                   (GDestroyNotify) g_free);
-
-  part_headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_MULTIPART);
-
-  soup_message_headers_append (part_headers, "Content-Type",
-                               "application/atom+xml; charset=UTF-8");
-
-
-  soup_multipart_append_part (mp, part_headers, sb);
-
-  soup_buffer_free (sb);
-
-  content_type = g_content_type_guess (
-      filename,
-      (const guchar*) g_mapped_file_get_contents (map),
-      g_mapped_file_get_length (map),
-      NULL);
-
-  sb = soup_buffer_new_with_owner (g_mapped_file_get_contents (map),
-                                   g_mapped_file_get_length (map),
-                                   map,
-                                   (GDestroyNotify) g_mapped_file_unref);
-
-  soup_message_headers_replace (part_headers, "Content-Type", content_type);
-
-  soup_multipart_append_part (mp, part_headers, sb);
-
-  soup_buffer_free (sb);
-
-  soup_message_headers_free (part_headers);
-
-  message = soup_form_request_new_from_multipart (UPLOAD_URL, mp);
-
-  soup_multipart_free (mp);
-
-  _set_upload_headers (self, message->request_headers, filename);
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+                            G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                            G_FILE_QUERY_INFO_NONE, NULL, error);
+  if (info == NULL) {
+    g_object_unref (stream);
+    g_object_unref (file);
+    return FALSE;
+  }
 
-  closure = _upload_async_closure_new (self, callback, message, weak_object,
-                                       user_data);
+  call = g_object_new (youtube_upload_call_get_type (),
+                       "proxy", self,
+                       NULL);
+  call->atom_xml = _construct_upload_atom_xml (fields, incomplete);
+  rest_proxy_call_set_method (REST_PROXY_CALL (call), "POST");
+  rest_proxy_call_set_function (REST_PROXY_CALL (call), UPLOAD_FUNCTION);
+  _set_upload_headers (self, REST_PROXY_CALL (call), filename);
 
-  g_signal_connect (message,
-                    "wrote-body-data",
-                    (GCallback) _message_wrote_data_cb,
-                    closure);
+  closure = g_slice_new0 (YoutubeProxyUploadClosure);
+  closure->proxy = g_object_ref (self);
+  closure->callback = callback;
+  closure->user_data = user_data;
 
+  ret = rest_proxy_call_upload_resumable (REST_PROXY_CALL (call),
+                                          G_INPUT_STREAM (stream),
+                                          g_file_info_get_size (info),
+                                          g_file_info_get_content_type (info),
+                                          0,
+                                          _upload_cb,
+                                          weak_object,
+                                          closure,
+                                          error);
+  if (!ret) {
+    g_object_unref (closure->proxy);
+    g_slice_free (YoutubeProxyUploadClosure, closure);
+  }
 
-  _rest_proxy_queue_message (REST_PROXY (self), message, _upload_completed_cb,
-                             closure);
+  g_object_unref (call);
+  g_object_unref (info);
+  g_object_unref (stream);
+  g_object_unref (file);
 
-  return TRUE;
+  return ret;
 }
@@ -25,22 +25,32 @@
 #include <rest/rest-proxy-call.h>
 #include "oauth-proxy-call.h"
 #include "oauth-proxy-private.h"
+#include "rest-private.h"
 #include "rest-proxy-call-private.h"
+#include "rest-text-codec.h"
 #include "sha1.h"
 
 G_DEFINE_TYPE (OAuthProxyCall, oauth_proxy_call, REST_TYPE_PROXY_CALL)
 
-#define OAUTH_ENCODE_STRING(x_) (x_ ? soup_uri_encode( (x_), "!$&'()*+,;=@") : g_strdup (""))
+#define CALL_GET_PRIVATE(o) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((o), OAUTH_TYPE_PROXY_CALL, OAuthProxyCallPrivate))
+
+typedef struct {
+  /* Credentials to sign with instead of the proxy's, or NULL */
+  OAuthCredentials *credentials;
+} OAuthProxyCallPrivate;
+
+#define OAUTH_ENCODE_STRING(x_) _rest_percent_encode_string (x_)
 
 static char *
-sign_plaintext (OAuthProxyPrivate *priv)
+sign_plaintext (OAuthCredentials *credentials)
 {
   char *cs;
   char *ts;
   char *rv;
 
-  cs = OAUTH_ENCODE_STRING (priv->consumer_secret);
-  ts = OAUTH_ENCODE_STRING (priv->token_secret);
+  cs = OAUTH_ENCODE_STRING (credentials->consumer_secret);
+  ts = OAUTH_ENCODE_STRING (credentials->token_secret);
   rv = g_strconcat (cs, "&", ts, NULL);
 
   g_free (cs);
@@ -49,105 +59,73 @@ sign_plaintext (OAuthProxyPrivate *priv)
   return rv;
 }
 
-static char *
-encode_params (GHashTable *hash)
-{
-  GList *l, *keys;
-  GString *s;
-
-  s = g_string_new (NULL);
-
-  keys = g_hash_table_get_keys (hash);
-  keys = g_list_sort (keys, (GCompareFunc)strcmp);
-
-  for (l = keys; l; l = l->next) {
-    const char *key;
-    const char *value;
-    char *k, *v;
-
-    key = l->data;
-    value = g_hash_table_lookup (hash, key);
-
-    k = OAUTH_ENCODE_STRING (key);
-    v = OAUTH_ENCODE_STRING (value);
-
-    if (s->len)
-      g_string_append (s, "&");
-
-    g_string_append_printf (s, "%s=%s", k, v);
-
-    g_free (k);
-    g_free (v);
-  }
-
-  g_list_free (keys);
-
-  return g_string_free (s, FALSE);
-}
-
 /*
- * Add the keys in @from to @hash.
+ * Get the HMAC state for the secrets in @credentials, making it if this is the
+ * first call signed with them.
  */
-static void
-merge_hashes (GHashTable *hash, GHashTable *from)
+static const Hmac *
+get_hmac (OAuthCredentials *credentials, RestShaAlgorithm algorithm)
 {
-  GHashTableIter iter;
-  gpointer key, value;
+  Hmac *hmac;
+  char *key;
 
-  g_hash_table_iter_init (&iter, from);
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    g_hash_table_insert (hash, key, value);
-  }
-}
+  hmac = g_atomic_pointer_get (&credentials->hmac[algorithm]);
+  if (G_LIKELY (hmac))
+    return hmac;
 
-static void
-merge_params (GHashTable *hash, RestParams *params)
-{
-  RestParamsIter iter;
-  const char *name;
-  RestParam *param;
+  /* PLAINTEXT signature value is the HMAC key value */
+  key = sign_plaintext (credentials);
+  hmac = hmac_new (algorithm, key);
+  g_free (key);
 
-  rest_params_iter_init (&iter, params);
-  while (rest_params_iter_next (&iter, &name, &param)) {
-    if (rest_param_is_string (param))
-      g_hash_table_insert (hash, (gpointer)name, (gpointer)rest_param_get_content (param));
+  /* Another thread may have got there first */
+  if (!g_atomic_pointer_compare_and_exchange ((gpointer *)&credentials->hmac[algorithm],
+                                              NULL, hmac)) {
+    hmac_free (hmac);
+    hmac = g_atomic_pointer_get (&credentials->hmac[algorithm]);
   }
+
+  return hmac;
 }
 
 static char *
-sign_hmac (OAuthProxy *proxy, RestProxyCall *call, GHashTable *oauth_params)
+sign_hmac (OAuthProxy       *proxy,
+           OAuthCredentials *credentials,
+           RestShaAlgorithm  algorithm,
+           RestRequestView  *view,
+           GHashTable       *oauth_params)
 {
   OAuthProxyPrivate *priv;
-  RestProxyCallPrivate *callpriv;
-  char *key, *signature, *ep, *eep;
+  char *key, *signature;
   const char *content_type;
   GString *text;
-  GHashTable *all_params;
+  RestEncodedParams *encoded;
+  GHashTableIter iter;
+  gpointer name, value;
   RestParamsIter params_iter;
   RestParam *param;
   gboolean encode_query_params = TRUE;
 
   priv = PROXY_GET_PRIVATE (proxy);
-  callpriv = call->priv;
 
   text = g_string_new (NULL);
-  g_string_append (text, rest_proxy_call_get_method (REST_PROXY_CALL (call)));
+  g_string_append (text, view->method);
   g_string_append_c (text, '&');
   if (priv->oauth_echo) {
-    g_string_append_uri_escaped (text, priv->service_url, NULL, FALSE);
+    _rest_string_append_percent_encoded (text, priv->service_url);
   } else if (priv->signature_host != NULL) {
-    SoupURI *url = soup_uri_new (callpriv->url);
+    SoupURI *url = soup_uri_new (view->url);
     gchar *signing_url;
 
     soup_uri_set_host (url, priv->signature_host);
     signing_url = soup_uri_to_string (url, FALSE);
 
-    g_string_append_uri_escaped (text, signing_url, NULL, FALSE);
+    _rest_string_append_percent_encoded (text, signing_url);
 
     soup_uri_free (url);
     g_free (signing_url);
   } else {
-    g_string_append_uri_escaped (text, callpriv->url, NULL, FALSE);
+    _rest_string_append_percent_encoded (text, view->url);
   }
   g_string_append_c (text, '&');
 
@@ -155,7 +133,7 @@ sign_hmac (OAuthProxy *proxy, RestProxyCall *call, GHashTable *oauth_params)
 
   /* If one of the call's parameters is a multipart/form-data parameter, the
      signature base string must be generated with only the oauth parameters */
-  rest_params_iter_init(&params_iter, callpriv->params);
+  rest_params_iter_init(&params_iter, view->params);
   while(rest_params_iter_next(&params_iter, (gpointer)&key, (gpointer)&param)) {
     content_type = rest_param_get_content_type(param);
     if (strcmp(content_type, "multipart/form-data") == 0){
@@ -166,27 +144,21 @@ sign_hmac (OAuthProxy *proxy, RestProxyCall *call, GHashTable *oauth_params)
 
 
 
-  /* Merge the OAuth parameters with the query parameters */
-  all_params = g_hash_table_new (g_str_hash, g_str_equal);
-  merge_hashes (all_params, oauth_params);
+  /* Merge the OAuth parameters with the query parameters, encoding each once */
+  encoded = _rest_encoded_params_get ();
+  g_hash_table_iter_init (&iter, oauth_params);
+  while (g_hash_table_iter_next (&iter, &name, &value)) {
+    _rest_encoded_params_add (encoded, name, value);
+  }
   if (encode_query_params && !priv->oauth_echo) {
-      merge_params (all_params, callpriv->params);
+      _rest_encoded_params_add_params (encoded, view->params);
   }
 
+  _rest_encoded_params_sort (encoded);
+  _rest_encoded_params_append_encoded (encoded, text);
 
-  ep = encode_params (all_params);
-  eep = OAUTH_ENCODE_STRING (ep);
-  g_string_append (text, eep);
-  g_free (ep);
-  g_free (eep);
-  g_hash_table_destroy (all_params);
-
-  /* PLAINTEXT signature value is the HMAC-SHA1 key value */
-  key = sign_plaintext (priv);
+  signature = hmac_sign (get_hmac (credentials, algorithm), text->str);
 
-  signature = hmac_sha1 (key, text->str);
-
-  g_free (key);
   g_string_free (text, TRUE);
 
   return signature;
@@ -210,29 +182,27 @@ make_authorized_header (GHashTable *oauth_params)
 
   g_hash_table_iter_init (&iter, oauth_params);
   while (g_hash_table_iter_next (&iter, (gpointer)&key, (gpointer)&value)) {
-    gchar *encoded_value = OAUTH_ENCODE_STRING (value);
-    g_string_append_printf (auth, ", %s=\"%s\"", key, encoded_value);
-    g_free (encoded_value);
+    g_string_append_printf (auth, ", %s=\"", key);
+    _rest_string_append_percent_encoded (auth, value);
+    g_string_append_c (auth, '"');
   }
 
   return g_string_free (auth, FALSE);
 }
 
 /*
- * Remove any OAuth parameters from the @call parameters and add them to
+ * Remove any OAuth parameters from the parameters of @view and add them to
  * @oauth_params for building an Authorized header with.
  */
 static void
-steal_oauth_params (RestProxyCall *call, GHashTable *oauth_params)
+steal_oauth_params (RestRequestView *view, GHashTable *oauth_params)
 {
-  RestParams *params;
+  RestParams *params = view->params;
   RestParamsIter iter;
   const char *name;
   RestParam *param;
   GList *to_remove = NULL;
 
-  params = rest_proxy_call_get_params (call);
-
   rest_params_iter_init (&iter, params);
   while (rest_params_iter_next (&iter, &name, &param)) {
     if (rest_param_is_string (param) && g_str_has_prefix (name, "oauth_")) {
@@ -249,17 +219,28 @@ steal_oauth_params (RestProxyCall *call, GHashTable *oauth_params)
   }
 }
 
-static gboolean
-_prepare (RestProxyCall *call, GError **error)
+/*
+ * Sign the request in @view with @credentials, or with the credentials of
+ * @proxy if that is %NULL.  Both calls and #RestRequest objects are signed
+ * here.
+ */
+void
+_oauth_proxy_sign (OAuthProxy       *proxy,
+                   OAuthCredentials *credentials,
+                   RestRequestView  *view)
 {
-  OAuthProxy *proxy = NULL;
   OAuthProxyPrivate *priv;
   char *s;
   GHashTable *oauth_params;
 
-  g_object_get (call, "proxy", &proxy, NULL);
   priv = PROXY_GET_PRIVATE (proxy);
 
+  /* Sign with one set of credentials, even if the proxy's change meanwhile */
+  if (credentials)
+    oauth_credentials_ref (credentials);
+  else
+    credentials = _oauth_proxy_get_credentials (proxy);
+
   /* We have to make this hash free the strings and thus duplicate when we put
    * them in since when we call call steal_oauth_params that has to duplicate
    * the param names since it removes them from the main hash
@@ -267,7 +248,7 @@ _prepare (RestProxyCall *call, GError **error)
   oauth_params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 
   /* First, steal any OAuth properties in the regular params */
-  steal_oauth_params (call, oauth_params);
+  steal_oauth_params (view, oauth_params);
 
   g_hash_table_insert (oauth_params, g_strdup ("oauth_version"), g_strdup ("1.0"));
 
@@ -278,43 +259,72 @@ _prepare (RestProxyCall *call, GError **error)
   g_hash_table_insert (oauth_params, g_strdup ("oauth_nonce"), s);
 
   g_hash_table_insert (oauth_params, g_strdup ("oauth_consumer_key"),
-                       g_strdup (priv->consumer_key));
+                       g_strdup (credentials->consumer_key));
 
-  if (priv->token)
-    g_hash_table_insert (oauth_params, g_strdup ("oauth_token"), g_strdup (priv->token));
+  if (credentials->token)
+    g_hash_table_insert (oauth_params, g_strdup ("oauth_token"), g_strdup (credentials->token));
 
   switch (priv->method) {
   case PLAINTEXT:
     g_hash_table_insert (oauth_params, g_strdup ("oauth_signature_method"), g_strdup ("PLAINTEXT"));
-    s = sign_plaintext (priv);
+    s = sign_plaintext (credentials);
     break;
   case HMAC_SHA1:
     g_hash_table_insert (oauth_params, g_strdup ("oauth_signature_method"), g_strdup ("HMAC-SHA1"));
-    s = sign_hmac (proxy, call, oauth_params);
+    s = sign_hmac (proxy, credentials, REST_SHA1, view, oauth_params);
+    break;
+  case HMAC_SHA256:
+    g_hash_table_insert (oauth_params, g_strdup ("oauth_signature_method"), g_strdup ("HMAC-SHA256"));
+    s = sign_hmac (proxy, credentials, REST_SHA256, view, oauth_params);
     break;
   }
   g_hash_table_insert (oauth_params, g_strdup ("oauth_signature"), s);
 
   s = make_authorized_header (oauth_params);
   if (priv->oauth_echo) {
-    rest_proxy_call_add_header (call, "X-Verify-Credentials-Authorization", s);
-    rest_proxy_call_add_param (call, "X-Auth-Service-Provider", priv->service_url);
+    _rest_request_view_set_header (view, "X-Verify-Credentials-Authorization", s);
+    _rest_request_view_set_param (view, "X-Auth-Service-Provider", priv->service_url);
   } else {
-    rest_proxy_call_add_header (call, "Authorization", s);
+    _rest_request_view_set_header (view, "Authorization", s);
   }
   g_free (s);
   g_hash_table_destroy (oauth_params);
 
-  g_object_unref (proxy);
+  oauth_credentials_unref (credentials);
+}
+
+static gboolean
+_prepare (RestProxyCall *call, GError **error)
+{
+  RestRequestView view;
+
+  _rest_proxy_call_init_view (call, &view);
+  _oauth_proxy_sign (OAUTH_PROXY (call->priv->proxy),
+                     CALL_GET_PRIVATE (call)->credentials,
+                     &view);
+  _rest_proxy_call_finish_view (call, &view);
 
   return TRUE;
 }
 
+static void
+oauth_proxy_call_finalize (GObject *object)
+{
+  oauth_credentials_unref (CALL_GET_PRIVATE (object)->credentials);
+
+  G_OBJECT_CLASS (oauth_proxy_call_parent_class)->finalize (object);
+}
+
 static void
 oauth_proxy_call_class_init (OAuthProxyCallClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
   RestProxyCallClass *call_class = REST_PROXY_CALL_CLASS (klass);
 
+  g_type_class_add_private (klass, sizeof (OAuthProxyCallPrivate));
+
+  object_class->finalize = oauth_proxy_call_finalize;
+
   call_class->prepare = _prepare;
 }
 
@@ -326,6 +336,7 @@ oauth_proxy_call_init (OAuthProxyCall *self)
 void
 oauth_proxy_call_parse_token_response (OAuthProxyCall *call)
 {
+  OAuthProxy *proxy;
   OAuthProxyPrivate *priv;
   GHashTable *form;
 
@@ -333,19 +344,52 @@ oauth_proxy_call_parse_token_response (OAuthProxyCall *call)
 
   g_return_if_fail (OAUTH_IS_PROXY_CALL (call));
 
-  priv = PROXY_GET_PRIVATE (REST_PROXY_CALL (call)->priv->proxy);
+  proxy = OAUTH_PROXY (REST_PROXY_CALL (call)->priv->proxy);
+  priv = PROXY_GET_PRIVATE (proxy);
   g_assert (priv);
 
   form = soup_form_decode (rest_proxy_call_get_payload (REST_PROXY_CALL (call)));
 
-  priv->token = g_strdup (g_hash_table_lookup (form, "oauth_token"));
-  priv->token_secret = g_strdup (g_hash_table_lookup (form, "oauth_token_secret"));
+  _oauth_proxy_update_credentials (proxy,
+                                   OAUTH_CREDENTIALS_TOKEN |
+                                   OAUTH_CREDENTIALS_TOKEN_SECRET,
+                                   NULL, NULL,
+                                   g_hash_table_lookup (form, "oauth_token"),
+                                   g_hash_table_lookup (form, "oauth_token_secret"));
   /* This header should only exist for request_token replies, but its easier just to always check it */
   priv->oauth_10a = g_hash_table_lookup (form, "oauth_callback_confirmed") != NULL;
 
   g_hash_table_destroy (form);
 }
 
+/**
+ * oauth_proxy_call_set_credentials:
+ * @call: an #OAuthProxyCall
+ * @credentials: (allow-none): the #OAuthCredentials to sign with, or %NULL
+ *
+ * Sign @call with @credentials, made with oauth_proxy_new_credentials(),
+ * instead of the token of the proxy.  This must be done before the call is
+ * run.  Passing %NULL signs with the proxy's token again.
+ *
+ * Token responses to calls with their own credentials still update the
+ * proxy's token in oauth_proxy_call_parse_token_response(), so calls that
+ * fetch a user's token should parse the response themselves.
+ */
+void
+oauth_proxy_call_set_credentials (OAuthProxyCall   *call,
+                                  OAuthCredentials *credentials)
+{
+  OAuthProxyCallPrivate *priv;
+
+  g_return_if_fail (OAUTH_IS_PROXY_CALL (call));
+  priv = CALL_GET_PRIVATE (call);
+
+  if (credentials)
+    oauth_credentials_ref (credentials);
+  oauth_credentials_unref (priv->credentials);
+  priv->credentials = credentials;
+}
+
 /*
  * Stub to keep ABI because this was the original (typo'd) function name.
  */
@@ -360,33 +404,91 @@ oauth_proxy_call_parse_token_reponse (OAuthProxyCall *call)
 void
 test_param_encoding (void)
 {
-  GHashTable *hash;
-  char *s;
+  RestEncodedParams *encoded;
+  GString *s;
 
 #define TEST(expected) \
-  s = encode_params (hash);                      \
-  g_assert_cmpstr (s, ==, expected);             \
-  g_free (s);                                    \
-  g_hash_table_remove_all (hash);
+  _rest_encoded_params_sort (encoded);           \
+  g_string_truncate (s, 0);                      \
+  _rest_encoded_params_append (encoded, s);      \
+  g_assert_cmpstr (s->str, ==, expected);        \
+  encoded = _rest_encoded_params_get ();
 
-  hash = g_hash_table_new (g_str_hash, g_str_equal);
+  s = g_string_new (NULL);
+  encoded = _rest_encoded_params_get ();
 
-  g_hash_table_insert (hash, "name", NULL);
+  _rest_encoded_params_add (encoded, "name", NULL);
   TEST("name=");
 
-  g_hash_table_insert (hash, "a", "b");
+  _rest_encoded_params_add (encoded, "a", "b");
   TEST("a=b");
 
-  g_hash_table_insert (hash, "a", "b");
-  g_hash_table_insert (hash, "c", "d");
+  _rest_encoded_params_add (encoded, "a", "b");
+  _rest_encoded_params_add (encoded, "c", "d");
   TEST("a=b&c=d");
 
-  /* Because we don't (yet) support multiple parameters with the same key we've
-     changed this case slightly */
-  g_hash_table_insert (hash, "b", "x!y");
-  g_hash_table_insert (hash, "a", "x y");
-  TEST("a=x%20y&b=x%21y");
+  _rest_encoded_params_add (encoded, "a", "x!y");
+  _rest_encoded_params_add (encoded, "a", "x y");
+  TEST("a=x%20y&a=x%21y");
+
+  _rest_encoded_params_add (encoded, "x!y", "a");
+  _rest_encoded_params_add (encoded, "x", "a");
+  TEST("x=a&x%21y=a");
+
+  g_string_free (s, TRUE);
 
 #undef TEST
 }
+
+/* The HMAC-SHA1 cases from the same page, with each SHA-1 implementation */
+void
+test_signature (void)
+{
+  static const char *impls[] = { "shani", "armv8", "scalar" };
+  RestEncodedParams *encoded;
+  GString *text;
+  char *s;
+  guint i;
+
+  encoded = _rest_encoded_params_get ();
+  _rest_encoded_params_add (encoded, "size", "original");
+  _rest_encoded_params_add (encoded, "oauth_version", "1.0");
+  _rest_encoded_params_add (encoded, "oauth_token", "nnch734d00sl2jdk");
+  _rest_encoded_params_add (encoded, "oauth_timestamp", "1191242096");
+  _rest_encoded_params_add (encoded, "oauth_signature_method", "HMAC-SHA1");
+  _rest_encoded_params_add (encoded, "oauth_nonce", "kllo9940pd9333jh");
+  _rest_encoded_params_add (encoded, "oauth_consumer_key", "dpf43f3p2l4k3l03");
+  _rest_encoded_params_add (encoded, "file", "vacation.jpg");
+  _rest_encoded_params_sort (encoded);
+
+  text = g_string_new ("GET&");
+  _rest_string_append_percent_encoded (text, "http://photos.example.net/photos");
+  g_string_append_c (text, '&');
+  _rest_encoded_params_append_encoded (encoded, text);
+  g_assert_cmpstr (text->str, ==,
+                   "GET&http%3A%2F%2Fphotos.example.net%2Fphotos&file%3Dvacation.jpg"
+                   "%26oauth_consumer_key%3Ddpf43f3p2l4k3l03%26oauth_nonce%3Dkllo9940pd9333jh"
+                   "%26oauth_signature_method%3DHMAC-SHA1%26oauth_timestamp%3D1191242096"
+                   "%26oauth_token%3Dnnch734d00sl2jdk%26oauth_version%3D1.0%26size%3Doriginal");
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    if (!_rest_sha_set_impl (impls[i]))
+      continue;
+
+    s = hmac_sha1 ("cs&", "bs");
+    g_assert_cmpstr (s, ==, "egQqG5AJep5sJ7anhXju1unge2I=");
+    g_free (s);
+
+    s = hmac_sha1 ("cs&ts", "bs");
+    g_assert_cmpstr (s, ==, "VZVjXceV7JgPq/dOTnNmEfO0Fv8=");
+    g_free (s);
+
+    s = hmac_sha1 ("kd94hf93k423kf44&pfkkdhi9sl3r4s00", text->str);
+    g_assert_cmpstr (s, ==, "tR3+Ty81lMeYAr/Fid0kMTYa/WM=");
+    g_free (s);
+  }
+
+  _rest_sha_set_impl (NULL);
+  g_string_free (text, TRUE);
+}
 #endif
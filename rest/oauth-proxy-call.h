@@ -24,6 +24,7 @@
 #define _OAUTH_PROXY_CALL
 
 #include <rest/rest-proxy-call.h>
+#include <rest/oauth-proxy.h>
 
 G_BEGIN_DECLS
 
@@ -64,6 +65,9 @@ GType oauth_proxy_call_get_type (void);
 
 void oauth_proxy_call_parse_token_response (OAuthProxyCall *call);
 
+void oauth_proxy_call_set_credentials (OAuthProxyCall   *call,
+                                       OAuthCredentials *credentials);
+
 G_GNUC_DEPRECATED_FOR(oauth_proxy_call_parse_token_response)
 void oauth_proxy_call_parse_token_reponse (OAuthProxyCall *call);
 
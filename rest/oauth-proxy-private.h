@@ -21,17 +21,41 @@
  */
 
 #include "oauth-proxy.h"
+#include "rest-private.h"
+#include "sha1.h"
 
 #define PROXY_GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), OAUTH_TYPE_PROXY, OAuthProxyPrivate))
 
-typedef struct {
+/*
+ * The keys and tokens that calls are signed with.  These are never changed
+ * once made: changing any of them swaps a new OAuthCredentials into the proxy,
+ * so a call that took a reference to the old one still signs with a
+ * consistent set, from any thread.
+ */
+struct _OAuthCredentials {
+  volatile gint ref_count;
   /* Application "consumer" keys */
   char *consumer_key;
   char *consumer_secret;
   /* Authorisation "user" tokens */
   char *token;
   char *token_secret;
+  /* The HMAC state for the secrets by RestShaAlgorithm, made when first signing */
+  Hmac *hmac[2];
+};
+
+/* Which credentials _oauth_proxy_update_credentials() changes */
+typedef enum {
+  OAUTH_CREDENTIALS_CONSUMER_KEY = 1 << 0,
+  OAUTH_CREDENTIALS_CONSUMER_SECRET = 1 << 1,
+  OAUTH_CREDENTIALS_TOKEN = 1 << 2,
+  OAUTH_CREDENTIALS_TOKEN_SECRET = 1 << 3
+} OAuthCredentialsMask;
+
+typedef struct {
+  /* The current credentials, only swapped while holding the credentials lock */
+  OAuthCredentials *credentials;
   /* How we're signing */
   OAuthSignatureMethod method;
   /* OAuth 1.0a */
@@ -43,3 +67,16 @@ typedef struct {
   /* URL to use for signatures */
   char *signature_host;
 } OAuthProxyPrivate;
+
+OAuthCredentials *_oauth_proxy_get_credentials (OAuthProxy *proxy);
+
+void _oauth_proxy_update_credentials (OAuthProxy          *proxy,
+                                      OAuthCredentialsMask mask,
+                                      const char          *consumer_key,
+                                      const char          *consumer_secret,
+                                      const char          *token,
+                                      const char          *token_secret);
+
+void _oauth_proxy_sign (OAuthProxy       *proxy,
+                        OAuthCredentials *credentials,
+                        RestRequestView  *view);
@@ -50,24 +50,125 @@ _new_call (RestProxy *proxy)
   return call;
 }
 
+/* Sign a #RestRequest as a call with the proxy's credentials would be */
+static gboolean
+_prepare_request (RestProxy        *proxy,
+                  RestRequestView  *view,
+                  GError          **error)
+{
+  _oauth_proxy_sign (OAUTH_PROXY (proxy), NULL, view);
+
+  return TRUE;
+}
+
+/* Held while reading or swapping OAuthProxyPrivate.credentials */
+G_LOCK_DEFINE_STATIC (credentials);
+
+static OAuthCredentials *
+credentials_new (const char *consumer_key,
+                 const char *consumer_secret,
+                 const char *token,
+                 const char *token_secret)
+{
+  OAuthCredentials *credentials;
+
+  credentials = g_slice_new0 (OAuthCredentials);
+  credentials->ref_count = 1;
+  credentials->consumer_key = g_strdup (consumer_key);
+  credentials->consumer_secret = g_strdup (consumer_secret);
+  credentials->token = g_strdup (token);
+  credentials->token_secret = g_strdup (token_secret);
+
+  return credentials;
+}
+
+/*
+ * Get a reference to the current credentials of @proxy, to be released with
+ * oauth_credentials_unref().  Whatever happens to the proxy, they won't
+ * change.
+ */
+OAuthCredentials *
+_oauth_proxy_get_credentials (OAuthProxy *proxy)
+{
+  OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (proxy);
+  OAuthCredentials *credentials;
+
+  /* Only so that the credentials can't be freed between reading the pointer
+     and taking the reference */
+  G_LOCK (credentials);
+  credentials = priv->credentials;
+  g_atomic_int_inc (&credentials->ref_count);
+  G_UNLOCK (credentials);
+
+  return credentials;
+}
+
+/*
+ * Swap in new credentials for @proxy, with the ones in @mask replaced by the
+ * arguments and the rest kept.  Calls being signed carry on with the
+ * credentials they already have.
+ */
+void
+_oauth_proxy_update_credentials (OAuthProxy          *proxy,
+                                 OAuthCredentialsMask mask,
+                                 const char          *consumer_key,
+                                 const char          *consumer_secret,
+                                 const char          *token,
+                                 const char          *token_secret)
+{
+  OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (proxy);
+  OAuthCredentials *old;
+
+  /* Copying under the lock means that two updates can't lose either change */
+  G_LOCK (credentials);
+  old = priv->credentials;
+  priv->credentials = credentials_new
+    (mask & OAUTH_CREDENTIALS_CONSUMER_KEY ? consumer_key : old->consumer_key,
+     mask & OAUTH_CREDENTIALS_CONSUMER_SECRET ? consumer_secret : old->consumer_secret,
+     mask & OAUTH_CREDENTIALS_TOKEN ? token : old->token,
+     mask & OAUTH_CREDENTIALS_TOKEN_SECRET ? token_secret : old->token_secret);
+  G_UNLOCK (credentials);
+
+  oauth_credentials_unref (old);
+}
+
+/* Set the token and token secret from a token response in @payload */
+static void
+update_tokens_from_form (OAuthProxy *proxy, const char *payload)
+{
+  GHashTable *form;
+
+  form = soup_form_decode (payload);
+  _oauth_proxy_update_credentials (proxy,
+                                   OAUTH_CREDENTIALS_TOKEN |
+                                   OAUTH_CREDENTIALS_TOKEN_SECRET,
+                                   NULL, NULL,
+                                   g_hash_table_lookup (form, "oauth_token"),
+                                   g_hash_table_lookup (form, "oauth_token_secret"));
+  g_hash_table_destroy (form);
+}
+
 static void
 oauth_proxy_get_property (GObject *object, guint property_id,
                               GValue *value, GParamSpec *pspec)
 {
   OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (object);
+  OAuthCredentials *credentials;
+
+  credentials = _oauth_proxy_get_credentials (OAUTH_PROXY (object));
 
   switch (property_id) {
   case PROP_CONSUMER_KEY:
-    g_value_set_string (value, priv->consumer_key);
+    g_value_set_string (value, credentials->consumer_key);
     break;
   case PROP_CONSUMER_SECRET:
-    g_value_set_string (value, priv->consumer_secret);
+    g_value_set_string (value, credentials->consumer_secret);
     break;
   case PROP_TOKEN:
-    g_value_set_string (value, priv->token);
+    g_value_set_string (value, credentials->token);
     break;
   case PROP_TOKEN_SECRET:
-    g_value_set_string (value, priv->token_secret);
+    g_value_set_string (value, credentials->token_secret);
     break;
   case PROP_SIGNATURE_HOST:
     g_value_set_string (value, priv->signature_host);
@@ -78,6 +179,8 @@ oauth_proxy_get_property (GObject *object, guint property_id,
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
+
+  oauth_credentials_unref (credentials);
 }
 
 static void
@@ -88,24 +191,24 @@ oauth_proxy_set_property (GObject *object, guint property_id,
 
   switch (property_id) {
   case PROP_CONSUMER_KEY:
-    if (priv->consumer_key)
-      g_free (priv->consumer_key);
-    priv->consumer_key = g_value_dup_string (value);
+    _oauth_proxy_update_credentials (OAUTH_PROXY (object),
+                                     OAUTH_CREDENTIALS_CONSUMER_KEY,
+                                     g_value_get_string (value), NULL, NULL, NULL);
     break;
   case PROP_CONSUMER_SECRET:
-    if (priv->consumer_secret)
-      g_free (priv->consumer_secret);
-    priv->consumer_secret = g_value_dup_string (value);
+    _oauth_proxy_update_credentials (OAUTH_PROXY (object),
+                                     OAUTH_CREDENTIALS_CONSUMER_SECRET,
+                                     NULL, g_value_get_string (value), NULL, NULL);
     break;
   case PROP_TOKEN:
-    if (priv->token)
-      g_free (priv->token);
-    priv->token = g_value_dup_string (value);
+    _oauth_proxy_update_credentials (OAUTH_PROXY (object),
+                                     OAUTH_CREDENTIALS_TOKEN,
+                                     NULL, NULL, g_value_get_string (value), NULL);
     break;
   case PROP_TOKEN_SECRET:
-    if (priv->token_secret)
-      g_free (priv->token_secret);
-    priv->token_secret = g_value_dup_string (value);
+    _oauth_proxy_update_credentials (OAUTH_PROXY (object),
+                                     OAUTH_CREDENTIALS_TOKEN_SECRET,
+                                     NULL, NULL, NULL, g_value_get_string (value));
     break;
   case PROP_SIGNATURE_HOST:
     if (priv->signature_host)
@@ -125,10 +228,7 @@ oauth_proxy_finalize (GObject *object)
 {
   OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (object);
 
-  g_free (priv->consumer_key);
-  g_free (priv->consumer_secret);
-  g_free (priv->token);
-  g_free (priv->token_secret);
+  oauth_credentials_unref (priv->credentials);
   g_free (priv->verifier);
   g_free (priv->service_url);
 
@@ -201,7 +301,12 @@ oauth_proxy_class_init (OAuthProxyClass *klass)
 static void
 oauth_proxy_init (OAuthProxy *self)
 {
-  PROXY_GET_PRIVATE (self)->method = HMAC_SHA1;
+  OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (self);
+
+  priv->credentials = credentials_new (NULL, NULL, NULL, NULL);
+  priv->method = HMAC_SHA1;
+
+  _rest_proxy_set_prepare_func (REST_PROXY (self), _prepare_request);
 }
 
 /**
@@ -292,18 +397,12 @@ auth_callback (RestProxyCall *call,
 {
   AuthData *data = user_data;
   OAuthProxy *proxy = NULL;
-  OAuthProxyPrivate *priv;
-  GHashTable *form;
 
   g_object_get (call, "proxy", &proxy, NULL);
-  priv = PROXY_GET_PRIVATE (proxy);
 
   if (!error) {
     /* TODO: sanity check response */
-    form = soup_form_decode (rest_proxy_call_get_payload (call));
-    priv->token = g_strdup (g_hash_table_lookup (form, "oauth_token"));
-    priv->token_secret = g_strdup (g_hash_table_lookup (form, "oauth_token_secret"));
-    g_hash_table_destroy (form);
+    update_tokens_from_form (proxy, rest_proxy_call_get_payload (call));
   }
 
   data->callback (proxy, error, weak_object, data->user_data);
@@ -365,9 +464,7 @@ oauth_proxy_auth_step_async (OAuthProxy *proxy,
 gboolean
 oauth_proxy_auth_step (OAuthProxy *proxy, const char *function, GError **error)
 {
-  OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (proxy);
   RestProxyCall *call;
-  GHashTable *form;
 
   call = rest_proxy_new_call (REST_PROXY (proxy));
   rest_proxy_call_set_function (call, function);
@@ -378,10 +475,7 @@ oauth_proxy_auth_step (OAuthProxy *proxy, const char *function, GError **error)
   }
 
   /* TODO: sanity check response */
-  form = soup_form_decode (rest_proxy_call_get_payload (call));
-  priv->token = g_strdup (g_hash_table_lookup (form, "oauth_token"));
-  priv->token_secret = g_strdup (g_hash_table_lookup (form, "oauth_token_secret"));
-  g_hash_table_destroy (form);
+  update_tokens_from_form (proxy, rest_proxy_call_get_payload (call));
 
   g_object_unref (call);
 
@@ -630,13 +724,41 @@ oauth_proxy_access_token_async (OAuthProxy            *proxy,
  * Get the current request or access token.
  *
  * Returns: the token, or %NULL if there is no token yet.  This string is owned
- * by #OAuthProxy and should not be freed.
+ * by #OAuthProxy, should not be freed, and is only valid until the token is
+ * changed.  If another thread may change the token, use
+ * oauth_proxy_dup_token() instead.
  */
 const char *
 oauth_proxy_get_token (OAuthProxy *proxy)
 {
   OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (proxy);
-  return priv->token;
+  return priv->credentials->token;
+}
+
+/**
+ * oauth_proxy_dup_token:
+ * @proxy: an #OAuthProxy
+ *
+ * Get a copy of the current request or access token.  Unlike
+ * oauth_proxy_get_token(), this is safe while other threads change the token.
+ *
+ * Returns: the token, or %NULL if there is no token yet.  Free with g_free().
+ */
+char *
+oauth_proxy_dup_token (OAuthProxy *proxy)
+{
+  OAuthProxyPrivate *priv;
+  char *token;
+
+  g_return_val_if_fail (OAUTH_IS_PROXY (proxy), NULL);
+
+  priv = PROXY_GET_PRIVATE (proxy);
+
+  G_LOCK (credentials);
+  token = g_strdup (priv->credentials->token);
+  G_UNLOCK (credentials);
+
+  return token;
 }
 
 /**
@@ -649,15 +771,10 @@ oauth_proxy_get_token (OAuthProxy *proxy)
 void
 oauth_proxy_set_token (OAuthProxy *proxy, const char *token)
 {
-  OAuthProxyPrivate *priv;
-
   g_return_if_fail (OAUTH_IS_PROXY (proxy));
-  priv = PROXY_GET_PRIVATE (proxy);
 
-  if (priv->token)
-    g_free (priv->token);
-
-  priv->token = g_strdup (token);
+  _oauth_proxy_update_credentials (proxy, OAUTH_CREDENTIALS_TOKEN,
+                                   NULL, NULL, token, NULL);
 }
 
 /**
@@ -667,13 +784,43 @@ oauth_proxy_set_token (OAuthProxy *proxy, const char *token)
  * Get the current request or access token secret.
  *
  * Returns: the token secret, or %NULL if there is no token secret yet.  This
- * string is owned by #OAuthProxy and should not be freed.
+ * string is owned by #OAuthProxy, should not be freed, and is only valid until
+ * the token secret is changed.  If another thread may change the token
+ * secret, use oauth_proxy_dup_token_secret() instead.
  */
 const char *
 oauth_proxy_get_token_secret (OAuthProxy *proxy)
 {
   OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (proxy);
-  return priv->token_secret;
+  return priv->credentials->token_secret;
+}
+
+/**
+ * oauth_proxy_dup_token_secret:
+ * @proxy: an #OAuthProxy
+ *
+ * Get a copy of the current request or access token secret.  Unlike
+ * oauth_proxy_get_token_secret(), this is safe while other threads change the
+ * token secret.
+ *
+ * Returns: the token secret, or %NULL if there is no token secret yet.  Free
+ * with g_free().
+ */
+char *
+oauth_proxy_dup_token_secret (OAuthProxy *proxy)
+{
+  OAuthProxyPrivate *priv;
+  char *token_secret;
+
+  g_return_val_if_fail (OAUTH_IS_PROXY (proxy), NULL);
+
+  priv = PROXY_GET_PRIVATE (proxy);
+
+  G_LOCK (credentials);
+  token_secret = g_strdup (priv->credentials->token_secret);
+  G_UNLOCK (credentials);
+
+  return token_secret;
 }
 
 /**
@@ -686,15 +833,10 @@ oauth_proxy_get_token_secret (OAuthProxy *proxy)
 void
 oauth_proxy_set_token_secret (OAuthProxy *proxy, const char *token_secret)
 {
-  OAuthProxyPrivate *priv;
-
   g_return_if_fail (OAUTH_IS_PROXY (proxy));
-  priv = PROXY_GET_PRIVATE (proxy);
 
-  if (priv->token_secret)
-    g_free (priv->token_secret);
-
-  priv->token_secret = g_strdup (token_secret);
+  _oauth_proxy_update_credentials (proxy, OAUTH_CREDENTIALS_TOKEN_SECRET,
+                                   NULL, NULL, NULL, token_secret);
 }
 
 /**
@@ -767,6 +909,10 @@ oauth_proxy_set_signature_host (OAuthProxy *proxy,
  * url="http://www.scribd.com/doc/26707268/OAuth-Echo-Identity-Veri%EF%AC%81cation-Delegation-Draft">OAuth
  * Echo</ulink> proxy.
  *
+ * The echo proxy delegates with the credentials @proxy has now.  To delegate
+ * for many users, create one echo proxy and give each call the user's
+ * credentials with oauth_proxy_call_set_credentials().
+ *
  * Returns: (transfer full): a new OAuth Echo proxy
  */
 RestProxy *
@@ -777,31 +923,131 @@ oauth_proxy_new_echo_proxy (OAuthProxy  *proxy,
                             gboolean     binding_required)
 {
   OAuthProxy *echo_proxy;
-  OAuthProxyPrivate *priv, *echo_priv;
+  OAuthProxyPrivate *echo_priv;
 
   g_return_val_if_fail (OAUTH_IS_PROXY (proxy), NULL);
   g_return_val_if_fail (service_url, NULL);
   g_return_val_if_fail (url_format, NULL);
 
-  priv = PROXY_GET_PRIVATE (proxy);
-
   echo_proxy = g_object_new (OAUTH_TYPE_PROXY,
                              "url-format", url_format,
                              "binding-required", binding_required,
                              "user-agent", rest_proxy_get_user_agent ((RestProxy *)proxy),
-                             "consumer-key", priv->consumer_key,
-                             "consumer-secret", priv->consumer_secret,
-                             "token", priv->token,
-                             "token-secret", priv->token_secret,
                              NULL);
   echo_priv = PROXY_GET_PRIVATE (echo_proxy);
 
+  /* The credentials never change, so the two proxies can share them */
+  oauth_credentials_unref (echo_priv->credentials);
+  echo_priv->credentials = _oauth_proxy_get_credentials (proxy);
+
   echo_priv->oauth_echo = TRUE;
   echo_priv->service_url = g_strdup (service_url);
 
   return (RestProxy *)echo_proxy;
 }
 
+/**
+ * oauth_proxy_new_credentials:
+ * @proxy: an #OAuthProxy
+ * @token: the access token
+ * @token_secret: the access token secret
+ *
+ * Create credentials for signing calls on behalf of a user other than the one
+ * whose token @proxy has, with the consumer key and secret of @proxy.  Pass
+ * them to oauth_proxy_call_set_credentials() for each call made for that
+ * user.
+ *
+ * This lets one #OAuthProxy, with its connections and configuration, serve
+ * any number of users.  The credentials only hold the keys and tokens, and
+ * the signing state made from them the first time they are used, so they can
+ * be kept for as long as the user's token is valid.
+ *
+ * Returns: (transfer full): new #OAuthCredentials, to be released with
+ * oauth_credentials_unref().
+ */
+OAuthCredentials *
+oauth_proxy_new_credentials (OAuthProxy *proxy,
+                             const char *token,
+                             const char *token_secret)
+{
+  OAuthCredentials *current, *credentials;
+
+  g_return_val_if_fail (OAUTH_IS_PROXY (proxy), NULL);
+
+  current = _oauth_proxy_get_credentials (proxy);
+  credentials = credentials_new (current->consumer_key,
+                                 current->consumer_secret,
+                                 token, token_secret);
+  oauth_credentials_unref (current);
+
+  return credentials;
+}
+
+/**
+ * oauth_credentials_ref: (skip):
+ * @credentials: an #OAuthCredentials
+ *
+ * Increases the reference count of @credentials.
+ *
+ * Returns: the same @credentials.
+ */
+OAuthCredentials *
+oauth_credentials_ref (OAuthCredentials *credentials)
+{
+  g_return_val_if_fail (credentials, NULL);
+  g_return_val_if_fail (credentials->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&credentials->ref_count);
+
+  return credentials;
+}
+
+/**
+ * oauth_credentials_unref: (skip):
+ * @credentials: an #OAuthCredentials
+ *
+ * Decreases the reference count of @credentials, freeing them when it reaches
+ * zero.
+ */
+void
+oauth_credentials_unref (OAuthCredentials *credentials)
+{
+  guint i;
+
+  if (credentials == NULL)
+    return;
+
+  if (!g_atomic_int_dec_and_test (&credentials->ref_count))
+    return;
+
+  g_free (credentials->consumer_key);
+  g_free (credentials->consumer_secret);
+  g_free (credentials->token);
+  g_free (credentials->token_secret);
+  for (i = 0; i < G_N_ELEMENTS (credentials->hmac); i++)
+    hmac_free (credentials->hmac[i]);
+
+  g_slice_free (OAuthCredentials, credentials);
+}
+
+GType
+oauth_credentials_get_type (void)
+{
+  static volatile gsize type_id = 0;
+
+  /* Credentials are used from many threads, so register the type once */
+  if (g_once_init_enter (&type_id)) {
+    GType type;
+
+    type = g_boxed_type_register_static ("OAuthCredentials",
+                                         (GBoxedCopyFunc)oauth_credentials_ref,
+                                         (GBoxedFreeFunc)oauth_credentials_unref);
+    g_once_init_leave (&type_id, type);
+  }
+
+  return type_id;
+}
+
 GType
 oauth_signature_method_get_type (void)
 {
@@ -812,6 +1058,7 @@ oauth_signature_method_get_type (void)
     {
       { PLAINTEXT, "PLAINTEXT", "plaintext" },
       { HMAC_SHA1, "HMAC_SHA1", "hmac-sha1" },
+      { HMAC_SHA256, "HMAC_SHA256", "hmac-sha256" },
       { 0, NULL, NULL }
     };
     enum_type_id = g_enum_register_static ("OAuthSignatureMethod", values);
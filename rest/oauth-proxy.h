@@ -60,6 +60,18 @@ typedef struct {
   gpointer _padding_dummy[8];
 } OAuthProxyClass;
 
+/**
+ * OAuthCredentials:
+ *
+ * The consumer key and secret of an #OAuthProxy together with a token and
+ * token secret, for signing calls on behalf of one user.  #OAuthCredentials
+ * never change once made, and have no publicly available members.
+ */
+typedef struct _OAuthCredentials OAuthCredentials;
+
+GType oauth_credentials_get_type (void) G_GNUC_CONST;
+#define OAUTH_TYPE_CREDENTIALS (oauth_credentials_get_type ())
+
 GType oauth_signature_method_get_type (void) G_GNUC_CONST;
 #define OAUTH_TYPE_SIGNATURE_METHOD (oauth_signature_method_get_type())
 
@@ -67,6 +79,7 @@ GType oauth_signature_method_get_type (void) G_GNUC_CONST;
  * OAuthSignatureMethod:
  * @PLAINTEXT: plain text signatures (not recommended)
  * @HMAC_SHA1: HMAC-SHA1 signatures (recommended)
+ * @HMAC_SHA256: HMAC-SHA256 signatures, for services that support them
  *
  * The signature method to use when signing method calls.  @PLAINTEXT is only
  * recommended for testing, in general @HMAC_SHA1 is well supported and more
@@ -74,7 +87,8 @@ GType oauth_signature_method_get_type (void) G_GNUC_CONST;
  */
 typedef enum {
   PLAINTEXT,
-  HMAC_SHA1
+  HMAC_SHA1,
+  HMAC_SHA256
 } OAuthSignatureMethod;
 
 GType oauth_proxy_get_type (void);
@@ -150,10 +164,14 @@ gboolean oauth_proxy_access_token_async (OAuthProxy            *proxy,
 
 const char * oauth_proxy_get_token (OAuthProxy *proxy);
 
+char * oauth_proxy_dup_token (OAuthProxy *proxy);
+
 void oauth_proxy_set_token (OAuthProxy *proxy, const char *token);
 
 const char * oauth_proxy_get_token_secret (OAuthProxy *proxy);
 
+char * oauth_proxy_dup_token_secret (OAuthProxy *proxy);
+
 void oauth_proxy_set_token_secret (OAuthProxy *proxy, const char *token_secret);
 const char * oauth_proxy_get_signature_host (OAuthProxy *proxy);
 
@@ -165,6 +183,14 @@ RestProxy *oauth_proxy_new_echo_proxy (OAuthProxy  *proxy,
                                        const gchar *url_format,
                                        gboolean     binding_required);
 
+OAuthCredentials *oauth_proxy_new_credentials (OAuthProxy *proxy,
+                                               const char *token,
+                                               const char *token_secret);
+
+OAuthCredentials *oauth_credentials_ref (OAuthCredentials *credentials);
+
+void oauth_credentials_unref (OAuthCredentials *credentials);
+
 G_END_DECLS
 
 #endif /* _OAUTH_PROXY */
@@ -31,25 +31,40 @@
 
 G_DEFINE_TYPE (OAuth2ProxyCall, oauth2_proxy_call, REST_TYPE_PROXY_CALL)
 
-static gboolean
-_prepare (RestProxyCall *call, GError **error)
+/*
+ * Add the access token to the request in @view.  Both calls and #RestRequest
+ * objects are prepared here.
+ */
+gboolean
+_oauth2_proxy_prepare (RestProxy        *proxy,
+                       RestRequestView  *view,
+                       GError          **error)
 {
-  OAuth2Proxy *proxy = NULL;
-  gboolean result = TRUE;
-
-  g_object_get (call, "proxy", &proxy, NULL);
+  OAuth2Proxy *oauth2_proxy = OAUTH2_PROXY (proxy);
 
-  if (!proxy->priv->access_token) {
+  if (!oauth2_proxy->priv->access_token) {
     g_set_error (error,
                  REST_PROXY_CALL_ERROR,
                  REST_PROXY_CALL_FAILED,
                  "Missing access token, web service not properly authenticated");
-    result = FALSE;
-  } else {
-    rest_proxy_call_add_param (call, "access_token", proxy->priv->access_token);
+    return FALSE;
   }
 
-  g_object_unref (proxy);
+  _rest_request_view_set_param (view, "access_token",
+                                oauth2_proxy->priv->access_token);
+
+  return TRUE;
+}
+
+static gboolean
+_prepare (RestProxyCall *call, GError **error)
+{
+  RestRequestView view;
+  gboolean result;
+
+  _rest_proxy_call_init_view (call, &view);
+  result = _oauth2_proxy_prepare (call->priv->proxy, &view, error);
+  _rest_proxy_call_finish_view (call, &view);
 
   return result;
 }
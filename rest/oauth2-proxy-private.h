@@ -24,6 +24,7 @@
 #define _OAUTH2_PROXY_PRIVATE
 
 #include "oauth2-proxy.h"
+#include "rest-private.h"
 
 struct _OAuth2ProxyPrivate {
   char *client_id;
@@ -31,4 +32,8 @@ struct _OAuth2ProxyPrivate {
   char *access_token;
 };
 
+gboolean _oauth2_proxy_prepare (RestProxy        *proxy,
+                                RestRequestView  *view,
+                                GError          **error);
+
 #endif /* _OAUTH2_PROXY_PRIVATE */
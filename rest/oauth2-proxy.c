@@ -26,6 +26,7 @@
 #include "oauth2-proxy.h"
 #include "oauth2-proxy-private.h"
 #include "oauth2-proxy-call.h"
+#include "rest-text-codec.h"
 
 G_DEFINE_TYPE (OAuth2Proxy, oauth2_proxy, REST_TYPE_PROXY)
 
@@ -38,8 +39,6 @@ oauth2_proxy_error_quark (void)
     return g_quark_from_static_string ("rest-oauth2-proxy");
 }
 
-#define EXTRA_CHARS_ENCODE "!$&'()*+,;=@"
-
 enum {
   PROP_0,
   PROP_CLIENT_ID,
@@ -160,6 +159,8 @@ static void
 oauth2_proxy_init (OAuth2Proxy *proxy)
 {
   proxy->priv = OAUTH2_PROXY_GET_PRIVATE (proxy);
+
+  _rest_proxy_set_prepare_func (REST_PROXY (proxy), _oauth2_proxy_prepare);
 }
 
 /**
@@ -237,26 +238,20 @@ oauth2_proxy_new_with_token (const char *client_id,
                        NULL);
 }
 
-/* allocates a new string of the form "key=value" */
+/* appends "key=value" to the string, encoding both */
 static void
 append_query_param (gpointer key, gpointer value, gpointer user_data)
 {
     GString *params = (GString*) user_data;
-    char *encoded_val, *encoded_key;
-    char *param;
-
-    encoded_val = soup_uri_encode (value, EXTRA_CHARS_ENCODE);
-    encoded_key = soup_uri_encode (key, EXTRA_CHARS_ENCODE);
-
-    param = g_strdup_printf ("%s=%s", encoded_key, encoded_val);
-    g_free (encoded_key);
-    g_free (encoded_val);
 
     // if there's already a parameter in the string, we need to add a '&'
     // separator before adding the new param
     if (params->len)
         g_string_append_c (params, '&');
-    g_string_append (params, param);
+
+    _rest_string_append_percent_encoded (params, key);
+    g_string_append_c (params, '=');
+    _rest_string_append_percent_encoded (params, value);
 }
 
 /**
@@ -298,8 +293,8 @@ oauth2_proxy_build_login_url_full (OAuth2Proxy *proxy,
         g_hash_table_foreach (extra_params, append_query_param, params);
     }
 
-    encoded_uri = soup_uri_encode (redirect_uri, EXTRA_CHARS_ENCODE);
-    encoded_id = soup_uri_encode (proxy->priv->client_id, EXTRA_CHARS_ENCODE);
+    encoded_uri = _rest_percent_encode_string (redirect_uri);
+    encoded_id = _rest_percent_encode_string (proxy->priv->client_id);
 
     url = g_strdup_printf ("%s?client_id=%s&redirect_uri=%s&type=user_agent",
                            proxy->priv->auth_endpoint, encoded_id,
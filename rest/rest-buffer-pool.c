@@ -0,0 +1,246 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include "rest-buffer-pool.h"
+
+/*
+ * A pool of response buffers in power of two size classes.  Freed buffers go
+ * back on a free list for their class instead of back to malloc, so pollers
+ * which make the same requests over and over reuse the same few buffers and
+ * the heap does not fragment.  The free lists are capped, and buffers larger
+ * than the biggest class are never pooled.
+ *
+ * Each buffer is preceded by a header naming its pool and class, so buffers
+ * can be freed without knowing where they came from.  Outstanding buffers
+ * hold a reference on their pool, so the pool outlives its owner if need be.
+ */
+
+#define POOL_MIN_SHIFT 8
+#define POOL_MAX_SHIFT 20
+#define POOL_N_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+
+/* The most memory kept idle on the free lists of one pool */
+#define POOL_MAX_RESIDENT (4 * 1024 * 1024)
+
+typedef union {
+  struct {
+    RestBufferPool *pool;
+    /* -1 if the buffer is not pooled */
+    gint size_class;
+  } h;
+  /* Keep the data that follows suitably aligned */
+  gint64 align[2];
+} Header;
+
+struct _RestBufferPool {
+  volatile gint ref_count;
+  /* Guards everything below */
+  GMutex lock;
+
+  /* Free buffers, linked through their first bytes */
+  gpointer free_list[POOL_N_CLASSES];
+
+  gsize resident;
+  guint64 hits;
+  guint64 misses;
+};
+
+RestBufferPool *
+_rest_buffer_pool_new (void)
+{
+  RestBufferPool *pool;
+
+  pool = g_slice_new0 (RestBufferPool);
+  pool->ref_count = 1;
+  g_mutex_init (&pool->lock);
+
+  return pool;
+}
+
+RestBufferPool *
+_rest_buffer_pool_ref (RestBufferPool *pool)
+{
+  g_return_val_if_fail (pool, NULL);
+
+  g_atomic_int_inc (&pool->ref_count);
+
+  return pool;
+}
+
+void
+_rest_buffer_pool_unref (RestBufferPool *pool)
+{
+  gpointer buffer;
+  guint i;
+
+  g_return_if_fail (pool);
+
+  if (!g_atomic_int_dec_and_test (&pool->ref_count))
+    return;
+
+  for (i = 0; i < POOL_N_CLASSES; i++) {
+    while ((buffer = pool->free_list[i])) {
+      pool->free_list[i] = *(gpointer *)buffer;
+      g_free ((Header *)buffer - 1);
+    }
+  }
+
+  g_mutex_clear (&pool->lock);
+  g_slice_free (RestBufferPool, pool);
+}
+
+static gint
+get_size_class (gsize size)
+{
+  gint klass = 0;
+
+  while (((gsize)1 << (klass + POOL_MIN_SHIFT)) < size) {
+    if (++klass == POOL_N_CLASSES)
+      return -1;
+  }
+
+  return klass;
+}
+
+/*
+ * Allocate a buffer from @pool that can hold at least @size bytes, the actual
+ * capacity being stored in @capacity if it is not %NULL.  Free it with
+ * _rest_buffer_pool_free().
+ */
+gpointer
+_rest_buffer_pool_alloc (RestBufferPool *pool,
+                         gsize           size,
+                         gsize          *capacity)
+{
+  Header *header = NULL;
+  gpointer buffer;
+  gint klass;
+  gsize len;
+
+  g_return_val_if_fail (pool, NULL);
+
+  klass = get_size_class (size);
+  len = klass < 0 ? size : (gsize)1 << (klass + POOL_MIN_SHIFT);
+
+  g_mutex_lock (&pool->lock);
+  if (klass >= 0 && (buffer = pool->free_list[klass])) {
+    pool->free_list[klass] = *(gpointer *)buffer;
+    pool->resident -= len;
+    pool->hits++;
+    header = (Header *)buffer - 1;
+  } else {
+    pool->misses++;
+  }
+  g_mutex_unlock (&pool->lock);
+
+  if (header == NULL) {
+    header = g_malloc (sizeof (Header) + len);
+    header->h.size_class = klass;
+  }
+
+  header->h.pool = _rest_buffer_pool_ref (pool);
+
+  if (capacity)
+    *capacity = len;
+
+  return header + 1;
+}
+
+/* Return @buffer to its pool, or to the heap if the pool is full. */
+void
+_rest_buffer_pool_free (gpointer buffer)
+{
+  Header *header;
+  RestBufferPool *pool;
+  gsize len;
+
+  if (buffer == NULL)
+    return;
+
+  header = (Header *)buffer - 1;
+  pool = header->h.pool;
+
+  if (header->h.size_class >= 0) {
+    len = (gsize)1 << (header->h.size_class + POOL_MIN_SHIFT);
+
+    g_mutex_lock (&pool->lock);
+    if (pool->resident + len <= POOL_MAX_RESIDENT) {
+      *(gpointer *)buffer = pool->free_list[header->h.size_class];
+      pool->free_list[header->h.size_class] = buffer;
+      pool->resident += len;
+      header = NULL;
+    }
+    g_mutex_unlock (&pool->lock);
+  }
+
+  g_free (header);
+  _rest_buffer_pool_unref (pool);
+}
+
+/*
+ * Grow @buffer, which holds @len bytes, so that it can hold at least @size
+ * bytes.  @buffer may be %NULL.
+ */
+gpointer
+_rest_buffer_pool_realloc (RestBufferPool *pool,
+                           gpointer        buffer,
+                           gsize           len,
+                           gsize           size,
+                           gsize          *capacity)
+{
+  gpointer new_buffer;
+
+  new_buffer = _rest_buffer_pool_alloc (pool, size, capacity);
+
+  if (buffer) {
+    memcpy (new_buffer, buffer, MIN (len, size));
+    _rest_buffer_pool_free (buffer);
+  }
+
+  return new_buffer;
+}
+
+void
+_rest_buffer_pool_get_stats (RestBufferPool *pool,
+                             guint64        *hits,
+                             guint64        *misses,
+                             guint64        *resident)
+{
+  g_return_if_fail (pool);
+
+  g_mutex_lock (&pool->lock);
+  *hits = pool->hits;
+  *misses = pool->misses;
+  *resident = pool->resident;
+  g_mutex_unlock (&pool->lock);
+}
+
+void
+_rest_buffer_pool_reset_stats (RestBufferPool *pool)
+{
+  g_return_if_fail (pool);
+
+  g_mutex_lock (&pool->lock);
+  pool->hits = 0;
+  pool->misses = 0;
+  g_mutex_unlock (&pool->lock);
+}
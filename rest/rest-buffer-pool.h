@@ -0,0 +1,56 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_BUFFER_POOL
+#define _REST_BUFFER_POOL
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RestBufferPool RestBufferPool;
+
+RestBufferPool *_rest_buffer_pool_new (void);
+
+RestBufferPool *_rest_buffer_pool_ref (RestBufferPool *pool);
+
+void _rest_buffer_pool_unref (RestBufferPool *pool);
+
+gpointer _rest_buffer_pool_alloc (RestBufferPool *pool,
+                                  gsize           size,
+                                  gsize          *capacity);
+
+gpointer _rest_buffer_pool_realloc (RestBufferPool *pool,
+                                    gpointer        buffer,
+                                    gsize           len,
+                                    gsize           size,
+                                    gsize          *capacity);
+
+void _rest_buffer_pool_free (gpointer buffer);
+
+void _rest_buffer_pool_get_stats (RestBufferPool *pool,
+                                  guint64        *hits,
+                                  guint64        *misses,
+                                  guint64        *resident);
+
+void _rest_buffer_pool_reset_stats (RestBufferPool *pool);
+
+G_END_DECLS
+
+#endif /* _REST_BUFFER_POOL */
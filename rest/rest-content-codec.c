@@ -0,0 +1,527 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <string.h>
+#include <gio/gio.h>
+#if HAVE_BROTLI
+#include <brotli/decode.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "rest-content-codec.h"
+
+/*
+ * Streaming decoders and encoders for the HTTP content codings.  Data is fed
+ * in as it arrives from the network (or as the request body is written) and the
+ * output is handed to a callback in blocks of at most CODEC_BUFFER_SIZE bytes,
+ * so the amount of memory used does not depend on the size of the body.
+ */
+
+#define CODEC_BUFFER_SIZE 16384
+
+typedef enum {
+  CODING_GZIP,
+  CODING_DEFLATE,
+  CODING_BROTLI,
+  CODING_ZSTD
+} Coding;
+
+struct _RestContentDecoder {
+  Coding coding;
+  gboolean started;
+  gboolean finished;
+  GConverter *converter;
+  /* The start of a deflate body, until there is enough of it to tell whether
+   * it has a zlib header */
+  guint8 head[2];
+  gsize head_len;
+#if HAVE_BROTLI
+  BrotliDecoderState *brotli;
+#endif
+#if HAVE_ZSTD
+  ZSTD_DStream *zstd;
+  /* Whether the last input ended on the end of a frame */
+  gboolean zstd_frame_end;
+#endif
+};
+
+/*
+ * The value to send as the Accept-Encoding header, listing every coding that
+ * this build is able to decode.
+ */
+const char *
+_rest_content_decoder_get_accept_encoding (void)
+{
+  return "gzip, deflate"
+#if HAVE_BROTLI
+    ", br"
+#endif
+#if HAVE_ZSTD
+    ", zstd"
+#endif
+    ;
+}
+
+/*
+ * Create a decoder for the content coding @coding, as found in the
+ * Content-Encoding header.  Returns %NULL if @coding is unknown, in which case
+ * the body should be passed through untouched.
+ */
+RestContentDecoder *
+_rest_content_decoder_new (const char *coding)
+{
+  RestContentDecoder *decoder;
+
+  g_return_val_if_fail (coding, NULL);
+
+  decoder = g_slice_new0 (RestContentDecoder);
+
+  if (g_ascii_strcasecmp (coding, "gzip") == 0 ||
+      g_ascii_strcasecmp (coding, "x-gzip") == 0) {
+    decoder->coding = CODING_GZIP;
+    decoder->converter = (GConverter *)
+      g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+  } else if (g_ascii_strcasecmp (coding, "deflate") == 0) {
+    /* The converter is made once the format is known */
+    decoder->coding = CODING_DEFLATE;
+#if HAVE_BROTLI
+  } else if (g_ascii_strcasecmp (coding, "br") == 0) {
+    decoder->coding = CODING_BROTLI;
+    decoder->brotli = BrotliDecoderCreateInstance (NULL, NULL, NULL);
+#endif
+#if HAVE_ZSTD
+  } else if (g_ascii_strcasecmp (coding, "zstd") == 0) {
+    decoder->coding = CODING_ZSTD;
+    decoder->zstd = ZSTD_createDStream ();
+    ZSTD_initDStream (decoder->zstd);
+#endif
+  } else {
+    g_slice_free (RestContentDecoder, decoder);
+    return NULL;
+  }
+
+  return decoder;
+}
+
+static gboolean
+push_converter (RestContentDecoder *decoder,
+                const gchar        *data,
+                gsize               len,
+                RestContentFunc     func,
+                gpointer            user_data,
+                GError            **error)
+{
+  gchar out[CODEC_BUFFER_SIZE];
+  GConverterResult res;
+  gsize bytes_read, bytes_written;
+  GError *err = NULL;
+
+  do {
+    res = g_converter_convert (decoder->converter,
+                               data, len,
+                               out, sizeof (out),
+                               G_CONVERTER_NO_FLAGS,
+                               &bytes_read, &bytes_written,
+                               &err);
+
+    if (res == G_CONVERTER_ERROR) {
+      /* Not an error, we just need to wait for the next chunk */
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT)) {
+        g_error_free (err);
+        return TRUE;
+      }
+
+      g_propagate_error (error, err);
+      return FALSE;
+    }
+
+    data += bytes_read;
+    len -= bytes_read;
+
+    if (bytes_written)
+      func (out, bytes_written, user_data);
+
+    if (res == G_CONVERTER_FINISHED) {
+      decoder->finished = TRUE;
+      break;
+    }
+  } while (len > 0 || bytes_written == sizeof (out));
+
+  return TRUE;
+}
+
+/*
+ * "deflate" should be zlib data, but some servers send raw deflate data
+ * instead.  Like libsoup, look at the first two bytes to tell them apart: a
+ * zlib header names the deflate method and is a multiple of 31.
+ */
+static gboolean
+push_deflate (RestContentDecoder *decoder,
+              const gchar        *data,
+              gsize               len,
+              RestContentFunc     func,
+              gpointer            user_data,
+              GError            **error)
+{
+  GZlibCompressorFormat format;
+  gsize n;
+
+  if (decoder->converter == NULL) {
+    n = MIN (len, sizeof (decoder->head) - decoder->head_len);
+    memcpy (decoder->head + decoder->head_len, data, n);
+    decoder->head_len += n;
+    data += n;
+    len -= n;
+
+    if (decoder->head_len < sizeof (decoder->head))
+      return TRUE;
+
+    if ((decoder->head[0] & 0x0f) == 8 &&
+        ((decoder->head[0] << 8) | decoder->head[1]) % 31 == 0)
+      format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
+    else
+      format = G_ZLIB_COMPRESSOR_FORMAT_RAW;
+
+    decoder->converter = (GConverter *)g_zlib_decompressor_new (format);
+
+    if (!push_converter (decoder, (const gchar *)decoder->head,
+                         decoder->head_len, func, user_data, error))
+      return FALSE;
+  }
+
+  if (len == 0 || decoder->finished)
+    return TRUE;
+
+  return push_converter (decoder, data, len, func, user_data, error);
+}
+
+#if HAVE_BROTLI
+static gboolean
+push_brotli (RestContentDecoder *decoder,
+             const gchar        *data,
+             gsize               len,
+             RestContentFunc     func,
+             gpointer            user_data,
+             GError            **error)
+{
+  guint8 out[CODEC_BUFFER_SIZE];
+  const guint8 *next_in = (const guint8 *)data;
+  gsize avail_in = len;
+  BrotliDecoderResult res;
+
+  do {
+    guint8 *next_out = out;
+    gsize avail_out = sizeof (out);
+
+    res = BrotliDecoderDecompressStream (decoder->brotli,
+                                         &avail_in, &next_in,
+                                         &avail_out, &next_out,
+                                         NULL);
+    if (res == BROTLI_DECODER_RESULT_ERROR) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid brotli data: %s",
+                   BrotliDecoderErrorString (BrotliDecoderGetErrorCode (decoder->brotli)));
+      return FALSE;
+    }
+
+    if (avail_out < sizeof (out))
+      func ((const gchar *)out, sizeof (out) - avail_out, user_data);
+  } while (res == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
+
+  if (res == BROTLI_DECODER_RESULT_SUCCESS)
+    decoder->finished = TRUE;
+
+  return TRUE;
+}
+#endif
+
+#if HAVE_ZSTD
+static gboolean
+push_zstd (RestContentDecoder *decoder,
+           const gchar        *data,
+           gsize               len,
+           RestContentFunc     func,
+           gpointer            user_data,
+           GError            **error)
+{
+  gchar out[CODEC_BUFFER_SIZE];
+  ZSTD_inBuffer input = { data, len, 0 };
+  ZSTD_outBuffer output;
+  gsize ret;
+
+  do {
+    output.dst = out;
+    output.size = sizeof (out);
+    output.pos = 0;
+
+    ret = ZSTD_decompressStream (decoder->zstd, &output, &input);
+    if (ZSTD_isError (ret)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid zstd data: %s", ZSTD_getErrorName (ret));
+      return FALSE;
+    }
+
+    if (output.pos)
+      func (out, output.pos, user_data);
+  } while (input.pos < input.size || output.pos == output.size);
+
+  decoder->zstd_frame_end = ret == 0;
+
+  return TRUE;
+}
+#endif
+
+/*
+ * Feed @len bytes of encoded @data into @decoder, calling @func with the
+ * decoded output as it is produced.  Any data after the end of the encoded
+ * stream is ignored.
+ */
+gboolean
+_rest_content_decoder_push (RestContentDecoder *decoder,
+                            const gchar        *data,
+                            gsize               len,
+                            RestContentFunc     func,
+                            gpointer            user_data,
+                            GError            **error)
+{
+  g_return_val_if_fail (decoder, FALSE);
+  g_return_val_if_fail (func, FALSE);
+
+  if (decoder->finished || len == 0)
+    return TRUE;
+
+  decoder->started = TRUE;
+
+  switch (decoder->coding) {
+  case CODING_GZIP:
+    return push_converter (decoder, data, len, func, user_data, error);
+  case CODING_DEFLATE:
+    return push_deflate (decoder, data, len, func, user_data, error);
+#if HAVE_BROTLI
+  case CODING_BROTLI:
+    return push_brotli (decoder, data, len, func, user_data, error);
+#endif
+#if HAVE_ZSTD
+  case CODING_ZSTD:
+    return push_zstd (decoder, data, len, func, user_data, error);
+#endif
+  default:
+    g_assert_not_reached ();
+  }
+
+  return FALSE;
+}
+
+/*
+ * Tell @decoder that there is no more input, calling @func with any output
+ * that was held back.  Fails if the encoded stream was cut short.  A decoder
+ * that was never given any data, as for a HEAD request, has nothing to
+ * finish.
+ */
+gboolean
+_rest_content_decoder_finish (RestContentDecoder *decoder,
+                              RestContentFunc     func,
+                              gpointer            user_data,
+                              GError            **error)
+{
+  gchar out[CODEC_BUFFER_SIZE];
+  GConverterResult res;
+  gsize bytes_read, bytes_written;
+
+  g_return_val_if_fail (decoder, FALSE);
+  g_return_val_if_fail (func, FALSE);
+
+  if (decoder->finished || !decoder->started)
+    return TRUE;
+
+  switch (decoder->coding) {
+  case CODING_GZIP:
+  case CODING_DEFLATE:
+    /* Not even enough of a deflate body to know its format */
+    if (decoder->converter == NULL)
+      break;
+
+    do {
+      res = g_converter_convert (decoder->converter,
+                                 NULL, 0,
+                                 out, sizeof (out),
+                                 G_CONVERTER_INPUT_AT_END,
+                                 &bytes_read, &bytes_written,
+                                 error);
+      if (res == G_CONVERTER_ERROR)
+        return FALSE;
+
+      if (bytes_written)
+        func (out, bytes_written, user_data);
+    } while (res != G_CONVERTER_FINISHED);
+
+    decoder->finished = TRUE;
+    return TRUE;
+#if HAVE_ZSTD
+  case CODING_ZSTD:
+    if (decoder->zstd_frame_end) {
+      decoder->finished = TRUE;
+      return TRUE;
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+               "Encoded response body is truncated");
+  return FALSE;
+}
+
+void
+_rest_content_decoder_free (RestContentDecoder *decoder)
+{
+  if (decoder == NULL)
+    return;
+
+  if (decoder->converter)
+    g_object_unref (decoder->converter);
+#if HAVE_BROTLI
+  if (decoder->brotli)
+    BrotliDecoderDestroyInstance (decoder->brotli);
+#endif
+#if HAVE_ZSTD
+  if (decoder->zstd)
+    ZSTD_freeDStream (decoder->zstd);
+#endif
+
+  g_slice_free (RestContentDecoder, decoder);
+}
+
+struct _RestContentEncoder {
+  GConverter *converter;
+  gboolean finished;
+};
+
+/*
+ * The token used in the Content-Encoding header for @coding, or %NULL for
+ * %REST_CONTENT_CODING_IDENTITY.
+ */
+const char *
+_rest_content_coding_to_string (RestContentCoding coding)
+{
+  switch (coding) {
+  case REST_CONTENT_CODING_GZIP:
+    return "gzip";
+  case REST_CONTENT_CODING_DEFLATE:
+    return "deflate";
+  case REST_CONTENT_CODING_IDENTITY:
+  default:
+    return NULL;
+  }
+}
+
+/*
+ * Create an encoder compressing with @coding, which must not be
+ * %REST_CONTENT_CODING_IDENTITY.
+ */
+RestContentEncoder *
+_rest_content_encoder_new (RestContentCoding coding)
+{
+  RestContentEncoder *encoder;
+  GZlibCompressorFormat format;
+
+  switch (coding) {
+  case REST_CONTENT_CODING_GZIP:
+    format = G_ZLIB_COMPRESSOR_FORMAT_GZIP;
+    break;
+  case REST_CONTENT_CODING_DEFLATE:
+    format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
+    break;
+  default:
+    g_return_val_if_reached (NULL);
+  }
+
+  encoder = g_slice_new0 (RestContentEncoder);
+  encoder->converter = (GConverter *)g_zlib_compressor_new (format, -1);
+
+  return encoder;
+}
+
+/*
+ * Feed @len bytes of @data into @encoder, calling @func with the compressed
+ * output as it is produced.  Set @finish on the last call to flush the
+ * remaining output and write the stream trailer.
+ */
+gboolean
+_rest_content_encoder_push (RestContentEncoder *encoder,
+                            const gchar        *data,
+                            gsize               len,
+                            gboolean            finish,
+                            RestContentFunc     func,
+                            gpointer            user_data,
+                            GError            **error)
+{
+  gchar out[CODEC_BUFFER_SIZE];
+  GConverterResult res;
+  gsize bytes_read, bytes_written;
+
+  g_return_val_if_fail (encoder, FALSE);
+  g_return_val_if_fail (func, FALSE);
+
+  /* zlib refuses to be called without any input unless it is finishing */
+  if (encoder->finished || (len == 0 && !finish))
+    return TRUE;
+
+  for (;;) {
+    res = g_converter_convert (encoder->converter,
+                               data, len,
+                               out, sizeof (out),
+                               finish ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+                               &bytes_read, &bytes_written,
+                               error);
+    if (res == G_CONVERTER_ERROR)
+      return FALSE;
+
+    data += bytes_read;
+    len -= bytes_read;
+
+    if (bytes_written)
+      func (out, bytes_written, user_data);
+
+    if (res == G_CONVERTER_FINISHED) {
+      encoder->finished = TRUE;
+      break;
+    }
+
+    if (len == 0 && !finish)
+      break;
+  }
+
+  return TRUE;
+}
+
+void
+_rest_content_encoder_free (RestContentEncoder *encoder)
+{
+  if (encoder == NULL)
+    return;
+
+  g_object_unref (encoder->converter);
+  g_slice_free (RestContentEncoder, encoder);
+}
@@ -0,0 +1,73 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_CONTENT_CODEC
+#define _REST_CONTENT_CODEC
+
+#include <glib.h>
+#include <rest/rest-proxy-call.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RestContentDecoder RestContentDecoder;
+typedef struct _RestContentEncoder RestContentEncoder;
+
+/*
+ * Called with each block of output produced by a codec.  The data is only
+ * valid for the duration of the call.
+ */
+typedef void (*RestContentFunc) (const gchar *data,
+                                 gsize        len,
+                                 gpointer     user_data);
+
+const char *_rest_content_decoder_get_accept_encoding (void);
+
+RestContentDecoder *_rest_content_decoder_new (const char *coding);
+
+gboolean _rest_content_decoder_push (RestContentDecoder *decoder,
+                                     const gchar        *data,
+                                     gsize               len,
+                                     RestContentFunc     func,
+                                     gpointer            user_data,
+                                     GError            **error);
+
+gboolean _rest_content_decoder_finish (RestContentDecoder *decoder,
+                                       RestContentFunc     func,
+                                       gpointer            user_data,
+                                       GError            **error);
+
+void _rest_content_decoder_free (RestContentDecoder *decoder);
+
+const char *_rest_content_coding_to_string (RestContentCoding coding);
+
+RestContentEncoder *_rest_content_encoder_new (RestContentCoding coding);
+
+gboolean _rest_content_encoder_push (RestContentEncoder *encoder,
+                                     const gchar        *data,
+                                     gsize               len,
+                                     gboolean            finish,
+                                     RestContentFunc     func,
+                                     gpointer            user_data,
+                                     GError            **error);
+
+void _rest_content_encoder_free (RestContentEncoder *encoder);
+
+G_END_DECLS
+
+#endif /* _REST_CONTENT_CODEC */
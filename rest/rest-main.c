@@ -45,3 +45,61 @@ _rest_setup_debugging (void)
   
   setup_done = TRUE;
 }
+
+/*
+ * Strings interned by this thread, so that names seen before can be found
+ * without taking the lock g_intern_string() does.  The keys are the interned
+ * strings themselves, which are never freed.
+ */
+static GPrivate intern_cache = G_PRIVATE_INIT ((GDestroyNotify)g_hash_table_unref);
+
+/* Past this many strings a thread's cache stops growing */
+#define INTERN_CACHE_MAX 4096
+
+/*
+ * The same as g_intern_string(), but strings that the calling thread has
+ * interned before are returned without locking.
+ */
+const char *
+_rest_intern (const char *string)
+{
+  GHashTable *cache;
+  const char *interned;
+
+  if (string == NULL)
+    return NULL;
+
+  cache = g_private_get (&intern_cache);
+
+  if (G_UNLIKELY (cache == NULL)) {
+    cache = g_hash_table_new (g_str_hash, g_str_equal);
+    g_private_set (&intern_cache, cache);
+  }
+
+  interned = g_hash_table_lookup (cache, string);
+  if (G_LIKELY (interned))
+    return interned;
+
+  interned = g_intern_string (string);
+  if (g_hash_table_size (cache) < INTERN_CACHE_MAX)
+    g_hash_table_insert (cache, (gpointer)interned, (gpointer)interned);
+
+  return interned;
+}
+
+#if BUILD_TESTS
+void
+test_intern (void)
+{
+  char name[] = "rest-intern-test";
+  const char *interned;
+
+  interned = _rest_intern (name);
+  g_assert (interned == g_intern_string (name));
+  g_assert (interned != name);
+
+  /* Found in the cache the second time */
+  g_assert (_rest_intern (name) == interned);
+  g_assert (_rest_intern (NULL) == NULL);
+}
+#endif
@@ -25,7 +25,12 @@
 
 #include <config.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "rest-param.h"
+#include "rest-private.h"
 
 /**
  * SECTION:rest-param
@@ -36,24 +41,122 @@
 
 /* Internal RestMemoryUse values */
 enum {
-  REST_MEMORY_OWNED = REST_MEMORY_COPY + 1
+  REST_MEMORY_OWNED = REST_MEMORY_COPY + 1,
+  /* Copied into the parameter's own allocation */
+  REST_MEMORY_INLINE
 };
 
+/*
+ * Values copied with REST_MEMORY_COPY that are no longer than this are stored
+ * after the structure, along with the name and filename, so that a typical
+ * parameter is a single allocation.
+ */
+#define PARAM_INLINE_MAX 128
+
 struct _RestParam {
-  char          *name;
+  const char    *name;
   RestMemoryUse  use;
   gconstpointer  data;
   gsize          length;
   const char    *content_type;
-  char          *filename;
+  const char    *filename;
+
+  GInputStream  *stream;
+  goffset        stream_length;
+
+  /* -1 if the value is not read from a file descriptor */
+  int            fd;
+  goffset        fd_offset;
+  goffset        fd_length;
 
   volatile gint  ref_count;
   gpointer       owner;
   GDestroyNotify owner_dnotify;
+
+  /* The size of the allocation, including the inline value and strings */
+  gsize          size;
 };
 
 G_DEFINE_BOXED_TYPE (RestParam, rest_param, rest_param_ref, rest_param_unref)
 
+/*
+ * "text/plain" is compared against on every parameter, so save looking it up
+ * each time.
+ */
+static const char *
+text_plain (void)
+{
+  static const char *interned = NULL;
+  const char *s;
+
+  /* Racing threads all store the same pointer */
+  s = g_atomic_pointer_get (&interned);
+  if (G_UNLIKELY (s == NULL)) {
+    s = g_intern_static_string ("text/plain");
+    g_atomic_pointer_set (&interned, s);
+  }
+
+  return s;
+}
+
+static const char *
+intern_content_type (const char *content_type)
+{
+  if (content_type == text_plain ())
+    return content_type;
+
+  return _rest_intern (content_type);
+}
+
+/*
+ * Allocate a parameter with room for @inline_size bytes of value, which is
+ * returned in @inline_data, and copies of @name and @filename.
+ */
+static RestParam *
+param_new (const char  *name,
+           const char  *content_type,
+           const char  *filename,
+           gsize        inline_size,
+           gpointer    *inline_data)
+{
+  RestParam *param;
+  gsize name_size, filename_size, size;
+  char *p;
+
+  name_size = name ? strlen (name) + 1 : 0;
+  filename_size = filename ? strlen (filename) + 1 : 0;
+  size = sizeof (RestParam) + inline_size + name_size + filename_size;
+
+  param = g_slice_alloc (size);
+  memset (param, 0, sizeof (RestParam));
+  param->size = size;
+
+  /* The value comes first as it is the only part that may need aligning */
+  p = (char *)(param + 1);
+  if (inline_data)
+    *inline_data = p;
+  p += inline_size;
+
+  if (name) {
+    memcpy (p, name, name_size);
+    param->name = p;
+    p += name_size;
+  }
+
+  if (filename) {
+    memcpy (p, filename, filename_size);
+    param->filename = p;
+  }
+
+  param->content_type = intern_content_type (content_type);
+
+  param->fd = -1;
+
+  param->ref_count = 1;
+
+  return param;
+}
+
 /**
  * rest_param_new_full:
  * @name: the parameter name
@@ -70,6 +173,9 @@ G_DEFINE_BOXED_TYPE (RestParam, rest_param, rest_param_ref, rest_param_unref)
  *
  * If the parameter is a file upload it can be passed as @filename.
  *
+ * Short values copied with %REST_MEMORY_COPY are stored in the same block of
+ * memory as the parameter itself.
+ *
  * Returns: a new #RestParam.
  **/
 RestParam *
@@ -81,24 +187,31 @@ rest_param_new_full (const char    *name,
                      const char    *filename)
 {
   RestParam *param;
+  gpointer inline_data;
+
+  if (use == REST_MEMORY_COPY && length <= PARAM_INLINE_MAX) {
+    param = param_new (name, content_type, filename, length, &inline_data);
+    if (length)
+      memcpy (inline_data, data, length);
 
-  param = g_slice_new0 (RestParam);
+    param->use    = REST_MEMORY_INLINE;
+    param->data   = inline_data;
+    param->length = length;
+
+    return param;
+  }
 
   if (use == REST_MEMORY_COPY) {
     data = g_memdup (data, length);
     use  = REST_MEMORY_TAKE;
   }
 
-  param->name   = g_strdup (name);
+  param = param_new (name, content_type, filename, 0, NULL);
+
   param->use    = use;
   param->data   = data;
   param->length = length;
 
-  param->content_type = g_intern_string (content_type);
-  param->filename     = g_strdup (filename);
-
-  param->ref_count = 1;
-
   if (use == REST_MEMORY_TAKE) {
     param->owner         = (gpointer)data;
     param->owner_dnotify = g_free;
@@ -139,6 +252,12 @@ rest_param_new_full (const char    *name,
  *                                               (GDestroyNotify)g_mapped_file_unref);
  * ]|
  *
+ * Parameters are reference counted and never modify their data, so one
+ * parameter can be added to any number of calls, including calls running at
+ * the same time in different threads, by passing a new reference to each with
+ * rest_param_ref().  @owner_dnotify is called once, when the last reference is
+ * dropped.
+ *
  * Returns: a new #RestParam.
  **/
 RestParam *
@@ -152,25 +271,213 @@ rest_param_new_with_owner (const char     *name,
 {
   RestParam *param;
 
-  param = g_slice_new0 (RestParam);
-
-  param->name = g_strdup (name);
+  param = param_new (name, content_type, filename, 0, NULL);
 
   param->use    = REST_MEMORY_OWNED;
   param->data   = data;
   param->length = length;
 
-  param->content_type = g_intern_string (content_type);
-  param->filename     = g_strdup (filename);
-
-  param->ref_count = 1;
-
   param->owner         = owner;
   param->owner_dnotify = owner_dnotify;
 
   return param;
 }
 
+/**
+ * rest_param_new_bytes:
+ * @name: the parameter name
+ * @bytes: the #GBytes holding the value
+ * @content_type: the content type of the data
+ * @filename: (allow-none): the original filename, or %NULL
+ *
+ * Create a new #RestParam called @name whose value is the contents of @bytes.
+ * The parameter holds a reference to @bytes instead of copying it, and the
+ * data is handed to the network layer without being copied either.
+ *
+ * Returns: a new #RestParam.
+ **/
+RestParam *
+rest_param_new_bytes (const char *name,
+                      GBytes     *bytes,
+                      const char *content_type,
+                      const char *filename)
+{
+  gconstpointer data;
+  gsize length;
+
+  g_return_val_if_fail (bytes, NULL);
+
+  data = g_bytes_get_data (bytes, &length);
+
+  return rest_param_new_with_owner (name, data, length, content_type, filename,
+                                    g_bytes_ref (bytes),
+                                    (GDestroyNotify)g_bytes_unref);
+}
+
+/**
+ * rest_param_new_from_file:
+ * @name: the parameter name
+ * @path: the file to send
+ * @content_type: the content type of the data
+ * @filename: (allow-none): the filename to send, or %NULL to use the base name
+ *   of @path
+ * @error: a #GError, or %NULL
+ *
+ * Create a new #RestParam called @name whose value is the contents of the file
+ * at @path.  The file is mapped into memory rather than read, and the mapping
+ * is handed to the network layer without being copied.  The file must not be
+ * changed while the parameter exists.
+ *
+ * Returns: a new #RestParam, or %NULL if the file could not be mapped.
+ **/
+RestParam *
+rest_param_new_from_file (const char  *name,
+                          const char  *path,
+                          const char  *content_type,
+                          const char  *filename,
+                          GError     **error)
+{
+  GMappedFile *map;
+  RestParam *param;
+  char *basename = NULL;
+
+  g_return_val_if_fail (path, NULL);
+
+  map = g_mapped_file_new (path, FALSE, error);
+  if (map == NULL)
+    return NULL;
+
+  if (filename == NULL)
+    filename = basename = g_path_get_basename (path);
+
+  param = rest_param_new_with_owner (name,
+                                     g_mapped_file_get_contents (map),
+                                     g_mapped_file_get_length (map),
+                                     content_type, filename,
+                                     map, (GDestroyNotify)g_mapped_file_unref);
+
+  g_free (basename);
+
+  return param;
+}
+
+/**
+ * rest_param_new_with_stream:
+ * @name: the parameter name
+ * @stream: the #GInputStream to read the value from
+ * @length: the number of bytes that will be read from @stream, or -1 if it is
+ *   not known
+ * @content_type: the content type of the data
+ * @filename: (allow-none): the original filename, or %NULL
+ *
+ * Create a new #RestParam called @name whose value is read from @stream while
+ * the request is being sent, so that large uploads never have to be held in
+ * memory.  The stream is read a block at a time from the main loop, so it
+ * should be one that will not block for long, such as a #GFileInputStream.  To
+ * upload from a file descriptor, wrap it in a #GUnixInputStream.
+ *
+ * If @length is known the request is sent with a Content-Length, otherwise
+ * chunked encoding is used.  Requests that have to be sent again, for example
+ * after authenticating, need @stream to be seekable.
+ *
+ * Parameters with a stream are always sent as part of a multipart request, and
+ * have no content in memory.
+ *
+ * Returns: a new #RestParam.
+ **/
+RestParam *
+rest_param_new_with_stream (const char   *name,
+                            GInputStream *stream,
+                            goffset       length,
+                            const char   *content_type,
+                            const char   *filename)
+{
+  RestParam *param;
+
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+
+  param = param_new (name, content_type, filename, 0, NULL);
+
+  param->use    = REST_MEMORY_STATIC;
+  param->data   = NULL;
+  param->length = 0;
+
+  param->stream        = g_object_ref (stream);
+  param->stream_length = length < 0 ? -1 : length;
+
+  return param;
+}
+
+/**
+ * rest_param_new_with_fd:
+ * @name: the parameter name
+ * @fd: a file descriptor open for reading
+ * @offset: the offset in @fd to start reading from
+ * @length: the number of bytes to send, or -1 to send everything up to the
+ *   end of the file
+ * @content_type: the content type of the data
+ * @filename: (allow-none): the original filename, or %NULL
+ *
+ * Create a new #RestParam called @name whose value is @length bytes of @fd
+ * starting at @offset.  @fd is duplicated, so the caller may close it once the
+ * parameter has been created.
+ *
+ * The value is read while the request is being sent, like
+ * rest_param_new_with_stream(), but straight from the file by offset: regular
+ * files are mapped into memory and handed to the network layer without being
+ * copied, and other seekable files are read with pread().  As the reads do not
+ * use the file position the request can be sent again, and one descriptor can
+ * be shared by several parameters.  Pipes and sockets are read in order, once.
+ * The file must not be truncated while the request is being sent.
+ *
+ * Parameters with a file descriptor are always sent as part of a multipart
+ * request, and have no content in memory.
+ *
+ * Returns: a new #RestParam, or %NULL if @fd could not be duplicated.
+ **/
+RestParam *
+rest_param_new_with_fd (const char *name,
+                        int         fd,
+                        goffset     offset,
+                        goffset     length,
+                        const char *content_type,
+                        const char *filename)
+{
+  RestParam *param;
+  struct stat st;
+  int new_fd;
+
+  g_return_val_if_fail (fd >= 0, NULL);
+  g_return_val_if_fail (offset >= 0, NULL);
+
+  do {
+    new_fd = dup (fd);
+  } while (new_fd < 0 && errno == EINTR);
+
+  if (new_fd < 0) {
+    g_warning ("Cannot duplicate file descriptor %d: %s",
+               fd, g_strerror (errno));
+    return NULL;
+  }
+
+  /* Work out the length of regular files up front, so that the request can
+   * be sent with a Content-Length */
+  if (length < 0 && fstat (new_fd, &st) == 0 && S_ISREG (st.st_mode))
+    length = MAX (st.st_size - offset, 0);
+
+  param = param_new (name, content_type, filename, 0, NULL);
+
+  param->use    = REST_MEMORY_STATIC;
+  param->data   = NULL;
+  param->length = 0;
+
+  param->fd        = new_fd;
+  param->fd_offset = offset;
+  param->fd_length = length < 0 ? -1 : length;
+
+  return param;
+}
+
 /**
  * rest_param_new_string:
  * @name: the parameter name
@@ -195,7 +502,7 @@ rest_param_new_string (const char    *name,
 
   return rest_param_new_full (name,
                               use, string, strlen (string) + 1,
-                              g_intern_static_string ("text/plain"),
+                              text_plain (),
                               NULL);
 }
 
@@ -253,7 +560,8 @@ rest_param_get_file_name (RestParam *param)
 gboolean
 rest_param_is_string (RestParam *param)
 {
-  return param->content_type == g_intern_static_string ("text/plain");
+  return param->stream == NULL && param->fd < 0 &&
+    param->content_type == text_plain ();
 }
 
 /**
@@ -285,6 +593,81 @@ rest_param_get_content_length (RestParam *param)
   return param->length;
 }
 
+/**
+ * rest_param_get_stream:
+ * @param: a valid #RestParam
+ *
+ * Get the stream the value of @param is read from, if it was created with
+ * rest_param_new_with_stream().
+ *
+ * Returns: (transfer none): the #GInputStream, or %NULL.
+ **/
+GInputStream *
+rest_param_get_stream (RestParam *param)
+{
+  return param->stream;
+}
+
+/**
+ * rest_param_get_stream_length:
+ * @param: a valid #RestParam
+ *
+ * Get the number of bytes that will be read from the stream of @param.
+ *
+ * Returns: the length, or -1 if it is not known or @param has no stream.
+ **/
+goffset
+rest_param_get_stream_length (RestParam *param)
+{
+  return param->stream ? param->stream_length : -1;
+}
+
+/**
+ * rest_param_get_fd:
+ * @param: a valid #RestParam
+ *
+ * Get the file descriptor the value of @param is read from, if it was created
+ * with rest_param_new_with_fd().  This is the parameter's own duplicate of the
+ * descriptor, and is closed when @param is freed.
+ *
+ * Returns: the file descriptor, or -1.
+ **/
+int
+rest_param_get_fd (RestParam *param)
+{
+  return param->fd;
+}
+
+/**
+ * rest_param_get_fd_offset:
+ * @param: a valid #RestParam
+ *
+ * Get the offset in the file descriptor of @param that the value starts at.
+ *
+ * Returns: the offset, or 0 if @param has no file descriptor.
+ **/
+goffset
+rest_param_get_fd_offset (RestParam *param)
+{
+  return param->fd >= 0 ? param->fd_offset : 0;
+}
+
+/**
+ * rest_param_get_fd_length:
+ * @param: a valid #RestParam
+ *
+ * Get the number of bytes that will be read from the file descriptor of
+ * @param.
+ *
+ * Returns: the length, or -1 if it is not known or @param has no file
+ * descriptor.
+ **/
+goffset
+rest_param_get_fd_length (RestParam *param)
+{
+  return param->fd >= 0 ? param->fd_length : -1;
+}
+
 /**
  * rest_param_ref:
  * @param: a valid #RestParam
@@ -320,9 +703,11 @@ rest_param_unref (RestParam *param)
   if (g_atomic_int_dec_and_test (&param->ref_count)) {
     if (param->owner_dnotify)
       param->owner_dnotify (param->owner);
-    g_free (param->name);
-    g_free (param->filename);
+    if (param->stream)
+      g_object_unref (param->stream);
+    if (param->fd >= 0)
+      close (param->fd);
 
-    g_slice_free (RestParam, param);
+    g_slice_free1 (param->size, param);
   }
 }
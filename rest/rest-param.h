@@ -27,6 +27,7 @@
 #define _REST_PARAM
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -70,6 +71,29 @@ RestParam *rest_param_new_with_owner (const char     *name,
                                       gpointer        owner,
                                       GDestroyNotify  owner_dnotify);
 
+RestParam *rest_param_new_bytes (const char *name,
+                                 GBytes     *bytes,
+                                 const char *content_type,
+                                 const char *filename);
+
+RestParam *rest_param_new_from_file (const char  *name,
+                                     const char  *path,
+                                     const char  *content_type,
+                                     const char  *filename,
+                                     GError     **error);
+
+RestParam *rest_param_new_with_stream (const char   *name,
+                                       GInputStream *stream,
+                                       goffset       length,
+                                       const char   *content_type,
+                                       const char   *filename);
+
+RestParam *rest_param_new_with_fd (const char *name,
+                                   int         fd,
+                                   goffset     offset,
+                                   goffset     length,
+                                   const char *content_type,
+                                   const char *filename);
 
 gboolean rest_param_is_string (RestParam *param);
 
@@ -78,6 +102,11 @@ const char *rest_param_get_content_type (RestParam *param);
 const char *rest_param_get_file_name (RestParam *param);
 gconstpointer rest_param_get_content (RestParam *param);
 gsize rest_param_get_content_length (RestParam *param);
+GInputStream *rest_param_get_stream (RestParam *param);
+goffset rest_param_get_stream_length (RestParam *param);
+int rest_param_get_fd (RestParam *param);
+goffset rest_param_get_fd_offset (RestParam *param);
+goffset rest_param_get_fd_length (RestParam *param);
 
 RestParam *rest_param_ref (RestParam *param);
 void rest_param_unref (RestParam *param);
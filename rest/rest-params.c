@@ -21,28 +21,47 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include <glib-object.h>
 #include "rest-params.h"
+#include "rest-private.h"
+#include "rest-text-codec.h"
 
 /**
  * SECTION:rest-params
  * @short_description: Container for call parameters
  * @see_also: #RestParam, #RestProxyCall.
+ *
+ * A #RestParams is an ordered list of parameters.  Parameters are kept in the
+ * order they were added, and more than one parameter can have the same name.
  */
 
 /*
- * RestParams is an alias for GHashTable achieved by opaque types in the public
- * headers and casting internally. This has several limitations, mainly
- * supporting multiple parameters with the same name and preserving the ordering
- * of parameters.
- *
- * These are not requirements for the bulk of the web services, but this
- * limitation does mean librest can't be used for a few web services.
- *
- * TODO: this should be a list to support multiple parameters with the same
- * name.
+ * Most calls have only a few parameters, so they are stored in an array that
+ * starts out inside the RestParams itself and is searched linearly.  Once
+ * there are more than PARAMS_INDEX_THRESHOLD parameters, an index from each
+ * name to the first parameter with that name is kept as well.
  */
 
+#define PARAMS_N_INLINE 8
+#define PARAMS_INDEX_THRESHOLD 16
+
+struct _RestParams {
+  RestParam **params;
+  guint len;
+  guint size;
+  /* Owned by the parameters */
+  GHashTable *index;
+  RestParam *inline_params[PARAMS_N_INLINE];
+};
+
+typedef struct {
+  RestParams *params;
+  guint position;
+} RealIter;
+
+G_STATIC_ASSERT (sizeof (RealIter) <= sizeof (RestParamsIter));
+
 /**
  * rest_params_new:
  *
@@ -53,11 +72,13 @@
 RestParams *
 rest_params_new (void)
 {
-  /* The key is a string that is owned by the RestParam, so we don't need to
-     explicitly free it on removal. */
-  return (RestParams *)
-    g_hash_table_new_full (g_str_hash, g_str_equal,
-                           NULL, (GDestroyNotify)rest_param_unref);
+  RestParams *params;
+
+  params = g_slice_new0 (RestParams);
+  params->params = params->inline_params;
+  params->size = PARAMS_N_INLINE;
+
+  return params;
 }
 
 /**
@@ -69,11 +90,29 @@ rest_params_new (void)
 void
 rest_params_free (RestParams *params)
 {
-  GHashTable *hash = (GHashTable *)params;
+  guint i;
 
   g_return_if_fail (params);
 
-  g_hash_table_destroy (hash);
+  if (params->index)
+    g_hash_table_destroy (params->index);
+
+  for (i = 0; i < params->len; i++)
+    rest_param_unref (params->params[i]);
+
+  if (params->params != params->inline_params)
+    g_free (params->params);
+
+  g_slice_free (RestParams, params);
+}
+
+static void
+index_param (RestParams *params, RestParam *param)
+{
+  const char *name = rest_param_get_name (param);
+
+  if (g_hash_table_lookup (params->index, name) == NULL)
+    g_hash_table_insert (params->index, (gpointer)name, param);
 }
 
 /**
@@ -81,17 +120,36 @@ rest_params_free (RestParams *params)
  * @params: a valid #RestParams
  * @param: a valid #RestParam
  *
- * Add @param to @params.
+ * Add @param to the end of @params.  Any parameters already in @params with
+ * the same name are kept.
  **/
 void
 rest_params_add (RestParams *params, RestParam *param)
 {
-  GHashTable *hash = (GHashTable *)params;
+  guint i;
 
   g_return_if_fail (params);
   g_return_if_fail (param);
 
-  g_hash_table_insert (hash, (gpointer)rest_param_get_name (param), param);
+  if (params->len == params->size) {
+    params->size *= 2;
+    if (params->params == params->inline_params) {
+      params->params = g_new (RestParam *, params->size);
+      memcpy (params->params, params->inline_params, sizeof (params->inline_params));
+    } else {
+      params->params = g_renew (RestParam *, params->params, params->size);
+    }
+  }
+
+  params->params[params->len++] = param;
+
+  if (params->index) {
+    index_param (params, param);
+  } else if (params->len > PARAMS_INDEX_THRESHOLD) {
+    params->index = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < params->len; i++)
+      index_param (params, params->params[i]);
+  }
 }
 
 /**
@@ -99,19 +157,27 @@ rest_params_add (RestParams *params, RestParam *param)
  * @params: a valid #RestParams
  * @name: a parameter name
  *
- * Return the #RestParam called @name, or %NULL if it doesn't exist.
+ * Return the first #RestParam called @name, or %NULL if it doesn't exist.
  *
  * Returns: a #RestParam or %NULL if the name doesn't exist
  **/
 RestParam *
 rest_params_get (RestParams *params, const char *name)
 {
-  GHashTable *hash = (GHashTable *)params;
+  guint i;
 
   g_return_val_if_fail (params, NULL);
   g_return_val_if_fail (name, NULL);
 
-  return g_hash_table_lookup (hash, name);
+  if (params->index)
+    return g_hash_table_lookup (params->index, name);
+
+  for (i = 0; i < params->len; i++) {
+    if (strcmp (rest_param_get_name (params->params[i]), name) == 0)
+      return params->params[i];
+  }
+
+  return NULL;
 }
 
 /**
@@ -119,17 +185,37 @@ rest_params_get (RestParams *params, const char *name)
  * @params: a valid #RestParams
  * @name: a parameter name
  *
- * Remove the #RestParam called @name.
+ * Remove every #RestParam called @name.
  **/
 void
 rest_params_remove (RestParams *params, const char *name)
 {
-  GHashTable *hash = (GHashTable *)params;
+  RestParam *owner = NULL;
+  guint i, j;
 
   g_return_if_fail (params);
   g_return_if_fail (name);
 
-  g_hash_table_remove (hash, name);
+  if (params->index)
+    g_hash_table_remove (params->index, name);
+
+  for (i = 0, j = 0; i < params->len; i++) {
+    RestParam *param = params->params[i];
+    const char *param_name = rest_param_get_name (param);
+
+    if (strcmp (param_name, name) != 0) {
+      params->params[j++] = param;
+    } else if (param_name == name) {
+      /* @name belongs to this parameter, so it has to outlive the loop */
+      owner = param;
+    } else {
+      rest_param_unref (param);
+    }
+  }
+  params->len = j;
+
+  if (owner)
+    rest_param_unref (owner);
 }
 
 /**
@@ -144,20 +230,16 @@ rest_params_remove (RestParams *params, const char *name)
 gboolean
 rest_params_are_strings (RestParams *params)
 {
-  GHashTable *hash = (GHashTable *)params;
-  GHashTableIter iter;
-  RestParam *param;
+  guint i;
 
   g_return_val_if_fail (params, FALSE);
 
-  g_hash_table_iter_init (&iter, hash);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer)&param)) {
-    if (!rest_param_is_string (param))
+  for (i = 0; i < params->len; i++) {
+    if (!rest_param_is_string (params->params[i]))
       return FALSE;
   }
 
   return TRUE;
-
 }
 
 /**
@@ -175,19 +257,21 @@ rest_params_are_strings (RestParams *params)
 GHashTable *
 rest_params_as_string_hash_table (RestParams *params)
 {
-  GHashTable *hash, *strings;
-  GHashTableIter iter;
-  const char *name = NULL;
-  RestParam *param = NULL;
+  GHashTable *strings;
+  RestParam *param;
+  const char *name;
+  guint i;
 
   g_return_val_if_fail (params, NULL);
 
-  hash = (GHashTable *)params;
   strings = g_hash_table_new (g_str_hash, g_str_equal);
 
-  g_hash_table_iter_init (&iter, hash);
-  while (g_hash_table_iter_next (&iter, (gpointer)&name, (gpointer)&param)) {
-    if (rest_param_is_string (param))
+  for (i = 0; i < params->len; i++) {
+    param = params->params[i];
+    name = rest_param_get_name (param);
+
+    /* As with rest_params_get(), the first parameter with a name wins */
+    if (rest_param_is_string (param) && !g_hash_table_lookup_extended (strings, name, NULL, NULL))
       g_hash_table_insert (strings, (gpointer)name, (gpointer)rest_param_get_content (param));
   }
 
@@ -199,8 +283,9 @@ rest_params_as_string_hash_table (RestParams *params)
  * @iter: an uninitialized #RestParamsIter
  * @params: a valid #RestParams
  *
- * Initialize a parameter iterator over @params. Modifying @params after calling
- * this function invalidates the returned iterator.
+ * Initialize a parameter iterator over @params, which returns the parameters
+ * in the order they were added. Modifying @params after calling this function
+ * invalidates the returned iterator.
  * |[
  * RestParamsIter iter;
  * const char *name;
@@ -215,10 +300,13 @@ rest_params_as_string_hash_table (RestParams *params)
 void
 rest_params_iter_init (RestParamsIter *iter, RestParams *params)
 {
+  RealIter *real = (RealIter *)iter;
+
   g_return_if_fail (iter);
   g_return_if_fail (params);
 
-  g_hash_table_iter_init ((GHashTableIter *)iter, (GHashTable *)params);
+  real->params = params;
+  real->position = 0;
 }
 
 /**
@@ -236,7 +324,589 @@ rest_params_iter_init (RestParamsIter *iter, RestParams *params)
 gboolean
 rest_params_iter_next (RestParamsIter *iter, const char **name, RestParam **param)
 {
+  RealIter *real = (RealIter *)iter;
+  RestParam *current;
+
   g_return_val_if_fail (iter, FALSE);
 
-  return g_hash_table_iter_next ((GHashTableIter *)iter, (gpointer)name, (gpointer)param);
+  if (real->position >= real->params->len)
+    return FALSE;
+
+  current = real->params->params[real->position++];
+
+  if (name)
+    *name = rest_param_get_name (current);
+  if (param)
+    *param = current;
+
+  return TRUE;
+}
+
+/*
+ * How each byte is written in an application/x-www-form-urlencoded form, as
+ * soup_form_encode() does it: FORM_ENCODE bytes become %XX, FORM_LITERAL bytes
+ * are copied, and spaces become '+'.
+ */
+enum {
+  FORM_ENCODE,
+  FORM_LITERAL,
+  FORM_SPACE
+};
+
+static const guchar form_class[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/* The length of @in once it has been encoded */
+static gsize
+form_encoded_length (const char *in)
+{
+  const guchar *s = (const guchar *)in;
+  gsize len = 0;
+
+  for (; *s; s++)
+    len += form_class[*s] == FORM_ENCODE ? 3 : 1;
+
+  return len;
+}
+
+/* Write @in encoded to @out, returning the end of what was written */
+static char *
+form_encode (char *out, const char *in)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  const guchar *s = (const guchar *)in;
+
+  for (; *s; s++) {
+    switch (form_class[*s]) {
+    case FORM_LITERAL:
+      *out++ = *s;
+      break;
+    case FORM_SPACE:
+      *out++ = '+';
+      break;
+    default:
+      *out++ = '%';
+      *out++ = hex[*s >> 4];
+      *out++ = hex[*s & 0xf];
+      break;
+    }
+  }
+
+  return out;
+}
+
+/*
+ * Append @in to @str encoded as application/x-www-form-urlencoded, in the same
+ * way as soup_form_encode().
+ */
+void
+_rest_form_append_encoded (GString *str, const char *in)
+{
+  gsize start = str->len;
+
+  g_string_set_size (str, start + form_encoded_length (in));
+  form_encode (str->str + start, in);
+}
+
+static gint
+compare_string_params (gconstpointer a, gconstpointer b)
+{
+  RestParam *param_a = *(RestParam **)a;
+  RestParam *param_b = *(RestParam **)b;
+  gint res;
+
+  res = strcmp (rest_param_get_name (param_a), rest_param_get_name (param_b));
+  if (res == 0)
+    res = strcmp (rest_param_get_content (param_a),
+                  rest_param_get_content (param_b));
+
+  return res;
+}
+
+/*
+ * Get the string parameters in @params sorted by name and then by value, for
+ * the services that sign the sorted parameters.  Unlike
+ * rest_params_as_string_hash_table(), every parameter with a repeated name is
+ * included.  The parameters are owned by @params; free the array with
+ * g_ptr_array_free().
+ */
+GPtrArray *
+_rest_params_sorted_strings (RestParams *params)
+{
+  GPtrArray *strings;
+  guint i;
+
+  strings = g_ptr_array_sized_new (params->len);
+
+  for (i = 0; i < params->len; i++) {
+    if (rest_param_is_string (params->params[i]))
+      g_ptr_array_add (strings, params->params[i]);
+  }
+
+  g_ptr_array_sort (strings, compare_string_params);
+
+  return strings;
+}
+
+/*
+ * Append the string parameters in @params to @str as an
+ * application/x-www-form-urlencoded form, in order and including repeated
+ * names.  The length of the form is worked out first, so that @str only grows
+ * once.
+ */
+void
+_rest_params_append_form (RestParams *params, GString *str)
+{
+  RestParam *param;
+  gsize start, len = 0;
+  gboolean first = TRUE;
+  char *out;
+  guint i;
+
+  for (i = 0; i < params->len; i++) {
+    param = params->params[i];
+    if (!rest_param_is_string (param))
+      continue;
+
+    /* The '=', and the '&' before all but the first */
+    len += first ? 1 : 2;
+    first = FALSE;
+
+    len += form_encoded_length (rest_param_get_name (param));
+    len += form_encoded_length (rest_param_get_content (param));
+  }
+
+  if (len == 0)
+    return;
+
+  start = str->len;
+  g_string_set_size (str, start + len);
+  out = str->str + start;
+
+  first = TRUE;
+  for (i = 0; i < params->len; i++) {
+    param = params->params[i];
+    if (!rest_param_is_string (param))
+      continue;
+
+    if (!first)
+      *out++ = '&';
+    first = FALSE;
+
+    out = form_encode (out, rest_param_get_name (param));
+    *out++ = '=';
+    out = form_encode (out, rest_param_get_content (param));
+  }
+
+  g_assert (out == str->str + start + len);
+}
+
+/*
+ * Parameters percent-encoded as RFC 3986 asks, for the OAuth signature base
+ * string.  Every name and value is encoded once, back to back in one buffer,
+ * and the pairs only hold offsets into it so that sorting moves a few words
+ * rather than strings.  Each thread keeps one RestEncodedParams and reuses it,
+ * so once the buffers have grown to fit signing does not allocate.
+ */
+
+typedef struct {
+  guint name;
+  guint name_len;
+  guint value;
+  guint value_len;
+} EncodedPair;
+
+struct _RestEncodedParams {
+  GString *buffer;
+  GArray *pairs;
+};
+
+static void
+encoded_params_free (RestEncodedParams *encoded)
+{
+  g_string_free (encoded->buffer, TRUE);
+  g_array_free (encoded->pairs, TRUE);
+  g_slice_free (RestEncodedParams, encoded);
+}
+
+static GPrivate encoded_params = G_PRIVATE_INIT ((GDestroyNotify)encoded_params_free);
+
+/*
+ * Get the calling thread's RestEncodedParams, emptied.  It must be finished
+ * with before anything else that could use it is called.
+ */
+RestEncodedParams *
+_rest_encoded_params_get (void)
+{
+  RestEncodedParams *encoded;
+
+  encoded = g_private_get (&encoded_params);
+
+  if (G_UNLIKELY (encoded == NULL)) {
+    encoded = g_slice_new (RestEncodedParams);
+    encoded->buffer = g_string_sized_new (256);
+    encoded->pairs = g_array_sized_new (FALSE, FALSE, sizeof (EncodedPair), 16);
+    g_private_set (&encoded_params, encoded);
+  }
+
+  g_string_truncate (encoded->buffer, 0);
+  g_array_set_size (encoded->pairs, 0);
+
+  return encoded;
+}
+
+/* Encode @in onto the end of @buffer, returning the length written */
+static guint
+encode_into (GString *buffer, const char *in)
+{
+  gsize start = buffer->len, len;
+
+  if (in == NULL)
+    return 0;
+
+  len = strlen (in);
+  g_string_set_size (buffer, start + REST_PERCENT_ENCODED_MAX (len));
+  len = _rest_percent_encode (buffer->str + start, in, len);
+  g_string_truncate (buffer, start + len);
+
+  return len;
+}
+
+/*
+ * Add @name and @value to @encoded.  A %NULL @value is treated as an empty
+ * string.
+ */
+void
+_rest_encoded_params_add (RestEncodedParams *encoded,
+                          const char        *name,
+                          const char        *value)
+{
+  EncodedPair pair;
+
+  g_return_if_fail (encoded);
+  g_return_if_fail (name);
+
+  pair.name = encoded->buffer->len;
+  pair.name_len = encode_into (encoded->buffer, name);
+  pair.value = encoded->buffer->len;
+  pair.value_len = encode_into (encoded->buffer, value);
+
+  g_array_append_val (encoded->pairs, pair);
+}
+
+/*
+ * Add the string parameters in @params to @encoded, including any that share
+ * a name.
+ */
+void
+_rest_encoded_params_add_params (RestEncodedParams *encoded,
+                                 RestParams        *params)
+{
+  RestParam *param;
+  guint i;
+
+  g_return_if_fail (encoded);
+  g_return_if_fail (params);
+
+  for (i = 0; i < params->len; i++) {
+    param = params->params[i];
+    if (rest_param_is_string (param))
+      _rest_encoded_params_add (encoded,
+                                rest_param_get_name (param),
+                                rest_param_get_content (param));
+  }
+}
+
+static int
+compare_encoded (const char *a, guint a_len, const char *b, guint b_len)
+{
+  int res;
+
+  res = memcmp (a, b, MIN (a_len, b_len));
+  if (res == 0)
+    res = a_len < b_len ? -1 : a_len > b_len;
+
+  return res;
+}
+
+static int
+compare_pairs (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const EncodedPair *pa = a, *pb = b;
+  const char *buffer = user_data;
+  int res;
+
+  res = compare_encoded (buffer + pa->name, pa->name_len,
+                         buffer + pb->name, pb->name_len);
+  if (res == 0)
+    res = compare_encoded (buffer + pa->value, pa->value_len,
+                           buffer + pb->value, pb->value_len);
+
+  return res;
+}
+
+/*
+ * Sort the parameters in @encoded by their encoded name, and those with the
+ * same name by their encoded value, as the OAuth signature base string needs.
+ */
+void
+_rest_encoded_params_sort (RestEncodedParams *encoded)
+{
+  g_return_if_fail (encoded);
+
+  g_array_sort_with_data (encoded->pairs, compare_pairs, encoded->buffer->str);
+}
+
+/*
+ * Append the parameters in @encoded to @str as name=value pairs separated by
+ * '&', in their current order.
+ */
+void
+_rest_encoded_params_append (RestEncodedParams *encoded, GString *str)
+{
+  const char *buffer;
+  gsize start, len = 0;
+  char *out;
+  guint i;
+
+  g_return_if_fail (encoded);
+  g_return_if_fail (str);
+
+  if (encoded->pairs->len == 0)
+    return;
+
+  for (i = 0; i < encoded->pairs->len; i++) {
+    EncodedPair *pair = &g_array_index (encoded->pairs, EncodedPair, i);
+    len += pair->name_len + 1 + pair->value_len;
+  }
+  len += encoded->pairs->len - 1;
+
+  start = str->len;
+  g_string_set_size (str, start + len);
+  out = str->str + start;
+  buffer = encoded->buffer->str;
+
+  for (i = 0; i < encoded->pairs->len; i++) {
+    EncodedPair *pair = &g_array_index (encoded->pairs, EncodedPair, i);
+
+    if (i)
+      *out++ = '&';
+    memcpy (out, buffer + pair->name, pair->name_len);
+    out += pair->name_len;
+    *out++ = '=';
+    memcpy (out, buffer + pair->value, pair->value_len);
+    out += pair->value_len;
+  }
+
+  g_assert (out == str->str + start + len);
+}
+
+/*
+ * Append what _rest_encoded_params_append() would, percent-encoded again, to
+ * @str.  This is the parameter part of the OAuth signature base string, made
+ * without building the singly-encoded string first.
+ */
+void
+_rest_encoded_params_append_encoded (RestEncodedParams *encoded, GString *str)
+{
+  const char *buffer;
+  gsize start, len = 0;
+  char *out;
+  guint i;
+
+  g_return_if_fail (encoded);
+  g_return_if_fail (str);
+
+  if (encoded->pairs->len == 0)
+    return;
+
+  /* Only the '%' in the encoded data grow, but allow for all of it */
+  for (i = 0; i < encoded->pairs->len; i++) {
+    EncodedPair *pair = &g_array_index (encoded->pairs, EncodedPair, i);
+    len += REST_PERCENT_ENCODED_MAX (pair->name_len + pair->value_len) + 3;
+  }
+  len += 3 * (encoded->pairs->len - 1);
+
+  start = str->len;
+  g_string_set_size (str, start + len);
+  out = str->str + start;
+  buffer = encoded->buffer->str;
+
+  for (i = 0; i < encoded->pairs->len; i++) {
+    EncodedPair *pair = &g_array_index (encoded->pairs, EncodedPair, i);
+
+    if (i) {
+      memcpy (out, "%26", 3);
+      out += 3;
+    }
+    out += _rest_percent_encode (out, buffer + pair->name, pair->name_len);
+    memcpy (out, "%3D", 3);
+    out += 3;
+    out += _rest_percent_encode (out, buffer + pair->value, pair->value_len);
+  }
+
+  g_string_truncate (str, out - str->str);
+}
+
+#if BUILD_TESTS
+void
+test_params_sorted_strings (void)
+{
+  RestParams *params;
+  GPtrArray *strings;
+  GString *signed_params;
+  guint i;
+
+  params = rest_params_new ();
+  rest_params_add (params, rest_param_new_string ("tag", REST_MEMORY_STATIC, "b"));
+  rest_params_add (params, rest_param_new_string ("api_key", REST_MEMORY_STATIC, "k"));
+  rest_params_add (params, rest_param_new_full ("photo", REST_MEMORY_STATIC, "\0", 1,
+                                                "image/jpeg", "photo.jpg"));
+  rest_params_add (params, rest_param_new_string ("tag", REST_MEMORY_STATIC, "a"));
+
+  /* Repeated names are all there, and only strings are */
+  strings = _rest_params_sorted_strings (params);
+  signed_params = g_string_new (NULL);
+  for (i = 0; i < strings->len; i++) {
+    RestParam *param = g_ptr_array_index (strings, i);
+
+    g_string_append (signed_params, rest_param_get_name (param));
+    g_string_append (signed_params, rest_param_get_content (param));
+  }
+  g_assert_cmpstr (signed_params->str, ==, "api_keyktagatagb");
+
+  g_string_free (signed_params, TRUE);
+  g_ptr_array_free (strings, TRUE);
+  rest_params_free (params);
+}
+
+void
+test_params_order (void)
+{
+  RestParams *params;
+  RestParamsIter iter;
+  RestParam *param;
+  const char *name;
+  GString *form;
+  char key[16];
+  int i;
+
+  params = rest_params_new ();
+  rest_params_add (params, rest_param_new_string ("z", REST_MEMORY_STATIC, "1"));
+  rest_params_add (params, rest_param_new_string ("a", REST_MEMORY_STATIC, "2"));
+  rest_params_add (params, rest_param_new_string ("z", REST_MEMORY_STATIC, "3"));
+
+  rest_params_iter_init (&iter, params);
+  g_assert (rest_params_iter_next (&iter, &name, &param));
+  g_assert_cmpstr (name, ==, "z");
+  g_assert_cmpstr (rest_param_get_content (param), ==, "1");
+  g_assert (rest_params_iter_next (&iter, &name, &param));
+  g_assert_cmpstr (name, ==, "a");
+  g_assert (rest_params_iter_next (&iter, &name, &param));
+  g_assert_cmpstr (rest_param_get_content (param), ==, "3");
+  g_assert (!rest_params_iter_next (&iter, &name, &param));
+
+  g_assert_cmpstr (rest_param_get_content (rest_params_get (params, "z")), ==, "1");
+
+  form = g_string_new (NULL);
+  _rest_params_append_form (params, form);
+  g_assert_cmpstr (form->str, ==, "z=1&a=2&z=3");
+
+  /* Removing takes out every parameter with the name */
+  param = rest_params_get (params, "z");
+  rest_params_remove (params, rest_param_get_name (param));
+  g_assert (rest_params_get (params, "z") == NULL);
+
+  g_string_truncate (form, 0);
+  _rest_params_append_form (params, form);
+  g_assert_cmpstr (form->str, ==, "a=2");
+
+  /* Everything but alphanumerics and "-_." is encoded, and spaces become + */
+  rest_params_add (params, rest_param_new_string ("q x", REST_MEMORY_STATIC, "a&b=c/d-e_f.g~\xc3\xa9"));
+  g_string_assign (form, "url?");
+  _rest_params_append_form (params, form);
+  g_assert_cmpstr (form->str, ==, "url?a=2&q+x=a%26b%3Dc%2Fd-e_f.g%7E%C3%A9");
+  rest_params_remove (params, "q x");
+
+  /* Enough parameters to be indexed */
+  for (i = 0; i < 3 * PARAMS_INDEX_THRESHOLD; i++) {
+    g_snprintf (key, sizeof (key), "key%d", i % PARAMS_INDEX_THRESHOLD);
+    rest_params_add (params, rest_param_new_string (key, REST_MEMORY_COPY, key));
+  }
+  g_assert (rest_params_get (params, "a") != NULL);
+  g_assert (rest_params_get (params, "key7") != NULL);
+
+  rest_params_remove (params, "key7");
+  g_assert (rest_params_get (params, "key7") == NULL);
+  g_assert (rest_params_get (params, "key8") != NULL);
+
+  rest_params_add (params, rest_param_new_string ("key7", REST_MEMORY_STATIC, "again"));
+  g_assert_cmpstr (rest_param_get_content (rest_params_get (params, "key7")), ==, "again");
+
+  g_string_free (form, TRUE);
+  rest_params_free (params);
+}
+
+void
+test_encoded_params (void)
+{
+  RestEncodedParams *encoded;
+  RestParams *params;
+  GString *str;
+
+  str = g_string_new (NULL);
+  params = rest_params_new ();
+  rest_params_add (params, rest_param_new_string ("b", REST_MEMORY_STATIC, "x y"));
+  rest_params_add (params, rest_param_new_string ("a~", REST_MEMORY_STATIC, "="));
+  rest_params_add (params, rest_param_new_string ("b", REST_MEMORY_STATIC, "x!y"));
+
+  encoded = _rest_encoded_params_get ();
+  g_assert (encoded == _rest_encoded_params_get ());
+
+  /* Nothing is written for no parameters */
+  _rest_encoded_params_append (encoded, str);
+  _rest_encoded_params_append_encoded (encoded, str);
+  g_assert_cmpuint (str->len, ==, 0);
+
+  _rest_encoded_params_add_params (encoded, params);
+  _rest_encoded_params_add (encoded, "a", NULL);
+
+  _rest_encoded_params_append (encoded, str);
+  g_assert_cmpstr (str->str, ==, "b=x%20y&a~=%3D&b=x%21y&a=");
+
+  /* Sorted by the encoded names, so "a" comes before "a~" */
+  _rest_encoded_params_sort (encoded);
+  g_string_truncate (str, 0);
+  _rest_encoded_params_append (encoded, str);
+  g_assert_cmpstr (str->str, ==, "a=&a~=%3D&b=x%20y&b=x%21y");
+
+  g_string_assign (str, "GET&");
+  _rest_encoded_params_append_encoded (encoded, str);
+  g_assert_cmpstr (str->str, ==, "GET&a%3D%26a~%3D%253D%26b%3Dx%2520y%26b%3Dx%2521y");
+
+  /* Getting it again empties it */
+  encoded = _rest_encoded_params_get ();
+  g_string_truncate (str, 0);
+  _rest_encoded_params_append (encoded, str);
+  g_assert_cmpuint (str->len, ==, 0);
+
+  rest_params_free (params);
+  g_string_free (str, TRUE);
 }
+#endif
@@ -0,0 +1,492 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <libsoup/soup.h>
+
+#include "rest-private.h"
+#include "rest-proxy-call-private.h"
+#include "rest-part-upload.h"
+
+/*
+ * Uploads a stream as a series of parts which are sent concurrently, as
+ * object stores such as S3 expect for large objects.
+ *
+ * Parts are read from the stream in order as there is room for them, so at
+ * most max_parallel parts are held in memory, and each is sent with a call
+ * made by the caller's new_part_call function.  A part that fails because of a
+ * network or server error is sent again with a fresh call after a short delay.
+ * Once every part is in, the identifiers the server gave them are passed to
+ * new_complete_call to make the call that puts the object together.
+ */
+
+/* How many times each part is retried */
+#define PART_MAX_RETRIES 3
+
+/* The first retry is after this many milliseconds, doubling each time */
+#define PART_RETRY_DELAY 500
+
+typedef struct _RestPartUpload RestPartUpload;
+
+typedef struct {
+  RestPartUpload *upload;
+  guint number;
+  SoupBuffer *buffer;
+  /* The call in flight, if any */
+  RestProxyCall *call;
+  gsize uploaded;
+  guint retries;
+  guint retry_source;
+} Part;
+
+struct _RestPartUpload {
+  RestProxy *proxy;
+  GInputStream *stream;
+  goffset total;
+  gsize part_size;
+  guint max_parallel;
+  RestProxyPartUploadFuncs funcs;
+  gpointer funcs_data;
+  RestProxyUploadProgressCallback progress;
+  gpointer progress_data;
+  GCancellable *cancellable;
+  gulong cancel_id;
+  GSimpleAsyncResult *result;
+
+  GPtrArray *parts;
+  GPtrArray *part_ids;
+  /* Parts being sent or waiting to be retried */
+  guint running;
+  /* Calls in flight and retries waiting, which keep the upload alive */
+  guint pending;
+  gboolean eof;
+  goffset read;
+  goffset uploaded;
+  RestProxyCall *complete_call;
+  gboolean completing;
+  GError *error;
+};
+
+static void part_start (Part *part);
+
+static void
+part_free (Part *part)
+{
+  if (part->buffer)
+    soup_buffer_free (part->buffer);
+  g_slice_free (Part, part);
+}
+
+static void
+upload_free (RestPartUpload *upload)
+{
+  if (upload->cancellable) {
+    g_signal_handler_disconnect (upload->cancellable, upload->cancel_id);
+    g_object_unref (upload->cancellable);
+  }
+
+  g_ptr_array_free (upload->parts, TRUE);
+  g_ptr_array_free (upload->part_ids, TRUE);
+  if (upload->complete_call)
+    g_object_unref (upload->complete_call);
+  g_clear_error (&upload->error);
+  g_object_unref (upload->result);
+  g_object_unref (upload->stream);
+  g_object_unref (upload->proxy);
+
+  g_slice_free (RestPartUpload, upload);
+}
+
+static void
+upload_finish (RestPartUpload *upload)
+{
+  if (upload->error) {
+    g_simple_async_result_set_from_error (upload->result, upload->error);
+  } else {
+    g_simple_async_result_set_op_res_gpointer (upload->result,
+                                               g_object_ref (upload->complete_call),
+                                               g_object_unref);
+  }
+
+  /* This can happen before _rest_part_upload_start() returns, if the upload
+   * was already cancelled or could not start, so always complete in idle */
+  g_simple_async_result_complete_in_idle (upload->result);
+
+  upload_free (upload);
+}
+
+/* Drop a reference held by a call in flight or a retry waiting, finishing
+ * the upload with the last one */
+static void
+upload_release (RestPartUpload *upload)
+{
+  if (--upload->pending == 0)
+    upload_finish (upload);
+}
+
+/* Record the first error, and stop everything still in progress */
+static void
+upload_fail (RestPartUpload *upload,
+             GError         *error)
+{
+  Part *part;
+  guint i;
+
+  if (upload->error) {
+    g_error_free (error);
+    return;
+  }
+
+  upload->error = error;
+
+  /* Cancelling can complete the calls right away, so hold the upload open
+   * until the loop is done */
+  upload->pending++;
+
+  for (i = 0; i < upload->parts->len; i++) {
+    part = g_ptr_array_index (upload->parts, i);
+
+    if (part->retry_source) {
+      g_source_remove (part->retry_source);
+      part->retry_source = 0;
+      upload_release (upload);
+    } else if (part->call) {
+      rest_proxy_call_cancel (part->call);
+    }
+  }
+
+  if (upload->completing)
+    rest_proxy_call_cancel (upload->complete_call);
+
+  upload_release (upload);
+}
+
+static void
+cancelled_cb (GCancellable   *cancellable,
+              RestPartUpload *upload)
+{
+  upload_fail (upload,
+               g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                    "Operation was cancelled"));
+}
+
+static void
+report_progress (RestPartUpload *upload)
+{
+  if (upload->progress)
+    upload->progress (upload->proxy, upload->uploaded, upload->total,
+                      upload->progress_data);
+}
+
+/* Read the next part from the stream, or return NULL at the end */
+static Part *
+read_part (RestPartUpload  *upload,
+           GError         **error)
+{
+  Part *part;
+  gchar *data;
+  gsize length, read;
+
+  length = upload->part_size;
+  if (upload->total >= 0)
+    length = MIN ((goffset)length, upload->total - upload->read);
+
+  data = g_malloc (length);
+  if (!g_input_stream_read_all (upload->stream, data, length, &read,
+                                NULL, error)) {
+    g_free (data);
+    return NULL;
+  }
+
+  upload->read += read;
+
+  if (upload->total >= 0) {
+    if (read < length) {
+      g_free (data);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "Stream ended before the upload was complete");
+      return NULL;
+    }
+    upload->eof = upload->read == upload->total;
+  } else {
+    upload->eof = read < length;
+  }
+
+  /* There is always at least one part, even if it is empty */
+  if (read == 0 && upload->parts->len > 0) {
+    g_free (data);
+    return NULL;
+  }
+
+  part = g_slice_new0 (Part);
+  part->upload = upload;
+  part->number = upload->parts->len + 1;
+  part->buffer = soup_buffer_new (SOUP_MEMORY_TAKE, data, read);
+  g_ptr_array_add (upload->parts, part);
+  g_ptr_array_add (upload->part_ids, NULL);
+
+  return part;
+}
+
+static void
+complete_cb (RestProxyCall *call,
+             const GError  *error,
+             GObject       *weak_object,
+             gpointer       user_data)
+{
+  RestPartUpload *upload = user_data;
+
+  upload->completing = FALSE;
+
+  if (error)
+    upload_fail (upload, g_error_copy (error));
+
+  upload_release (upload);
+}
+
+/* Every part is in, so put them together */
+static void
+upload_complete (RestPartUpload *upload)
+{
+  GError *error = NULL;
+
+  /* Terminate the list of identifiers */
+  g_ptr_array_add (upload->part_ids, NULL);
+
+  upload->complete_call =
+    upload->funcs.new_complete_call (upload->proxy,
+                                     (const gchar * const *)upload->part_ids->pdata,
+                                     upload->parts->len,
+                                     upload->funcs_data);
+
+  upload->pending++;
+  upload->completing = TRUE;
+
+  if (!rest_proxy_call_async (upload->complete_call, complete_cb, NULL,
+                              upload, &error)) {
+    upload->completing = FALSE;
+    if (error == NULL)
+      error = g_error_new_literal (REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                                   "Could not make the completion call");
+    upload_fail (upload, error);
+    upload_release (upload);
+  }
+}
+
+/* Start as many parts as there is room for */
+static void
+upload_fill (RestPartUpload *upload)
+{
+  GError *error = NULL;
+  Part *part;
+
+  while (upload->running < upload->max_parallel &&
+         !upload->eof && upload->error == NULL) {
+    part = read_part (upload, &error);
+    if (error) {
+      upload_fail (upload, error);
+      return;
+    }
+
+    if (part) {
+      upload->running++;
+      part_start (part);
+    }
+  }
+
+  if (upload->running == 0 && upload->eof && upload->error == NULL)
+    upload_complete (upload);
+}
+
+static gboolean
+part_retry_cb (gpointer user_data)
+{
+  Part *part = user_data;
+  RestPartUpload *upload = part->upload;
+
+  part->retry_source = 0;
+  part_start (part);
+
+  /* part_start() took its own reference */
+  upload_release (upload);
+
+  return FALSE;
+}
+
+/* Whether the part failed in a way that might go away */
+static gboolean
+is_transient_failure (RestProxyCall *call)
+{
+  guint status = rest_proxy_call_get_status_code (call);
+
+  if (status == SOUP_STATUS_CANCELLED)
+    return FALSE;
+
+  return SOUP_STATUS_IS_TRANSPORT_ERROR (status) ||
+    SOUP_STATUS_IS_SERVER_ERROR (status);
+}
+
+static void
+part_upload_cb (RestProxyCall *call,
+                gsize          total,
+                gsize          uploaded,
+                const GError  *error,
+                GObject       *weak_object,
+                gpointer       user_data)
+{
+  Part *part = user_data;
+  RestPartUpload *upload = part->upload;
+  gchar *id;
+
+  /* Progress */
+  if (error == NULL && uploaded < total) {
+    upload->uploaded += (goffset)uploaded - (goffset)part->uploaded;
+    part->uploaded = uploaded;
+    report_progress (upload);
+    return;
+  }
+
+  part->call = NULL;
+
+  if (upload->error)
+    goto done;
+
+  if (error) {
+    upload->uploaded -= part->uploaded;
+    part->uploaded = 0;
+
+    if (part->retries < PART_MAX_RETRIES && is_transient_failure (call)) {
+      /* The wait keeps the reference this call had */
+      part->retry_source = g_timeout_add (PART_RETRY_DELAY << part->retries,
+                                          part_retry_cb, part);
+      part->retries++;
+      g_object_unref (call);
+      return;
+    }
+
+    upload_fail (upload, g_error_copy (error));
+    goto done;
+  }
+
+  if (upload->funcs.get_part_id)
+    id = upload->funcs.get_part_id (upload->proxy, call, part->number,
+                                    upload->funcs_data);
+  else
+    id = g_strdup (rest_proxy_call_lookup_response_header (call, "ETag"));
+
+  if (id == NULL) {
+    upload_fail (upload,
+                 g_error_new (REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                              "No identifier was returned for part %u",
+                              part->number));
+    goto done;
+  }
+
+  g_ptr_array_index (upload->part_ids, part->number - 1) = id;
+
+  upload->uploaded += (goffset)part->buffer->length - (goffset)part->uploaded;
+  part->uploaded = part->buffer->length;
+  report_progress (upload);
+
+  /* The data isn't needed any more */
+  soup_buffer_free (part->buffer);
+  part->buffer = NULL;
+
+  upload->running--;
+  upload_fill (upload);
+
+ done:
+  g_object_unref (call);
+  upload_release (upload);
+}
+
+static void
+part_start (Part *part)
+{
+  RestPartUpload *upload = part->upload;
+  GError *error = NULL;
+
+  part->call = upload->funcs.new_part_call (upload->proxy, part->number,
+                                            upload->funcs_data);
+  _rest_proxy_call_set_request_buffer (part->call, part->buffer);
+
+  upload->pending++;
+
+  if (!rest_proxy_call_upload (part->call, part_upload_cb, NULL, part, &error)) {
+    g_object_unref (part->call);
+    part->call = NULL;
+    if (error == NULL)
+      error = g_error_new (REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                           "Could not make the call for part %u",
+                           part->number);
+    upload_fail (upload, error);
+    upload_release (upload);
+  }
+}
+
+/*
+ * Upload @length bytes of @stream, or all of it if @length is -1, in parts of
+ * @part_size bytes with up to @max_parallel in flight at once.  @result is
+ * completed with the completion call when done.
+ */
+void
+_rest_part_upload_start (RestProxy                       *proxy,
+                         GInputStream                    *stream,
+                         goffset                          length,
+                         gsize                            part_size,
+                         guint                            max_parallel,
+                         const RestProxyPartUploadFuncs  *funcs,
+                         gpointer                         funcs_data,
+                         RestProxyUploadProgressCallback  progress,
+                         gpointer                         progress_data,
+                         GCancellable                    *cancellable,
+                         GSimpleAsyncResult              *result)
+{
+  RestPartUpload *upload;
+
+  upload = g_slice_new0 (RestPartUpload);
+  upload->proxy = g_object_ref (proxy);
+  upload->stream = g_object_ref (stream);
+  upload->total = length;
+  upload->part_size = part_size;
+  upload->max_parallel = max_parallel;
+  upload->funcs = *funcs;
+  upload->funcs_data = funcs_data;
+  upload->progress = progress;
+  upload->progress_data = progress_data;
+  upload->result = g_object_ref (result);
+  upload->parts = g_ptr_array_new_with_free_func ((GDestroyNotify)part_free);
+  upload->part_ids = g_ptr_array_new_with_free_func (g_free);
+
+  /* Held until the first parts are started */
+  upload->pending = 1;
+
+  if (cancellable) {
+    upload->cancellable = g_object_ref (cancellable);
+    upload->cancel_id = g_signal_connect (cancellable, "cancelled",
+                                          G_CALLBACK (cancelled_cb), upload);
+  }
+
+  if (cancellable && g_cancellable_is_cancelled (cancellable))
+    cancelled_cb (cancellable, upload);
+  else
+    upload_fill (upload);
+
+  upload_release (upload);
+}
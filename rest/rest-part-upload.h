@@ -0,0 +1,42 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_PART_UPLOAD
+#define _REST_PART_UPLOAD
+
+#include <gio/gio.h>
+#include <rest/rest-proxy.h>
+
+G_BEGIN_DECLS
+
+void _rest_part_upload_start (RestProxy                       *proxy,
+                              GInputStream                    *stream,
+                              goffset                          length,
+                              gsize                            part_size,
+                              guint                            max_parallel,
+                              const RestProxyPartUploadFuncs  *funcs,
+                              gpointer                         funcs_data,
+                              RestProxyUploadProgressCallback  progress,
+                              gpointer                         progress_data,
+                              GCancellable                    *cancellable,
+                              GSimpleAsyncResult              *result);
+
+G_END_DECLS
+
+#endif /* _REST_PART_UPLOAD */
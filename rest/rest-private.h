@@ -29,6 +29,7 @@
 #include <rest/rest-xml-node.h>
 #include <libsoup/soup.h>
 #include "glib-compat.h"
+#include "rest-buffer-pool.h"
 
 G_BEGIN_DECLS
 
@@ -50,16 +51,82 @@ extern guint rest_debug_flags;
 
 void _rest_setup_debugging (void);
 
+const char *_rest_intern (const char *string);
+
 gboolean _rest_proxy_get_binding_required (RestProxy *proxy);
 const gchar *_rest_proxy_get_bound_url (RestProxy *proxy);
+gchar *_rest_proxy_build_url (RestProxy   *proxy,
+                              const gchar *function);
 void _rest_proxy_queue_message (RestProxy   *proxy,
                                 SoupMessage *message,
                                 SoupSessionCallback callback,
                                 gpointer user_data);
 void _rest_proxy_cancel_message (RestProxy   *proxy,
                                  SoupMessage *message);
+void _rest_proxy_abort_message (RestProxy   *proxy,
+                                SoupMessage *message,
+                                guint        status);
 guint _rest_proxy_send_message (RestProxy   *proxy,
                                 SoupMessage *message);
+gboolean _rest_proxy_get_decode_content (RestProxy *proxy);
+gint64 _rest_proxy_get_expect_continue_threshold (RestProxy *proxy);
+gint64 _rest_proxy_get_response_spill_threshold (RestProxy *proxy);
+gint64 _rest_proxy_get_max_response_size (RestProxy *proxy);
+RestBufferPool *_rest_proxy_get_buffer_pool (RestProxy *proxy);
+void _rest_proxy_account_response (RestProxy *proxy,
+                                   goffset    wire_bytes,
+                                   goffset    bytes);
+void _rest_proxy_account_discarded (RestProxy *proxy,
+                                    goffset    wire_bytes);
+
+/*
+ * A request about to be made, as seen by a proxy that signs or otherwise
+ * changes it.  Calls and #RestRequest objects are both prepared through one.
+ */
+typedef struct {
+  const gchar *method;
+  const gchar *function;
+  /* Owned by whoever made the view, but a proxy may free and replace it */
+  gchar *url;
+  RestParams *params;
+  /* Owns its names and values */
+  GHashTable *headers;
+} RestRequestView;
+
+typedef gboolean (*RestProxyPrepareFunc) (RestProxy        *proxy,
+                                          RestRequestView  *view,
+                                          GError          **error);
+
+void _rest_proxy_set_prepare_func (RestProxy            *proxy,
+                                   RestProxyPrepareFunc  func);
+gboolean _rest_proxy_can_prepare (RestProxy *proxy);
+RestProxyPrepareFunc _rest_proxy_get_prepare_func (RestProxy *proxy);
+void _rest_request_view_set_param (RestRequestView *view,
+                                   const gchar     *name,
+                                   const gchar     *value);
+void _rest_request_view_set_header (RestRequestView *view,
+                                    const gchar     *name,
+                                    const gchar     *value);
+
+void _rest_form_append_encoded (GString    *str,
+                                const char *in);
+void _rest_params_append_form (RestParams *params,
+                               GString    *str);
+GPtrArray *_rest_params_sorted_strings (RestParams *params);
+
+typedef struct _RestEncodedParams RestEncodedParams;
+
+RestEncodedParams *_rest_encoded_params_get (void);
+void _rest_encoded_params_add (RestEncodedParams *encoded,
+                               const char        *name,
+                               const char        *value);
+void _rest_encoded_params_add_params (RestEncodedParams *encoded,
+                                      RestParams        *params);
+void _rest_encoded_params_sort (RestEncodedParams *encoded);
+void _rest_encoded_params_append (RestEncodedParams *encoded,
+                                  GString           *str);
+void _rest_encoded_params_append_encoded (RestEncodedParams *encoded,
+                                          GString           *str);
 
 RestXmlNode *_rest_xml_node_new (void);
 void         _rest_xml_node_reverse_children_siblings (RestXmlNode *node);
@@ -23,17 +23,49 @@
 #ifndef _REST_PROXY_CALL_PRIVATE
 #define _REST_PROXY_CALL_PRIVATE
 
+#include <libsoup/soup.h>
 #include <rest/rest-proxy.h>
 #include <rest/rest-proxy-call.h>
 #include <rest/rest-params.h>
+#include "rest-content-codec.h"
+#include "rest-private.h"
+#include "rest-spill-buffer.h"
 
 G_BEGIN_DECLS
 
 typedef struct _RestProxyCallAsyncClosure RestProxyCallAsyncClosure;
 typedef struct _RestProxyCallContinuousClosure RestProxyCallContinuousClosure;
 typedef struct _RestProxyCallUploadClosure RestProxyCallUploadClosure;
+typedef struct _RestProxyCallResumableClosure RestProxyCallResumableClosure;
+typedef struct _RestProxyCallDownloadClosure RestProxyCallDownloadClosure;
+
+/*
+ * Receives the (decoded) response body of a call as it arrives, instead of it
+ * being accumulated into the payload.
+ */
+typedef void (*RestProxyCallBodyFunc) (RestProxyCall *call,
+                                       const gchar   *data,
+                                       gsize          len,
+                                       gpointer       user_data);
+
+gboolean _rest_proxy_call_error_from_message (SoupMessage  *message,
+                                              GError      **error);
+
+void _rest_proxy_call_set_request_buffer (RestProxyCall *call,
+                                          SoupBuffer    *buffer);
+
+void _rest_proxy_call_init_view (RestProxyCall   *call,
+                                 RestRequestView *view);
+void _rest_proxy_call_finish_view (RestProxyCall   *call,
+                                   RestRequestView *view);
 
 struct _RestProxyCallPrivate {
+  /*
+   * Backs the status message, which is interned as there are only a few of
+   * them, and freed when the call is finalized
+   */
+  GStringChunk *strings;
+
   gchar *method;
   gchar *function;
   GHashTable *headers;
@@ -44,12 +76,39 @@ struct _RestProxyCallPrivate {
   GHashTable *response_headers;
   goffset length;
   gchar *payload;
+  /* The size of the mapping payload is in, or 0 if it was allocated */
+  gsize payload_mapped;
+  /* Made on demand, and then owns payload */
+  GBytes *payload_bytes;
   guint status_code;
-  gchar *status_message;
+  const gchar *status_message;
+
+  /* Response body processing */
+  RestContentDecoder *decoder;
+  RestSpillBuffer *body;
+  GError *body_error;
+  RestProxyCallBodyFunc body_func;
+  gpointer body_data;
+  goffset wire_length;
+  /* The part of wire_length from the current response, if it was requeued */
+  goffset response_wire_length;
+  goffset body_length;
+  /* -1 to use the proxy's limit */
+  gint64 max_response_size;
+
+  /* A request body set directly instead of made from the parameters */
+  SoupBuffer *request_buffer;
+
+  /* Request body compression */
+  RestContentCoding request_coding;
+  gsize request_coding_threshold;
 
   GCancellable *cancellable;
   gulong cancel_sig;
 
+  /* A resumable upload waiting to try again */
+  guint retry_source;
+
   RestProxy *proxy;
 
   RestProxyCallAsyncClosure *cur_call_closure;
@@ -20,6 +20,9 @@
  *
  */
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 #include <rest/rest-proxy.h>
 #include <rest/rest-proxy-call.h>
 #include <rest/rest-params.h>
@@ -27,6 +30,8 @@
 
 #include "rest-private.h"
 #include "rest-proxy-call-private.h"
+#include "rest-range-download.h"
+#include "rest-request-body.h"
 
 G_DEFINE_TYPE (RestProxyCall, rest_proxy_call, G_TYPE_OBJECT)
 
@@ -59,12 +64,74 @@ struct _RestProxyCallUploadClosure {
   gsize uploaded;
 };
 
+struct _RestProxyCallResumableClosure {
+  RestProxyCall *call;
+  RestProxyCallUploadCallback callback;
+  GObject *weak_object;
+  gpointer userdata;
+  SoupMessage *message;
+
+  GInputStream *stream;
+  /* Where the data starts in the stream */
+  goffset start;
+  goffset total;
+  gchar *content_type;
+  gchar *upload_url;
+  gsize chunk_size;
+  /* How much the server has, and how much of the current chunk is sent */
+  goffset offset;
+  gsize written;
+  guint retries;
+};
+
+struct _RestProxyCallDownloadClosure {
+  RestProxyCall *call;
+  GAsyncReadyCallback callback;
+  GObject *weak_object;
+  gpointer userdata;
+  SoupMessage *message;
+
+  GSimpleAsyncResult *result;
+  GOutputStream *stream;
+  int fd;
+  RestDownloadSyncPolicy sync;
+  RestProxyCallDownloadCallback progress;
+  gpointer progress_data;
+
+  /* Whether the current response is the one being downloaded */
+  gboolean active;
+  gchar *buffer;
+  gsize buffered;
+  goffset received;
+  goffset total;
+  goffset unsynced;
+};
+
+/* Downloads are written out in blocks of this size */
+#define DOWNLOAD_BUFFER_SIZE 65536
+
+/* How much is written between syncs with REST_DOWNLOAD_SYNC_PERIODIC */
+#define DOWNLOAD_SYNC_INTERVAL (4 * 1024 * 1024)
+
 enum
 {
   PROP_0 = 0,
-  PROP_PROXY
+  PROP_PROXY,
+  PROP_MAX_RESPONSE_SIZE
 };
 
+/*
+ * Copy @string, which may be %NULL, into the strings owned by the call,
+ * sharing copies of equal strings.  Nothing is freed until the call is, so
+ * this is only for strings drawn from a small set.
+ */
+static const gchar *
+_call_intern (RestProxyCallPrivate *priv,
+              const gchar          *string)
+{
+  return string ? g_string_chunk_insert_const (priv->strings, string) : NULL;
+}
+
 GQuark
 rest_proxy_call_error_quark (void)
 {
@@ -83,6 +150,9 @@ rest_proxy_call_get_property (GObject    *object,
     case PROP_PROXY:
       g_value_set_object (value, priv->proxy);
       break;
+    case PROP_MAX_RESPONSE_SIZE:
+      g_value_set_int64 (value, priv->max_response_size);
+      break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -100,6 +170,9 @@ rest_proxy_call_set_property (GObject      *object,
     case PROP_PROXY:
       priv->proxy = g_value_dup_object (value);
       break;
+    case PROP_MAX_RESPONSE_SIZE:
+      priv->max_response_size = g_value_get_int64 (value);
+      break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -143,18 +216,54 @@ rest_proxy_call_dispose (GObject *object)
   G_OBJECT_CLASS (rest_proxy_call_parent_class)->dispose (object);
 }
 
+typedef struct {
+  gchar *contents;
+  gsize mapped;
+} PayloadMapping;
+
+static void
+_call_unmap_payload (gpointer data)
+{
+  PayloadMapping *mapping = data;
+
+  _rest_spill_buffer_unmap (mapping->contents, mapping->mapped);
+  g_slice_free (PayloadMapping, mapping);
+}
+
+static void
+_call_free_payload (RestProxyCallPrivate *priv)
+{
+  if (priv->payload_bytes)
+    g_bytes_unref (priv->payload_bytes);
+  else if (priv->payload_mapped)
+    _rest_spill_buffer_unmap (priv->payload, priv->payload_mapped);
+  else
+    _rest_buffer_pool_free (priv->payload);
+
+  priv->payload = NULL;
+  priv->payload_mapped = 0;
+  priv->payload_bytes = NULL;
+}
+
 static void
 rest_proxy_call_finalize (GObject *object)
 {
   RestProxyCallPrivate *priv = GET_PRIVATE (object);
 
-  g_free (priv->method);
-  g_free (priv->function);
+  _call_free_payload (priv);
+
+  _rest_content_decoder_free (priv->decoder);
+  _rest_spill_buffer_free (priv->body);
+  g_clear_error (&priv->body_error);
 
-  g_free (priv->payload);
-  g_free (priv->status_message);
+  if (priv->request_buffer)
+    soup_buffer_free (priv->request_buffer);
 
   g_free (priv->url);
+  g_free (priv->method);
+  g_free (priv->function);
+
+  g_string_chunk_free (priv->strings);
 
   G_OBJECT_CLASS (rest_proxy_call_parent_class)->finalize (object);
 }
@@ -178,6 +287,20 @@ rest_proxy_call_class_init (RestProxyCallClass *klass)
                                REST_TYPE_PROXY,
                                G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
   g_object_class_install_property (object_class, PROP_PROXY, pspec);
+
+  /**
+   * RestProxyCall:max-response-size:
+   *
+   * The largest response body, in bytes, that this call will accept, or -1
+   * to use #RestProxy:max-response-size.  Set it to %G_MAXINT64 to lift the
+   * proxy's limit for this call.
+   */
+  pspec = g_param_spec_int64 ("max-response-size",
+                              "max-response-size",
+                              "The largest response body to accept",
+                              -1, G_MAXINT64, -1,
+                              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_MAX_RESPONSE_SIZE, pspec);
 }
 
 static void
@@ -187,18 +310,20 @@ rest_proxy_call_init (RestProxyCall *self)
 
   self->priv = priv;
 
+  priv->strings = g_string_chunk_new (256);
+
   priv->method = g_strdup ("GET");
 
+  priv->max_response_size = -1;
+
   priv->params = rest_params_new ();
 
-  priv->headers = g_hash_table_new_full (g_str_hash,
-                                         g_str_equal,
-                                         g_free,
-                                         g_free);
-  priv->response_headers = g_hash_table_new_full (g_str_hash,
-                                                  g_str_equal,
-                                                  g_free,
-                                                  g_free);
+  priv->headers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, g_free);
+  /* This table is handed out by rest_proxy_call_get_response_headers() and
+   * can outlive the call, so it owns its strings */
+  priv->response_headers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, g_free);
 }
 
 /**
@@ -263,7 +388,6 @@ rest_proxy_call_set_function (RestProxyCall *call,
   priv = GET_PRIVATE (call);
 
   g_free (priv->function);
-
   priv->function = g_strdup (function);
 }
 
@@ -289,7 +413,6 @@ rest_proxy_call_add_header (RestProxyCall *call,
   g_hash_table_insert (priv->headers,
                        g_strdup (header),
                        g_strdup (value));
-
 }
 
 /**
@@ -386,7 +509,8 @@ rest_proxy_call_remove_header (RestProxyCall *call,
  *
  * Add a query parameter called @param with the string value @value to the call.
  * If a parameter with this name already exists, the new value will replace the
- * old.
+ * old.  To send more than one parameter with the same name, add them to the
+ * #RestParams returned by rest_proxy_call_get_params() with rest_params_add().
  */
 void
 rest_proxy_call_add_param (RestProxyCall *call,
@@ -400,6 +524,7 @@ rest_proxy_call_add_param (RestProxyCall *call,
   priv = GET_PRIVATE (call);
 
   param = rest_param_new_string (name, REST_MEMORY_COPY, value);
+  rest_params_remove (priv->params, name);
   rest_params_add (priv->params, param);
 }
 
@@ -413,6 +538,7 @@ rest_proxy_call_add_param_full (RestProxyCall *call, RestParam *param)
 
   priv = GET_PRIVATE (call);
 
+  rest_params_remove (priv->params, rest_param_get_name (param));
   rest_params_add (priv->params, param);
 }
 
@@ -526,6 +652,37 @@ rest_proxy_call_get_params (RestProxyCall *call)
   return priv->params;
 }
 
+/**
+ * rest_proxy_call_set_request_compression:
+ * @call: The #RestProxyCall
+ * @coding: the #RestContentCoding to compress the request body with
+ * @threshold: the smallest request body, in bytes, that will be compressed
+ *
+ * Compress the body of the request with @coding if it is at least @threshold
+ * bytes long, trading CPU time for bandwidth on large form posts and uploads.
+ * The body is compressed a block at a time while it is being sent, and the
+ * Content-Encoding header is set accordingly.  The server must be able to
+ * decode a compressed request body for this to be useful.
+ *
+ * Pass %REST_CONTENT_CODING_IDENTITY to disable compression, which is the
+ * default.  Bodies which already have a Content-Encoding header are never
+ * compressed.
+ */
+void
+rest_proxy_call_set_request_compression (RestProxyCall     *call,
+                                         RestContentCoding  coding,
+                                         gsize              threshold)
+{
+  RestProxyCallPrivate *priv;
+
+  g_return_if_fail (REST_IS_PROXY_CALL (call));
+
+  priv = GET_PRIVATE (call);
+
+  priv->request_coding = coding;
+  priv->request_coding_threshold = threshold;
+}
+
 
 
 static void _call_async_weak_notify_cb (gpointer *data,
@@ -540,9 +697,11 @@ _populate_headers_hash_table (const gchar *name,
                               const gchar *value,
                               gpointer     userdata)
 {
-  GHashTable *headers = (GHashTable *)userdata;
+  RestProxyCallPrivate *priv = userdata;
 
-  g_hash_table_insert (headers, g_strdup (name), g_strdup (value));
+  g_hash_table_insert (priv->response_headers,
+                       g_strdup (name),
+                       g_strdup (value));
 }
 
 /* I apologise for this macro, but it saves typing ;-) */
@@ -593,6 +752,227 @@ _handle_error_from_message (SoupMessage *message, GError **error)
   return FALSE;
 }
 
+/*
+ * Check the result of @message, for code outside of this file which sends
+ * messages on behalf of a call.
+ */
+gboolean
+_rest_proxy_call_error_from_message (SoupMessage  *message,
+                                     GError      **error)
+{
+  return _handle_error_from_message (message, error);
+}
+
+/*
+ * Check the result of @message, preferring any error that happened while
+ * processing the response body.
+ */
+static gboolean
+_handle_error_from_call (RestProxyCall *call,
+                         SoupMessage   *message,
+                         GError       **error)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  if (priv->body_error)
+  {
+    g_propagate_error (error, g_error_copy (priv->body_error));
+    return FALSE;
+  }
+
+  return _handle_error_from_message (message, error);
+}
+
+static void
+_call_body_deliver (const gchar *data,
+                    gsize        len,
+                    gpointer     user_data)
+{
+  RestProxyCall *call = REST_PROXY_CALL (user_data);
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  priv->body_length += len;
+
+  if (priv->body_func)
+    priv->body_func (call, data, len, priv->body_data);
+  else if (priv->body && !priv->body_error)
+    _rest_spill_buffer_append (priv->body, data, len, &priv->body_error);
+}
+
+/*
+ * The largest response body @call will hold in memory, or -1 if there is no
+ * limit.  Bodies passed on to a body function are not held at all.
+ */
+static gint64
+_call_get_max_response_size (RestProxyCall *call,
+                             SoupMessage   *message)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  if (priv->body_func || message->method == SOUP_METHOD_HEAD)
+    return -1;
+
+  if (priv->max_response_size >= 0)
+    return priv->max_response_size;
+
+  return _rest_proxy_get_max_response_size (priv->proxy);
+}
+
+/* Give up on a response which is larger than @max bytes */
+static void
+_call_response_too_large (RestProxyCall *call,
+                          SoupMessage   *message,
+                          gint64         max)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  g_clear_error (&priv->body_error);
+  priv->body_error = g_error_new (REST_PROXY_ERROR,
+                                  REST_PROXY_ERROR_RESPONSE_TOO_LARGE,
+                                  "Response is larger than the maximum of %"
+                                  G_GINT64_FORMAT " bytes", max);
+
+  /* None of the body is kept */
+  _rest_spill_buffer_free (priv->body);
+  priv->body = NULL;
+  soup_message_body_truncate (message->response_body);
+  _rest_proxy_account_discarded (priv->proxy, priv->response_wire_length);
+
+  _rest_proxy_abort_message (priv->proxy, message, SOUP_STATUS_MALFORMED);
+}
+
+static void
+_call_message_got_headers_cb (SoupMessage   *message,
+                              RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  const char *coding;
+  gint64 threshold, max;
+  goffset size_hint;
+
+  /* The message may have been requeued, for example after authenticating, so
+   * forget about any previous response */
+  _rest_content_decoder_free (priv->decoder);
+  priv->decoder = NULL;
+  _rest_spill_buffer_free (priv->body);
+  priv->body = NULL;
+  priv->body_length = 0;
+  priv->wire_length = 0;
+  priv->response_wire_length = 0;
+  g_clear_error (&priv->body_error);
+
+  /* Refuse announced bodies that are too large before reading any of them */
+  max = _call_get_max_response_size (call, message);
+  if (max >= 0 &&
+      soup_message_headers_get_encoding (message->response_headers) == SOUP_ENCODING_CONTENT_LENGTH &&
+      soup_message_headers_get_content_length (message->response_headers) > (goffset)max)
+  {
+    _call_response_too_large (call, message, max);
+    return;
+  }
+
+  if (_rest_proxy_get_decode_content (priv->proxy))
+  {
+    coding = soup_message_headers_get_one (message->response_headers,
+                                           "Content-Encoding");
+    if (coding)
+      priv->decoder = _rest_content_decoder_new (coding);
+  }
+
+  /* The body is collected here instead of in the message, in a buffer from
+   * the proxy's pool which becomes the payload without being copied.  This
+   * also means we never hold both the encoded and the decoded body. */
+  if (!priv->body_func)
+  {
+    size_hint = -1;
+    if (!priv->decoder &&
+        soup_message_headers_get_encoding (message->response_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+      size_hint = soup_message_headers_get_content_length (message->response_headers);
+
+    threshold = _rest_proxy_get_response_spill_threshold (priv->proxy);
+    priv->body = _rest_spill_buffer_new (_rest_proxy_get_buffer_pool (priv->proxy),
+                                         threshold, size_hint);
+  }
+
+  soup_message_body_set_accumulate (message->response_body, FALSE);
+}
+
+static void
+_call_message_got_chunk_cb (SoupMessage   *message,
+                            SoupBuffer    *chunk,
+                            RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  GError *error = NULL;
+  gint64 max;
+
+  priv->wire_length += chunk->length;
+  priv->response_wire_length += chunk->length;
+
+  if (priv->body_error)
+    return;
+
+  /* Check both sizes, as a small compressed body can decode to a huge one */
+  max = _call_get_max_response_size (call, message);
+  if (max >= 0 && priv->response_wire_length > max)
+  {
+    _call_response_too_large (call, message, max);
+    return;
+  }
+
+  if (!priv->decoder)
+  {
+    _call_body_deliver (chunk->data, chunk->length, call);
+  }
+  else if (!_rest_content_decoder_push (priv->decoder,
+                                        chunk->data, chunk->length,
+                                        _call_body_deliver, call,
+                                        &error))
+  {
+    priv->body_error = error;
+  }
+
+  /* Either the body could not be decoded or it could not be stored */
+  if (priv->body_error)
+    _rest_proxy_abort_message (priv->proxy, message, SOUP_STATUS_MALFORMED);
+  else if (max >= 0 && priv->body_length > max)
+    _call_response_too_large (call, message, max);
+}
+
+static void
+_call_message_got_body_cb (SoupMessage   *message,
+                           RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  GError *error = NULL;
+
+  if (priv->decoder == NULL || priv->body_error)
+    return;
+
+  /* A body that stops part way through a compressed stream is not complete */
+  if (!_rest_content_decoder_finish (priv->decoder, _call_body_deliver, call,
+                                     &error))
+    priv->body_error = error;
+}
+
+/* A nul terminated copy of @data in a buffer from the proxy's pool */
+static gchar *
+_call_payload_new (RestProxyCall *call,
+                   const gchar   *data,
+                   gsize          len)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  gchar *payload;
+
+  payload = _rest_buffer_pool_alloc (_rest_proxy_get_buffer_pool (priv->proxy),
+                                     len + 1, NULL);
+  if (len)
+    memcpy (payload, data, len);
+  payload[len] = '\0';
+
+  return payload;
+}
+
 static gboolean
 finish_call (RestProxyCall *call, SoupMessage *message, GError **error)
 {
@@ -607,16 +987,42 @@ finish_call (RestProxyCall *call, SoupMessage *message, GError **error)
   g_hash_table_remove_all (priv->response_headers);
   soup_message_headers_foreach (message->response_headers,
       (SoupMessageHeadersForeachFunc)_populate_headers_hash_table,
-      priv->response_headers);
+      priv);
+
+  _call_free_payload (priv);
+
+  if (priv->body)
+  {
+    gsize length;
+    GError *err = NULL;
+
+    /* Collected body, terminated like the message body is */
+    priv->payload = _rest_spill_buffer_finish (priv->body, &length,
+                                               &priv->payload_mapped, &err);
+    priv->body = NULL;
+    priv->length = length;
 
-  priv->payload = g_memdup (message->response_body->data,
-                            message->response_body->length + 1);
-  priv->length = message->response_body->length;
+    if (priv->payload == NULL)
+    {
+      priv->payload = _call_payload_new (call, "", 0);
+      if (priv->body_error == NULL)
+        priv->body_error = err;
+      else
+        g_clear_error (&err);
+    }
+  } else {
+    /* No body was read, for example if the request could not be sent */
+    priv->payload = _call_payload_new (call, message->response_body->data,
+                                       message->response_body->length);
+    priv->length = message->response_body->length;
+  }
 
   priv->status_code = message->status_code;
-  priv->status_message = g_strdup (message->reason_phrase);
+  priv->status_message = _call_intern (priv, message->reason_phrase);
 
-  return _handle_error_from_message (message, error);
+  _rest_proxy_account_response (priv->proxy, priv->wire_length, priv->length);
+
+  return _handle_error_from_call (call, message, error);
 }
 
 static void
@@ -671,9 +1077,13 @@ _continuous_call_message_completed_cb (SoupSession *session,
   priv = GET_PRIVATE (call);
 
   priv->status_code = message->status_code;
-  priv->status_message = g_strdup (message->reason_phrase);
+  priv->status_message = _call_intern (priv, message->reason_phrase);
 
-  _handle_error_from_message (message, &error);
+  _rest_proxy_account_response (priv->proxy,
+                                priv->wire_length,
+                                priv->body_length);
+
+  _handle_error_from_call (call, message, &error);
 
   closure->callback (closure->call,
                      NULL,
@@ -692,6 +1102,8 @@ _continuous_call_message_completed_cb (SoupSession *session,
         closure);
   }
 
+  priv->body_func = NULL;
+  priv->body_data = NULL;
   priv->cur_call_closure = NULL;
   g_object_unref (closure->call);
   g_slice_free (RestProxyCallContinuousClosure, closure);
@@ -710,6 +1122,197 @@ _call_async_weak_notify_cb (gpointer *data,
   rest_proxy_call_cancel (closure->call);
 }
 
+static void
+_call_request_body_error_cb (SoupMessage  *message,
+                             const GError *error,
+                             gpointer      user_data)
+{
+  RestProxyCall *call = REST_PROXY_CALL (user_data);
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  if (priv->body_error == NULL)
+    priv->body_error = g_error_copy (error);
+
+  _rest_proxy_abort_message (priv->proxy, message, SOUP_STATUS_IO_ERROR);
+}
+
+/*
+ * Create a streamed body from the request body already in @message.  The
+ * existing body buffers are referenced, not copied.
+ */
+static RestRequestBody *
+_call_body_from_message (SoupMessage *message)
+{
+  RestRequestBody *body;
+  SoupBuffer *chunk;
+  goffset offset = 0;
+
+  body = _rest_request_body_new ();
+
+  while ((chunk = soup_message_body_get_chunk (message->request_body, offset))) {
+    if (chunk->length == 0) {
+      soup_buffer_free (chunk);
+      break;
+    }
+
+    _rest_request_body_append (body, chunk);
+    offset += chunk->length;
+    soup_buffer_free (chunk);
+  }
+
+  return body;
+}
+
+static gboolean
+_call_params_have_streams (RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  RestParamsIter iter;
+  const char *name;
+  RestParam *param;
+
+  rest_params_iter_init (&iter, priv->params);
+  while (rest_params_iter_next (&iter, &name, &param)) {
+    if (rest_param_get_stream (param) || rest_param_get_fd (param) >= 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Build a multipart/form-data body in the same format as
+ * soup_form_request_new_from_multipart(), but reading parameters that have a
+ * stream or file descriptor while the request is sent instead of holding them
+ * in memory.
+ */
+static RestRequestBody *
+_call_multipart_body_new (RestProxyCall  *call,
+                          gchar         **content_type)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  RestRequestBody *body;
+  RestParamsIter iter;
+  const char *name;
+  RestParam *param;
+  gchar *boundary;
+  GString *str;
+  gboolean first = TRUE;
+  SoupBuffer *sb;
+
+  boundary = g_strdup_printf ("rest-%08x%08x",
+                              g_random_int (), g_random_int ());
+
+  body = _rest_request_body_new ();
+
+  rest_params_iter_init (&iter, priv->params);
+  while (rest_params_iter_next (&iter, &name, &param)) {
+    str = g_string_new (first ? NULL : "\r\n");
+    first = FALSE;
+
+    g_string_append_printf (str, "--%s\r\n", boundary);
+    g_string_append (str, "Content-Disposition: form-data; ");
+    soup_header_g_string_append_param_quoted (str, "name", name);
+    if (rest_param_get_file_name (param)) {
+      g_string_append (str, "; ");
+      soup_header_g_string_append_param_quoted (str, "filename",
+                                                rest_param_get_file_name (param));
+    }
+    g_string_append (str, "\r\n");
+    if (!rest_param_is_string (param) && rest_param_get_content_type (param))
+      g_string_append_printf (str, "Content-Type: %s\r\n",
+                              rest_param_get_content_type (param));
+    g_string_append (str, "\r\n");
+
+    sb = soup_buffer_new (SOUP_MEMORY_TAKE, str->str, str->len);
+    g_string_free (str, FALSE);
+    _rest_request_body_append (body, sb);
+    soup_buffer_free (sb);
+
+    if (rest_param_get_stream (param)) {
+      _rest_request_body_append_stream (body,
+                                        rest_param_get_stream (param),
+                                        rest_param_get_stream_length (param));
+    } else if (rest_param_get_fd (param) >= 0) {
+      _rest_request_body_append_fd (body,
+                                    rest_param_get_fd (param),
+                                    rest_param_get_fd_offset (param),
+                                    rest_param_get_fd_length (param));
+    } else {
+      gsize length;
+
+      /* Strings are stored with their terminator, which is not sent */
+      if (rest_param_is_string (param))
+        length = strlen (rest_param_get_content (param));
+      else
+        length = rest_param_get_content_length (param);
+
+      sb = soup_buffer_new_with_owner (rest_param_get_content (param),
+                                       length,
+                                       rest_param_ref (param),
+                                       (GDestroyNotify)rest_param_unref);
+      _rest_request_body_append (body, sb);
+      soup_buffer_free (sb);
+    }
+  }
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "\r\n--%s--\r\n", boundary);
+  sb = soup_buffer_new (SOUP_MEMORY_TAKE, str->str, str->len);
+  g_string_free (str, FALSE);
+  _rest_request_body_append (body, sb);
+  soup_buffer_free (sb);
+
+  *content_type = g_strdup_printf ("%s; boundary=\"%s\"",
+                                   SOUP_FORM_MIME_TYPE_MULTIPART, boundary);
+  g_free (boundary);
+
+  return body;
+}
+
+/*
+ * Make @view look at @call, for a prepare function to sign or otherwise
+ * change it in the same way as a #RestRequest.  The parameters and headers
+ * are those of the call, and any new URL is picked up by
+ * _rest_proxy_call_finish_view().
+ */
+void
+_rest_proxy_call_init_view (RestProxyCall   *call,
+                            RestRequestView *view)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  view->method = priv->method;
+  view->function = priv->function;
+  view->url = priv->url;
+  view->params = priv->params;
+  view->headers = priv->headers;
+}
+
+void
+_rest_proxy_call_finish_view (RestProxyCall   *call,
+                              RestRequestView *view)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  priv->url = view->url;
+}
+
+/*
+ * Send @buffer as the body of @call, instead of anything made from the
+ * parameters.  The buffer is referenced, not copied.
+ */
+void
+_rest_proxy_call_set_request_buffer (RestProxyCall *call,
+                                     SoupBuffer    *buffer)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+
+  if (priv->request_buffer)
+    soup_buffer_free (priv->request_buffer);
+  priv->request_buffer = buffer ? soup_buffer_copy (buffer) : NULL;
+}
+
 static void
 set_header (gpointer key, gpointer value, gpointer user_data)
 {
@@ -719,13 +1322,57 @@ set_header (gpointer key, gpointer value, gpointer user_data)
   soup_message_headers_replace (headers, name, value);
 }
 
+/*
+ * Make a message sending the parameters of @call as a form, in the same way as
+ * soup_form_request_new_from_hash() but keeping their order and any repeated
+ * names.
+ */
+static SoupMessage *
+_call_form_request_new (RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  SoupMessage *message;
+  SoupURI *uri;
+  GString *form;
+
+  uri = soup_uri_new (priv->url);
+  if (uri == NULL)
+    return NULL;
+
+  form = g_string_new (NULL);
+  _rest_params_append_form (priv->params, form);
+
+  if (strcmp (priv->method, "GET") == 0) {
+    soup_uri_set_query (uri, form->str);
+    message = soup_message_new_from_uri (priv->method, uri);
+    g_string_free (form, TRUE);
+  } else if (strcmp (priv->method, "POST") == 0 ||
+             strcmp (priv->method, "PUT") == 0) {
+    message = soup_message_new_from_uri (priv->method, uri);
+    soup_message_set_request (message, SOUP_FORM_MIME_TYPE_URLENCODED,
+                              SOUP_MEMORY_TAKE, form->str, form->len);
+    g_string_free (form, FALSE);
+  } else {
+    g_warning ("invalid method passed to soup_form_request_new");
+    message = soup_message_new_from_uri (priv->method, uri);
+    g_string_free (form, TRUE);
+  }
+
+  soup_uri_free (uri);
+
+  return message;
+}
+
 static SoupMessage *
 prepare_message (RestProxyCall *call, GError **error_out)
 {
   RestProxyCallPrivate *priv;
   RestProxyCallClass *call_class;
-  const gchar *bound_url, *user_agent;
+  const gchar *user_agent;
   SoupMessage *message;
+  RestRequestBody *body = NULL;
+  goffset body_length;
+  gint64 threshold;
   GError *error = NULL;
 
   priv = GET_PRIVATE (call);
@@ -737,26 +1384,13 @@ prepare_message (RestProxyCall *call, GError **error_out)
     g_warning (G_STRLOC ": re-use of RestProxyCall %p, don't do this", call);
   }
 
-  bound_url =_rest_proxy_get_bound_url (priv->proxy);
-
-  if (_rest_proxy_get_binding_required (priv->proxy) && !bound_url)
-  {
-    g_critical (G_STRLOC ": URL requires binding and is unbound");
-    return FALSE;
-  }
+  /* Nothing from a previous invocation carries over */
+  g_clear_error (&priv->body_error);
+  priv->wire_length = 0;
 
-  /* FIXME: Perhaps excessive memory duplication */
-  if (priv->function)
-  {
-    if (g_str_has_suffix (bound_url, "/"))
-    {
-      priv->url = g_strdup_printf ("%s%s", bound_url, priv->function);
-    } else {
-      priv->url = g_strdup_printf ("%s/%s", bound_url, priv->function);
-    }
-  } else {
-    priv->url = g_strdup (bound_url);
-  }
+  priv->url = _rest_proxy_build_url (priv->proxy, priv->function);
+  if (priv->url == NULL)
+    return NULL;
 
   /* Allow an overrideable prepare function that is called before every
    * invocation so subclasses can do magic
@@ -770,7 +1404,37 @@ prepare_message (RestProxyCall *call, GError **error_out)
     }
   }
 
-  if (call_class->serialize_params) {
+  if (priv->request_buffer) {
+    GString *url;
+    gsize len;
+
+    /* Only strings can be put in a query string, and dropping the rest would
+     * send an incomplete request */
+    if (!rest_params_are_strings (priv->params))
+    {
+      g_set_error_literal (error_out, REST_PROXY_CALL_ERROR,
+                           REST_PROXY_CALL_FAILED,
+                           "Only string parameters can be sent with a request body");
+      return NULL;
+    }
+
+    /* The parameters can't go in the body, so they go in the query */
+    url = g_string_new (priv->url);
+    g_string_append_c (url, strchr (priv->url, '?') ? '&' : '?');
+    len = url->len;
+    _rest_params_append_form (priv->params, url);
+
+    /* No separator if there were no parameters */
+    if (url->len == len)
+      g_string_truncate (url, len - 1);
+
+    message = soup_message_new (priv->method, url->str);
+    g_string_free (url, TRUE);
+
+    soup_message_headers_replace (message->request_headers, "Content-Type",
+                                  "application/octet-stream");
+    soup_message_body_append_buffer (message->request_body, priv->request_buffer);
+  } else if (call_class->serialize_params) {
     gchar *content;
     gchar *content_type;
     gsize content_len;
@@ -788,15 +1452,17 @@ prepare_message (RestProxyCall *call, GError **error_out)
 
     g_free (content_type);
   } else if (rest_params_are_strings (priv->params)) {
-    GHashTable *hash;
+    message = _call_form_request_new (call);
+  } else if (_call_params_have_streams (call)) {
+    gchar *content_type;
 
-    hash = rest_params_as_string_hash_table (priv->params);
+    body = _call_multipart_body_new (call, &content_type);
 
-    message = soup_form_request_new_from_hash (priv->method,
-                                               priv->url,
-                                               hash);
+    message = soup_message_new (SOUP_METHOD_POST, priv->url);
+    soup_message_headers_replace (message->request_headers,
+                                  "Content-Type", content_type);
 
-    g_hash_table_unref (hash);
+    g_free (content_type);
   } else {
     SoupMultipart *mp;
     RestParamsIter iter;
@@ -832,8 +1498,49 @@ prepare_message (RestProxyCall *call, GError **error_out)
     soup_multipart_free (mp);
   }
 
-  /* Set the user agent, if one was set in the proxy */
-  user_agent = rest_proxy_get_user_agent (priv->proxy);
+  body_length = body ? _rest_request_body_get_length (body)
+                     : message->request_body->length;
+
+  /* Bodies of unknown length are assumed to be worth compressing */
+  if (priv->request_coding != REST_CONTENT_CODING_IDENTITY &&
+      body_length != 0 &&
+      (body_length < 0 || body_length >= priv->request_coding_threshold) &&
+      !g_hash_table_lookup (priv->headers, "Content-Encoding")) {
+    if (body == NULL)
+      body = _call_body_from_message (message);
+
+    _rest_request_body_set_coding (body, priv->request_coding);
+    soup_message_headers_replace (message->request_headers, "Content-Encoding",
+                                  _rest_content_coding_to_string (priv->request_coding));
+  }
+
+  /* Let the server refuse large bodies before they are sent */
+  threshold = _rest_proxy_get_expect_continue_threshold (priv->proxy);
+  if (threshold >= 0 && body_length != 0 &&
+      (body_length < 0 || body_length >= threshold)) {
+    soup_message_headers_set_expectations (message->request_headers,
+                                           SOUP_EXPECTATION_CONTINUE);
+  }
+
+  if (body)
+    _rest_request_body_attach (body, message, _call_request_body_error_cb, call);
+
+  if (_rest_proxy_get_decode_content (priv->proxy)) {
+    soup_message_headers_replace (message->request_headers, "Accept-Encoding",
+                                  _rest_content_decoder_get_accept_encoding ());
+  }
+
+  /* Route the response body through the call so it can be decoded and
+   * counted, whichever way the call is invoked */
+  g_signal_connect_object (message, "got-headers",
+                           G_CALLBACK (_call_message_got_headers_cb), call, 0);
+  g_signal_connect_object (message, "got-chunk",
+                           G_CALLBACK (_call_message_got_chunk_cb), call, 0);
+  g_signal_connect_object (message, "got-body",
+                           G_CALLBACK (_call_message_got_body_cb), call, 0);
+
+  /* Set the user agent, if one was set in the proxy */
+  user_agent = rest_proxy_get_user_agent (priv->proxy);
   if (user_agent) {
     soup_message_headers_append (message->request_headers, "User-Agent", user_agent);
   }
@@ -1021,13 +1728,16 @@ rest_proxy_call_invoke_finish (RestProxyCall *call,
 }
 
 static void
-_continuous_call_message_got_chunk_cb (SoupMessage                    *msg,
-                                       SoupBuffer                     *chunk,
-                                       RestProxyCallContinuousClosure *closure)
+_continuous_call_body_cb (RestProxyCall *call,
+                          const gchar   *data,
+                          gsize          len,
+                          gpointer       user_data)
 {
+  RestProxyCallContinuousClosure *closure = user_data;
+
   closure->callback (closure->call,
-                     chunk->data,
-                     chunk->length,
+                     data,
+                     len,
                      NULL,
                      closure->weak_object,
                      closure->userdata);
@@ -1101,10 +1811,9 @@ rest_proxy_call_continuous (RestProxyCall                    *call,
         closure);
   }
 
-  g_signal_connect (message,
-                    "got-chunk",
-                    (GCallback)_continuous_call_message_got_chunk_cb,
-                    closure);
+  /* Chunks are decoded if needed and then passed to the callback */
+  priv->body_func = _continuous_call_body_cb;
+  priv->body_data = closure;
 
   _rest_proxy_queue_message (priv->proxy,
                              message,
@@ -1122,15 +1831,17 @@ _upload_call_message_completed_cb (SoupSession *session,
   RestProxyCallPrivate *priv;
   GError *error = NULL;
   RestProxyCallUploadClosure *closure;
+  RestRequestBody *body;
 
   closure = (RestProxyCallUploadClosure *) user_data;
   call = closure->call;
   priv = GET_PRIVATE (call);
 
-  priv->status_code = message->status_code;
-  priv->status_message = g_strdup (message->reason_phrase);
+  finish_call (call, message, &error);
 
-  _handle_error_from_message (message, &error);
+  body = _rest_request_body_from_message (message);
+  if (body && error == NULL)
+    closure->uploaded = _rest_request_body_get_written (body);
 
   closure->callback (closure->call,
                      closure->uploaded,
@@ -1159,17 +1870,59 @@ _upload_call_message_wrote_data_cb (SoupMessage                *msg,
                                     SoupBuffer                 *chunk,
                                     RestProxyCallUploadClosure *closure)
 {
-  closure->uploaded = closure->uploaded + chunk->length;
+  RestRequestBody *body;
+  gsize total;
+
+  /* Bodies that are streamed report progress in terms of the source data, as
+   * the length of what goes over the wire may not be known */
+  body = _rest_request_body_from_message (msg);
+  if (body) {
+    total = MAX (_rest_request_body_get_length (body), 0);
+    closure->uploaded = _rest_request_body_get_written (body);
+  } else {
+    total = msg->request_body->length;
+    closure->uploaded = closure->uploaded + chunk->length;
+  }
 
-  if (closure->uploaded < msg->request_body->length)
+  if (closure->uploaded < total || total == 0)
     closure->callback (closure->call,
-                       msg->request_body->length,
+                       total,
                        closure->uploaded,
                        NULL,
                        closure->weak_object,
                        closure->userdata);
 }
 
+static void
+_upload_call_message_got_informational_cb (SoupMessage                *msg,
+                                           RestProxyCallUploadClosure *closure)
+{
+  RestRequestBody *body;
+  goffset total;
+
+  if (msg->status_code != SOUP_STATUS_CONTINUE)
+    return;
+
+  /* The server has agreed to take the body, so report that the upload is
+   * starting.  A total of 0 with nothing uploaded would look like an empty
+   * body that has been sent, so say nothing if the length isn't known. */
+  body = _rest_request_body_from_message (msg);
+  if (body)
+    total = _rest_request_body_get_length (body);
+  else
+    total = msg->request_body->length;
+
+  if (total < 0)
+    return;
+
+  closure->callback (closure->call,
+                     total,
+                     0,
+                     NULL,
+                     closure->weak_object,
+                     closure->userdata);
+}
+
 /**
  * rest_proxy_call_upload:
  * @call: The #RestProxyCall
@@ -1183,7 +1936,16 @@ _upload_call_message_wrote_data_cb (SoupMessage                *msg,
  * chunk of our request's body is written.
  *
  * When the callback is invoked with the uploaded byte count equaling the message
- * byte count, the call has completed.
+ * byte count, the call has completed.  If the call has parameters created with
+ * rest_param_new_with_stream() whose length is not known, the message
+ * byte count is 0 until then.  Once the call has completed its response
+ * headers and payload are available as usual.
+ *
+ * If the request is sent with "Expect: 100-continue" (see
+ * #RestProxy:expect-continue-threshold) the callback is invoked with an
+ * uploaded byte count of 0 once the server has agreed to take the body, unless
+ * the length of the body is not known.  If the server refuses the request instead, the callback is invoked with an
+ * error and an uploaded byte count of 0, as nothing was sent.
  *
  * If @weak_object is disposed during the call then this call will be
  * cancelled. If the call is cancelled then the callback will be invoked with
@@ -1239,6 +2001,10 @@ rest_proxy_call_upload (RestProxyCall                *call,
                     "wrote-body-data",
                     (GCallback) _upload_call_message_wrote_data_cb,
                     closure);
+  g_signal_connect (message,
+                    "got-informational",
+                    (GCallback) _upload_call_message_got_informational_cb,
+                    closure);
 
   _rest_proxy_queue_message (priv->proxy,
                              message,
@@ -1247,6 +2013,958 @@ rest_proxy_call_upload (RestProxyCall                *call,
   return TRUE;
 }
 
+/* Resumable uploads are sent in pieces of this size unless told otherwise */
+#define RESUMABLE_CHUNK_SIZE (8 * 1024 * 1024)
+
+/* How many times in a row a resumable upload may fail to make progress */
+#define RESUMABLE_MAX_RETRIES 5
+
+/* The first retry is after this many milliseconds, doubling each time */
+#define RESUMABLE_RETRY_DELAY 500
+
+/* The status servers use to say that more of a resumable upload is expected */
+#define RESUMABLE_STATUS_INCOMPLETE 308
+
+static void _resumable_send_chunk (RestProxyCallResumableClosure *closure);
+static void _resumable_send_query (RestProxyCallResumableClosure *closure);
+
+static void
+_resumable_complete (RestProxyCallResumableClosure *closure,
+                     SoupMessage                   *message,
+                     GError                        *error)
+{
+  RestProxyCall *call = closure->call;
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  goffset uploaded = closure->offset;
+
+  /* Pick up the payload and headers of the final response */
+  if (message)
+  {
+    if (error)
+      finish_call (call, message, NULL);
+    else if (finish_call (call, message, &error))
+      uploaded = closure->total;
+  }
+
+  closure->callback (call,
+                     closure->total,
+                     uploaded,
+                     error,
+                     closure->weak_object,
+                     closure->userdata);
+
+  g_clear_error (&error);
+
+  if (closure->weak_object)
+  {
+    g_object_weak_unref (closure->weak_object,
+        (GWeakNotify)_call_async_weak_notify_cb,
+        closure);
+  }
+
+  priv->cur_call_closure = NULL;
+
+  g_object_unref (closure->stream);
+  g_free (closure->content_type);
+  g_free (closure->upload_url);
+  g_object_unref (closure->call);
+  g_slice_free (RestProxyCallResumableClosure, closure);
+}
+
+static gboolean
+_resumable_retry_cb (gpointer user_data)
+{
+  RestProxyCallResumableClosure *closure = user_data;
+  RestProxyCallPrivate *priv = GET_PRIVATE (closure->call);
+
+  priv->retry_source = 0;
+  _resumable_send_query (closure);
+
+  return FALSE;
+}
+
+/*
+ * Try again after @message failed, if it failed in a way that might go away
+ * and there are retries left.
+ */
+static gboolean
+_resumable_retry (RestProxyCallResumableClosure *closure,
+                  SoupMessage                   *message)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (closure->call);
+
+  if (message->status_code == SOUP_STATUS_CANCELLED)
+    return FALSE;
+
+  if (!SOUP_STATUS_IS_TRANSPORT_ERROR (message->status_code) &&
+      !SOUP_STATUS_IS_SERVER_ERROR (message->status_code))
+    return FALSE;
+
+  if (closure->retries == RESUMABLE_MAX_RETRIES)
+    return FALSE;
+
+  priv->retry_source = g_timeout_add (RESUMABLE_RETRY_DELAY << closure->retries,
+                                      _resumable_retry_cb, closure);
+  closure->retries++;
+
+  return TRUE;
+}
+
+/* Called from rest_proxy_call_cancel() while waiting to retry */
+static void
+_resumable_cancel (RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  RestProxyCallResumableClosure *closure;
+
+  closure = (RestProxyCallResumableClosure *)priv->cur_call_closure;
+
+  g_source_remove (priv->retry_source);
+  priv->retry_source = 0;
+
+  _resumable_complete (closure, NULL,
+                       g_error_new_literal (REST_PROXY_ERROR,
+                                            REST_PROXY_ERROR_CANCELLED,
+                                            "Cancelled"));
+}
+
+/*
+ * How much of the upload the server has, from the Range header of an
+ * incomplete response.  No header means nothing was received.
+ */
+static goffset
+_resumable_get_committed (SoupMessage *message)
+{
+  const char *range;
+  const char *dash;
+
+  range = soup_message_headers_get_one (message->response_headers, "Range");
+  if (range == NULL || !g_str_has_prefix (range, "bytes="))
+    return 0;
+
+  dash = strchr (range, '-');
+  if (dash == NULL)
+    return 0;
+
+  return g_ascii_strtoll (dash + 1, NULL, 10) + 1;
+}
+
+/*
+ * Handle the response to a chunk or a status query, which either ends the
+ * upload or says where to carry on from.
+ */
+static void
+_resumable_message_completed_cb (SoupSession *session,
+                                 SoupMessage *message,
+                                 gpointer     user_data)
+{
+  RestProxyCallResumableClosure *closure = user_data;
+  goffset committed;
+
+  closure->message = NULL;
+
+  if (message->status_code == RESUMABLE_STATUS_INCOMPLETE)
+  {
+    committed = _resumable_get_committed (message);
+
+    if (committed < 0 || committed > closure->total)
+    {
+      _resumable_complete (closure, NULL,
+                           g_error_new_literal (REST_PROXY_ERROR,
+                                                REST_PROXY_ERROR_FAILED,
+                                                "Invalid committed range"));
+      return;
+    }
+
+    /* A chunk that none of was taken counts as a failure */
+    if (committed > closure->offset)
+    {
+      closure->retries = 0;
+    }
+    else if (message->request_body->length > 0 &&
+             closure->retries++ == RESUMABLE_MAX_RETRIES)
+    {
+      _resumable_complete (closure, NULL,
+                           g_error_new_literal (REST_PROXY_ERROR,
+                                                REST_PROXY_ERROR_FAILED,
+                                                "Upload is not making progress"));
+      return;
+    }
+    closure->offset = committed;
+
+    _resumable_send_chunk (closure);
+    return;
+  }
+
+  if (_resumable_retry (closure, message))
+    return;
+
+  _resumable_complete (closure, message, NULL);
+}
+
+static void
+_resumable_wrote_data_cb (SoupMessage                   *message,
+                          SoupBuffer                    *chunk,
+                          RestProxyCallResumableClosure *closure)
+{
+  closure->written += chunk->length;
+
+  if (closure->offset + closure->written < closure->total)
+    closure->callback (closure->call,
+                       closure->total,
+                       closure->offset + closure->written,
+                       NULL,
+                       closure->weak_object,
+                       closure->userdata);
+}
+
+static SoupMessage *
+_resumable_message_new (RestProxyCallResumableClosure *closure)
+{
+  RestProxyCall *call = closure->call;
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  SoupMessage *message;
+  const gchar *user_agent;
+
+  message = soup_message_new (SOUP_METHOD_PUT, closure->upload_url);
+
+  /* An incomplete response is not a redirect, whatever its status says */
+  soup_message_set_flags (message, SOUP_MESSAGE_NO_REDIRECT);
+
+  g_hash_table_foreach (priv->headers, set_header, message->request_headers);
+  soup_message_headers_remove (message->request_headers, "Content-Type");
+
+  user_agent = rest_proxy_get_user_agent (priv->proxy);
+  if (user_agent)
+    soup_message_headers_replace (message->request_headers, "User-Agent", user_agent);
+
+  g_signal_connect_object (message, "got-headers",
+                           G_CALLBACK (_call_message_got_headers_cb), call, 0);
+  g_signal_connect_object (message, "got-chunk",
+                           G_CALLBACK (_call_message_got_chunk_cb), call, 0);
+  g_signal_connect_object (message, "got-body",
+                           G_CALLBACK (_call_message_got_body_cb), call, 0);
+
+  return message;
+}
+
+static void
+_resumable_queue (RestProxyCallResumableClosure *closure,
+                  SoupMessage                   *message)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (closure->call);
+
+  closure->message = message;
+  _rest_proxy_queue_message (priv->proxy,
+                             message,
+                             _resumable_message_completed_cb,
+                             closure);
+}
+
+/* Ask the server how much of the upload it has */
+static void
+_resumable_send_query (RestProxyCallResumableClosure *closure)
+{
+  SoupMessage *message;
+  gchar *range;
+
+  message = _resumable_message_new (closure);
+
+  range = g_strdup_printf ("bytes */%" G_GOFFSET_FORMAT, closure->total);
+  soup_message_headers_replace (message->request_headers, "Content-Range", range);
+  g_free (range);
+
+  _resumable_queue (closure, message);
+}
+
+/* Send the chunk starting at the committed offset */
+static void
+_resumable_send_chunk (RestProxyCallResumableClosure *closure)
+{
+  SoupMessage *message;
+  GError *error = NULL;
+  gsize length, read;
+  gchar *buffer;
+  gchar *range;
+
+  length = MIN ((goffset)closure->chunk_size, closure->total - closure->offset);
+  buffer = g_malloc (length);
+
+  if (!g_seekable_seek (G_SEEKABLE (closure->stream),
+                        closure->start + closure->offset,
+                        G_SEEK_SET, NULL, &error) ||
+      !g_input_stream_read_all (closure->stream, buffer, length,
+                                &read, NULL, &error))
+  {
+    g_free (buffer);
+    _resumable_complete (closure, NULL, error);
+    return;
+  }
+
+  if (read < length)
+  {
+    g_free (buffer);
+    _resumable_complete (closure, NULL,
+                         g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                              "Stream ended before the upload was complete"));
+    return;
+  }
+
+  message = _resumable_message_new (closure);
+
+  if (length > 0)
+    range = g_strdup_printf ("bytes %" G_GOFFSET_FORMAT "-%" G_GOFFSET_FORMAT
+                             "/%" G_GOFFSET_FORMAT,
+                             closure->offset, closure->offset + length - 1,
+                             closure->total);
+  else
+    range = g_strdup_printf ("bytes */%" G_GOFFSET_FORMAT, closure->total);
+  soup_message_headers_replace (message->request_headers, "Content-Range", range);
+  g_free (range);
+
+  soup_message_set_request (message, closure->content_type,
+                            SOUP_MEMORY_TAKE, buffer, length);
+
+  closure->written = 0;
+  g_signal_connect (message,
+                    "wrote-body-data",
+                    (GCallback) _resumable_wrote_data_cb,
+                    closure);
+
+  _resumable_queue (closure, message);
+}
+
+/* The session has been created, so start sending the data */
+static void
+_resumable_session_completed_cb (SoupSession *session,
+                                 SoupMessage *message,
+                                 gpointer     user_data)
+{
+  RestProxyCallResumableClosure *closure = user_data;
+  RestProxyCallPrivate *priv = GET_PRIVATE (closure->call);
+  GError *error = NULL;
+  const char *location;
+  SoupURI *uri;
+
+  closure->message = NULL;
+
+  if (priv->body_error)
+  {
+    _resumable_complete (closure, message, g_error_copy (priv->body_error));
+    return;
+  }
+
+  if (!_handle_error_from_message (message, &error))
+  {
+    _resumable_complete (closure, message, error);
+    return;
+  }
+
+  location = soup_message_headers_get_one (message->response_headers, "Location");
+  if (location == NULL)
+  {
+    _resumable_complete (closure, message,
+                         g_error_new_literal (REST_PROXY_ERROR,
+                                              REST_PROXY_ERROR_FAILED,
+                                              "No upload location was returned"));
+    return;
+  }
+
+  uri = soup_uri_new_with_base (soup_message_get_uri (message), location);
+  closure->upload_url = soup_uri_to_string (uri, FALSE);
+  soup_uri_free (uri);
+
+  _resumable_send_chunk (closure);
+}
+
+/**
+ * rest_proxy_call_upload_resumable:
+ * @call: The #RestProxyCall
+ * @stream: a seekable #GInputStream to read the data from
+ * @length: the number of bytes to upload from @stream
+ * @content_type: (allow-none): the MIME type of the data, or %NULL for
+ *   application/octet-stream
+ * @chunk_size: the size of each piece of the upload, or 0 for the default of
+ *   8 megabytes
+ * @callback: a #RestProxyCallUploadCallback to invoke when a chunk of data was
+ *   uploaded
+ * @weak_object: The #GObject to weakly reference and tie the lifecycle to
+ * @userdata: data to pass to @callback
+ * @error: a #GError, or %NULL
+ *
+ * Asynchronously upload @length bytes from the current position of @stream
+ * using the resumable upload protocol, so that a failure part of the way
+ * through does not mean starting again.
+ *
+ * @call is the request that creates the upload session, usually a POST
+ * describing the data.  Its response is expected to give the URL to upload to
+ * in the Location header.  The data is then sent to that URL as a series of
+ * PUT requests of at most @chunk_size bytes, each with a Content-Range header.
+ * The server answers each chunk but the last with status 308 and a Range
+ * header saying how much it has received.  If a chunk fails because of a
+ * network or server error, the server is asked how much it has and the upload
+ * carries on from there, after a short and increasing delay.  Some servers
+ * require @chunk_size to be a multiple of 256 kilobytes.
+ *
+ * The headers added to @call, other than Content-Type, are sent with every
+ * request.  @callback is invoked as the data is written, and after a failure
+ * the uploaded byte count may go back to what the server has.  When the
+ * callback is invoked with the uploaded byte count equaling @length, or with
+ * an error, the call has completed and the payload of @call is that of the
+ * final response.
+ *
+ * If @weak_object is disposed during the call then this call will be
+ * cancelled. If the call is cancelled then the callback will be invoked with
+ * an error state.
+ *
+ * You may unref the call after calling this function since there is an
+ * internal reference, or you may unref in the callback.
+ *
+ * Returns: %TRUE if the upload was started, or %FALSE if @stream can't be
+ *   seeked or the call could not be made
+ */
+gboolean
+rest_proxy_call_upload_resumable (RestProxyCall                *call,
+                                  GInputStream                 *stream,
+                                  goffset                       length,
+                                  const gchar                  *content_type,
+                                  gsize                         chunk_size,
+                                  RestProxyCallUploadCallback   callback,
+                                  GObject                      *weak_object,
+                                  gpointer                      userdata,
+                                  GError                      **error)
+{
+  RestProxyCallPrivate *priv;
+  SoupMessage *message;
+  RestProxyCallResumableClosure *closure;
+
+  g_return_val_if_fail (REST_IS_PROXY_CALL (call), FALSE);
+  g_return_val_if_fail (G_IS_INPUT_STREAM (stream), FALSE);
+  g_return_val_if_fail (length >= 0, FALSE);
+  priv = GET_PRIVATE (call);
+  g_assert (priv->proxy);
+
+  if (priv->cur_call_closure)
+  {
+    g_warning (G_STRLOC ": re-use of RestProxyCall %p, don't do this", call);
+    return FALSE;
+  }
+
+  /* Chunks have to be read again if sending them fails */
+  if (!G_IS_SEEKABLE (stream) || !g_seekable_can_seek (G_SEEKABLE (stream)))
+  {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Resumable uploads need a seekable stream");
+    return FALSE;
+  }
+
+  message = prepare_message (call, error);
+  if (message == NULL)
+    return FALSE;
+
+  if (chunk_size == 0)
+    chunk_size = RESUMABLE_CHUNK_SIZE;
+
+  closure = g_slice_new0 (RestProxyCallResumableClosure);
+  closure->call = g_object_ref (call);
+  closure->callback = callback;
+  closure->weak_object = weak_object;
+  closure->message = message;
+  closure->userdata = userdata;
+  closure->stream = g_object_ref (stream);
+  closure->start = g_seekable_tell (G_SEEKABLE (stream));
+  closure->total = length;
+  closure->content_type = g_strdup (content_type ? content_type
+                                                 : "application/octet-stream");
+  closure->chunk_size = chunk_size;
+
+  priv->cur_call_closure = (RestProxyCallAsyncClosure *)closure;
+
+  /* Weakly reference this object. We remove our callback if it goes away. */
+  if (closure->weak_object)
+  {
+    g_object_weak_ref (closure->weak_object,
+        (GWeakNotify)_call_async_weak_notify_cb,
+        closure);
+  }
+
+  _rest_proxy_queue_message (priv->proxy,
+                             message,
+                             _resumable_session_completed_cb,
+                             closure);
+  return TRUE;
+}
+
+static gboolean
+_download_write (RestProxyCallDownloadClosure  *closure,
+                 const gchar                   *data,
+                 gsize                          len,
+                 GError                       **error)
+{
+  gssize n;
+
+  if (closure->stream)
+    return g_output_stream_write_all (closure->stream, data, len,
+                                      NULL, NULL, error);
+
+  while (len > 0) {
+    n = write (closure->fd, data, len);
+    if (n < 0) {
+      int errsv = errno;
+
+      if (errsv == EINTR)
+        continue;
+
+      g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                           g_strerror (errsv));
+      return FALSE;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Make sure everything written so far is stored.  Output streams can only be
+ * flushed, but file descriptors are synced to disk.
+ */
+static gboolean
+_download_sync (RestProxyCallDownloadClosure  *closure,
+                GError                       **error)
+{
+  closure->unsynced = 0;
+
+  if (closure->stream)
+    return g_output_stream_flush (closure->stream, NULL, error);
+
+#ifdef G_OS_UNIX
+  if (fsync (closure->fd) < 0) {
+    int errsv = errno;
+
+    g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                         g_strerror (errsv));
+    return FALSE;
+  }
+#endif
+
+  return TRUE;
+}
+
+static gboolean
+_download_flush (RestProxyCallDownloadClosure  *closure,
+                 GError                       **error)
+{
+  if (closure->buffered == 0)
+    return TRUE;
+
+  if (!_download_write (closure, closure->buffer, closure->buffered, error))
+    return FALSE;
+
+  closure->unsynced += closure->buffered;
+  closure->buffered = 0;
+
+  if (closure->sync == REST_DOWNLOAD_SYNC_PERIODIC &&
+      closure->unsynced >= DOWNLOAD_SYNC_INTERVAL)
+    return _download_sync (closure, error);
+
+  return TRUE;
+}
+
+static void
+_download_call_body_cb (RestProxyCall *call,
+                        const gchar   *data,
+                        gsize          len,
+                        gpointer       user_data)
+{
+  RestProxyCallDownloadClosure *closure = user_data;
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  GError *error = NULL;
+  gsize n;
+
+  if (!closure->active || priv->body_error)
+    return;
+
+  closure->received += len;
+
+  while (len > 0) {
+    n = MIN (len, DOWNLOAD_BUFFER_SIZE - closure->buffered);
+    memcpy (closure->buffer + closure->buffered, data, n);
+    closure->buffered += n;
+    data += n;
+    len -= n;
+
+    if (closure->buffered == DOWNLOAD_BUFFER_SIZE &&
+        !_download_flush (closure, &error)) {
+      priv->body_error = error;
+      _rest_proxy_abort_message (priv->proxy, closure->message,
+                                 SOUP_STATUS_IO_ERROR);
+      return;
+    }
+  }
+
+  if (closure->progress)
+    closure->progress (call, closure->received, closure->total,
+                       closure->progress_data);
+}
+
+static void
+_download_call_got_headers_cb (SoupMessage                  *message,
+                               RestProxyCallDownloadClosure *closure)
+{
+  RestProxyCallPrivate *priv = GET_PRIVATE (closure->call);
+
+  /* Only write out the final response, not the bodies of redirects or
+   * errors */
+  closure->active = SOUP_STATUS_IS_SUCCESSFUL (message->status_code);
+  closure->received = 0;
+  closure->total = -1;
+
+  /* The length on the wire is only the length written if it isn't decoded */
+  if (priv->decoder == NULL &&
+      soup_message_headers_get_encoding (message->response_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+    closure->total = soup_message_headers_get_content_length (message->response_headers);
+}
+
+static void
+_download_call_message_completed_cb (SoupSession *session,
+                                     SoupMessage *message,
+                                     gpointer     user_data)
+{
+  RestProxyCallDownloadClosure *closure = user_data;
+  RestProxyCall *call = closure->call;
+  RestProxyCallPrivate *priv = GET_PRIVATE (call);
+  GError *error = NULL;
+
+  g_hash_table_remove_all (priv->response_headers);
+  soup_message_headers_foreach (message->response_headers,
+      (SoupMessageHeadersForeachFunc)_populate_headers_hash_table,
+      priv);
+
+  priv->status_code = message->status_code;
+  priv->status_message = _call_intern (priv, message->reason_phrase);
+
+  _rest_proxy_account_response (priv->proxy,
+                                priv->wire_length,
+                                priv->body_length);
+
+  if (_handle_error_from_call (call, message, &error) &&
+      _download_flush (closure, &error) &&
+      closure->sync != REST_DOWNLOAD_SYNC_NONE)
+    _download_sync (closure, &error);
+
+  if (error != NULL)
+    g_simple_async_result_take_error (closure->result, error);
+  else
+    g_simple_async_result_set_op_res_gboolean (closure->result, TRUE);
+
+  if (priv->cancellable)
+    {
+      g_signal_handler_disconnect (priv->cancellable, priv->cancel_sig);
+      g_clear_object (&priv->cancellable);
+    }
+
+  priv->body_func = NULL;
+  priv->body_data = NULL;
+  priv->cur_call_closure = NULL;
+
+  g_simple_async_result_complete (closure->result);
+  g_object_unref (closure->result);
+
+  if (closure->stream)
+    g_object_unref (closure->stream);
+  g_free (closure->buffer);
+  g_object_unref (closure->call);
+  g_slice_free (RestProxyCallDownloadClosure, closure);
+}
+
+static void
+_call_download_async (RestProxyCall                 *call,
+                      GOutputStream                 *stream,
+                      int                            fd,
+                      RestDownloadSyncPolicy         sync,
+                      GCancellable                  *cancellable,
+                      RestProxyCallDownloadCallback  progress,
+                      gpointer                       progress_data,
+                      GAsyncReadyCallback            callback,
+                      gpointer                       user_data)
+{
+  RestProxyCallPrivate *priv;
+  RestProxyCallDownloadClosure *closure;
+  SoupMessage *message;
+  GError *error = NULL;
+
+  priv = GET_PRIVATE (call);
+  g_assert (priv->proxy);
+
+  if (priv->cur_call_closure)
+  {
+    g_warning (G_STRLOC ": re-use of RestProxyCall %p, don't do this", call);
+    g_simple_async_report_error_in_idle (G_OBJECT (call), callback, user_data,
+                                         REST_PROXY_CALL_ERROR,
+                                         REST_PROXY_CALL_FAILED,
+                                         "Call already in progress");
+    return;
+  }
+
+  message = prepare_message (call, &error);
+  if (message == NULL)
+    {
+      g_simple_async_report_take_gerror_in_idle (G_OBJECT (call), callback,
+                                                 user_data, error);
+      return;
+    }
+
+  closure = g_slice_new0 (RestProxyCallDownloadClosure);
+  closure->call = g_object_ref (call);
+  closure->callback = callback;
+  closure->userdata = user_data;
+  closure->message = message;
+  closure->result = g_simple_async_result_new (G_OBJECT (call), callback,
+                                               user_data,
+                                               rest_proxy_call_download_to_stream_async);
+  closure->stream = stream ? g_object_ref (stream) : NULL;
+  closure->fd = fd;
+  closure->sync = sync;
+  closure->progress = progress;
+  closure->progress_data = progress_data;
+  closure->buffer = g_malloc (DOWNLOAD_BUFFER_SIZE);
+  closure->total = -1;
+
+  priv->cur_call_closure = (RestProxyCallAsyncClosure *)closure;
+
+  /* Have the body handed to us as it arrives instead of accumulating it */
+  priv->body_func = _download_call_body_cb;
+  priv->body_data = closure;
+
+  g_signal_connect (message, "got-headers",
+                    G_CALLBACK (_download_call_got_headers_cb), closure);
+
+  if (cancellable != NULL)
+    {
+      priv->cancel_sig = g_signal_connect (cancellable, "cancelled",
+          G_CALLBACK (_call_message_call_cancelled_cb), call);
+      priv->cancellable = g_object_ref (cancellable);
+    }
+
+  _rest_proxy_queue_message (priv->proxy,
+                             message,
+                             _download_call_message_completed_cb,
+                             closure);
+}
+
+/**
+ * rest_proxy_call_download_to_stream_async:
+ * @call: The #RestProxyCall
+ * @stream: the #GOutputStream to write the response body to
+ * @sync: when to flush @stream
+ * @cancellable: (allow-none): an optional #GCancellable that can be used to
+ *   cancel the call, or %NULL
+ * @progress: (allow-none) (scope notified): a #RestProxyCallDownloadCallback
+ *   called as data is received, or %NULL
+ * @progress_data: (closure progress): data to pass to @progress
+ * @callback: (scope async): callback to call when the download is finished
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Asynchronously invoke @call, writing the body of the response to @stream as
+ * it arrives instead of collecting it into the payload, so that the memory
+ * used does not depend on the size of the response.  Data is written in
+ * blocks of at most 64 kilobytes.  @stream is not closed.
+ *
+ * Only the body of a successful response is written.  If the proxy decodes
+ * content, the decoded body is written.
+ *
+ * @progress is called with the number of bytes received so far and the total
+ * expected, or -1 if that is not known.  Since @stream can only be flushed,
+ * use rest_proxy_call_download_to_fd_async() if the data has to be synced to
+ * disk.
+ *
+ * Call rest_proxy_call_download_finish() from @callback to get the result.
+ */
+void
+rest_proxy_call_download_to_stream_async (RestProxyCall                 *call,
+                                          GOutputStream                 *stream,
+                                          RestDownloadSyncPolicy         sync,
+                                          GCancellable                  *cancellable,
+                                          RestProxyCallDownloadCallback  progress,
+                                          gpointer                       progress_data,
+                                          GAsyncReadyCallback            callback,
+                                          gpointer                       user_data)
+{
+  g_return_if_fail (REST_IS_PROXY_CALL (call));
+  g_return_if_fail (G_IS_OUTPUT_STREAM (stream));
+
+  _call_download_async (call, stream, -1, sync, cancellable,
+                        progress, progress_data, callback, user_data);
+}
+
+/**
+ * rest_proxy_call_download_to_fd_async:
+ * @call: The #RestProxyCall
+ * @fd: the file descriptor to write the response body to
+ * @sync: when to sync @fd to disk
+ * @cancellable: (allow-none): an optional #GCancellable that can be used to
+ *   cancel the call, or %NULL
+ * @progress: (allow-none) (scope notified): a #RestProxyCallDownloadCallback
+ *   called as data is received, or %NULL
+ * @progress_data: (closure progress): data to pass to @progress
+ * @callback: (scope async): callback to call when the download is finished
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Like rest_proxy_call_download_to_stream_async(), but writing to the file
+ * descriptor @fd, which is synced to disk according to @sync.  @fd is not
+ * closed.
+ */
+void
+rest_proxy_call_download_to_fd_async (RestProxyCall                 *call,
+                                      int                            fd,
+                                      RestDownloadSyncPolicy         sync,
+                                      GCancellable                  *cancellable,
+                                      RestProxyCallDownloadCallback  progress,
+                                      gpointer                       progress_data,
+                                      GAsyncReadyCallback            callback,
+                                      gpointer                       user_data)
+{
+  g_return_if_fail (REST_IS_PROXY_CALL (call));
+  g_return_if_fail (fd >= 0);
+
+  _call_download_async (call, NULL, fd, sync, cancellable,
+                        progress, progress_data, callback, user_data);
+}
+
+/**
+ * rest_proxy_call_download_ranges_to_fd_async:
+ * @call: The #RestProxyCall
+ * @fd: the file descriptor to write the resource to
+ * @n_ranges: the maximum number of ranges to download at once
+ * @sync: when to sync @fd to disk
+ * @cancellable: (allow-none): an optional #GCancellable that can be used to
+ *   cancel the call, or %NULL
+ * @progress: (allow-none) (scope notified): a #RestProxyCallDownloadCallback
+ *   called as data is received, or %NULL
+ * @progress_data: (closure progress): data to pass to @progress
+ * @callback: (scope async): callback to call when the download is finished
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Download the resource named by @call, which must be a GET, into @fd by
+ * splitting it into up to @n_ranges byte ranges that are requested at the same
+ * time.  This is faster than rest_proxy_call_download_to_fd_async() when the
+ * throughput of a single connection is limited, for example by the server.
+ *
+ * The ranges are written at their offsets in @fd, which must be a regular file
+ * opened for writing; it is set to the size of the resource first.  A range
+ * that fails because of a network or server error is retried from where it
+ * got to, after a delay that doubles with each attempt.  If the server does not
+ * support range requests the resource is downloaded over a single connection
+ * as usual, replacing anything already in @fd.
+ *
+ * Every range is requested with a copy of the same message, so this can't be
+ * used with calls whose class has a #RestProxyCallClass.prepare function, such
+ * as the ones that sign each request; the download then fails with
+ * %REST_PROXY_CALL_FAILED.
+ *
+ * The content is never decoded, since ranges are of the encoded body.  How
+ * many ranges can really be in flight at once is limited by the
+ * #RestProxy:max-conns-per-host property of the proxy.  Unlike the other
+ * download functions, the response headers and status of @call are not set.
+ *
+ * Call rest_proxy_call_download_finish() from @callback to get the result.
+ */
+void
+rest_proxy_call_download_ranges_to_fd_async (RestProxyCall                 *call,
+                                             int                            fd,
+                                             guint                          n_ranges,
+                                             RestDownloadSyncPolicy         sync,
+                                             GCancellable                  *cancellable,
+                                             RestProxyCallDownloadCallback  progress,
+                                             gpointer                       progress_data,
+                                             GAsyncReadyCallback            callback,
+                                             gpointer                       user_data)
+{
+  RestProxyCallPrivate *priv;
+  GSimpleAsyncResult *result;
+  SoupMessage *message;
+  GError *error = NULL;
+
+  g_return_if_fail (REST_IS_PROXY_CALL (call));
+  g_return_if_fail (fd >= 0);
+
+  priv = GET_PRIVATE (call);
+  g_assert (priv->proxy);
+
+  if (priv->method && g_ascii_strcasecmp (priv->method, "GET") != 0)
+  {
+    g_simple_async_report_error_in_idle (G_OBJECT (call), callback, user_data,
+                                         REST_PROXY_CALL_ERROR,
+                                         REST_PROXY_CALL_FAILED,
+                                         "Only GET can be downloaded in ranges");
+    return;
+  }
+
+  /* Each range request is a copy of one prepared message, which would replay
+   * anything a prepare function added to it, such as a signature */
+  if (REST_PROXY_CALL_GET_CLASS (call)->prepare)
+  {
+    g_simple_async_report_error_in_idle (G_OBJECT (call), callback, user_data,
+                                         REST_PROXY_CALL_ERROR,
+                                         REST_PROXY_CALL_FAILED,
+                                         "Calls that are signed can't be downloaded in ranges");
+    return;
+  }
+
+  message = prepare_message (call, &error);
+  if (message == NULL)
+    {
+      g_simple_async_report_take_gerror_in_idle (G_OBJECT (call), callback,
+                                                 user_data, error);
+      return;
+    }
+
+  result = g_simple_async_result_new (G_OBJECT (call), callback, user_data,
+                                      rest_proxy_call_download_to_stream_async);
+
+  _rest_range_download_start (priv->proxy, call, message, fd, n_ranges, sync,
+                              cancellable, progress, progress_data, result);
+
+  g_object_unref (result);
+  g_object_unref (message);
+}
+
+/**
+ * rest_proxy_call_download_finish:
+ * @call: a #RestProxyCall
+ * @result: the result from the #GAsyncReadyCallback
+ * @error: optional #GError
+ *
+ * Finish a download started with rest_proxy_call_download_to_stream_async(),
+ * rest_proxy_call_download_to_fd_async() or
+ * rest_proxy_call_download_ranges_to_fd_async().
+ *
+ * Returns: %TRUE if the whole body was received and written
+ */
+gboolean
+rest_proxy_call_download_finish (RestProxyCall  *call,
+                                 GAsyncResult   *result,
+                                 GError        **error)
+{
+  GSimpleAsyncResult *simple;
+
+  g_return_val_if_fail (REST_IS_PROXY_CALL (call), FALSE);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (result), FALSE);
+
+  simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+        G_OBJECT (call), rest_proxy_call_download_to_stream_async), FALSE);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return FALSE;
+
+  return g_simple_async_result_get_op_res_gboolean (simple);
+}
+
 /**
  * rest_proxy_call_cancel: (skip):
  * @call: The #RestProxyCall
@@ -1274,12 +2992,17 @@ rest_proxy_call_cancel (RestProxyCall *call)
       g_clear_object (&priv->cancellable);
     }
 
-  if (closure)
+  if (closure && closure->message)
   {
     /* This will cause the _call_message_completed_cb to be fired which will
      * tidy up the closure and so forth */
     _rest_proxy_cancel_message (priv->proxy, closure->message);
   }
+  else if (closure && priv->retry_source)
+  {
+    /* A resumable upload waiting to try again */
+    _resumable_cancel (call);
+  }
 
   return TRUE;
 }
@@ -1469,6 +3192,50 @@ rest_proxy_call_get_payload (RestProxyCall *call)
   return priv->payload;
 }
 
+/**
+ * rest_proxy_call_get_payload_bytes:
+ * @call: The #RestProxyCall
+ *
+ * Get the return payload as a #GBytes, without copying it.  The #GBytes holds
+ * on to the payload, whether it is in memory or a mapped temporary file, so
+ * it stays valid after @call is run again or freed.
+ *
+ * Returns: (transfer full): the payload, or %NULL if there is none.  Free
+ * with g_bytes_unref().
+ */
+GBytes *
+rest_proxy_call_get_payload_bytes (RestProxyCall *call)
+{
+  RestProxyCallPrivate *priv;
+  PayloadMapping *mapping;
+
+  g_return_val_if_fail (REST_IS_PROXY_CALL (call), NULL);
+
+  priv = GET_PRIVATE (call);
+
+  if (priv->payload == NULL)
+    return NULL;
+
+  if (priv->payload_bytes == NULL) {
+    if (priv->payload_mapped) {
+      mapping = g_slice_new (PayloadMapping);
+      mapping->contents = priv->payload;
+      mapping->mapped = priv->payload_mapped;
+      priv->payload_bytes = g_bytes_new_with_free_func (priv->payload,
+                                                        priv->length,
+                                                        _call_unmap_payload,
+                                                        mapping);
+    } else {
+      priv->payload_bytes = g_bytes_new_with_free_func (priv->payload,
+                                                        priv->length,
+                                                        _rest_buffer_pool_free,
+                                                        priv->payload);
+    }
+  }
+
+  return g_bytes_ref (priv->payload_bytes);
+}
+
 /**
  * rest_proxy_call_get_status_code:
  * @call: The #RestProxyCall
@@ -98,6 +98,20 @@ typedef enum {
 
 GQuark rest_proxy_call_error_quark (void);
 
+/**
+ * RestContentCoding:
+ * @REST_CONTENT_CODING_IDENTITY: the body is sent as it is
+ * @REST_CONTENT_CODING_GZIP: the body is compressed with gzip
+ * @REST_CONTENT_CODING_DEFLATE: the body is compressed with zlib's deflate
+ *
+ * The content codings a request body can be compressed with.
+ */
+typedef enum {
+  REST_CONTENT_CODING_IDENTITY,
+  REST_CONTENT_CODING_GZIP,
+  REST_CONTENT_CODING_DEFLATE
+} RestContentCoding;
+
 GType rest_proxy_call_get_type (void);
 
 /* Functions for dealing with request */
@@ -148,6 +162,10 @@ void rest_proxy_call_remove_param (RestProxyCall *call,
 
 RestParams *rest_proxy_call_get_params (RestProxyCall *call);
 
+void rest_proxy_call_set_request_compression (RestProxyCall     *call,
+                                              RestContentCoding  coding,
+                                              gsize              threshold);
+
 gboolean rest_proxy_call_run (RestProxyCall *call,
                               GMainLoop    **loop,
                               GError       **error);
@@ -197,6 +215,68 @@ gboolean rest_proxy_call_upload (RestProxyCall                *call,
                                  gpointer                      userdata,
                                  GError                      **error);
 
+gboolean rest_proxy_call_upload_resumable (RestProxyCall                *call,
+                                           GInputStream                 *stream,
+                                           goffset                       length,
+                                           const gchar                  *content_type,
+                                           gsize                         chunk_size,
+                                           RestProxyCallUploadCallback   callback,
+                                           GObject                      *weak_object,
+                                           gpointer                      userdata,
+                                           GError                      **error);
+
+/**
+ * RestDownloadSyncPolicy:
+ * @REST_DOWNLOAD_SYNC_NONE: never sync, leaving it to the operating system
+ * @REST_DOWNLOAD_SYNC_ON_COMPLETE: sync once the whole body has been written
+ * @REST_DOWNLOAD_SYNC_PERIODIC: sync after every few megabytes written, and
+ *   once the whole body has been written
+ *
+ * When a download should make sure the data written so far is on disk.
+ */
+typedef enum {
+  REST_DOWNLOAD_SYNC_NONE,
+  REST_DOWNLOAD_SYNC_ON_COMPLETE,
+  REST_DOWNLOAD_SYNC_PERIODIC
+} RestDownloadSyncPolicy;
+
+typedef void (*RestProxyCallDownloadCallback) (RestProxyCall *call,
+                                               goffset        received,
+                                               goffset        total,
+                                               gpointer       userdata);
+
+void rest_proxy_call_download_to_stream_async (RestProxyCall                 *call,
+                                               GOutputStream                 *stream,
+                                               RestDownloadSyncPolicy         sync,
+                                               GCancellable                  *cancellable,
+                                               RestProxyCallDownloadCallback  progress,
+                                               gpointer                       progress_data,
+                                               GAsyncReadyCallback            callback,
+                                               gpointer                       user_data);
+
+void rest_proxy_call_download_to_fd_async (RestProxyCall                 *call,
+                                           int                            fd,
+                                           RestDownloadSyncPolicy         sync,
+                                           GCancellable                  *cancellable,
+                                           RestProxyCallDownloadCallback  progress,
+                                           gpointer                       progress_data,
+                                           GAsyncReadyCallback            callback,
+                                           gpointer                       user_data);
+
+void rest_proxy_call_download_ranges_to_fd_async (RestProxyCall                 *call,
+                                                  int                            fd,
+                                                  guint                          n_ranges,
+                                                  RestDownloadSyncPolicy         sync,
+                                                  GCancellable                  *cancellable,
+                                                  RestProxyCallDownloadCallback  progress,
+                                                  gpointer                       progress_data,
+                                                  GAsyncReadyCallback            callback,
+                                                  gpointer                       user_data);
+
+gboolean rest_proxy_call_download_finish (RestProxyCall  *call,
+                                          GAsyncResult   *result,
+                                          GError        **error);
+
 gboolean rest_proxy_call_cancel (RestProxyCall *call);
 
 gboolean rest_proxy_call_sync (RestProxyCall *call, GError **error_out);
@@ -210,6 +290,7 @@ GHashTable *rest_proxy_call_get_response_headers (RestProxyCall *call);
 
 goffset rest_proxy_call_get_payload_length (RestProxyCall *call);
 const gchar *rest_proxy_call_get_payload (RestProxyCall *call);
+GBytes *rest_proxy_call_get_payload_bytes (RestProxyCall *call);
 guint rest_proxy_call_get_status_code (RestProxyCall *call);
 const gchar *rest_proxy_call_get_status_message (RestProxyCall *call);
 gboolean rest_proxy_call_serialize_params (RestProxyCall *call,
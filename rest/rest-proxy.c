@@ -32,6 +32,7 @@
 #include "rest-proxy-auth-private.h"
 #include "rest-proxy.h"
 #include "rest-private.h"
+#include "rest-part-upload.h"
 
 G_DEFINE_TYPE (RestProxy, rest_proxy, G_TYPE_OBJECT)
 
@@ -51,6 +52,14 @@ struct _RestProxyPrivate {
   SoupSession *session_sync;
   gboolean disable_cookies;
   char *ssl_ca_file;
+  gboolean decode_content;
+  gint64 expect_continue_threshold;
+  gint64 response_spill_threshold;
+  gint64 max_response_size;
+  RestBufferPool *buffer_pool;
+  RestProxyStats stats;
+  /* Signs or otherwise changes requests, or NULL */
+  RestProxyPrepareFunc prepare;
 };
 
 enum
@@ -63,7 +72,12 @@ enum
   PROP_USERNAME,
   PROP_PASSWORD,
   PROP_SSL_STRICT,
-  PROP_SSL_CA_FILE
+  PROP_SSL_CA_FILE,
+  PROP_DECODE_CONTENT,
+  PROP_MAX_CONNS_PER_HOST,
+  PROP_EXPECT_CONTINUE_THRESHOLD,
+  PROP_RESPONSE_SPILL_THRESHOLD,
+  PROP_MAX_RESPONSE_SIZE
 };
 
 enum {
@@ -73,6 +87,12 @@ enum {
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* Protects the statistics of every proxy */
+G_LOCK_DEFINE_STATIC (stats);
+
+/* Set on messages sent with the synchronous session */
+#define SYNC_MESSAGE_QUARK (g_quark_from_static_string ("rest-proxy-sync-message"))
+
 
 static gboolean _rest_proxy_simple_run_valist (RestProxy *proxy, 
                                                char     **payload, 
@@ -129,6 +149,26 @@ rest_proxy_get_property (GObject   *object,
     case PROP_SSL_CA_FILE:
       g_value_set_string (value, priv->ssl_ca_file);
       break;
+    case PROP_DECODE_CONTENT:
+      g_value_set_boolean (value, priv->decode_content);
+      break;
+    case PROP_MAX_CONNS_PER_HOST: {
+      int max_conns;
+      g_object_get (G_OBJECT(priv->session),
+                    SOUP_SESSION_MAX_CONNS_PER_HOST, &max_conns,
+                    NULL);
+      g_value_set_int (value, max_conns);
+      break;
+    }
+    case PROP_EXPECT_CONTINUE_THRESHOLD:
+      g_value_set_int64 (value, priv->expect_continue_threshold);
+      break;
+    case PROP_RESPONSE_SPILL_THRESHOLD:
+      g_value_set_int64 (value, priv->response_spill_threshold);
+      break;
+    case PROP_MAX_RESPONSE_SIZE:
+      g_value_set_int64 (value, priv->max_response_size);
+      break;
 
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -186,6 +226,26 @@ rest_proxy_set_property (GObject      *object,
       g_free(priv->ssl_ca_file);
       priv->ssl_ca_file = g_value_dup_string (value);
       break;
+    case PROP_DECODE_CONTENT:
+      priv->decode_content = g_value_get_boolean (value);
+      break;
+    case PROP_MAX_CONNS_PER_HOST:
+      g_object_set (G_OBJECT(priv->session),
+                    SOUP_SESSION_MAX_CONNS_PER_HOST, g_value_get_int (value),
+                    NULL);
+      g_object_set (G_OBJECT(priv->session_sync),
+                    SOUP_SESSION_MAX_CONNS_PER_HOST, g_value_get_int (value),
+                    NULL);
+      break;
+    case PROP_EXPECT_CONTINUE_THRESHOLD:
+      priv->expect_continue_threshold = g_value_get_int64 (value);
+      break;
+    case PROP_RESPONSE_SPILL_THRESHOLD:
+      priv->response_spill_threshold = g_value_get_int64 (value);
+      break;
+    case PROP_MAX_RESPONSE_SIZE:
+      priv->max_response_size = g_value_get_int64 (value);
+      break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -283,6 +343,8 @@ rest_proxy_finalize (GObject *object)
   g_free (priv->password);
   g_free (priv->ssl_ca_file);
 
+  _rest_buffer_pool_unref (priv->buffer_pool);
+
   G_OBJECT_CLASS (rest_proxy_parent_class)->finalize (object);
 }
 
@@ -379,6 +441,102 @@ rest_proxy_class_init (RestProxyClass *klass)
                                    PROP_SSL_CA_FILE,
                                    pspec);
 
+  /**
+   * RestProxy:decode-content:
+   *
+   * Whether to advertise the supported content codings in the
+   * Accept-Encoding header and transparently decode compressed responses.
+   * The payload, and the data passed to continuous callbacks, is always the
+   * decoded content.
+   */
+  pspec = g_param_spec_boolean ("decode-content",
+                                "decode-content",
+                                "Whether to request and decode compressed responses",
+                                FALSE,
+                                G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+                                   PROP_DECODE_CONTENT,
+                                   pspec);
+
+  /**
+   * RestProxy:max-conns-per-host:
+   *
+   * The maximum number of connections that will be opened to a single host.
+   * Raise this to get more out of
+   * rest_proxy_call_download_ranges_to_fd_async().
+   */
+  pspec = g_param_spec_int ("max-conns-per-host",
+                            "max-conns-per-host",
+                            "The maximum number of connections to a host",
+                            1, G_MAXINT, 2,
+                            G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_CONNS_PER_HOST,
+                                   pspec);
+
+  /**
+   * RestProxy:expect-continue-threshold:
+   *
+   * The smallest request body, in bytes, that is sent with an
+   * "Expect: 100-continue" header, or -1 to never send one.  The body of such
+   * a request is only sent once the server has agreed to take it, so a
+   * request that is going to be refused, for example because the credentials
+   * have expired, is refused without uploading the body first.  Bodies of
+   * unknown length count as large.
+   *
+   * The server must support the header, which all HTTP/1.1 servers should.
+   */
+  pspec = g_param_spec_int64 ("expect-continue-threshold",
+                              "expect-continue-threshold",
+                              "The smallest request body to wait for 100 Continue before sending",
+                              -1, G_MAXINT64, -1,
+                              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+                                   PROP_EXPECT_CONTINUE_THRESHOLD,
+                                   pspec);
+
+  /**
+   * RestProxy:response-spill-threshold:
+   *
+   * The largest response body, in bytes, that is held in memory, or -1 for no
+   * limit.  Once a response grows past this it is moved to an unlinked
+   * temporary file, which is mapped into memory when the response is
+   * complete, so rest_proxy_call_get_payload() works as usual without the
+   * body taking up heap.  Smaller responses are not affected.
+   */
+  pspec = g_param_spec_int64 ("response-spill-threshold",
+                              "response-spill-threshold",
+                              "The largest response body to hold in memory",
+                              -1, G_MAXINT64, -1,
+                              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+                                   PROP_RESPONSE_SPILL_THRESHOLD,
+                                   pspec);
+
+  /**
+   * RestProxy:max-response-size:
+   *
+   * The largest response body, in bytes, that calls will accept, or -1 for
+   * no limit.  A response which announces a larger Content-Length is
+   * abandoned as soon as its headers arrive, and one which grows larger while
+   * it is being read, either on the wire or once decoded, is abandoned at
+   * that point.  The call then fails with
+   * %REST_PROXY_ERROR_RESPONSE_TOO_LARGE and the bytes that were read are
+   * counted in #RestProxyStats.bytes_discarded.
+   *
+   * Responses that are passed on as they arrive, such as downloads and
+   * continuous calls, are never held in memory and are not limited.  Calls
+   * can override the limit with #RestProxyCall:max-response-size.
+   */
+  pspec = g_param_spec_int64 ("max-response-size",
+                              "max-response-size",
+                              "The largest response body to accept",
+                              -1, G_MAXINT64, -1,
+                              G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+                                   PROP_MAX_RESPONSE_SIZE,
+                                   pspec);
+
   /**
    * RestProxy::authenticate:
    * @proxy: the proxy
@@ -423,6 +581,12 @@ rest_proxy_init (RestProxy *self)
   priv->session = soup_session_async_new ();
   priv->session_sync = soup_session_sync_new ();
 
+  priv->expect_continue_threshold = -1;
+  priv->response_spill_threshold = -1;
+  priv->max_response_size = -1;
+
+  priv->buffer_pool = _rest_buffer_pool_new ();
+
 #ifdef REST_SYSTEM_CA_FILE
   /* with ssl-strict (defaults TRUE) setting ssl-ca-file forces all
    * certificates to be trusted */
@@ -577,6 +741,59 @@ _rest_proxy_new_call (RestProxy *proxy)
   return call;
 }
 
+/*
+ * Have @proxy prepare its requests with @func, which a subclass that signs or
+ * otherwise changes requests sets when it is initialised.  Its calls should
+ * be prepared with the same function, so that a #RestRequest made with
+ * @proxy is sent just as a call would be.
+ */
+void
+_rest_proxy_set_prepare_func (RestProxy            *proxy,
+                              RestProxyPrepareFunc  func)
+{
+  GET_PRIVATE (proxy)->prepare = func;
+}
+
+/*
+ * Whether requests made with @proxy can be prepared as its calls are: either
+ * it has a prepare function, or it makes plain #RestProxyCall objects.  A
+ * subclass with its own calls but no prepare function may sign them in a way
+ * that a #RestRequest can't.
+ */
+gboolean
+_rest_proxy_can_prepare (RestProxy *proxy)
+{
+  return GET_PRIVATE (proxy)->prepare != NULL ||
+    REST_PROXY_GET_CLASS (proxy)->new_call == _rest_proxy_new_call;
+}
+
+/* The function requests made with @proxy are prepared with, or %NULL */
+RestProxyPrepareFunc
+_rest_proxy_get_prepare_func (RestProxy *proxy)
+{
+  return GET_PRIVATE (proxy)->prepare;
+}
+
+/* Set the string parameter @name of @view, replacing any already set */
+void
+_rest_request_view_set_param (RestRequestView *view,
+                              const gchar     *name,
+                              const gchar     *value)
+{
+  rest_params_remove (view->params, name);
+  rest_params_add (view->params,
+                   rest_param_new_string (name, REST_MEMORY_COPY, value));
+}
+
+/* Set the header @name of @view, replacing any already set */
+void
+_rest_request_view_set_header (RestRequestView *view,
+                               const gchar     *name,
+                               const gchar     *value)
+{
+  g_hash_table_replace (view->headers, g_strdup (name), g_strdup (value));
+}
+
 /**
  * rest_proxy_new_call:
  * @proxy: the #RestProxy
@@ -593,6 +810,315 @@ rest_proxy_new_call (RestProxy *proxy)
   return proxy_class->new_call (proxy);
 }
 
+G_DEFINE_BOXED_TYPE (RestProxyStats, rest_proxy_stats,
+                     rest_proxy_stats_copy, rest_proxy_stats_free)
+
+/**
+ * rest_proxy_stats_copy:
+ * @stats: a #RestProxyStats
+ *
+ * Returns: (transfer full): a copy of @stats.
+ */
+RestProxyStats *
+rest_proxy_stats_copy (RestProxyStats *stats)
+{
+  return g_slice_dup (RestProxyStats, stats);
+}
+
+/**
+ * rest_proxy_stats_free:
+ * @stats: a #RestProxyStats
+ *
+ * Free @stats.
+ */
+void
+rest_proxy_stats_free (RestProxyStats *stats)
+{
+  g_slice_free (RestProxyStats, stats);
+}
+
+/**
+ * rest_proxy_get_stats:
+ * @proxy: the #RestProxy
+ *
+ * Get a snapshot of the transfer statistics of all calls made with @proxy.
+ *
+ * Returns: (transfer full): a new #RestProxyStats, free with
+ * rest_proxy_stats_free().
+ */
+RestProxyStats *
+rest_proxy_get_stats (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+  RestProxyStats *stats;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), NULL);
+
+  priv = GET_PRIVATE (proxy);
+
+  G_LOCK (stats);
+  stats = rest_proxy_stats_copy (&priv->stats);
+  G_UNLOCK (stats);
+
+  _rest_buffer_pool_get_stats (priv->buffer_pool,
+                               &stats->pool_hits,
+                               &stats->pool_misses,
+                               &stats->pool_resident_bytes);
+
+  return stats;
+}
+
+/**
+ * rest_proxy_reset_stats:
+ * @proxy: the #RestProxy
+ *
+ * Reset all of the transfer statistics of @proxy to zero.
+ */
+void
+rest_proxy_reset_stats (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+
+  priv = GET_PRIVATE (proxy);
+
+  G_LOCK (stats);
+  memset (&priv->stats, 0, sizeof (RestProxyStats));
+  G_UNLOCK (stats);
+
+  _rest_buffer_pool_reset_stats (priv->buffer_pool);
+}
+
+void
+_rest_proxy_account_response (RestProxy *proxy,
+                              goffset    wire_bytes,
+                              goffset    bytes)
+{
+  RestProxyPrivate *priv;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+
+  priv = GET_PRIVATE (proxy);
+
+  G_LOCK (stats);
+  priv->stats.requests++;
+  priv->stats.wire_bytes_received += wire_bytes;
+  priv->stats.bytes_received += bytes;
+  G_UNLOCK (stats);
+}
+
+void
+_rest_proxy_account_discarded (RestProxy *proxy,
+                               goffset    wire_bytes)
+{
+  RestProxyPrivate *priv;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+
+  priv = GET_PRIVATE (proxy);
+
+  G_LOCK (stats);
+  priv->stats.bytes_discarded += wire_bytes;
+  G_UNLOCK (stats);
+}
+
+/* Parts are this big unless asked otherwise */
+#define PART_UPLOAD_SIZE (8 * 1024 * 1024)
+
+/* How many parts are sent at once unless asked otherwise */
+#define PART_UPLOAD_PARALLEL 4
+
+/**
+ * rest_proxy_upload_parts_async:
+ * @proxy: a #RestProxy
+ * @stream: the #GInputStream to upload
+ * @length: the number of bytes to upload, or -1 to upload to the end of
+ *   @stream
+ * @part_size: the size of each part, or 0 for the default of 8 megabytes
+ * @max_parallel: the most parts to send at once, or 0 for the default of 4
+ * @funcs: the functions making the calls of the upload
+ * @funcs_data: data to pass to @funcs
+ * @progress: (allow-none) (scope notified): a #RestProxyUploadProgressCallback
+ *   called as data is sent, or %NULL
+ * @progress_data: (closure progress): data to pass to @progress
+ * @cancellable: (allow-none): an optional #GCancellable, or %NULL
+ * @callback: (scope async): callback to call when the upload is finished
+ * @user_data: (closure callback): user data for @callback
+ *
+ * Upload @stream as a series of parts sent at the same time, the way object
+ * stores such as Amazon S3 take large objects.
+ *
+ * The stream is read a part at a time as there is room to send another, so at
+ * most @max_parallel parts are held in memory.  Each part is sent with a call
+ * made by the @new_part_call function of @funcs, using the connections of
+ * @proxy, so #RestProxy:max-conns-per-host should be at least @max_parallel.
+ * A part that fails because of a network or server error is sent again with a
+ * new call, a few times, after a short delay.  When every part has been sent,
+ * the call made by @new_complete_call is invoked with the identifiers the
+ * server returned for them.
+ *
+ * @progress is called with the number of bytes of every part sent so far,
+ * which may go down if a part has to be sent again.  If the upload fails,
+ * the parts already sent are left on the server.
+ *
+ * Call rest_proxy_upload_parts_finish() from @callback to get the result.
+ */
+void
+rest_proxy_upload_parts_async (RestProxy                       *proxy,
+                               GInputStream                    *stream,
+                               goffset                          length,
+                               gsize                            part_size,
+                               guint                            max_parallel,
+                               const RestProxyPartUploadFuncs  *funcs,
+                               gpointer                         funcs_data,
+                               RestProxyUploadProgressCallback  progress,
+                               gpointer                         progress_data,
+                               GCancellable                    *cancellable,
+                               GAsyncReadyCallback              callback,
+                               gpointer                         user_data)
+{
+  GSimpleAsyncResult *result;
+
+  g_return_if_fail (REST_IS_PROXY (proxy));
+  g_return_if_fail (G_IS_INPUT_STREAM (stream));
+  g_return_if_fail (funcs != NULL);
+  g_return_if_fail (funcs->new_part_call != NULL);
+  g_return_if_fail (funcs->new_complete_call != NULL);
+
+  result = g_simple_async_result_new (G_OBJECT (proxy), callback, user_data,
+                                      rest_proxy_upload_parts_async);
+
+  _rest_part_upload_start (proxy, stream, length,
+                           part_size ? part_size : PART_UPLOAD_SIZE,
+                           max_parallel ? max_parallel : PART_UPLOAD_PARALLEL,
+                           funcs, funcs_data, progress, progress_data,
+                           cancellable, result);
+
+  g_object_unref (result);
+}
+
+/**
+ * rest_proxy_upload_parts_finish:
+ * @proxy: a #RestProxy
+ * @result: the result from the #GAsyncReadyCallback
+ * @error: optional #GError
+ *
+ * Finish an upload started with rest_proxy_upload_parts_async().
+ *
+ * Returns: (transfer full): the completed call that finished the upload, to
+ *   get the response from, or %NULL on error
+ */
+RestProxyCall *
+rest_proxy_upload_parts_finish (RestProxy     *proxy,
+                                GAsyncResult  *result,
+                                GError       **error)
+{
+  GSimpleAsyncResult *simple;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), NULL);
+  g_return_val_if_fail (G_IS_SIMPLE_ASYNC_RESULT (result), NULL);
+
+  simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+        G_OBJECT (proxy), rest_proxy_upload_parts_async), NULL);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  return g_object_ref (g_simple_async_result_get_op_res_gpointer (simple));
+}
+
+gboolean
+_rest_proxy_get_decode_content (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), FALSE);
+
+  priv = GET_PRIVATE (proxy);
+
+  return priv->decode_content;
+}
+
+gint64
+_rest_proxy_get_expect_continue_threshold (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), -1);
+
+  priv = GET_PRIVATE (proxy);
+
+  return priv->expect_continue_threshold;
+}
+
+gint64
+_rest_proxy_get_response_spill_threshold (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), -1);
+
+  priv = GET_PRIVATE (proxy);
+
+  return priv->response_spill_threshold;
+}
+
+/*
+ * The URL to invoke @function, which may be %NULL, on @proxy.  Returns %NULL
+ * if the proxy requires binding and has not been bound.
+ */
+gchar *
+_rest_proxy_build_url (RestProxy   *proxy,
+                       const gchar *function)
+{
+  const gchar *bound_url;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), NULL);
+
+  bound_url = _rest_proxy_get_bound_url (proxy);
+
+  if (_rest_proxy_get_binding_required (proxy) && !bound_url)
+  {
+    g_critical (G_STRLOC ": URL requires binding and is unbound");
+    return NULL;
+  }
+
+  if (function == NULL)
+    return g_strdup (bound_url);
+
+  if (g_str_has_suffix (bound_url, "/"))
+    return g_strconcat (bound_url, function, NULL);
+  else
+    return g_strconcat (bound_url, "/", function, NULL);
+}
+
+RestBufferPool *
+_rest_proxy_get_buffer_pool (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), NULL);
+
+  priv = GET_PRIVATE (proxy);
+
+  return priv->buffer_pool;
+}
+
+gint64
+_rest_proxy_get_max_response_size (RestProxy *proxy)
+{
+  RestProxyPrivate *priv;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), -1);
+
+  priv = GET_PRIVATE (proxy);
+
+  return priv->max_response_size;
+}
+
 gboolean
 _rest_proxy_get_binding_required (RestProxy *proxy)
 {
@@ -710,6 +1236,18 @@ _rest_proxy_queue_message (RestProxy   *proxy,
 void
 _rest_proxy_cancel_message (RestProxy   *proxy,
                             SoupMessage *message)
+{
+  _rest_proxy_abort_message (proxy, message, SOUP_STATUS_CANCELLED);
+}
+
+/*
+ * Stop processing @message, which may have been sent with either the
+ * asynchronous or the synchronous session, and complete it with @status.
+ */
+void
+_rest_proxy_abort_message (RestProxy   *proxy,
+                           SoupMessage *message,
+                           guint        status)
 {
   RestProxyPrivate *priv;
 
@@ -717,9 +1255,11 @@ _rest_proxy_cancel_message (RestProxy   *proxy,
   g_return_if_fail (SOUP_IS_MESSAGE (message));
 
   priv = GET_PRIVATE (proxy);
-  soup_session_cancel_message (priv->session,
-                               message,
-                               SOUP_STATUS_CANCELLED);
+
+  if (g_object_get_qdata (G_OBJECT (message), SYNC_MESSAGE_QUARK))
+    soup_session_cancel_message (priv->session_sync, message, status);
+  else
+    soup_session_cancel_message (priv->session, message, status);
 }
 
 guint
@@ -733,5 +1273,8 @@ _rest_proxy_send_message (RestProxy   *proxy,
 
   priv = GET_PRIVATE (proxy);
 
+  g_object_set_qdata (G_OBJECT (message), SYNC_MESSAGE_QUARK,
+                      GINT_TO_POINTER (TRUE));
+
   return soup_session_send_message (priv->session_sync, message);
 }
@@ -99,6 +99,7 @@ typedef enum {
   REST_PROXY_ERROR_SSL,
   REST_PROXY_ERROR_IO,
   REST_PROXY_ERROR_FAILED,
+  REST_PROXY_ERROR_RESPONSE_TOO_LARGE,
 
   REST_PROXY_ERROR_HTTP_MULTIPLE_CHOICES                = 300,
   REST_PROXY_ERROR_HTTP_MOVED_PERMANENTLY               = 301,
@@ -136,6 +137,42 @@ typedef enum {
 
 GQuark rest_proxy_error_quark (void);
 
+#define REST_TYPE_PROXY_STATS (rest_proxy_stats_get_type ())
+
+/**
+ * RestProxyStats:
+ * @requests: the number of requests that have completed
+ * @wire_bytes_received: the number of response body bytes read from the
+ * network, before any content decoding
+ * @bytes_received: the number of response body bytes after content decoding
+ * @bytes_discarded: the number of response body bytes read from the network
+ * and then thrown away because the response was larger than the
+ * #RestProxy:max-response-size
+ * @pool_hits: the number of response buffers that were reused from the
+ * proxy's buffer pool
+ * @pool_misses: the number of response buffers that had to be allocated
+ * @pool_resident_bytes: the memory currently held idle in the buffer pool
+ *
+ * A snapshot of the transfer statistics of a #RestProxy.  Response payloads
+ * are kept in buffers from a pool owned by the proxy, and returned to it when
+ * the call is freed, so that polling the same resources again and again does
+ * not keep allocating memory.
+ */
+typedef struct {
+  guint64 requests;
+  guint64 wire_bytes_received;
+  guint64 bytes_received;
+  guint64 bytes_discarded;
+  guint64 pool_hits;
+  guint64 pool_misses;
+  guint64 pool_resident_bytes;
+} RestProxyStats;
+
+GType rest_proxy_stats_get_type (void) G_GNUC_CONST;
+
+RestProxyStats *rest_proxy_stats_copy (RestProxyStats *stats);
+void rest_proxy_stats_free (RestProxyStats *stats);
+
 GType rest_proxy_get_type (void);
 
 RestProxy *rest_proxy_new (const gchar *url_format, 
@@ -159,6 +196,67 @@ const gchar *rest_proxy_get_user_agent (RestProxy *proxy);
 
 RestProxyCall *rest_proxy_new_call (RestProxy *proxy);
 
+RestProxyStats *rest_proxy_get_stats (RestProxy *proxy);
+void rest_proxy_reset_stats (RestProxy *proxy);
+
+/**
+ * RestProxyPartUploadFuncs:
+ * @new_part_call: make the call that uploads part @part_number, counting from
+ *   one.  The data of the part is sent as its body, so any parameters go in
+ *   the query string and must all be strings, or the upload fails.
+ * @get_part_id: get the identifier of a part from its completed call, or %NULL
+ *   to use the ETag response header
+ * @new_complete_call: make the call that finishes the upload, given the
+ *   %NULL-terminated identifiers of every part in order
+ *
+ * The functions which make the calls of a part based upload with
+ * rest_proxy_upload_parts_async().  Each is passed the data given with them.
+ */
+typedef struct {
+  RestProxyCall *(*new_part_call) (RestProxy *proxy,
+                                   guint      part_number,
+                                   gpointer   user_data);
+  gchar *(*get_part_id) (RestProxy     *proxy,
+                         RestProxyCall *call,
+                         guint          part_number,
+                         gpointer       user_data);
+  RestProxyCall *(*new_complete_call) (RestProxy          *proxy,
+                                       const gchar * const *part_ids,
+                                       guint               n_parts,
+                                       gpointer            user_data);
+} RestProxyPartUploadFuncs;
+
+/**
+ * RestProxyUploadProgressCallback:
+ * @proxy: the #RestProxy
+ * @uploaded: the number of bytes sent so far
+ * @total: the number of bytes to send, or -1 if not known
+ * @user_data: the data passed with the callback
+ *
+ * Reports the progress of rest_proxy_upload_parts_async().
+ */
+typedef void (*RestProxyUploadProgressCallback) (RestProxy *proxy,
+                                                 goffset    uploaded,
+                                                 goffset    total,
+                                                 gpointer   user_data);
+
+void rest_proxy_upload_parts_async (RestProxy                       *proxy,
+                                    GInputStream                    *stream,
+                                    goffset                          length,
+                                    gsize                            part_size,
+                                    guint                            max_parallel,
+                                    const RestProxyPartUploadFuncs  *funcs,
+                                    gpointer                         funcs_data,
+                                    RestProxyUploadProgressCallback  progress,
+                                    gpointer                         progress_data,
+                                    GCancellable                    *cancellable,
+                                    GAsyncReadyCallback              callback,
+                                    gpointer                         user_data);
+
+RestProxyCall *rest_proxy_upload_parts_finish (RestProxy     *proxy,
+                                               GAsyncResult  *result,
+                                               GError       **error);
+
 G_GNUC_NULL_TERMINATED
 gboolean rest_proxy_simple_run (RestProxy *proxy, 
                                 gchar    **payload, 
@@ -0,0 +1,541 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rest-private.h"
+#include "rest-proxy-call-private.h"
+#include "rest-range-download.h"
+
+/*
+ * Downloads a resource as several byte ranges fetched concurrently, each
+ * written into a file at its own offset.
+ *
+ * A first request asks for just the first byte, which tells us the size of
+ * the resource and whether the server supports ranges at all.  If it doesn't,
+ * the full response to that request is simply written out.  Otherwise the rest
+ * of the file is split into ranges which are all queued at once, so they are
+ * spread over as many connections as the session allows.  A range that fails
+ * is retried from the last byte written, a few times and after a growing
+ * delay, before the whole download is given up.
+ *
+ * Every range request is a copy of the one message prepared by the call, so
+ * calls that sign each request can't be downloaded like this; that is checked
+ * by the caller.
+ */
+
+/* Ranges are not made smaller than this */
+#define RANGE_MIN_SIZE (1024 * 1024)
+
+/* How many times each range is retried */
+#define RANGE_MAX_RETRIES 3
+
+/* Milliseconds before the first retry of a range, doubled for each one after */
+#define RANGE_RETRY_DELAY 250
+
+typedef struct _RestRangeDownload RestRangeDownload;
+
+typedef struct {
+  RestRangeDownload *download;
+  SoupMessage *message;
+  /* The next byte to write, and the last byte of the range or -1 if the
+   * response is the whole resource */
+  goffset start;
+  goffset end;
+  guint retries;
+  /* The timeout that will retry the range, or 0 */
+  guint retry_source;
+  gboolean probe;
+  /* Whether the current response is the data we asked for */
+  gboolean writing;
+  goffset written;
+} Range;
+
+struct _RestRangeDownload {
+  RestProxy *proxy;
+  RestProxyCall *call;
+  SoupMessage *template;
+  int fd;
+  guint n_ranges;
+  RestDownloadSyncPolicy sync;
+  GCancellable *cancellable;
+  gulong cancel_id;
+  RestProxyCallDownloadCallback progress;
+  gpointer progress_data;
+  GSimpleAsyncResult *result;
+
+  GPtrArray *ranges;
+  guint pending;
+  goffset total;
+  goffset received;
+  GError *error;
+};
+
+static void range_queue (Range *range);
+
+static void
+copy_header (const char *name,
+             const char *value,
+             gpointer    user_data)
+{
+  soup_message_headers_append (user_data, name, value);
+}
+
+static void
+download_free (RestRangeDownload *download)
+{
+  if (download->cancellable) {
+    g_signal_handler_disconnect (download->cancellable, download->cancel_id);
+    g_object_unref (download->cancellable);
+  }
+
+  g_ptr_array_free (download->ranges, TRUE);
+  g_clear_error (&download->error);
+  g_object_unref (download->template);
+  g_object_unref (download->result);
+  g_object_unref (download->call);
+  g_object_unref (download->proxy);
+
+  g_slice_free (RestRangeDownload, download);
+}
+
+static void
+set_error_from_errno (GError **error, int errsv)
+{
+  g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                       g_strerror (errsv));
+}
+
+static void
+download_finish (RestRangeDownload *download)
+{
+  GError *error = NULL;
+
+  if (download->error == NULL && download->sync != REST_DOWNLOAD_SYNC_NONE) {
+#ifdef G_OS_UNIX
+    if (fsync (download->fd) < 0)
+      set_error_from_errno (&error, errno);
+#endif
+  }
+
+  if (download->error) {
+    g_simple_async_result_set_from_error (download->result, download->error);
+  } else if (error) {
+    g_simple_async_result_take_error (download->result, error);
+  } else {
+    g_simple_async_result_set_op_res_gboolean (download->result, TRUE);
+  }
+
+  g_simple_async_result_complete (download->result);
+
+  download_free (download);
+}
+
+/* Drop a reference held by a range in flight, finishing the download with the
+ * last one */
+static void
+download_release (RestRangeDownload *download)
+{
+  if (--download->pending == 0)
+    download_finish (download);
+}
+
+/* Record the first error, and stop every range still in progress */
+static void
+download_fail (RestRangeDownload *download,
+               GError            *error)
+{
+  Range *range;
+  guint i;
+
+  if (download->error) {
+    g_error_free (error);
+    return;
+  }
+
+  download->error = error;
+
+  /* Cancelling can complete the messages right away, so hold the download
+   * open until the loop is done */
+  download->pending++;
+  for (i = 0; i < download->ranges->len; i++) {
+    range = g_ptr_array_index (download->ranges, i);
+    if (range->message)
+      _rest_proxy_cancel_message (download->proxy, range->message);
+
+    if (range->retry_source) {
+      g_source_remove (range->retry_source);
+      range->retry_source = 0;
+      download_release (download);
+    }
+  }
+  download_release (download);
+}
+
+static void
+cancelled_cb (GCancellable      *cancellable,
+              RestRangeDownload *download)
+{
+  download_fail (download,
+                 g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                      "Operation was cancelled"));
+}
+
+static gboolean
+write_at (int           fd,
+          const gchar  *data,
+          gsize         len,
+          goffset       offset,
+          GError      **error)
+{
+  gssize n;
+
+  while (len > 0) {
+    n = pwrite (fd, data, len, offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      set_error_from_errno (error, errno);
+      return FALSE;
+    }
+
+    data += n;
+    len -= n;
+    offset += n;
+  }
+
+  return TRUE;
+}
+
+static void
+range_got_headers_cb (SoupMessage *message,
+                      Range       *range)
+{
+  RestRangeDownload *download = range->download;
+  goffset start, end, total;
+
+  range->writing = FALSE;
+
+  if (message->status_code == SOUP_STATUS_PARTIAL_CONTENT) {
+    if (!soup_message_headers_get_content_range (message->response_headers,
+                                                 &start, &end, &total) ||
+        start != range->start) {
+      download_fail (download,
+                     g_error_new_literal (REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                                          "Server returned the wrong range"));
+      return;
+    }
+
+    if (range->probe) {
+      if (total < 0) {
+        download_fail (download,
+                       g_error_new_literal (REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                                            "Server did not give the size of the resource"));
+        return;
+      }
+      download->total = total;
+    }
+
+    range->writing = TRUE;
+  } else if (message->status_code == SOUP_STATUS_OK) {
+    /* The server doesn't do ranges.  That's fine for the first request, as
+     * we just take the whole thing, but means it changed its mind later. */
+    if (!range->probe) {
+      download_fail (download,
+                     g_error_new_literal (REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                                          "Server stopped accepting range requests"));
+      return;
+    }
+
+    /* The body is written from the start of the file, so anything already in
+     * it mustn't be left after a shorter body */
+    if (ftruncate (download->fd, 0) < 0) {
+      GError *error = NULL;
+
+      set_error_from_errno (&error, errno);
+      download_fail (download, error);
+      return;
+    }
+
+    range->start = 0;
+    range->end = -1;
+    if (soup_message_headers_get_encoding (message->response_headers) == SOUP_ENCODING_CONTENT_LENGTH)
+      download->total = soup_message_headers_get_content_length (message->response_headers);
+
+    range->writing = TRUE;
+  }
+}
+
+static void
+range_got_chunk_cb (SoupMessage *message,
+                    SoupBuffer  *chunk,
+                    Range       *range)
+{
+  RestRangeDownload *download = range->download;
+  GError *error = NULL;
+  gsize len;
+
+  if (!range->writing || download->error)
+    return;
+
+  len = chunk->length;
+  if (range->end >= 0)
+    len = MIN (len, range->end - range->start + 1);
+
+  if (!write_at (download->fd, chunk->data, len, range->start, &error)) {
+    download_fail (download, error);
+    return;
+  }
+
+  range->start += len;
+  range->written += len;
+  download->received += len;
+
+  if (download->progress)
+    download->progress (download->call, download->received, download->total,
+                        download->progress_data);
+}
+
+/* Split the rest of the resource into ranges and queue them all */
+static gboolean
+queue_ranges (RestRangeDownload  *download,
+              goffset             start,
+              GError            **error)
+{
+  goffset remaining, size;
+  guint n, i;
+  Range *range;
+  int res;
+
+  remaining = download->total - start;
+  if (remaining <= 0)
+    return TRUE;
+
+  /* Make the file its final size up front, so the ranges can be written
+   * anywhere in it and nothing that was there before is left past the end */
+  res = ftruncate (download->fd, download->total) < 0 ? errno : 0;
+#ifdef HAVE_POSIX_FALLOCATE
+  if (res == 0) {
+    res = posix_fallocate (download->fd, 0, download->total);
+    if (res == EINVAL || res == EOPNOTSUPP)
+      res = 0;
+  }
+#endif
+  if (res != 0) {
+    set_error_from_errno (error, res);
+    return FALSE;
+  }
+
+  n = MAX (1, MIN ((goffset)download->n_ranges, remaining / RANGE_MIN_SIZE));
+  size = remaining / n;
+
+  for (i = 0; i < n; i++) {
+    range = g_slice_new0 (Range);
+    range->download = download;
+    range->start = start + i * size;
+    range->end = (i == n - 1) ? download->total - 1 : range->start + size - 1;
+    g_ptr_array_add (download->ranges, range);
+
+    range_queue (range);
+  }
+
+  return TRUE;
+}
+
+/* Whether it is worth trying @message again */
+static gboolean
+is_transient_failure (SoupMessage *message)
+{
+  if (message->status_code == SOUP_STATUS_CANCELLED)
+    return FALSE;
+
+  return SOUP_STATUS_IS_TRANSPORT_ERROR (message->status_code) ||
+    SOUP_STATUS_IS_SERVER_ERROR (message->status_code) ||
+    SOUP_STATUS_IS_SUCCESSFUL (message->status_code);
+}
+
+static gboolean
+range_retry_cb (gpointer user_data)
+{
+  Range *range = user_data;
+  RestRangeDownload *download = range->download;
+
+  range->retry_source = 0;
+
+  if (download->error == NULL)
+    range_queue (range);
+
+  download_release (download);
+
+  return FALSE;
+}
+
+static void
+range_completed_cb (SoupSession *session,
+                    SoupMessage *message,
+                    gpointer     user_data)
+{
+  Range *range = user_data;
+  RestRangeDownload *download = range->download;
+  GError *error = NULL;
+
+  range->message = NULL;
+
+  _rest_proxy_account_response (download->proxy,
+                                range->written, range->written);
+  range->written = 0;
+
+  if (download->error)
+    goto done;
+
+  /* There is no first byte to ask for in an empty resource */
+  if (range->probe &&
+      message->status_code == SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE) {
+    download->total = 0;
+    if (ftruncate (download->fd, 0) < 0) {
+      set_error_from_errno (&error, errno);
+      download_fail (download, error);
+    }
+    goto done;
+  }
+
+  if (SOUP_STATUS_IS_SUCCESSFUL (message->status_code) &&
+      (range->end < 0 || range->start > range->end)) {
+    /* The first byte told us how big the resource is, so fetch the rest */
+    if (range->probe && range->end >= 0 &&
+        !queue_ranges (download, range->start, &error))
+      download_fail (download, error);
+
+    goto done;
+  }
+
+  /* Retry from where the range got to, unless the whole response was being
+   * taken, which can't be resumed */
+  if (range->end >= 0 && range->retries < RANGE_MAX_RETRIES &&
+      is_transient_failure (message)) {
+    /* Hold the download open until the retry is sent */
+    download->pending++;
+    range->retry_source = g_timeout_add (RANGE_RETRY_DELAY << range->retries,
+                                     range_retry_cb, range);
+    range->retries++;
+    goto done;
+  }
+
+  if (!_rest_proxy_call_error_from_message (message, &error))
+    download_fail (download, error);
+  else
+    download_fail (download,
+                   g_error_new_literal (REST_PROXY_ERROR, REST_PROXY_ERROR_IO,
+                                        "Range ended early"));
+
+ done:
+  download_release (download);
+}
+
+static void
+range_queue (Range *range)
+{
+  RestRangeDownload *download = range->download;
+  SoupMessage *message;
+
+  message = soup_message_new_from_uri (download->template->method,
+                                       soup_message_get_uri (download->template));
+  soup_message_headers_foreach (download->template->request_headers,
+                                copy_header, message->request_headers);
+
+  /* Ranges are of the encoded body, so don't ask for it to be encoded */
+  soup_message_headers_remove (message->request_headers, "Accept-Encoding");
+  soup_message_headers_set_range (message->request_headers,
+                                  range->start, range->end);
+
+  soup_message_body_set_accumulate (message->response_body, FALSE);
+
+  g_signal_connect (message, "got-headers",
+                    G_CALLBACK (range_got_headers_cb), range);
+  g_signal_connect (message, "got-chunk",
+                    G_CALLBACK (range_got_chunk_cb), range);
+
+  range->message = message;
+  download->pending++;
+
+  _rest_proxy_queue_message (download->proxy, message,
+                             range_completed_cb, range);
+}
+
+static void
+range_free (Range *range)
+{
+  g_slice_free (Range, range);
+}
+
+/*
+ * Download the resource requested by @message, which is used as a template for
+ * the range requests and is not sent itself, into @fd using up to @n_ranges
+ * concurrent requests.  @result is completed when done.
+ */
+void
+_rest_range_download_start (RestProxy                     *proxy,
+                            RestProxyCall                 *call,
+                            SoupMessage                   *message,
+                            int                            fd,
+                            guint                          n_ranges,
+                            RestDownloadSyncPolicy         sync,
+                            GCancellable                  *cancellable,
+                            RestProxyCallDownloadCallback  progress,
+                            gpointer                       progress_data,
+                            GSimpleAsyncResult            *result)
+{
+  RestRangeDownload *download;
+  Range *range;
+
+  download = g_slice_new0 (RestRangeDownload);
+  download->proxy = g_object_ref (proxy);
+  download->call = g_object_ref (call);
+  download->template = g_object_ref (message);
+  download->fd = fd;
+  download->n_ranges = MAX (n_ranges, 1);
+  download->sync = sync;
+  download->progress = progress;
+  download->progress_data = progress_data;
+  download->result = g_object_ref (result);
+  download->ranges = g_ptr_array_new_with_free_func ((GDestroyNotify)range_free);
+  download->total = -1;
+
+  range = g_slice_new0 (Range);
+  range->download = download;
+  range->probe = TRUE;
+  range->start = 0;
+  range->end = 0;
+  g_ptr_array_add (download->ranges, range);
+
+  range_queue (range);
+
+  if (cancellable) {
+    download->cancellable = g_object_ref (cancellable);
+    download->cancel_id = g_signal_connect (cancellable, "cancelled",
+                                            G_CALLBACK (cancelled_cb), download);
+
+    if (g_cancellable_is_cancelled (cancellable))
+      cancelled_cb (cancellable, download);
+  }
+}
@@ -0,0 +1,43 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_RANGE_DOWNLOAD
+#define _REST_RANGE_DOWNLOAD
+
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+#include <rest/rest-proxy-call.h>
+
+G_BEGIN_DECLS
+
+void _rest_range_download_start (RestProxy                     *proxy,
+                                 RestProxyCall                 *call,
+                                 SoupMessage                   *message,
+                                 int                            fd,
+                                 guint                          n_ranges,
+                                 RestDownloadSyncPolicy         sync,
+                                 GCancellable                  *cancellable,
+                                 RestProxyCallDownloadCallback  progress,
+                                 gpointer                       progress_data,
+                                 GSimpleAsyncResult            *result);
+
+G_END_DECLS
+
+#endif /* _REST_RANGE_DOWNLOAD */
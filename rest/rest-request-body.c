@@ -0,0 +1,696 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#include <config.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "rest-content-codec.h"
+#include "rest-request-body.h"
+
+/*
+ * A request body which is handed to libsoup one block at a time as the
+ * previous block is written, optionally compressing it on the way.  The
+ * source data is a list of segments, each either a SoupBuffer, an input
+ * stream or a range of a file descriptor.  The message body does not
+ * accumulate, so at any time only the in-memory segments and a single block of
+ * output are held.
+ *
+ * Ranges of regular files are mapped in FD_BLOCK_SIZE blocks and the mapping
+ * is handed to libsoup as it is, so the data is only copied when the kernel
+ * writes it to the socket.
+ */
+
+#define REQUEST_BLOCK_SIZE 65536
+#define FD_BLOCK_SIZE (1024 * 1024)
+
+#define REQUEST_BODY_KEY "rest-request-body"
+
+typedef struct {
+  SoupBuffer *buffer;
+  GInputStream *stream;
+  /* -1 if the stream length is not known */
+  goffset length;
+  /* Where the stream was when it was added, to rewind to, or the offset of
+   * the range in fd */
+  goffset start;
+  /* -1 unless the segment is a range of a file descriptor */
+  int fd;
+  /* Set once mapping fd has failed, to read it instead */
+  gboolean no_map;
+} Segment;
+
+struct _RestRequestBody {
+  GArray *segments;
+  /* -1 if the length of any segment is not known */
+  goffset length;
+
+  RestContentCoding coding;
+  RestContentEncoder *encoder;
+  GByteArray *out;
+
+  /* Position in the source data */
+  guint index;
+  goffset offset;
+  goffset read;
+
+  /* Source bytes covered by the block queued in the message, and by the blocks
+   * already written */
+  goffset pending;
+  goffset written;
+
+  gboolean complete;
+  /* Waiting for the server to answer "Expect: 100-continue" */
+  gboolean waiting;
+
+  SoupMessage *message;
+  RestRequestBodyErrorFunc error_func;
+  gpointer error_data;
+};
+
+RestRequestBody *
+_rest_request_body_new (void)
+{
+  RestRequestBody *body;
+
+  body = g_slice_new0 (RestRequestBody);
+  body->segments = g_array_new (FALSE, TRUE, sizeof (Segment));
+  body->coding = REST_CONTENT_CODING_IDENTITY;
+
+  return body;
+}
+
+/*
+ * Add @buffer to the end of the source data.  The buffer is referenced, not
+ * copied.
+ */
+void
+_rest_request_body_append (RestRequestBody *body,
+                           SoupBuffer      *buffer)
+{
+  Segment segment = { NULL, };
+
+  g_return_if_fail (body);
+  g_return_if_fail (buffer);
+  g_return_if_fail (body->message == NULL);
+
+  if (buffer->length == 0)
+    return;
+
+  segment.buffer = soup_buffer_copy (buffer);
+  segment.length = buffer->length;
+  segment.fd = -1;
+  g_array_append_val (body->segments, segment);
+
+  if (body->length >= 0)
+    body->length += buffer->length;
+}
+
+/*
+ * Add @length bytes read from @stream to the end of the source data, or all
+ * of @stream if @length is -1.
+ */
+void
+_rest_request_body_append_stream (RestRequestBody *body,
+                                  GInputStream    *stream,
+                                  goffset          length)
+{
+  Segment segment = { NULL, };
+
+  g_return_if_fail (body);
+  g_return_if_fail (G_IS_INPUT_STREAM (stream));
+  g_return_if_fail (body->message == NULL);
+
+  if (length == 0)
+    return;
+
+  segment.stream = g_object_ref (stream);
+  segment.length = length < 0 ? -1 : length;
+  segment.fd = -1;
+  if (G_IS_SEEKABLE (stream))
+    segment.start = g_seekable_tell (G_SEEKABLE (stream));
+  g_array_append_val (body->segments, segment);
+
+  if (segment.length < 0)
+    body->length = -1;
+  else if (body->length >= 0)
+    body->length += length;
+}
+
+/*
+ * Add @length bytes of @fd starting at @offset to the end of the source data,
+ * or everything up to the end of the file if @length is -1.  @fd is
+ * duplicated, and is read by offset so its file position is left alone.
+ */
+void
+_rest_request_body_append_fd (RestRequestBody *body,
+                              int              fd,
+                              goffset          offset,
+                              goffset          length)
+{
+  Segment segment = { NULL, };
+
+  g_return_if_fail (body);
+  g_return_if_fail (fd >= 0);
+  g_return_if_fail (offset >= 0);
+  g_return_if_fail (body->message == NULL);
+
+  if (length == 0)
+    return;
+
+  do {
+    segment.fd = dup (fd);
+  } while (segment.fd < 0 && errno == EINTR);
+
+  if (segment.fd < 0) {
+    g_warning ("Cannot duplicate file descriptor %d: %s",
+               fd, g_strerror (errno));
+    return;
+  }
+
+  segment.start = offset;
+  segment.length = length < 0 ? -1 : length;
+  /* Mapping past the end of the file faults, so only map known lengths */
+  segment.no_map = (segment.length < 0);
+  g_array_append_val (body->segments, segment);
+
+  if (segment.length < 0)
+    body->length = -1;
+  else if (body->length >= 0)
+    body->length += length;
+}
+
+void
+_rest_request_body_set_coding (RestRequestBody   *body,
+                               RestContentCoding  coding)
+{
+  g_return_if_fail (body);
+  g_return_if_fail (body->message == NULL);
+
+  body->coding = coding;
+}
+
+/*
+ * The length of the source data, which is what upload progress is reported
+ * against, or -1 if it is not known.
+ */
+goffset
+_rest_request_body_get_length (RestRequestBody *body)
+{
+  g_return_val_if_fail (body, 0);
+
+  return body->length;
+}
+
+/*
+ * The number of source bytes which have been completely written to the
+ * network, once encoded.
+ */
+goffset
+_rest_request_body_get_written (RestRequestBody *body)
+{
+  g_return_val_if_fail (body, 0);
+
+  return body->written;
+}
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+typedef struct {
+  gpointer addr;
+  gsize len;
+} Mapping;
+
+static void
+mapping_free (Mapping *mapping)
+{
+  munmap (mapping->addr, mapping->len);
+  g_slice_free (Mapping, mapping);
+}
+
+/*
+ * Map @len bytes of @segment at @offset, or return NULL if it cannot be
+ * mapped.
+ */
+static SoupBuffer *
+map_block (Segment *segment,
+           goffset  offset,
+           gsize    len)
+{
+  static gsize page_size = 0;
+  Mapping *mapping;
+  gpointer addr;
+  gsize delta;
+  struct stat st;
+
+  if (page_size == 0)
+    page_size = sysconf (_SC_PAGESIZE);
+
+  /* Only regular files can be relied on to map */
+  if (fstat (segment->fd, &st) != 0 || !S_ISREG (st.st_mode) ||
+      st.st_size < offset + (goffset)len) {
+    segment->no_map = TRUE;
+    return NULL;
+  }
+
+  delta = offset % page_size;
+  addr = mmap (NULL, len + delta, PROT_READ, MAP_SHARED,
+               segment->fd, offset - delta);
+  if (addr == MAP_FAILED) {
+    segment->no_map = TRUE;
+    return NULL;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise (addr, len + delta, MADV_SEQUENTIAL);
+#endif
+
+  mapping = g_slice_new (Mapping);
+  mapping->addr = addr;
+  mapping->len = len + delta;
+
+  return soup_buffer_new_with_owner ((const gchar *)addr + delta, len,
+                                     mapping, (GDestroyNotify)mapping_free);
+}
+#endif
+
+/*
+ * Read up to @len bytes of @segment at @offset, returning 0 at the end of the
+ * file or -1 if reading failed.
+ */
+static gssize
+read_fd (Segment  *segment,
+         goffset   offset,
+         gchar    *data,
+         gsize     len,
+         GError  **error)
+{
+  gssize n;
+
+  do {
+    n = pread (segment->fd, data, len, offset);
+  } while (n < 0 && errno == EINTR);
+
+  /* Pipes and sockets can only be read in order, and once */
+  if (n < 0 && errno == ESPIPE) {
+    do {
+      n = read (segment->fd, data, len);
+    } while (n < 0 && errno == EINTR);
+  }
+
+  if (n < 0) {
+    int errsv = errno;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Error reading file: %s", g_strerror (errsv));
+  }
+
+  return n;
+}
+
+/*
+ * Return up to REQUEST_BLOCK_SIZE bytes of source data, or NULL at the end or
+ * if reading a stream failed.  Ranges of file descriptors that can be mapped
+ * are returned in larger blocks.
+ */
+static SoupBuffer *
+read_block (RestRequestBody  *body,
+            GError          **error)
+{
+  Segment *segment;
+  SoupBuffer *block;
+  gsize len;
+  gssize n;
+  gchar *data;
+
+  while (body->index < body->segments->len) {
+    segment = &g_array_index (body->segments, Segment, body->index);
+
+    if (body->offset == segment->length) {
+      body->index++;
+      body->offset = 0;
+      continue;
+    }
+
+    if (segment->buffer) {
+      len = MIN (segment->length - body->offset, REQUEST_BLOCK_SIZE);
+      block = soup_buffer_new_subbuffer (segment->buffer, body->offset, len);
+    } else {
+      block = NULL;
+      len = REQUEST_BLOCK_SIZE;
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+      if (segment->fd >= 0 && !segment->no_map) {
+        len = MIN (segment->length - body->offset, FD_BLOCK_SIZE);
+        block = map_block (segment, segment->start + body->offset, len);
+        if (block == NULL)
+          len = REQUEST_BLOCK_SIZE;
+      }
+#endif
+
+      if (block == NULL) {
+        if (segment->length >= 0)
+          len = MIN (segment->length - body->offset, len);
+
+        data = g_malloc (len);
+        if (segment->fd >= 0)
+          n = read_fd (segment, segment->start + body->offset, data, len, error);
+        else
+          n = g_input_stream_read (segment->stream, data, len, NULL, error);
+        if (n < 0) {
+          g_free (data);
+          return NULL;
+        }
+
+        if (n == 0) {
+          g_free (data);
+
+          if (segment->length >= 0) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Stream ended after %" G_GOFFSET_FORMAT " of %"
+                         G_GOFFSET_FORMAT " bytes",
+                         body->offset, segment->length);
+            return NULL;
+          }
+
+          body->index++;
+          body->offset = 0;
+          continue;
+        }
+
+        len = n;
+        block = soup_buffer_new (SOUP_MEMORY_TAKE, data, len);
+      }
+    }
+
+    body->offset += len;
+    body->read += len;
+
+    return block;
+  }
+
+  return NULL;
+}
+
+static void
+collect_output (const gchar *data,
+                gsize        len,
+                gpointer     user_data)
+{
+  RestRequestBody *body = user_data;
+
+  g_byte_array_append (body->out, (const guint8 *)data, len);
+}
+
+/*
+ * Return the next block to write, or NULL at the end of the body or if
+ * @error is set.
+ */
+static SoupBuffer *
+next_block (RestRequestBody  *body,
+            GError          **error)
+{
+  SoupBuffer *block;
+  GError *err = NULL;
+  gboolean finish = FALSE;
+  gsize len;
+
+  if (body->encoder == NULL)
+    return read_block (body, error);
+
+  /* The compressor buffers internally, so keep feeding it until it produces
+   * something or the source runs out */
+  while (body->out->len == 0 && !finish) {
+    block = read_block (body, &err);
+    if (err) {
+      g_propagate_error (error, err);
+      return NULL;
+    }
+
+    finish = (block == NULL);
+
+    if (!_rest_content_encoder_push (body->encoder,
+                                     block ? block->data : NULL,
+                                     block ? block->length : 0,
+                                     finish,
+                                     collect_output, body,
+                                     error)) {
+      if (block)
+        soup_buffer_free (block);
+      return NULL;
+    }
+
+    if (block)
+      soup_buffer_free (block);
+  }
+
+  if (body->out->len == 0)
+    return NULL;
+
+  len = body->out->len;
+  block = soup_buffer_new (SOUP_MEMORY_TAKE,
+                           g_byte_array_free (body->out, FALSE), len);
+  body->out = g_byte_array_new ();
+
+  return block;
+}
+
+/* Stop sending the body and report @error */
+static void
+fail (RestRequestBody *body,
+      GError          *error)
+{
+  body->complete = TRUE;
+  soup_message_body_complete (body->message->request_body);
+
+  if (body->error_func)
+    body->error_func (body->message, error, body->error_data);
+
+  g_error_free (error);
+}
+
+/* Queue the next block on the message, completing it at the end */
+static void
+feed (RestRequestBody *body)
+{
+  SoupBuffer *block;
+  GError *error = NULL;
+
+  body->written = body->pending;
+
+  if (body->complete)
+    return;
+
+  block = next_block (body, &error);
+
+  if (error) {
+    fail (body, error);
+    return;
+  }
+
+  if (block) {
+    soup_message_body_append_buffer (body->message->request_body, block);
+    soup_buffer_free (block);
+    body->pending = body->read;
+  } else {
+    body->complete = TRUE;
+    soup_message_body_complete (body->message->request_body);
+  }
+}
+
+/* Go back to the start of the source data */
+static gboolean
+rewind_body (RestRequestBody  *body,
+             GError          **error)
+{
+  Segment *segment;
+  guint i;
+
+  /* Only streams which have been read from need to seek */
+  for (i = 0; i < body->segments->len && body->read > 0; i++) {
+    segment = &g_array_index (body->segments, Segment, i);
+
+    if (i > body->index || (i == body->index && body->offset == 0))
+      break;
+
+    if (segment->stream == NULL)
+      continue;
+
+    if (!G_IS_SEEKABLE (segment->stream) ||
+        !g_seekable_can_seek (G_SEEKABLE (segment->stream))) {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           "Cannot send the request body again as the stream cannot seek");
+      return FALSE;
+    }
+
+    if (!g_seekable_seek (G_SEEKABLE (segment->stream), segment->start,
+                          G_SEEK_SET, NULL, error))
+      return FALSE;
+  }
+
+  body->index = 0;
+  body->offset = 0;
+  body->read = 0;
+  body->pending = 0;
+  body->written = 0;
+  body->complete = FALSE;
+
+  if (body->coding != REST_CONTENT_CODING_IDENTITY) {
+    _rest_content_encoder_free (body->encoder);
+    body->encoder = _rest_content_encoder_new (body->coding);
+
+    if (body->out)
+      g_byte_array_set_size (body->out, 0);
+    else
+      body->out = g_byte_array_new ();
+  }
+
+  return TRUE;
+}
+
+static void
+message_wrote_headers_cb (SoupMessage     *message,
+                          RestRequestBody *body)
+{
+  GError *error = NULL;
+
+  /* Start from the beginning each time the request is sent, as it may be sent
+   * again after authenticating or following a redirect */
+  soup_message_body_truncate (message->request_body);
+
+  if (!rewind_body (body, &error)) {
+    fail (body, error);
+    return;
+  }
+
+  /* Nothing is read until the server agrees to take the body, so a refusal
+   * costs no I/O at all */
+  if (soup_message_headers_get_expectations (message->request_headers) &
+      SOUP_EXPECTATION_CONTINUE) {
+    body->waiting = TRUE;
+    return;
+  }
+
+  feed (body);
+}
+
+static void
+message_got_informational_cb (SoupMessage     *message,
+                              RestRequestBody *body)
+{
+  if (!body->waiting || message->status_code != SOUP_STATUS_CONTINUE)
+    return;
+
+  /* libsoup is about to start writing the body, which it will find queued */
+  body->waiting = FALSE;
+  feed (body);
+}
+
+static void
+message_wrote_chunk_cb (SoupMessage     *message,
+                        RestRequestBody *body)
+{
+  feed (body);
+}
+
+/*
+ * Make @body the request body of @message, replacing anything already there.
+ * The message takes ownership of @body.  Nothing is read from the source until
+ * the request headers have been written, or if the message expects
+ * "100 Continue", until the server has sent it.  Encoded bodies, and bodies
+ * with a stream of unknown length, are sent with chunked encoding.
+ */
+void
+_rest_request_body_attach (RestRequestBody          *body,
+                           SoupMessage              *message,
+                           RestRequestBodyErrorFunc  error_func,
+                           gpointer                  user_data)
+{
+  g_return_if_fail (body);
+  g_return_if_fail (SOUP_IS_MESSAGE (message));
+  g_return_if_fail (body->message == NULL);
+
+  body->message = message;
+  body->error_func = error_func;
+  body->error_data = user_data;
+
+  if (body->coding == REST_CONTENT_CODING_IDENTITY && body->length >= 0) {
+    soup_message_headers_set_content_length (message->request_headers,
+                                             body->length);
+  } else {
+    soup_message_headers_set_encoding (message->request_headers,
+                                       SOUP_ENCODING_CHUNKED);
+  }
+
+  soup_message_body_truncate (message->request_body);
+  soup_message_body_set_accumulate (message->request_body, FALSE);
+
+  g_object_set_data_full (G_OBJECT (message), REQUEST_BODY_KEY,
+                          body, (GDestroyNotify)_rest_request_body_free);
+
+  g_signal_connect (message, "wrote-headers",
+                    G_CALLBACK (message_wrote_headers_cb), body);
+  g_signal_connect (message, "wrote-chunk",
+                    G_CALLBACK (message_wrote_chunk_cb), body);
+  g_signal_connect (message, "got-informational",
+                    G_CALLBACK (message_got_informational_cb), body);
+}
+
+/*
+ * The body attached to @message with _rest_request_body_attach(), or %NULL.
+ */
+RestRequestBody *
+_rest_request_body_from_message (SoupMessage *message)
+{
+  g_return_val_if_fail (SOUP_IS_MESSAGE (message), NULL);
+
+  return g_object_get_data (G_OBJECT (message), REQUEST_BODY_KEY);
+}
+
+void
+_rest_request_body_free (RestRequestBody *body)
+{
+  guint i;
+
+  if (body == NULL)
+    return;
+
+  for (i = 0; i < body->segments->len; i++) {
+    Segment *segment = &g_array_index (body->segments, Segment, i);
+
+    if (segment->buffer)
+      soup_buffer_free (segment->buffer);
+    if (segment->stream)
+      g_object_unref (segment->stream);
+    if (segment->fd >= 0)
+      close (segment->fd);
+  }
+  g_array_free (body->segments, TRUE);
+
+  _rest_content_encoder_free (body->encoder);
+  if (body->out)
+    g_byte_array_free (body->out, TRUE);
+
+  g_slice_free (RestRequestBody, body);
+}
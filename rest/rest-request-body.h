@@ -0,0 +1,71 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+#ifndef _REST_REQUEST_BODY
+#define _REST_REQUEST_BODY
+
+#include <libsoup/soup.h>
+#include <rest/rest-proxy-call.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RestRequestBody RestRequestBody;
+
+/*
+ * Called if producing the body failed part way through writing it.  The
+ * message should be aborted, since the server cannot be sent a valid body.
+ */
+typedef void (*RestRequestBodyErrorFunc) (SoupMessage  *message,
+                                          const GError *error,
+                                          gpointer      user_data);
+
+RestRequestBody *_rest_request_body_new (void);
+
+void _rest_request_body_append (RestRequestBody *body,
+                                SoupBuffer      *buffer);
+
+void _rest_request_body_append_stream (RestRequestBody *body,
+                                       GInputStream    *stream,
+                                       goffset          length);
+
+void _rest_request_body_append_fd (RestRequestBody *body,
+                                   int              fd,
+                                   goffset          offset,
+                                   goffset          length);
+
+void _rest_request_body_set_coding (RestRequestBody   *body,
+                                    RestContentCoding  coding);
+
+goffset _rest_request_body_get_length (RestRequestBody *body);
+
+goffset _rest_request_body_get_written (RestRequestBody *body);
+
+void _rest_request_body_attach (RestRequestBody          *body,
+                                SoupMessage              *message,
+                                RestRequestBodyErrorFunc  error_func,
+                                gpointer                  user_data);
+
+RestRequestBody *_rest_request_body_from_message (SoupMessage *message);
+
+void _rest_request_body_free (RestRequestBody *body);
+
+G_END_DECLS
+
+#endif /* _REST_REQUEST_BODY */
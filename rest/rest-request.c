@@ -0,0 +1,488 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsoup/soup.h>
+
+#include "rest-request.h"
+#include "rest-private.h"
+#include "rest-proxy-call-private.h"
+
+/**
+ * SECTION:rest-request
+ * @short_description: Lightweight requests for high request rates
+ * @see_also: #RestProxyCall
+ *
+ * A #RestRequest is a plain structure for making simple requests with a
+ * #RestProxy when a #RestProxyCall costs too much, for example when polling
+ * at tens of thousands of requests a second.  It has no signals or
+ * properties: its function and headers are kept in a single #GStringChunk,
+ * its string parameters in a #RestParams, and the response headers and
+ * payload are read straight from the underlying message.  The URL is made in
+ * the same way as for a #RestProxyCall, and requests share the proxy's
+ * connections, user agent, credentials and statistics.
+ *
+ * Requests made with an #OAuthProxy, #OAuth2Proxy or the proxies of
+ * rest-extras are signed in the same way as their calls.  Requests can't be
+ * made with other proxy subclasses which make their own calls, as they may
+ * change the calls in ways a request can't follow.  Requests also do not
+ * decode compressed responses, stream their bodies, or take anything but
+ * string parameters.
+ */
+
+typedef struct {
+  const gchar *name;
+  const gchar *value;
+} Pair;
+
+struct _RestRequest {
+  RestProxy *proxy;
+  /* Interned, as libsoup's method names are */
+  const gchar *method;
+  const gchar *function;
+
+  /* Backs the function and headers */
+  GStringChunk *strings;
+  GArray *headers;
+  RestParams *params;
+
+  SoupMessage *message;
+  gboolean running;
+
+  RestRequestCallback callback;
+  gpointer user_data;
+};
+
+/* The header array starts with room for this many headers */
+#define REQUEST_N_HEADERS 8
+
+/**
+ * rest_request_new:
+ * @proxy: the #RestProxy to make the request with
+ * @method: (allow-none): the HTTP method, or %NULL for GET
+ * @function: (allow-none): the function to call, or %NULL
+ *
+ * Create a request to @function on @proxy.  If @proxy signs its calls, the
+ * request is signed in the same way when it is made.
+ *
+ * Returns: a new #RestRequest, free with rest_request_free(), or %NULL if
+ * @proxy makes calls that a request can't be prepared like.
+ */
+RestRequest *
+rest_request_new (RestProxy   *proxy,
+                  const gchar *method,
+                  const gchar *function)
+{
+  RestRequest *request;
+
+  g_return_val_if_fail (REST_IS_PROXY (proxy), NULL);
+  /* The request would be sent without whatever the proxy's calls add */
+  g_return_val_if_fail (_rest_proxy_can_prepare (proxy), NULL);
+
+  request = g_slice_new0 (RestRequest);
+  request->proxy = g_object_ref (proxy);
+  request->method = method ? _rest_intern (method) : SOUP_METHOD_GET;
+  request->strings = g_string_chunk_new (256);
+
+  if (function)
+    request->function = g_string_chunk_insert (request->strings, function);
+
+  return request;
+}
+
+/**
+ * rest_request_add_header:
+ * @request: a #RestRequest
+ * @name: the header name
+ * @value: the header value
+ *
+ * Add a header to @request.  Unlike rest_proxy_call_add_header(), adding a
+ * header twice sends it twice.
+ */
+void
+rest_request_add_header (RestRequest *request,
+                         const gchar *name,
+                         const gchar *value)
+{
+  Pair pair;
+
+  g_return_if_fail (request);
+  g_return_if_fail (name && value);
+  g_return_if_fail (request->message == NULL);
+
+  if (request->headers == NULL)
+    request->headers = g_array_sized_new (FALSE, FALSE, sizeof (Pair),
+                                          REQUEST_N_HEADERS);
+
+  pair.name = g_string_chunk_insert (request->strings, name);
+  pair.value = g_string_chunk_insert (request->strings, value);
+  g_array_append_val (request->headers, pair);
+}
+
+/**
+ * rest_request_add_param:
+ * @request: a #RestRequest
+ * @name: the parameter name
+ * @value: the parameter value
+ *
+ * Add a string parameter to @request.  Parameters are sent in the order they
+ * are added, in the body of POST and PUT requests and in the query string
+ * otherwise.  Adding a parameter twice sends it twice.
+ */
+void
+rest_request_add_param (RestRequest *request,
+                        const gchar *name,
+                        const gchar *value)
+{
+  g_return_if_fail (request);
+  g_return_if_fail (name && value);
+  g_return_if_fail (request->message == NULL);
+
+  if (request->params == NULL)
+    request->params = rest_params_new ();
+
+  rest_params_add (request->params,
+                   rest_param_new_string (name, REST_MEMORY_COPY, value));
+}
+
+static void
+replace_header (gpointer name,
+                gpointer value,
+                gpointer user_data)
+{
+  soup_message_headers_replace (user_data, name, value);
+}
+
+/*
+ * Make the message for @request.  The request is seen by the proxy through a
+ * #RestRequestView, so a proxy that signs its calls signs the request in the
+ * same way, and the parameters are encoded as a call's are.
+ */
+static SoupMessage *
+build_message (RestRequest  *request,
+               GError      **error)
+{
+  RestProxyPrepareFunc prepare;
+  RestRequestView view;
+  SoupMessage *message = NULL;
+  const gchar *user_agent;
+  GString *form;
+  guint i;
+
+  view.method = request->method;
+  view.function = request->function;
+  view.url = _rest_proxy_build_url (request->proxy, request->function);
+  view.params = NULL;
+  view.headers = NULL;
+  if (view.url == NULL) {
+    g_set_error_literal (error, REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                         "URL requires binding and is unbound");
+    return NULL;
+  }
+
+  /* Only a proxy that changes requests needs somewhere to put headers */
+  prepare = _rest_proxy_get_prepare_func (request->proxy);
+  if (prepare) {
+    if (request->params == NULL)
+      request->params = rest_params_new ();
+    view.params = request->params;
+    view.headers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, g_free);
+    if (!prepare (request->proxy, &view, error))
+      goto done;
+  }
+
+  form = g_string_sized_new (128);
+  if (request->params)
+    _rest_params_append_form (request->params, form);
+
+  if (form->len && (request->method == SOUP_METHOD_POST ||
+                    request->method == SOUP_METHOD_PUT)) {
+    message = soup_message_new (request->method, view.url);
+    if (message)
+      soup_message_set_request (message, SOUP_FORM_MIME_TYPE_URLENCODED,
+                                SOUP_MEMORY_TAKE, form->str, form->len);
+    g_string_free (form, message == NULL);
+  } else if (form->len) {
+    gchar *full;
+
+    full = g_strconcat (view.url, strchr (view.url, '?') ? "&" : "?",
+                        form->str, NULL);
+    message = soup_message_new (request->method, full);
+    g_string_free (form, TRUE);
+    g_free (full);
+  } else {
+    message = soup_message_new (request->method, view.url);
+    g_string_free (form, TRUE);
+  }
+
+  if (message == NULL) {
+    g_set_error (error, REST_PROXY_ERROR, REST_PROXY_ERROR_FAILED,
+                 "Invalid URL %s", view.url);
+    goto done;
+  }
+
+  user_agent = rest_proxy_get_user_agent (request->proxy);
+  if (user_agent)
+    soup_message_headers_append (message->request_headers,
+                                 "User-Agent", user_agent);
+
+  for (i = 0; request->headers && i < request->headers->len; i++) {
+    Pair *pair = &g_array_index (request->headers, Pair, i);
+
+    soup_message_headers_append (message->request_headers,
+                                 pair->name, pair->value);
+  }
+
+  /* The proxy's headers replace any of the same name, as for a call */
+  if (view.headers)
+    g_hash_table_foreach (view.headers, replace_header,
+                          message->request_headers);
+
+ done:
+  g_free (view.url);
+  if (view.headers)
+    g_hash_table_destroy (view.headers);
+
+  return message;
+}
+
+static gboolean
+finish_request (RestRequest  *request,
+                GError      **error)
+{
+  SoupBuffer *buffer;
+
+  request->running = FALSE;
+
+  /* Flattening leaves the terminated body in the message */
+  buffer = soup_message_body_flatten (request->message->response_body);
+  soup_buffer_free (buffer);
+
+  _rest_proxy_account_response (request->proxy,
+                                request->message->response_body->length,
+                                request->message->response_body->length);
+
+  return _rest_proxy_call_error_from_message (request->message, error);
+}
+
+/**
+ * rest_request_run:
+ * @request: a #RestRequest
+ * @error: a #GError, or %NULL
+ *
+ * Make @request, blocking until it has completed.  A request can only be
+ * made once.
+ *
+ * Returns: %TRUE on success, %FALSE if the request could not be made or the
+ * server returned an error.
+ */
+gboolean
+rest_request_run (RestRequest  *request,
+                  GError      **error)
+{
+  g_return_val_if_fail (request, FALSE);
+  g_return_val_if_fail (request->message == NULL, FALSE);
+
+  request->message = build_message (request, error);
+  if (request->message == NULL)
+    return FALSE;
+
+  request->running = TRUE;
+  _rest_proxy_send_message (request->proxy, request->message);
+
+  return finish_request (request, error);
+}
+
+static void
+request_completed_cb (SoupSession *session,
+                      SoupMessage *message,
+                      gpointer     user_data)
+{
+  RestRequest *request = user_data;
+  GError *error = NULL;
+
+  finish_request (request, &error);
+
+  request->callback (request, error, request->user_data);
+
+  g_clear_error (&error);
+}
+
+/**
+ * rest_request_run_async:
+ * @request: a #RestRequest
+ * @callback: a #RestRequestCallback to call when the request has completed
+ * @user_data: data to pass to @callback
+ *
+ * Make @request from the main loop.  @callback is always called, and
+ * @request must not be freed until it has been.  A request can only be made
+ * once.
+ */
+void
+rest_request_run_async (RestRequest         *request,
+                        RestRequestCallback  callback,
+                        gpointer             user_data)
+{
+  GError *error = NULL;
+
+  g_return_if_fail (request);
+  g_return_if_fail (callback);
+  g_return_if_fail (request->message == NULL);
+
+  request->callback = callback;
+  request->user_data = user_data;
+
+  request->message = build_message (request, &error);
+  if (request->message == NULL) {
+    callback (request, error, user_data);
+    g_error_free (error);
+    return;
+  }
+
+  request->running = TRUE;
+
+  /* The session drops its reference when the request completes, but the
+   * response is read from the message after that */
+  g_object_ref (request->message);
+  _rest_proxy_queue_message (request->proxy, request->message,
+                             request_completed_cb, request);
+}
+
+/**
+ * rest_request_cancel:
+ * @request: a #RestRequest
+ *
+ * Cancel @request if it is in progress.  The callback passed to
+ * rest_request_run_async() is called with an error.
+ */
+void
+rest_request_cancel (RestRequest *request)
+{
+  g_return_if_fail (request);
+
+  if (request->running)
+    _rest_proxy_cancel_message (request->proxy, request->message);
+}
+
+/**
+ * rest_request_get_status_code:
+ * @request: a #RestRequest
+ *
+ * Returns: the HTTP status code of the response, or 0 if there is no response
+ * yet.
+ */
+guint
+rest_request_get_status_code (RestRequest *request)
+{
+  g_return_val_if_fail (request, 0);
+
+  if (request->message == NULL || request->running)
+    return 0;
+
+  return request->message->status_code;
+}
+
+/**
+ * rest_request_get_payload:
+ * @request: a #RestRequest
+ *
+ * Get the body of the response, which is followed by a nul byte.  It is owned
+ * by @request.
+ *
+ * Returns: the payload, or %NULL if there is no response yet.
+ */
+const gchar *
+rest_request_get_payload (RestRequest *request)
+{
+  g_return_val_if_fail (request, NULL);
+
+  if (request->message == NULL || request->running)
+    return NULL;
+
+  return request->message->response_body->data;
+}
+
+/**
+ * rest_request_get_payload_length:
+ * @request: a #RestRequest
+ *
+ * Returns: the length of the payload in bytes.
+ */
+goffset
+rest_request_get_payload_length (RestRequest *request)
+{
+  g_return_val_if_fail (request, 0);
+
+  if (request->message == NULL || request->running)
+    return 0;
+
+  return request->message->response_body->length;
+}
+
+/**
+ * rest_request_lookup_response_header:
+ * @request: a #RestRequest
+ * @header: the header name
+ *
+ * Get the value of the response header @header.  If the header appears more
+ * than once the values are joined with commas.
+ *
+ * Returns: the value, or %NULL if the header is not in the response.
+ */
+const gchar *
+rest_request_lookup_response_header (RestRequest *request,
+                                     const gchar *header)
+{
+  g_return_val_if_fail (request, NULL);
+  g_return_val_if_fail (header, NULL);
+
+  if (request->message == NULL || request->running)
+    return NULL;
+
+  return soup_message_headers_get_list (request->message->response_headers,
+                                        header);
+}
+
+/**
+ * rest_request_free:
+ * @request: a #RestRequest
+ *
+ * Free @request, which must not be in progress.
+ */
+void
+rest_request_free (RestRequest *request)
+{
+  if (request == NULL)
+    return;
+
+  g_return_if_fail (!request->running);
+
+  if (request->message)
+    g_object_unref (request->message);
+  if (request->headers)
+    g_array_free (request->headers, TRUE);
+  if (request->params)
+    rest_params_free (request->params);
+  g_string_chunk_free (request->strings);
+  g_object_unref (request->proxy);
+
+  g_slice_free (RestRequest, request);
+}
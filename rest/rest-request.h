@@ -0,0 +1,81 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_REQUEST
+#define _REST_REQUEST
+
+#include <glib.h>
+#include <rest/rest-proxy.h>
+
+G_BEGIN_DECLS
+
+/**
+ * RestRequest:
+ *
+ * #RestRequest has no publicly available members.
+ */
+typedef struct _RestRequest RestRequest;
+
+/**
+ * RestRequestCallback:
+ * @request: the #RestRequest
+ * @error: the error, or %NULL if the request succeeded
+ * @user_data: the data passed to rest_request_run_async()
+ *
+ * Called when a request made with rest_request_run_async() has completed.
+ */
+typedef void (*RestRequestCallback) (RestRequest  *request,
+                                     const GError *error,
+                                     gpointer      user_data);
+
+RestRequest *rest_request_new (RestProxy   *proxy,
+                               const gchar *method,
+                               const gchar *function);
+
+void rest_request_add_header (RestRequest *request,
+                              const gchar *name,
+                              const gchar *value);
+
+void rest_request_add_param (RestRequest *request,
+                             const gchar *name,
+                             const gchar *value);
+
+gboolean rest_request_run (RestRequest  *request,
+                           GError      **error);
+
+void rest_request_run_async (RestRequest         *request,
+                             RestRequestCallback  callback,
+                             gpointer             user_data);
+
+void rest_request_cancel (RestRequest *request);
+
+guint rest_request_get_status_code (RestRequest *request);
+
+const gchar *rest_request_get_payload (RestRequest *request);
+
+goffset rest_request_get_payload_length (RestRequest *request);
+
+const gchar *rest_request_lookup_response_header (RestRequest *request,
+                                                  const gchar *header);
+
+void rest_request_free (RestRequest *request);
+
+G_END_DECLS
+
+#endif /* _REST_REQUEST */
@@ -0,0 +1,742 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__)) && \
+  (defined (__clang__) || __GNUC__ >= 5)
+#define SHA_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined (__aarch64__) && defined (__linux__) && \
+  (defined (__ARM_FEATURE_CRYPTO) || defined (__ARM_FEATURE_SHA2) || \
+   (!defined (__clang__) && __GNUC__ >= 8))
+#define SHA_ARM 1
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+#endif
+
+#include "rest-sha.h"
+
+/*
+ * SHA-1 and SHA-256, for HMAC signatures.  The block functions have a
+ * portable version and versions using the SHA extensions on x86 and the
+ * cryptography extensions on ARMv8, which are picked at runtime.  Unlike
+ * GChecksum the state is a plain structure, so HMAC can keep the state after
+ * hashing the key pads and copy it for each message.
+ */
+
+typedef void (*BlocksFunc) (guint32 *state, const guint8 *data, gsize n_blocks);
+
+typedef struct {
+  const char *name;
+  gboolean (*supported) (void);
+  BlocksFunc sha1;
+  BlocksFunc sha256;
+} ShaImpl;
+
+static const guint32 sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline guint32
+load_be32 (const guint8 *p)
+{
+  return (guint32)p[0] << 24 | (guint32)p[1] << 16 | (guint32)p[2] << 8 | p[3];
+}
+
+static inline void
+store_be32 (guint8 *p, guint32 v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+/*
+ * Each round step leaves its result in the variable that held e, so the
+ * rounds are unrolled in fives (eights for SHA-256) with the names rotated
+ * rather than shuffling the values between variables.
+ */
+#define SHA1_CH(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_PARITY(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_MAJ(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+#define SHA1_ROUND(a, b, c, d, e, f, k, i)              \
+  e += ROL (a, 5) + f (b, c, d) + (k) + w[i];           \
+  b = ROL (b, 30)
+#define SHA1_FIVE(f, k)                                 \
+  for (end = i + 20; i < end; i += 5) {                 \
+    SHA1_ROUND (a, b, c, d, e, f, k, i);                \
+    SHA1_ROUND (e, a, b, c, d, f, k, i + 1);            \
+    SHA1_ROUND (d, e, a, b, c, f, k, i + 2);            \
+    SHA1_ROUND (c, d, e, a, b, f, k, i + 3);            \
+    SHA1_ROUND (b, c, d, e, a, f, k, i + 4);            \
+  }
+
+static void
+sha1_blocks_scalar (guint32 *state, const guint8 *data, gsize n_blocks)
+{
+  guint32 w[80], a, b, c, d, e;
+  int i, end;
+
+  for (; n_blocks; n_blocks--, data += REST_SHA_BLOCK_SIZE) {
+    for (i = 0; i < 16; i++)
+      w[i] = load_be32 (data + 4 * i);
+    for (; i < 80; i++)
+      w[i] = ROL (w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+
+    i = 0;
+    SHA1_FIVE (SHA1_CH, 0x5a827999);
+    SHA1_FIVE (SHA1_PARITY, 0x6ed9eba1);
+    SHA1_FIVE (SHA1_MAJ, 0x8f1bbcdc);
+    SHA1_FIVE (SHA1_PARITY, 0xca62c1d6);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i)                         \
+  t = h + (ROR (e, 6) ^ ROR (e, 11) ^ ROR (e, 25)) +                    \
+    (g ^ (e & (f ^ g))) + sha256_k[i] + w[i];                           \
+  d += t;                                                               \
+  h = t + (ROR (a, 2) ^ ROR (a, 13) ^ ROR (a, 22)) +                    \
+    ((a & b) | (c & (a | b)))
+
+static void
+sha256_blocks_scalar (guint32 *state, const guint8 *data, gsize n_blocks)
+{
+  guint32 w[64], a, b, c, d, e, f, g, h, t, s0, s1;
+  int i;
+
+  for (; n_blocks; n_blocks--, data += REST_SHA_BLOCK_SIZE) {
+    for (i = 0; i < 16; i++)
+      w[i] = load_be32 (data + 4 * i);
+    for (; i < 64; i++) {
+      s0 = ROR (w[i - 15], 7) ^ ROR (w[i - 15], 18) ^ (w[i - 15] >> 3);
+      s1 = ROR (w[i - 2], 17) ^ ROR (w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for (i = 0; i < 64; i += 8) {
+      SHA256_ROUND (a, b, c, d, e, f, g, h, i);
+      SHA256_ROUND (h, a, b, c, d, e, f, g, i + 1);
+      SHA256_ROUND (g, h, a, b, c, d, e, f, i + 2);
+      SHA256_ROUND (f, g, h, a, b, c, d, e, i + 3);
+      SHA256_ROUND (e, f, g, h, a, b, c, d, i + 4);
+      SHA256_ROUND (d, e, f, g, h, a, b, c, i + 5);
+      SHA256_ROUND (c, d, e, f, g, h, a, b, i + 6);
+      SHA256_ROUND (b, c, d, e, f, g, h, a, i + 7);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#if SHA_X86
+
+#define SHA_TARGET __attribute__ ((target ("sha,sse4.1,ssse3")))
+
+static gboolean
+shani_supported (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+    return FALSE;
+  if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+    return FALSE;
+
+  if (__get_cpuid_max (0, NULL) < 7)
+    return FALSE;
+  __cpuid_count (7, 0, eax, ebx, ecx, edx);
+
+  /* SHA is bit 29 of EBX */
+  return (ebx & (1 << 29)) != 0;
+}
+
+/*
+ * The message schedule is done four words at a time in w0-w3, which hold the
+ * last four groups in turn.  SHA1RNDS4 does four rounds and SHA256RNDS2 two.
+ */
+#define SHA1_LOAD_X86(w, n) \
+  w = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 16 * (n))), swap)
+#define SHA1_SCHEDULE_X86(a, b, c, d) \
+  a = _mm_sha1msg2_epu32 (_mm_xor_si128 (_mm_sha1msg1_epu32 (a, b), c), d)
+#define SHA1_STEP_X86(w, f)                     \
+  e = _mm_sha1nexte_epu32 (prev, w);            \
+  prev = abcd;                                  \
+  abcd = _mm_sha1rnds4_epu32 (abcd, e, f)
+#define SHA1_FOUR_X86(f0, f1, f2, f3)                           \
+  SHA1_SCHEDULE_X86 (w0, w1, w2, w3); SHA1_STEP_X86 (w0, f0);   \
+  SHA1_SCHEDULE_X86 (w1, w2, w3, w0); SHA1_STEP_X86 (w1, f1);   \
+  SHA1_SCHEDULE_X86 (w2, w3, w0, w1); SHA1_STEP_X86 (w2, f2);   \
+  SHA1_SCHEDULE_X86 (w3, w0, w1, w2); SHA1_STEP_X86 (w3, f3)
+
+static void SHA_TARGET
+sha1_blocks_shani (guint32 *state, const guint8 *data, gsize n_blocks)
+{
+  const __m128i swap = _mm_set_epi64x (0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd, abcd_save, e, e_save, prev, w0, w1, w2, w3;
+
+  abcd = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)state), 0x1b);
+  e = _mm_set_epi32 (state[4], 0, 0, 0);
+
+  for (; n_blocks; n_blocks--, data += REST_SHA_BLOCK_SIZE) {
+    abcd_save = abcd;
+    e_save = e;
+
+    /* Rounds 0-15 */
+    SHA1_LOAD_X86 (w0, 0);
+    e = _mm_add_epi32 (e, w0);
+    prev = abcd;
+    abcd = _mm_sha1rnds4_epu32 (abcd, e, 0);
+    SHA1_LOAD_X86 (w1, 1);
+    SHA1_STEP_X86 (w1, 0);
+    SHA1_LOAD_X86 (w2, 2);
+    SHA1_STEP_X86 (w2, 0);
+    SHA1_LOAD_X86 (w3, 3);
+    SHA1_STEP_X86 (w3, 0);
+
+    /* Rounds 16-79 */
+    SHA1_FOUR_X86 (0, 1, 1, 1);
+    SHA1_FOUR_X86 (1, 1, 2, 2);
+    SHA1_FOUR_X86 (2, 2, 2, 3);
+    SHA1_FOUR_X86 (3, 3, 3, 3);
+
+    e = _mm_sha1nexte_epu32 (prev, e_save);
+    abcd = _mm_add_epi32 (abcd, abcd_save);
+  }
+
+  _mm_storeu_si128 ((__m128i *)state, _mm_shuffle_epi32 (abcd, 0x1b));
+  state[4] = _mm_extract_epi32 (e, 3);
+}
+
+#define SHA256_LOAD_X86(w, n) \
+  w = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 16 * (n))), swap)
+#define SHA256_SCHEDULE_X86(a, b, c, d)                                 \
+  a = _mm_sha256msg2_epu32 (_mm_add_epi32 (_mm_sha256msg1_epu32 (a, b),  \
+                                           _mm_alignr_epi8 (d, c, 4)), d)
+#define SHA256_STEP_X86(w, n)                                           \
+  msg = _mm_add_epi32 (w, _mm_loadu_si128 ((const __m128i *)(sha256_k + 4 * (n)))); \
+  cdgh = _mm_sha256rnds2_epu32 (cdgh, abef, msg);                       \
+  abef = _mm_sha256rnds2_epu32 (abef, cdgh, _mm_shuffle_epi32 (msg, 0x0e))
+#define SHA256_FOUR_X86(n)                                              \
+  SHA256_SCHEDULE_X86 (w0, w1, w2, w3); SHA256_STEP_X86 (w0, n);        \
+  SHA256_SCHEDULE_X86 (w1, w2, w3, w0); SHA256_STEP_X86 (w1, n + 1);    \
+  SHA256_SCHEDULE_X86 (w2, w3, w0, w1); SHA256_STEP_X86 (w2, n + 2);    \
+  SHA256_SCHEDULE_X86 (w3, w0, w1, w2); SHA256_STEP_X86 (w3, n + 3)
+
+static void SHA_TARGET
+sha256_blocks_shani (guint32 *state, const guint8 *data, gsize n_blocks)
+{
+  const __m128i swap = _mm_set_epi64x (0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i abef, cdgh, abef_save, cdgh_save, msg, tmp, w0, w1, w2, w3;
+
+  /* SHA256RNDS2 wants the state as ABEF and CDGH */
+  tmp = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)state), 0xb1);
+  cdgh = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)(state + 4)), 0x1b);
+  abef = _mm_alignr_epi8 (tmp, cdgh, 8);
+  cdgh = _mm_blend_epi16 (cdgh, tmp, 0xf0);
+
+  for (; n_blocks; n_blocks--, data += REST_SHA_BLOCK_SIZE) {
+    abef_save = abef;
+    cdgh_save = cdgh;
+
+    SHA256_LOAD_X86 (w0, 0);
+    SHA256_STEP_X86 (w0, 0);
+    SHA256_LOAD_X86 (w1, 1);
+    SHA256_STEP_X86 (w1, 1);
+    SHA256_LOAD_X86 (w2, 2);
+    SHA256_STEP_X86 (w2, 2);
+    SHA256_LOAD_X86 (w3, 3);
+    SHA256_STEP_X86 (w3, 3);
+
+    SHA256_FOUR_X86 (4);
+    SHA256_FOUR_X86 (8);
+    SHA256_FOUR_X86 (12);
+
+    abef = _mm_add_epi32 (abef, abef_save);
+    cdgh = _mm_add_epi32 (cdgh, cdgh_save);
+  }
+
+  tmp = _mm_shuffle_epi32 (abef, 0x1b);
+  cdgh = _mm_shuffle_epi32 (cdgh, 0xb1);
+  _mm_storeu_si128 ((__m128i *)state, _mm_blend_epi16 (tmp, cdgh, 0xf0));
+  _mm_storeu_si128 ((__m128i *)(state + 4), _mm_alignr_epi8 (cdgh, tmp, 8));
+}
+
+#elif SHA_ARM
+
+#if defined (__ARM_FEATURE_CRYPTO) || defined (__ARM_FEATURE_SHA2)
+#define SHA_TARGET
+#else
+#define SHA_TARGET __attribute__ ((target ("+crypto")))
+#endif
+
+static gboolean
+armv8_supported (void)
+{
+  unsigned long hwcap = getauxval (AT_HWCAP);
+
+  return (hwcap & HWCAP_SHA1) && (hwcap & HWCAP_SHA2);
+}
+
+static inline uint32x4_t SHA_TARGET
+load_be32x4 (const guint8 *data)
+{
+  return vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (data)));
+}
+
+#define SHA1_SCHEDULE_ARM(a, b, c, d) \
+  a = vsha1su1q_u32 (vsha1su0q_u32 (a, b, c), d)
+#define SHA1_STEP_ARM(w, round, k)                      \
+  wk = vaddq_u32 (w, vdupq_n_u32 (k));                  \
+  e_next = vsha1h_u32 (vgetq_lane_u32 (abcd, 0));       \
+  abcd = round (abcd, e, wk);                           \
+  e = e_next
+#define SHA1_FOUR_ARM(r0, k0, r1, k1, r2, k2, r3, k3)                   \
+  SHA1_SCHEDULE_ARM (w0, w1, w2, w3); SHA1_STEP_ARM (w0, r0, k0);       \
+  SHA1_SCHEDULE_ARM (w1, w2, w3, w0); SHA1_STEP_ARM (w1, r1, k1);       \
+  SHA1_SCHEDULE_ARM (w2, w3, w0, w1); SHA1_STEP_ARM (w2, r2, k2);       \
+  SHA1_SCHEDULE_ARM (w3, w0, w1, w2); SHA1_STEP_ARM (w3, r3, k3)
+
+#define K0 0x5a827999
+#define K1 0x6ed9eba1
+#define K2 0x8f1bbcdc
+#define K3 0xca62c1d6
+
+static void SHA_TARGET
+sha1_blocks_armv8 (guint32 *state, const guint8 *data, gsize n_blocks)
+{
+  uint32x4_t abcd, abcd_save, wk, w0, w1, w2, w3;
+  guint32 e, e_save, e_next;
+
+  abcd = vld1q_u32 (state);
+  e = state[4];
+
+  for (; n_blocks; n_blocks--, data += REST_SHA_BLOCK_SIZE) {
+    abcd_save = abcd;
+    e_save = e;
+
+    /* Rounds 0-15 */
+    w0 = load_be32x4 (data);
+    SHA1_STEP_ARM (w0, vsha1cq_u32, K0);
+    w1 = load_be32x4 (data + 16);
+    SHA1_STEP_ARM (w1, vsha1cq_u32, K0);
+    w2 = load_be32x4 (data + 32);
+    SHA1_STEP_ARM (w2, vsha1cq_u32, K0);
+    w3 = load_be32x4 (data + 48);
+    SHA1_STEP_ARM (w3, vsha1cq_u32, K0);
+
+    /* Rounds 16-79 */
+    SHA1_FOUR_ARM (vsha1cq_u32, K0, vsha1pq_u32, K1, vsha1pq_u32, K1, vsha1pq_u32, K1);
+    SHA1_FOUR_ARM (vsha1pq_u32, K1, vsha1pq_u32, K1, vsha1mq_u32, K2, vsha1mq_u32, K2);
+    SHA1_FOUR_ARM (vsha1mq_u32, K2, vsha1mq_u32, K2, vsha1mq_u32, K2, vsha1pq_u32, K3);
+    SHA1_FOUR_ARM (vsha1pq_u32, K3, vsha1pq_u32, K3, vsha1pq_u32, K3, vsha1pq_u32, K3);
+
+    abcd = vaddq_u32 (abcd, abcd_save);
+    e += e_save;
+  }
+
+  vst1q_u32 (state, abcd);
+  state[4] = e;
+}
+
+#define SHA256_SCHEDULE_ARM(a, b, c, d) \
+  a = vsha256su1q_u32 (vsha256su0q_u32 (a, b), c, d)
+#define SHA256_STEP_ARM(w, n)                           \
+  wk = vaddq_u32 (w, vld1q_u32 (sha256_k + 4 * (n)));   \
+  tmp = abcd;                                           \
+  abcd = vsha256hq_u32 (abcd, efgh, wk);                \
+  efgh = vsha256h2q_u32 (efgh, tmp, wk)
+#define SHA256_FOUR_ARM(n)                                              \
+  SHA256_SCHEDULE_ARM (w0, w1, w2, w3); SHA256_STEP_ARM (w0, n);        \
+  SHA256_SCHEDULE_ARM (w1, w2, w3, w0); SHA256_STEP_ARM (w1, n + 1);    \
+  SHA256_SCHEDULE_ARM (w2, w3, w0, w1); SHA256_STEP_ARM (w2, n + 2);    \
+  SHA256_SCHEDULE_ARM (w3, w0, w1, w2); SHA256_STEP_ARM (w3, n + 3)
+
+static void SHA_TARGET
+sha256_blocks_armv8 (guint32 *state, const guint8 *data, gsize n_blocks)
+{
+  uint32x4_t abcd, efgh, abcd_save, efgh_save, wk, tmp, w0, w1, w2, w3;
+
+  abcd = vld1q_u32 (state);
+  efgh = vld1q_u32 (state + 4);
+
+  for (; n_blocks; n_blocks--, data += REST_SHA_BLOCK_SIZE) {
+    abcd_save = abcd;
+    efgh_save = efgh;
+
+    w0 = load_be32x4 (data);
+    SHA256_STEP_ARM (w0, 0);
+    w1 = load_be32x4 (data + 16);
+    SHA256_STEP_ARM (w1, 1);
+    w2 = load_be32x4 (data + 32);
+    SHA256_STEP_ARM (w2, 2);
+    w3 = load_be32x4 (data + 48);
+    SHA256_STEP_ARM (w3, 3);
+
+    SHA256_FOUR_ARM (4);
+    SHA256_FOUR_ARM (8);
+    SHA256_FOUR_ARM (12);
+
+    abcd = vaddq_u32 (abcd, abcd_save);
+    efgh = vaddq_u32 (efgh, efgh_save);
+  }
+
+  vst1q_u32 (state, abcd);
+  vst1q_u32 (state + 4, efgh);
+}
+
+#endif
+
+/* In order of preference */
+static const ShaImpl impls[] = {
+#if SHA_X86
+  { "shani", shani_supported, sha1_blocks_shani, sha256_blocks_shani },
+#elif SHA_ARM
+  { "armv8", armv8_supported, sha1_blocks_armv8, sha256_blocks_armv8 },
+#endif
+  { "scalar", NULL, sha1_blocks_scalar, sha256_blocks_scalar }
+};
+
+static gpointer current_impl = NULL;
+
+static const ShaImpl *
+get_impl (void)
+{
+  const ShaImpl *impl;
+  guint i;
+
+  impl = g_atomic_pointer_get (&current_impl);
+  if (G_LIKELY (impl))
+    return impl;
+
+  /* The last entry is always supported.  Racing threads pick the same one. */
+  for (i = 0; i < G_N_ELEMENTS (impls) - 1; i++) {
+    if (impls[i].supported == NULL || impls[i].supported ())
+      break;
+  }
+  impl = &impls[i];
+
+  g_atomic_pointer_set (&current_impl, (gpointer)impl);
+
+  return impl;
+}
+
+/*
+ * The name of the implementation in use: "shani", "armv8" or "scalar".
+ */
+const char *
+_rest_sha_get_impl (void)
+{
+  return get_impl ()->name;
+}
+
+/*
+ * Use the implementation called @name, or the best one again if @name is
+ * %NULL.  Returns %FALSE if there is no such implementation or the CPU does not
+ * support it.  This is only meant for the benchmarks.
+ */
+gboolean
+_rest_sha_set_impl (const char *name)
+{
+  guint i;
+
+  if (name == NULL) {
+    g_atomic_pointer_set (&current_impl, NULL);
+    return TRUE;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    if (strcmp (impls[i].name, name) == 0) {
+      if (impls[i].supported && !impls[i].supported ())
+        return FALSE;
+      g_atomic_pointer_set (&current_impl, (gpointer)&impls[i]);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+gsize
+_rest_sha_digest_length (RestShaAlgorithm algorithm)
+{
+  return algorithm == REST_SHA1 ? REST_SHA1_LENGTH : REST_SHA256_LENGTH;
+}
+
+void
+_rest_sha_init (RestSha *sha, RestShaAlgorithm algorithm)
+{
+  static const guint32 sha1_init[5] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+  };
+  static const guint32 sha256_init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  g_return_if_fail (sha);
+
+  sha->algorithm = algorithm;
+  sha->length = 0;
+
+  if (algorithm == REST_SHA1)
+    memcpy (sha->state, sha1_init, sizeof (sha1_init));
+  else
+    memcpy (sha->state, sha256_init, sizeof (sha256_init));
+}
+
+static void
+update (RestSha *sha, const ShaImpl *impl, const guchar *data, gsize len)
+{
+  BlocksFunc blocks;
+  gsize used, fill;
+
+  blocks = sha->algorithm == REST_SHA1 ? impl->sha1 : impl->sha256;
+  used = sha->length % REST_SHA_BLOCK_SIZE;
+  sha->length += len;
+
+  if (used) {
+    fill = MIN (REST_SHA_BLOCK_SIZE - used, len);
+    memcpy (sha->buffer + used, data, fill);
+    data += fill;
+    len -= fill;
+
+    if (used + fill < REST_SHA_BLOCK_SIZE)
+      return;
+
+    blocks (sha->state, sha->buffer, 1);
+  }
+
+  if (len >= REST_SHA_BLOCK_SIZE) {
+    blocks (sha->state, data, len / REST_SHA_BLOCK_SIZE);
+    data += len & ~(gsize)(REST_SHA_BLOCK_SIZE - 1);
+    len &= REST_SHA_BLOCK_SIZE - 1;
+  }
+
+  memcpy (sha->buffer, data, len);
+}
+
+void
+_rest_sha_update (RestSha *sha, const guchar *data, gsize len)
+{
+  g_return_if_fail (sha);
+  g_return_if_fail (data || len == 0);
+
+  update (sha, get_impl (), data, len);
+}
+
+/*
+ * Finish the hash and write the digest to @digest, which must have room for
+ * _rest_sha_digest_length() bytes.  Returns the length of the digest.  @sha
+ * can't be updated afterwards, but can be initialised again.
+ */
+gsize
+_rest_sha_final (RestSha *sha, guchar *digest)
+{
+  const ShaImpl *impl;
+  guint8 pad[REST_SHA_BLOCK_SIZE + 8];
+  guint64 bits;
+  gsize used, pad_len, i, n;
+
+  g_return_val_if_fail (sha, 0);
+  g_return_val_if_fail (digest, 0);
+
+  impl = get_impl ();
+
+  /* A one bit, zeros up to 8 bytes short of a block, then the length in bits */
+  bits = sha->length * 8;
+  used = sha->length % REST_SHA_BLOCK_SIZE;
+  pad_len = (used < REST_SHA_BLOCK_SIZE - 8 ? REST_SHA_BLOCK_SIZE : 2 * REST_SHA_BLOCK_SIZE) - 8 - used;
+
+  memset (pad, 0, pad_len);
+  pad[0] = 0x80;
+  store_be32 (pad + pad_len, bits >> 32);
+  store_be32 (pad + pad_len + 4, bits);
+  update (sha, impl, pad, pad_len + 8);
+
+  n = _rest_sha_digest_length (sha->algorithm) / 4;
+  for (i = 0; i < n; i++)
+    store_be32 (digest + 4 * i, sha->state[i]);
+
+  return 4 * n;
+}
+
+#if BUILD_TESTS
+
+static void
+check_digest (const ShaImpl *impl, RestShaAlgorithm algorithm,
+              const char *data, gsize len, guint repeat, const char *expected)
+{
+  RestSha sha;
+  guchar digest[REST_SHA_MAX_LENGTH];
+  GString *hex;
+  gsize digest_len, i;
+
+  _rest_sha_init (&sha, algorithm);
+  for (i = 0; i < repeat; i++)
+    update (&sha, impl, (const guchar *)data, len);
+  digest_len = _rest_sha_final (&sha, digest);
+
+  hex = g_string_new (NULL);
+  for (i = 0; i < digest_len; i++)
+    g_string_append_printf (hex, "%02x", digest[i]);
+
+  if (strcmp (hex->str, expected) != 0)
+    g_error ("%s SHA-%s gave %s, expected %s", impl->name,
+             algorithm == REST_SHA1 ? "1" : "256", hex->str, expected);
+
+  g_string_free (hex, TRUE);
+}
+
+/* Test vectors from FIPS 180-2 and RFC 3174 */
+void
+test_sha (void)
+{
+  static const char long_message[] =
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  guchar data[1000], digest[REST_SHA_MAX_LENGTH];
+  GRand *rand;
+  guint i, round;
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    const ShaImpl *impl = &impls[i];
+
+    if (impl->supported && !impl->supported ())
+      continue;
+
+    check_digest (impl, REST_SHA1, "", 0, 1,
+                  "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    check_digest (impl, REST_SHA1, "abc", 3, 1,
+                  "a9993e364706816aba3e25717850c26c9cd0d89d");
+    check_digest (impl, REST_SHA1, long_message, strlen (long_message), 1,
+                  "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    check_digest (impl, REST_SHA1, "a", 1, 1000000,
+                  "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    check_digest (impl, REST_SHA1,
+                  "0123456701234567012345670123456701234567012345670123456701234567",
+                  64, 10, "dea356a2cddd90c7a7ecedc5ebb563934f460452");
+
+    check_digest (impl, REST_SHA256, "", 0, 1,
+                  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    check_digest (impl, REST_SHA256, "abc", 3, 1,
+                  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    check_digest (impl, REST_SHA256, long_message, strlen (long_message), 1,
+                  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    check_digest (impl, REST_SHA256, "a", 1, 1000000,
+                  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+  }
+
+  /* And random messages, fed in random pieces, against GChecksum */
+  rand = g_rand_new_with_seed (0x5a1);
+
+  for (round = 0; round < 200; round++) {
+    gsize len = g_rand_int_range (rand, 0, sizeof (data));
+    GChecksum *checksum;
+    gchar *expected;
+
+    for (i = 0; i < len; i++)
+      data[i] = g_rand_int_range (rand, 0, 256);
+
+    for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+      const ShaImpl *impl = &impls[i];
+      RestShaAlgorithm algorithm = round & 1 ? REST_SHA256 : REST_SHA1;
+      GString *hex;
+      RestSha sha;
+      gsize done, piece, j, digest_len;
+
+      if (impl->supported && !impl->supported ())
+        continue;
+
+      checksum = g_checksum_new (algorithm == REST_SHA1 ? G_CHECKSUM_SHA1 : G_CHECKSUM_SHA256);
+      g_checksum_update (checksum, data, len);
+      expected = g_strdup (g_checksum_get_string (checksum));
+      g_checksum_free (checksum);
+
+      _rest_sha_init (&sha, algorithm);
+      for (done = 0; done < len; done += piece) {
+        piece = g_rand_int_range (rand, 0, 200);
+        piece = MIN (len - done, piece);
+        update (&sha, impl, data + done, piece);
+      }
+      digest_len = _rest_sha_final (&sha, digest);
+
+      hex = g_string_new (NULL);
+      for (j = 0; j < digest_len; j++)
+        g_string_append_printf (hex, "%02x", digest[j]);
+      g_assert_cmpstr (hex->str, ==, expected);
+      g_string_free (hex, TRUE);
+      g_free (expected);
+    }
+  }
+
+  g_rand_free (rand);
+}
+
+#endif
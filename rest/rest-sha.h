@@ -0,0 +1,63 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_SHA
+#define _REST_SHA
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define REST_SHA_BLOCK_SIZE 64
+#define REST_SHA1_LENGTH 20
+#define REST_SHA256_LENGTH 32
+#define REST_SHA_MAX_LENGTH REST_SHA256_LENGTH
+
+typedef enum {
+  REST_SHA1,
+  REST_SHA256
+} RestShaAlgorithm;
+
+/*
+ * The state of a running hash.  This is a plain structure so that it can be
+ * kept on the stack, and copied by assignment to resume hashing from the same
+ * point more than once.
+ */
+typedef struct {
+  RestShaAlgorithm algorithm;
+  guint32 state[8];
+  guint64 length;
+  guint8 buffer[REST_SHA_BLOCK_SIZE];
+} RestSha;
+
+void _rest_sha_init (RestSha *sha, RestShaAlgorithm algorithm);
+
+void _rest_sha_update (RestSha *sha, const guchar *data, gsize len);
+
+gsize _rest_sha_final (RestSha *sha, guchar *digest);
+
+gsize _rest_sha_digest_length (RestShaAlgorithm algorithm);
+
+const char *_rest_sha_get_impl (void);
+
+gboolean _rest_sha_set_impl (const char *name);
+
+G_END_DECLS
+
+#endif /* _REST_SHA */
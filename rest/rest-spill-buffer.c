@@ -0,0 +1,260 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "rest-spill-buffer.h"
+
+/*
+ * A buffer for a response body which is held in memory, in a buffer from the
+ * proxy's pool, until it grows past a threshold, after which the whole body is
+ * moved to a temporary file and the rest is appended to that.  The file is
+ * unlinked as soon as it is created, so nothing is left behind, and when the
+ * body is complete it is mapped into memory.  The pages of the mapping are
+ * backed by the file rather than by swap, so the kernel can drop them whenever
+ * it needs the memory.
+ */
+
+/* The most memory allocated up front for a body of a known length.  The length
+ * comes from the server, so anything larger is allocated as it arrives. */
+#define SPILL_MAX_PREALLOC (1024 * 1024)
+
+struct _RestSpillBuffer {
+  /* -1 to never spill */
+  goffset threshold;
+  RestBufferPool *pool;
+  gchar *data;
+  gsize capacity;
+  /* -1 until the buffer has spilled */
+  int fd;
+  goffset length;
+};
+
+/*
+ * Create a buffer which spills to disk once it holds more than @threshold
+ * bytes, or never if @threshold is -1.  If the length of the body is known it
+ * can be passed as @size_hint, so that the memory for it is allocated once if
+ * it is not too large.
+ */
+RestSpillBuffer *
+_rest_spill_buffer_new (RestBufferPool *pool,
+                        goffset         threshold,
+                        goffset         size_hint)
+{
+  RestSpillBuffer *buffer;
+
+  g_return_val_if_fail (pool, NULL);
+
+  buffer = g_slice_new0 (RestSpillBuffer);
+  buffer->threshold = threshold < 0 ? -1 : threshold;
+  buffer->pool = _rest_buffer_pool_ref (pool);
+  buffer->fd = -1;
+
+  /* Leave room for the terminator added when finishing */
+  if (size_hint >= 0 && (threshold < 0 || size_hint <= threshold))
+    buffer->data = _rest_buffer_pool_alloc (pool,
+                                            MIN (size_hint, SPILL_MAX_PREALLOC) + 1,
+                                            &buffer->capacity);
+
+  return buffer;
+}
+
+static gboolean
+write_all (int           fd,
+           const gchar  *data,
+           gsize         len,
+           GError      **error)
+{
+  gssize n;
+
+  while (len > 0) {
+    n = write (fd, data, len);
+    if (n < 0) {
+      int errsv = errno;
+
+      if (errsv == EINTR)
+        continue;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Cannot write response to temporary file: %s",
+                   g_strerror (errsv));
+      return FALSE;
+    }
+
+    data += n;
+    len -= n;
+  }
+
+  return TRUE;
+}
+
+/* Move the body so far out of memory and into a temporary file */
+static gboolean
+spill (RestSpillBuffer  *buffer,
+       GError          **error)
+{
+  gchar *filename;
+
+  buffer->fd = g_file_open_tmp ("rest-response-XXXXXX", &filename, error);
+  if (buffer->fd < 0)
+    return FALSE;
+
+  g_unlink (filename);
+  g_free (filename);
+
+  if (!write_all (buffer->fd, buffer->data, buffer->length, error))
+    return FALSE;
+
+  _rest_buffer_pool_free (buffer->data);
+  buffer->data = NULL;
+  buffer->capacity = 0;
+
+  return TRUE;
+}
+
+/*
+ * Add @len bytes of @data to the end of @buffer, spilling it to a file if it
+ * grows past the threshold.  Returns %FALSE if the file could not be written.
+ */
+gboolean
+_rest_spill_buffer_append (RestSpillBuffer  *buffer,
+                           const gchar      *data,
+                           gsize             len,
+                           GError          **error)
+{
+  g_return_val_if_fail (buffer, FALSE);
+
+  if (buffer->fd < 0 && buffer->threshold >= 0 &&
+      buffer->length + (goffset)len > buffer->threshold) {
+    if (!spill (buffer, error))
+      return FALSE;
+  }
+
+  if (buffer->fd >= 0) {
+    if (!write_all (buffer->fd, data, len, error))
+      return FALSE;
+  } else {
+    if (buffer->length + len > buffer->capacity)
+      buffer->data = _rest_buffer_pool_realloc (buffer->pool, buffer->data,
+                                                buffer->length,
+                                                MAX (buffer->length + len,
+                                                     buffer->capacity * 2),
+                                                &buffer->capacity);
+    memcpy (buffer->data + buffer->length, data, len);
+  }
+
+  buffer->length += len;
+
+  return TRUE;
+}
+
+/*
+ * Free @buffer and return its contents, followed by a nul byte that is not
+ * counted in @length.  If @mapped is set to something other than 0 the
+ * contents are a mapping of that size and must be released with
+ * _rest_spill_buffer_unmap(), otherwise they are freed with
+ * _rest_buffer_pool_free().  Returns
+ * %NULL if a spilled buffer could not be mapped.
+ */
+gchar *
+_rest_spill_buffer_finish (RestSpillBuffer  *buffer,
+                           gsize            *length,
+                           gsize            *mapped,
+                           GError          **error)
+{
+  gchar *contents = NULL;
+
+  g_return_val_if_fail (buffer, NULL);
+  g_return_val_if_fail (length, NULL);
+  g_return_val_if_fail (mapped, NULL);
+
+  *length = 0;
+  *mapped = 0;
+
+  if (buffer->fd < 0) {
+    if (buffer->length + 1 > buffer->capacity)
+      buffer->data = _rest_buffer_pool_realloc (buffer->pool, buffer->data,
+                                                buffer->length,
+                                                buffer->length + 1,
+                                                &buffer->capacity);
+    buffer->data[buffer->length] = '\0';
+
+    *length = buffer->length;
+    contents = buffer->data;
+    buffer->data = NULL;
+  } else if (write_all (buffer->fd, "", 1, error)) {
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+    gpointer addr;
+
+    addr = mmap (NULL, buffer->length + 1, PROT_READ, MAP_PRIVATE,
+                 buffer->fd, 0);
+    if (addr != MAP_FAILED) {
+      contents = addr;
+      *length = buffer->length;
+      *mapped = buffer->length + 1;
+    } else {
+      int errsv = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Cannot map response: %s", g_strerror (errsv));
+    }
+#else
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "Cannot map response");
+#endif
+  }
+
+  _rest_spill_buffer_free (buffer);
+
+  return contents;
+}
+
+/* Release the contents returned by _rest_spill_buffer_finish() */
+void
+_rest_spill_buffer_unmap (gchar *contents,
+                          gsize  mapped)
+{
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+  if (contents)
+    munmap (contents, mapped);
+#endif
+}
+
+void
+_rest_spill_buffer_free (RestSpillBuffer *buffer)
+{
+  if (buffer == NULL)
+    return;
+
+  _rest_buffer_pool_free (buffer->data);
+  _rest_buffer_pool_unref (buffer->pool);
+  /* The mapping, if any, stays valid after the file is closed */
+  if (buffer->fd >= 0)
+    close (buffer->fd);
+
+  g_slice_free (RestSpillBuffer, buffer);
+}
@@ -0,0 +1,51 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_SPILL_BUFFER
+#define _REST_SPILL_BUFFER
+
+#include <glib.h>
+#include "rest-buffer-pool.h"
+
+G_BEGIN_DECLS
+
+typedef struct _RestSpillBuffer RestSpillBuffer;
+
+RestSpillBuffer *_rest_spill_buffer_new (RestBufferPool *pool,
+                                         goffset         threshold,
+                                         goffset         size_hint);
+
+gboolean _rest_spill_buffer_append (RestSpillBuffer  *buffer,
+                                    const gchar      *data,
+                                    gsize             len,
+                                    GError          **error);
+
+gchar *_rest_spill_buffer_finish (RestSpillBuffer  *buffer,
+                                  gsize            *length,
+                                  gsize            *mapped,
+                                  GError          **error);
+
+void _rest_spill_buffer_unmap (gchar *contents,
+                               gsize  mapped);
+
+void _rest_spill_buffer_free (RestSpillBuffer *buffer);
+
+G_END_DECLS
+
+#endif /* _REST_SPILL_BUFFER */
@@ -0,0 +1,886 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__)) && \
+  (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define CODEC_X86 1
+#include <immintrin.h>
+#elif defined (__aarch64__) && defined (__ARM_NEON)
+#define CODEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "rest-text-codec.h"
+
+/*
+ * Percent, base64 and hex encoders for the strings that go into signatures
+ * and query strings.  Each has a portable scalar version and vector versions
+ * for SSE2, SSSE3 and AVX2 (picked at runtime from what the CPU supports) or
+ * NEON.  They all produce exactly the same output as the GLib and libsoup
+ * functions they replace.
+ *
+ * The vector versions may use all of the space the REST_*_ENCODED macros
+ * allow for as scratch, even when the encoded string turns out shorter.
+ */
+
+typedef gsize (*EncodeFunc) (gchar *out, const guchar *in, gsize len);
+
+typedef struct {
+  const char *name;
+  gboolean (*supported) (void);
+  EncodeFunc percent;
+  EncodeFunc base64;
+  EncodeFunc hex;
+} CodecImpl;
+
+static const char hex_upper[] = "0123456789ABCDEF";
+static const char hex_lower[] = "0123456789abcdef";
+static const char base64_alphabet[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*
+ * The RFC 3986 unreserved characters, which are the only ones that OAuth
+ * leaves unencoded.
+ */
+static const guint8 unreserved[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline gchar *
+percent_encode_byte (gchar *out, guchar c)
+{
+  if (unreserved[c]) {
+    *out++ = c;
+  } else {
+    *out++ = '%';
+    *out++ = hex_upper[c >> 4];
+    *out++ = hex_upper[c & 0xf];
+  }
+
+  return out;
+}
+
+static gsize
+percent_encode_scalar (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+
+  while (len--)
+    out = percent_encode_byte (out, *in++);
+
+  return out - start;
+}
+
+/* Also used for the last few bytes by the vector versions, for the padding */
+static gsize
+base64_encode_scalar (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+  guint32 v;
+
+  for (; len >= 3; in += 3, len -= 3) {
+    v = in[0] << 16 | in[1] << 8 | in[2];
+    *out++ = base64_alphabet[v >> 18];
+    *out++ = base64_alphabet[(v >> 12) & 0x3f];
+    *out++ = base64_alphabet[(v >> 6) & 0x3f];
+    *out++ = base64_alphabet[v & 0x3f];
+  }
+
+  if (len) {
+    v = in[0] << 16 | (len > 1 ? in[1] << 8 : 0);
+    *out++ = base64_alphabet[v >> 18];
+    *out++ = base64_alphabet[(v >> 12) & 0x3f];
+    *out++ = len > 1 ? base64_alphabet[(v >> 6) & 0x3f] : '=';
+    *out++ = '=';
+  }
+
+  return out - start;
+}
+
+static gsize
+hex_encode_scalar (gchar *out, const guchar *in, gsize len)
+{
+  gsize i;
+
+  for (i = 0; i < len; i++) {
+    out[2 * i] = hex_lower[in[i] >> 4];
+    out[2 * i + 1] = hex_lower[in[i] & 0xf];
+  }
+
+  return 2 * len;
+}
+
+#if CODEC_X86
+
+#define TARGET(t) __attribute__ ((target (t)))
+/*
+ * For the 128-bit versions, which the AVX2 ones finish with: inlining them
+ * there keeps the tails in VEX-encoded code, avoiding the penalty for mixing
+ * that with legacy SSE code.
+ */
+#define TAIL_INLINE __attribute__ ((always_inline))
+
+static gboolean
+sse2_supported (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("sse2");
+}
+
+static gboolean
+ssse3_supported (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("ssse3");
+}
+
+static gboolean
+avx2_supported (void)
+{
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2");
+}
+
+/* 0xff in each byte where lo <= v <= lo + n, comparing as unsigned */
+static inline __m128i TARGET ("sse2")
+in_range_sse2 (__m128i v, char lo, char n)
+{
+  __m128i d = _mm_sub_epi8 (v, _mm_set1_epi8 (lo));
+  return _mm_cmpeq_epi8 (_mm_min_epu8 (d, _mm_set1_epi8 (n)), d);
+}
+
+static inline __m128i TARGET ("sse2")
+unreserved_sse2 (__m128i v)
+{
+  __m128i m;
+
+  /* Setting 0x20 folds upper case onto lower case without creating letters */
+  m = in_range_sse2 (_mm_or_si128 (v, _mm_set1_epi8 (0x20)), 'a', 'z' - 'a');
+  m = _mm_or_si128 (m, in_range_sse2 (v, '0', 9));
+  m = _mm_or_si128 (m, in_range_sse2 (v, '-', '.' - '-'));
+  m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('_')));
+  m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, _mm_set1_epi8 ('~')));
+
+  return m;
+}
+
+/*
+ * Copy blocks straight through while they are entirely unreserved, and drop
+ * to the scalar encoder for the rest of any block that is not.
+ */
+static inline gsize TARGET ("sse2") TAIL_INLINE
+percent_encode_sse2 (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+  guint mask, run;
+  __m128i v;
+
+  while (len >= 16) {
+    v = _mm_loadu_si128 ((const __m128i *)in);
+    mask = _mm_movemask_epi8 (unreserved_sse2 (v));
+
+    _mm_storeu_si128 ((__m128i *)out, v);
+    if (mask == 0xffff) {
+      run = 16;
+    } else {
+      run = __builtin_ctz (~mask);
+      out += percent_encode_scalar (out + run, in + run, 16 - run);
+    }
+
+    in += 16;
+    out += run;
+    len -= 16;
+  }
+
+  return (out - start) + percent_encode_scalar (out, in, len);
+}
+
+static inline __m128i TARGET ("sse2")
+nibbles_to_hex_sse2 (__m128i n)
+{
+  __m128i letters = _mm_and_si128 (_mm_cmpgt_epi8 (n, _mm_set1_epi8 (9)),
+                                   _mm_set1_epi8 ('a' - '0' - 10));
+  return _mm_add_epi8 (n, _mm_add_epi8 (_mm_set1_epi8 ('0'), letters));
+}
+
+static inline gsize TARGET ("sse2") TAIL_INLINE
+hex_encode_sse2 (gchar *out, const guchar *in, gsize len)
+{
+  const __m128i low = _mm_set1_epi8 (0x0f);
+  __m128i v, hi, lo;
+  gsize i;
+
+  for (i = 0; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128 ((const __m128i *)(in + i));
+    hi = _mm_and_si128 (_mm_srli_epi16 (v, 4), low);
+    lo = _mm_and_si128 (v, low);
+    _mm_storeu_si128 ((__m128i *)(out + 2 * i),
+                      nibbles_to_hex_sse2 (_mm_unpacklo_epi8 (hi, lo)));
+    _mm_storeu_si128 ((__m128i *)(out + 2 * i + 16),
+                      nibbles_to_hex_sse2 (_mm_unpackhi_epi8 (hi, lo)));
+  }
+
+  return 2 * i + hex_encode_scalar (out + 2 * i, in + i, len - i);
+}
+
+/*
+ * Base64 with the byte shuffle and multiply-shift approach of Muła and
+ * Klomp: spread each 3 input bytes over 4 output bytes, pull the four 6-bit
+ * fields into place, then map them onto the alphabet by adding an offset
+ * chosen from which of the five ranges each falls into.
+ */
+static inline __m128i TARGET ("ssse3")
+base64_reshuffle_ssse3 (__m128i in)
+{
+  __m128i t0, t1, t2, t3;
+
+  in = _mm_shuffle_epi8 (in, _mm_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7,
+                                           4, 5, 3, 4, 1, 2, 0, 1));
+  t0 = _mm_and_si128 (in, _mm_set1_epi32 (0x0fc0fc00));
+  t1 = _mm_mulhi_epu16 (t0, _mm_set1_epi32 (0x04000040));
+  t2 = _mm_and_si128 (in, _mm_set1_epi32 (0x003f03f0));
+  t3 = _mm_mullo_epi16 (t2, _mm_set1_epi32 (0x01000010));
+
+  return _mm_or_si128 (t1, t3);
+}
+
+static inline __m128i TARGET ("ssse3")
+base64_translate_ssse3 (__m128i in)
+{
+  const __m128i offsets = _mm_setr_epi8 ('A', 'a' - 26,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                         '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+                                         0, 0);
+  __m128i index;
+
+  /* 0 for A-Z, 1 for a-z, 2-11 for 0-9, 12 for + and 13 for / */
+  index = _mm_subs_epu8 (in, _mm_set1_epi8 (51));
+  index = _mm_sub_epi8 (index, _mm_cmpgt_epi8 (in, _mm_set1_epi8 (25)));
+
+  return _mm_add_epi8 (in, _mm_shuffle_epi8 (offsets, index));
+}
+
+static inline gsize TARGET ("ssse3") TAIL_INLINE
+base64_encode_ssse3 (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+  __m128i v;
+
+  /* Each step loads 16 bytes but only encodes the first 12 */
+  while (len >= 16) {
+    v = _mm_loadu_si128 ((const __m128i *)in);
+    _mm_storeu_si128 ((__m128i *)out,
+                      base64_translate_ssse3 (base64_reshuffle_ssse3 (v)));
+    in += 12;
+    out += 16;
+    len -= 12;
+  }
+
+  return (out - start) + base64_encode_scalar (out, in, len);
+}
+
+static inline __m256i TARGET ("avx2")
+in_range_avx2 (__m256i v, char lo, char n)
+{
+  __m256i d = _mm256_sub_epi8 (v, _mm256_set1_epi8 (lo));
+  return _mm256_cmpeq_epi8 (_mm256_min_epu8 (d, _mm256_set1_epi8 (n)), d);
+}
+
+static inline __m256i TARGET ("avx2")
+unreserved_avx2 (__m256i v)
+{
+  __m256i m;
+
+  m = in_range_avx2 (_mm256_or_si256 (v, _mm256_set1_epi8 (0x20)), 'a', 'z' - 'a');
+  m = _mm256_or_si256 (m, in_range_avx2 (v, '0', 9));
+  m = _mm256_or_si256 (m, in_range_avx2 (v, '-', '.' - '-'));
+  m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('_')));
+  m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v, _mm256_set1_epi8 ('~')));
+
+  return m;
+}
+
+static gsize TARGET ("avx2")
+percent_encode_avx2 (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+  guint32 mask, run;
+  __m256i v;
+
+  while (len >= 32) {
+    v = _mm256_loadu_si256 ((const __m256i *)in);
+    mask = _mm256_movemask_epi8 (unreserved_avx2 (v));
+
+    _mm256_storeu_si256 ((__m256i *)out, v);
+    if (mask == 0xffffffff) {
+      run = 32;
+    } else {
+      run = __builtin_ctz (~mask);
+      out += percent_encode_scalar (out + run, in + run, 32 - run);
+    }
+
+    in += 32;
+    out += run;
+    len -= 32;
+  }
+
+  return (out - start) + percent_encode_sse2 (out, in, len);
+}
+
+static inline __m256i TARGET ("avx2")
+nibbles_to_hex_avx2 (__m256i n)
+{
+  __m256i letters = _mm256_and_si256 (_mm256_cmpgt_epi8 (n, _mm256_set1_epi8 (9)),
+                                      _mm256_set1_epi8 ('a' - '0' - 10));
+  return _mm256_add_epi8 (n, _mm256_add_epi8 (_mm256_set1_epi8 ('0'), letters));
+}
+
+static gsize TARGET ("avx2")
+hex_encode_avx2 (gchar *out, const guchar *in, gsize len)
+{
+  const __m256i low = _mm256_set1_epi8 (0x0f);
+  __m256i v, hi, lo;
+  gsize i;
+
+  for (i = 0; i + 32 <= len; i += 32) {
+    /*
+     * The unpacks work within each 128-bit lane, so first swap the middle
+     * quarters to leave the input for each 32 bytes of output in one lane.
+     */
+    v = _mm256_loadu_si256 ((const __m256i *)(in + i));
+    v = _mm256_permute4x64_epi64 (v, 0xd8);
+    hi = _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low);
+    lo = _mm256_and_si256 (v, low);
+    _mm256_storeu_si256 ((__m256i *)(out + 2 * i),
+                         nibbles_to_hex_avx2 (_mm256_unpacklo_epi8 (hi, lo)));
+    _mm256_storeu_si256 ((__m256i *)(out + 2 * i + 32),
+                         nibbles_to_hex_avx2 (_mm256_unpackhi_epi8 (hi, lo)));
+  }
+
+  return 2 * i + hex_encode_sse2 (out + 2 * i, in + i, len - i);
+}
+
+static inline __m256i TARGET ("avx2")
+base64_reshuffle_avx2 (__m256i in)
+{
+  __m256i t0, t1, t2, t3;
+
+  in = _mm256_shuffle_epi8 (in, _mm256_set_epi8 (10, 11, 9, 10, 7, 8, 6, 7,
+                                                 4, 5, 3, 4, 1, 2, 0, 1,
+                                                 10, 11, 9, 10, 7, 8, 6, 7,
+                                                 4, 5, 3, 4, 1, 2, 0, 1));
+  t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0fc0fc00));
+  t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+  t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003f03f0));
+  t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+
+  return _mm256_or_si256 (t1, t3);
+}
+
+static inline __m256i TARGET ("avx2")
+base64_translate_avx2 (__m256i in)
+{
+  const __m256i offsets = _mm256_setr_epi8 ('A', 'a' - 26,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+                                            0, 0,
+                                            'A', 'a' - 26,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+                                            0, 0);
+  __m256i index;
+
+  index = _mm256_subs_epu8 (in, _mm256_set1_epi8 (51));
+  index = _mm256_sub_epi8 (index, _mm256_cmpgt_epi8 (in, _mm256_set1_epi8 (25)));
+
+  return _mm256_add_epi8 (in, _mm256_shuffle_epi8 (offsets, index));
+}
+
+static gsize TARGET ("avx2")
+base64_encode_avx2 (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+  __m256i v;
+
+  /*
+   * The shuffle cannot cross lanes, so load 12 bytes into the bottom of each
+   * lane; the second load reads up to 28 bytes in.
+   */
+  while (len >= 28) {
+    v = _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *)in));
+    v = _mm256_inserti128_si256 (v, _mm_loadu_si128 ((const __m128i *)(in + 12)), 1);
+    _mm256_storeu_si256 ((__m256i *)out,
+                         base64_translate_avx2 (base64_reshuffle_avx2 (v)));
+    in += 24;
+    out += 32;
+    len -= 24;
+  }
+
+  return (out - start) + base64_encode_ssse3 (out, in, len);
+}
+
+#elif CODEC_NEON
+
+static inline uint8x16_t
+in_range_neon (uint8x16_t v, guint8 lo, guint8 n)
+{
+  return vcleq_u8 (vsubq_u8 (v, vdupq_n_u8 (lo)), vdupq_n_u8 (n));
+}
+
+static inline uint8x16_t
+unreserved_neon (uint8x16_t v)
+{
+  uint8x16_t m;
+
+  m = in_range_neon (vorrq_u8 (v, vdupq_n_u8 (0x20)), 'a', 'z' - 'a');
+  m = vorrq_u8 (m, in_range_neon (v, '0', 9));
+  m = vorrq_u8 (m, in_range_neon (v, '-', '.' - '-'));
+  m = vorrq_u8 (m, vceqq_u8 (v, vdupq_n_u8 ('_')));
+  m = vorrq_u8 (m, vceqq_u8 (v, vdupq_n_u8 ('~')));
+
+  return m;
+}
+
+static gsize
+percent_encode_neon (gchar *out, const guchar *in, gsize len)
+{
+  gchar *start = out;
+  uint8x16_t v;
+  guint64 mask;
+  guint run;
+
+  while (len >= 16) {
+    v = vld1q_u8 (in);
+
+    /* Narrow the byte mask to a nibble per byte, as NEON has no movemask */
+    mask = vget_lane_u64 (vreinterpret_u64_u8 (
+             vshrn_n_u16 (vreinterpretq_u16_u8 (unreserved_neon (v)), 4)), 0);
+
+    vst1q_u8 ((guint8 *)out, v);
+    if (mask == G_GUINT64_CONSTANT (0xffffffffffffffff)) {
+      run = 16;
+    } else {
+      run = __builtin_ctzll (~mask) / 4;
+      out += percent_encode_scalar (out + run, in + run, 16 - run);
+    }
+
+    in += 16;
+    out += run;
+    len -= 16;
+  }
+
+  return (out - start) + percent_encode_scalar (out, in, len);
+}
+
+static gsize
+hex_encode_neon (gchar *out, const guchar *in, gsize len)
+{
+  const uint8x16_t digits = vld1q_u8 ((const guint8 *)hex_lower);
+  uint8x16x2_t n;
+  uint8x16_t v;
+  gsize i;
+
+  for (i = 0; i + 16 <= len; i += 16) {
+    v = vld1q_u8 (in + i);
+    n.val[0] = vqtbl1q_u8 (digits, vshrq_n_u8 (v, 4));
+    n.val[1] = vqtbl1q_u8 (digits, vandq_u8 (v, vdupq_n_u8 (0x0f)));
+    vst2q_u8 ((guint8 *)(out + 2 * i), n);
+  }
+
+  return 2 * i + hex_encode_scalar (out + 2 * i, in + i, len - i);
+}
+
+static gsize
+base64_encode_neon (gchar *out, const guchar *in, gsize len)
+{
+  const guint8 *alphabet = (const guint8 *)base64_alphabet;
+  const uint8x16_t field = vdupq_n_u8 (0x3f);
+  uint8x16x4_t table, o;
+  uint8x16x3_t s;
+  gchar *start = out;
+
+  table.val[0] = vld1q_u8 (alphabet);
+  table.val[1] = vld1q_u8 (alphabet + 16);
+  table.val[2] = vld1q_u8 (alphabet + 32);
+  table.val[3] = vld1q_u8 (alphabet + 48);
+
+  /* De-interleave 16 groups of 3 bytes, and interleave the 4 output bytes */
+  while (len >= 48) {
+    s = vld3q_u8 (in);
+    o.val[0] = vshrq_n_u8 (s.val[0], 2);
+    o.val[1] = vandq_u8 (vorrq_u8 (vshlq_n_u8 (s.val[0], 4),
+                                   vshrq_n_u8 (s.val[1], 4)), field);
+    o.val[2] = vandq_u8 (vorrq_u8 (vshlq_n_u8 (s.val[1], 2),
+                                   vshrq_n_u8 (s.val[2], 6)), field);
+    o.val[3] = vandq_u8 (s.val[2], field);
+
+    o.val[0] = vqtbl4q_u8 (table, o.val[0]);
+    o.val[1] = vqtbl4q_u8 (table, o.val[1]);
+    o.val[2] = vqtbl4q_u8 (table, o.val[2]);
+    o.val[3] = vqtbl4q_u8 (table, o.val[3]);
+    vst4q_u8 ((guint8 *)out, o);
+
+    in += 48;
+    out += 64;
+    len -= 48;
+  }
+
+  return (out - start) + base64_encode_scalar (out, in, len);
+}
+
+#endif
+
+/* In order of preference */
+static const CodecImpl impls[] = {
+#if CODEC_X86
+  { "avx2", avx2_supported,
+    percent_encode_avx2, base64_encode_avx2, hex_encode_avx2 },
+  { "ssse3", ssse3_supported,
+    percent_encode_sse2, base64_encode_ssse3, hex_encode_sse2 },
+  { "sse2", sse2_supported,
+    percent_encode_sse2, base64_encode_scalar, hex_encode_sse2 },
+#elif CODEC_NEON
+  { "neon", NULL,
+    percent_encode_neon, base64_encode_neon, hex_encode_neon },
+#endif
+  { "scalar", NULL,
+    percent_encode_scalar, base64_encode_scalar, hex_encode_scalar }
+};
+
+static gpointer current_impl = NULL;
+
+static const CodecImpl *
+get_impl (void)
+{
+  const CodecImpl *impl;
+  guint i;
+
+  impl = g_atomic_pointer_get (&current_impl);
+  if (G_LIKELY (impl))
+    return impl;
+
+  /* The last entry is always supported.  Racing threads pick the same one. */
+  for (i = 0; i < G_N_ELEMENTS (impls) - 1; i++) {
+    if (impls[i].supported == NULL || impls[i].supported ())
+      break;
+  }
+  impl = &impls[i];
+
+  g_atomic_pointer_set (&current_impl, (gpointer)impl);
+
+  return impl;
+}
+
+/*
+ * The name of the implementation in use: "avx2", "ssse3", "sse2", "neon" or
+ * "scalar".
+ */
+const char *
+_rest_text_codec_get_impl (void)
+{
+  return get_impl ()->name;
+}
+
+/*
+ * Use the implementation called @name, or the best one again if @name is
+ * %NULL.  Returns %FALSE if there is no such implementation or the CPU does not
+ * support it.  This is only meant for the benchmarks.
+ */
+gboolean
+_rest_text_codec_set_impl (const char *name)
+{
+  guint i;
+
+  if (name == NULL) {
+    g_atomic_pointer_set (&current_impl, NULL);
+    return TRUE;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    if (strcmp (impls[i].name, name) == 0) {
+      if (impls[i].supported && !impls[i].supported ())
+        return FALSE;
+      g_atomic_pointer_set (&current_impl, (gpointer)&impls[i]);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/*
+ * Percent-encode the @len bytes at @in into @out, leaving only the unreserved
+ * characters alone as OAuth requires.  @out must have room for
+ * REST_PERCENT_ENCODED_MAX(@len) bytes.  Returns the number of bytes written,
+ * without a terminating nul.
+ */
+gsize
+_rest_percent_encode (gchar *out, const gchar *in, gsize len)
+{
+  return get_impl ()->percent (out, (const guchar *)in, len);
+}
+
+/*
+ * Percent-encode @s as _rest_percent_encode() does, returning a newly
+ * allocated string.  %NULL is encoded as the empty string.  The same as
+ * soup_uri_encode (s, "!$&'()*+,;=@").
+ */
+gchar *
+_rest_percent_encode_string (const gchar *s)
+{
+  gsize len;
+  gchar *out;
+
+  if (s == NULL)
+    return g_strdup ("");
+
+  len = strlen (s);
+  out = g_malloc (REST_PERCENT_ENCODED_MAX (len) + 1);
+  out[_rest_percent_encode (out, s, len)] = '\0';
+
+  return out;
+}
+
+/*
+ * Append @s to @string, percent-encoded as _rest_percent_encode() does.
+ * Nothing is appended if @s is %NULL.
+ */
+void
+_rest_string_append_percent_encoded (GString *string, const gchar *s)
+{
+  gsize len, old_len;
+
+  g_return_if_fail (string);
+
+  if (s == NULL)
+    return;
+
+  len = strlen (s);
+  old_len = string->len;
+
+  g_string_set_size (string, old_len + REST_PERCENT_ENCODED_MAX (len));
+  g_string_truncate (string,
+                     old_len + _rest_percent_encode (string->str + old_len, s, len));
+}
+
+/*
+ * Base64-encode the @len bytes at @in into @out, which must have room for
+ * REST_BASE64_ENCODED_LEN(@len) bytes.  Returns the number of bytes written,
+ * without a terminating nul.
+ */
+gsize
+_rest_base64_encode (gchar *out, const guchar *in, gsize len)
+{
+  return get_impl ()->base64 (out, in, len);
+}
+
+/*
+ * Base64-encode @in, returning a newly allocated string.  The same as
+ * g_base64_encode().
+ */
+gchar *
+_rest_base64_encode_string (const guchar *in, gsize len)
+{
+  gchar *out;
+
+  out = g_malloc (REST_BASE64_ENCODED_LEN (len) + 1);
+  out[_rest_base64_encode (out, in, len)] = '\0';
+
+  return out;
+}
+
+/*
+ * Write the @len bytes at @in into @out as lower case hex, which needs
+ * REST_HEX_ENCODED_LEN(@len) bytes.  Returns the number of bytes written,
+ * without a terminating nul.
+ */
+gsize
+_rest_hex_encode (gchar *out, const guchar *in, gsize len)
+{
+  return get_impl ()->hex (out, in, len);
+}
+
+/*
+ * Hex-encode @in, returning a newly allocated string.  The same as
+ * g_checksum_get_string() gives for a digest.
+ */
+gchar *
+_rest_hex_encode_string (const guchar *in, gsize len)
+{
+  gchar *out;
+
+  out = g_malloc (REST_HEX_ENCODED_LEN (len) + 1);
+  out[_rest_hex_encode (out, in, len)] = '\0';
+
+  return out;
+}
+
+#if BUILD_TESTS
+
+#include <libsoup/soup.h>
+
+#define FUZZ_ROUNDS 4000
+#define FUZZ_MAX_LEN 300
+/* Misalign the input, and leave a guard after the space the output may use */
+#define FUZZ_SLACK 32
+
+static void
+fuzz_fill (GRand *rand, guchar *buf, gsize len)
+{
+  static const char plain[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._~";
+  int mode;
+  gsize i;
+
+  /*
+   * Random bytes, entirely unreserved characters, or unreserved characters
+   * with the occasional other byte, so that the percent encoders go down each
+   * of their paths.  There are no nuls so libsoup can encode it too.
+   */
+  mode = g_rand_int_range (rand, 0, 3);
+  for (i = 0; i < len; i++) {
+    if (mode == 0 || (mode == 2 && g_rand_int_range (rand, 0, 16) == 0))
+      buf[i] = g_rand_int_range (rand, 1, 256);
+    else
+      buf[i] = plain[g_rand_int_range (rand, 0, sizeof (plain) - 1)];
+  }
+}
+
+static void
+fuzz_check (const char *what, const CodecImpl *impl, EncodeFunc func,
+            const guchar *in, gsize len, gsize space, const char *expected)
+{
+  guchar out[REST_PERCENT_ENCODED_MAX (FUZZ_MAX_LEN) + FUZZ_SLACK];
+  gsize written, i;
+
+  memset (out, 0xaa, sizeof (out));
+  written = func ((gchar *)out, in, len);
+
+  if (written != strlen (expected) ||
+      memcmp (out, expected, written) != 0) {
+    g_error ("%s %s of %" G_GSIZE_FORMAT " bytes gave \"%.*s\", expected \"%s\"",
+             impl->name, what, len, (int)written, (char *)out, expected);
+  }
+
+  for (i = space; i < sizeof (out); i++) {
+    if (out[i] != 0xaa)
+      g_error ("%s %s of %" G_GSIZE_FORMAT " bytes wrote past the end",
+               impl->name, what, len);
+  }
+}
+
+void
+test_text_codec (void)
+{
+  guchar buf[FUZZ_MAX_LEN + FUZZ_SLACK + 1];
+  GRand *rand;
+  GString *hex;
+  guint round, i;
+
+  rand = g_rand_new_with_seed (0x5e11);
+  hex = g_string_new (NULL);
+
+  for (round = 0; round < FUZZ_ROUNDS; round++) {
+    gsize offset, len, j;
+    guchar *in;
+    char *percent, *base64;
+
+    offset = g_rand_int_range (rand, 0, FUZZ_SLACK);
+    len = g_rand_int_range (rand, 0, FUZZ_MAX_LEN + 1);
+    in = buf + offset;
+    fuzz_fill (rand, in, len);
+    in[len] = '\0';
+
+    percent = soup_uri_encode ((char *)in, "!$&'()*+,;=@");
+    base64 = g_base64_encode (in, len);
+    g_string_truncate (hex, 0);
+    for (j = 0; j < len; j++)
+      g_string_append_printf (hex, "%02x", in[j]);
+
+    for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+      const CodecImpl *impl = &impls[i];
+
+      if (impl->supported && !impl->supported ())
+        continue;
+
+      fuzz_check ("percent", impl, impl->percent, in, len,
+                  REST_PERCENT_ENCODED_MAX (len), percent);
+      fuzz_check ("base64", impl, impl->base64, in, len,
+                  REST_BASE64_ENCODED_LEN (len), base64);
+      fuzz_check ("hex", impl, impl->hex, in, len,
+                  REST_HEX_ENCODED_LEN (len), hex->str);
+    }
+
+    g_free (percent);
+    g_free (base64);
+  }
+
+  g_string_free (hex, TRUE);
+  g_rand_free (rand);
+
+  /* And through the public functions, with whichever implementation is best */
+  {
+    GString *s = g_string_new ("a=");
+    char *encoded;
+
+    encoded = _rest_percent_encode_string (NULL);
+    g_assert_cmpstr (encoded, ==, "");
+    g_free (encoded);
+
+    encoded = _rest_percent_encode_string ("Ladies + Gentlemen");
+    g_assert_cmpstr (encoded, ==, "Ladies%20%2B%20Gentlemen");
+    g_free (encoded);
+
+    _rest_string_append_percent_encoded (s, "a/b~c");
+    g_assert_cmpstr (s->str, ==, "a=a%2Fb~c");
+    g_string_free (s, TRUE);
+
+    encoded = _rest_base64_encode_string ((const guchar *)"foob", 4);
+    g_assert_cmpstr (encoded, ==, "Zm9vYg==");
+    g_free (encoded);
+
+    encoded = _rest_hex_encode_string ((const guchar *)"\x01\xab\xff", 3);
+    g_assert_cmpstr (encoded, ==, "01abff");
+    g_free (encoded);
+  }
+}
+
+#endif
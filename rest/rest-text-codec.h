@@ -0,0 +1,52 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef _REST_TEXT_CODEC
+#define _REST_TEXT_CODEC
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The most space that encoding @len bytes can need, excluding any nul */
+#define REST_PERCENT_ENCODED_MAX(len) ((len) * 3)
+#define REST_BASE64_ENCODED_LEN(len) (((len) + 2) / 3 * 4)
+#define REST_HEX_ENCODED_LEN(len) ((len) * 2)
+
+gsize _rest_percent_encode (gchar *out, const gchar *in, gsize len);
+
+gchar *_rest_percent_encode_string (const gchar *s);
+
+void _rest_string_append_percent_encoded (GString *string, const gchar *s);
+
+gsize _rest_base64_encode (gchar *out, const guchar *in, gsize len);
+
+gchar *_rest_base64_encode_string (const guchar *in, gsize len);
+
+gsize _rest_hex_encode (gchar *out, const guchar *in, gsize len);
+
+gchar *_rest_hex_encode_string (const guchar *in, gsize len);
+
+const char *_rest_text_codec_get_impl (void);
+
+gboolean _rest_text_codec_set_impl (const char *name);
+
+G_END_DECLS
+
+#endif /* _REST_TEXT_CODEC */
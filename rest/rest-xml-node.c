@@ -22,6 +22,7 @@
  */
 
 #include "rest-xml-node.h"
+#include "rest-private.h"
 
 #define G(x) (gchar *)x
 
@@ -246,7 +247,7 @@ rest_xml_node_find (RestXmlNode *start,
   g_return_val_if_fail (start, NULL);
   g_return_val_if_fail (start->ref_count > 0, NULL);
 
-  tag_interned = g_intern_string (tag);
+  tag_interned = _rest_intern (tag);
 
   g_queue_push_head (&stack, start);
 
@@ -339,7 +340,7 @@ rest_xml_node_add_child (RestXmlNode *parent, const char *tag)
   escaped = g_markup_escape_text (tag, -1);
 
   node = _rest_xml_node_new ();
-  node->name = (char *) g_intern_string (escaped);
+  node->name = (char *) _rest_intern (escaped);
 
   if (parent)
     {
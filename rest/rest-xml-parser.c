@@ -106,7 +106,7 @@ rest_xml_parser_parse_from_data (RestXmlParser *parser,
         /* Create our new node for this tag */
 
         new_node = _rest_xml_node_new ();
-        new_node->name = G (g_intern_string (name));
+        new_node->name = G (_rest_intern (name));
 
         if (!root_node)
         {
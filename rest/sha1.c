@@ -21,88 +21,201 @@
 
 #include <string.h>
 #include <glib.h>
+#include "rest-text-codec.h"
 #include "sha1.h"
 
-#define SHA1_BLOCK_SIZE 64
-#define SHA1_LENGTH 20
+/*
+ * HMAC as in RFC 2104, over the internal SHA-1 and SHA-256.  The states after
+ * hashing the inner and outer pads only depend on the key, so they are worked
+ * out once and copied for each message.
+ */
+struct _Hmac {
+  RestSha inner;
+  RestSha outer;
+};
 
 /*
- * hmac_sha1:
+ * hmac_new:
+ * @algorithm: The hash to use
  * @key: The key
- * @message: The message
  *
- * Given the key and message, compute the HMAC-SHA1 hash and return the base-64
- * encoding of it.  This is very geared towards OAuth, and as such both key and
- * message must be NULL-terminated strings, and the result is base-64 encoded.
+ * Do the work of HMAC that only depends on the key, so that hmac_sign() only
+ * needs to hash the message.  The key must be a NULL-terminated string.
  */
-char *
-hmac_sha1 (const char *key, const char *message)
+Hmac *
+hmac_new (RestShaAlgorithm algorithm, const char *key)
 {
-  GChecksum *checksum;
-  char *real_key;
-  guchar ipad[SHA1_BLOCK_SIZE];
-  guchar opad[SHA1_BLOCK_SIZE];
-  guchar inner[SHA1_LENGTH];
-  guchar digest[SHA1_LENGTH];
-  gsize key_length, inner_length, digest_length;
+  Hmac *hmac;
+  guchar real_key[REST_SHA_BLOCK_SIZE];
+  guchar ipad[REST_SHA_BLOCK_SIZE];
+  guchar opad[REST_SHA_BLOCK_SIZE];
+  gsize key_length;
   int i;
 
   g_return_val_if_fail (key, NULL);
-  g_return_val_if_fail (message, NULL);
-
-  checksum = g_checksum_new (G_CHECKSUM_SHA1);
-
-  /* If the key is longer than the block size, hash it first */
-  if (strlen (key) > SHA1_BLOCK_SIZE) {
-    guchar new_key[SHA1_LENGTH];
 
-    key_length = sizeof (new_key);
+  hmac = g_slice_new (Hmac);
 
-    g_checksum_update (checksum, (guchar*)key, strlen (key));
-    g_checksum_get_digest (checksum, new_key, &key_length);
-    g_checksum_reset (checksum);
+  memset (real_key, 0, sizeof (real_key));
+  key_length = strlen (key);
 
-    real_key = g_memdup (new_key, key_length);
+  /* If the key is longer than the block size, hash it first */
+  if (key_length > REST_SHA_BLOCK_SIZE) {
+    _rest_sha_init (&hmac->inner, algorithm);
+    _rest_sha_update (&hmac->inner, (guchar*)key, key_length);
+    key_length = _rest_sha_final (&hmac->inner, real_key);
   } else {
-    real_key = g_strdup (key);
-    key_length = strlen (key);
+    memcpy (real_key, key, key_length);
   }
 
-  /* Sanity check the length */
-  g_assert (key_length <= SHA1_BLOCK_SIZE);
-
   /* Protect against use of the provided key by NULLing it */
   key = NULL;
 
-  /* Stage 1 */
-  memset (ipad, 0, sizeof (ipad));
-  memset (opad, 0, sizeof (opad));
-
-  memcpy (ipad, real_key, key_length);
-  memcpy (opad, real_key, key_length);
-
-  /* Stage 2 and 5 */
   for (i = 0; i < sizeof (ipad); i++) {
-    ipad[i] ^= 0x36;
-    opad[i] ^= 0x5C;
+    ipad[i] = real_key[i] ^ 0x36;
+    opad[i] = real_key[i] ^ 0x5C;
   }
 
-  /* Stage 3 and 4 */
-  g_checksum_update (checksum, ipad, sizeof (ipad));
-  g_checksum_update (checksum, (guchar*)message, strlen (message));
-  inner_length = sizeof (inner);
-  g_checksum_get_digest (checksum, inner, &inner_length);
-  g_checksum_reset (checksum);
+  _rest_sha_init (&hmac->inner, algorithm);
+  _rest_sha_update (&hmac->inner, ipad, sizeof (ipad));
+  _rest_sha_init (&hmac->outer, algorithm);
+  _rest_sha_update (&hmac->outer, opad, sizeof (opad));
+
+  return hmac;
+}
+
+RestShaAlgorithm
+hmac_get_algorithm (const Hmac *hmac)
+{
+  return hmac->inner.algorithm;
+}
+
+/*
+ * hmac_sign:
+ * @hmac: The keyed state from hmac_new()
+ * @message: The message
+ *
+ * Compute the HMAC of @message and return the base-64 encoding of it.  @hmac
+ * is not changed, so it can be used from several threads at once.
+ */
+char *
+hmac_sign (const Hmac *hmac, const char *message)
+{
+  RestSha sha;
+  guchar digest[REST_SHA_MAX_LENGTH];
+  gsize digest_length;
+
+  g_return_val_if_fail (hmac, NULL);
+  g_return_val_if_fail (message, NULL);
+
+  sha = hmac->inner;
+  _rest_sha_update (&sha, (guchar*)message, strlen (message));
+  digest_length = _rest_sha_final (&sha, digest);
+
+  sha = hmac->outer;
+  _rest_sha_update (&sha, digest, digest_length);
+  digest_length = _rest_sha_final (&sha, digest);
+
+  return _rest_base64_encode_string (digest, digest_length);
+}
+
+void
+hmac_free (Hmac *hmac)
+{
+  if (hmac == NULL)
+    return;
+
+  g_slice_free (Hmac, hmac);
+}
 
-  /* Stage 6 and 7 */
-  g_checksum_update (checksum, opad, sizeof (opad));
-  g_checksum_update (checksum, inner, inner_length);
+static char *
+hmac_once (RestShaAlgorithm algorithm, const char *key, const char *message)
+{
+  Hmac *hmac;
+  char *signature;
+
+  g_return_val_if_fail (key, NULL);
+  g_return_val_if_fail (message, NULL);
 
-  digest_length = sizeof (digest);
-  g_checksum_get_digest (checksum, digest, &digest_length);
+  hmac = hmac_new (algorithm, key);
+  signature = hmac_sign (hmac, message);
+  hmac_free (hmac);
+
+  return signature;
+}
+
+/*
+ * hmac_sha1:
+ * @key: The key
+ * @message: The message
+ *
+ * Given the key and message, compute the HMAC-SHA1 hash and return the base-64
+ * encoding of it.  This is very geared towards OAuth, and as such both key and
+ * message must be NULL-terminated strings, and the result is base-64 encoded.
+ */
+char *
+hmac_sha1 (const char *key, const char *message)
+{
+  return hmac_once (REST_SHA1, key, message);
+}
 
-  g_checksum_free (checksum);
-  g_free (real_key);
+/*
+ * hmac_sha256:
+ * @key: The key
+ * @message: The message
+ *
+ * As hmac_sha1(), but with SHA-256.
+ */
+char *
+hmac_sha256 (const char *key, const char *message)
+{
+  return hmac_once (REST_SHA256, key, message);
+}
 
-  return g_base64_encode (digest, digest_length);
+#if BUILD_TESTS
+void
+test_hmac (void)
+{
+  Hmac *hmac;
+  char *long_key, *signature;
+
+  /* From RFC 2202 */
+  signature = hmac_sha1 ("Jefe", "what do ya want for nothing?");
+  g_assert_cmpstr (signature, ==, "7/zfauXrL6LSdBbV8YTfnCWafHk=");
+  g_free (signature);
+
+  long_key = g_strnfill (80, 0xaa);
+  signature = hmac_sha1 (long_key, "Test Using Larger Than Block-Size Key - Hash Key First");
+  g_assert_cmpstr (signature, ==, "qkrl4VJy0A6VcFY3zoo7Ve1AIRI=");
+  g_free (signature);
+  g_free (long_key);
+
+  /* From RFC 4231 */
+  long_key = g_strnfill (20, 0x0b);
+  signature = hmac_sha256 (long_key, "Hi There");
+  g_assert_cmpstr (signature, ==, "sDRMYdjbOFNcqK/OrwvxK4gdwgDJgz2nJuk3bC4yz/c=");
+  g_free (signature);
+  g_free (long_key);
+
+  signature = hmac_sha256 ("Jefe", "what do ya want for nothing?");
+  g_assert_cmpstr (signature, ==, "W9zBRr9gdU5qBCQmCJV1x1oAPwidJzmDnexYuWTsOEM=");
+  g_free (signature);
+
+  long_key = g_strnfill (131, 0xaa);
+  signature = hmac_sha256 (long_key, "Test Using Larger Than Block-Size Key - Hash Key First");
+  g_assert_cmpstr (signature, ==, "YOQxWR7gtn8Niiaqy/W3f44LxiE3KMUUBUYEDw7jf1Q=");
+  g_free (signature);
+  g_free (long_key);
+
+  /* A keyed state gives the same answer every time it is used */
+  hmac = hmac_new (REST_SHA1, "Jefe");
+  g_assert_cmpint (hmac_get_algorithm (hmac), ==, REST_SHA1);
+  signature = hmac_sign (hmac, "what do ya want for nothing?");
+  g_assert_cmpstr (signature, ==, "7/zfauXrL6LSdBbV8YTfnCWafHk=");
+  g_free (signature);
+  signature = hmac_sign (hmac, "what do ya want for nothing?");
+  g_assert_cmpstr (signature, ==, "7/zfauXrL6LSdBbV8YTfnCWafHk=");
+  g_free (signature);
+  hmac_free (hmac);
 }
+#endif
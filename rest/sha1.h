@@ -19,4 +19,23 @@
  *
  */
 
+#ifndef _REST_SHA1
+#define _REST_SHA1
+
+#include "rest-sha.h"
+
+typedef struct _Hmac Hmac;
+
+Hmac * hmac_new (RestShaAlgorithm algorithm, const char *key);
+
+RestShaAlgorithm hmac_get_algorithm (const Hmac *hmac);
+
+char * hmac_sign (const Hmac *hmac, const char *message);
+
+void hmac_free (Hmac *hmac);
+
 char * hmac_sha1 (const char *key, const char *message);
+
+char * hmac_sha256 (const char *key, const char *message);
+
+#endif /* _REST_SHA1 */
@@ -29,7 +29,15 @@ main (int argc, char *argv[])
   g_type_init ();
   g_test_init (&argc, &argv, NULL);
 
+  test_add ("/intern", test_intern);
+  test_add ("/hmac", test_hmac);
+  test_add ("/params/order", test_params_order);
+  test_add ("/params/sorted-strings", test_params_sorted_strings);
+  test_add ("/params/encoded", test_encoded_params);
   test_add ("/oauth/param-encoding", test_param_encoding);
+  test_add ("/oauth/signature", test_signature);
+  test_add ("/sha", test_sha);
+  test_add ("/text-codec", test_text_codec);
 
   return g_test_run ();
 }
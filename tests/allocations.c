@@ -0,0 +1,286 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2008, 2009, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Counts the allocations made while building and freeing calls, to check
+ * that a header is not copied more than it needs to be and that a short
+ * parameter is a single allocation, and the memory a call holds, to check
+ * that replacing a header frees the old one.  It also records the memory
+ * each tenant's OAuth credentials hold, before and after they first sign a
+ * call and keep the keyed HMAC state.
+ *
+ * The allocations are counted by replacing malloc() itself, which the
+ * libraries resolve to this program's definition, as g_mem_set_vtable() has
+ * no effect with newer versions of GLib.  This needs the glibc entry points
+ * to forward to, so elsewhere the test is skipped.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <rest/rest-proxy.h>
+#include <rest/oauth-proxy.h>
+#include <rest/oauth-proxy-call.h>
+
+#define HEADERS 32
+#define PARAMS 32
+#define REPLACEMENTS 1000
+/* The most a tenant's credentials may hold once they have signed a call */
+#define CREDENTIALS_BYTES 4096
+
+static int allocs = 0;
+/* The bytes allocated and not yet freed */
+static gssize live = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void __libc_free (void *ptr);
+
+void *
+malloc (size_t size)
+{
+  void *ptr;
+
+  allocs++;
+  ptr = __libc_malloc (size);
+  if (ptr)
+    live += malloc_usable_size (ptr);
+  return ptr;
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  void *ptr;
+
+  allocs++;
+  ptr = __libc_calloc (nmemb, size);
+  if (ptr)
+    live += malloc_usable_size (ptr);
+  return ptr;
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    allocs++;
+  else
+    live -= malloc_usable_size (ptr);
+
+  ptr = __libc_realloc (ptr, size);
+  if (ptr)
+    live += malloc_usable_size (ptr);
+  return ptr;
+}
+
+void
+free (void *ptr)
+{
+  if (ptr)
+    live -= malloc_usable_size (ptr);
+  __libc_free (ptr);
+}
+#endif
+
+static void
+build_call (RestProxy *proxy, int n_headers, int n_params)
+{
+  RestProxyCall *call;
+  char name[32], value[32];
+  int i;
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_set_function (call, "statuses/update");
+
+  for (i = 0; i < n_headers; i++) {
+    snprintf (name, sizeof (name), "X-Header-%d", i);
+    snprintf (value, sizeof (value), "value %d", i);
+    rest_proxy_call_add_header (call, name, value);
+  }
+
+  for (i = 0; i < n_params; i++) {
+    snprintf (name, sizeof (name), "param%d", i);
+    snprintf (value, sizeof (value), "%d", i);
+    rest_proxy_call_add_param (call, name, value);
+  }
+
+  g_object_unref (call);
+}
+
+/* Set the same header @times times, returning the bytes the call then holds */
+static gssize
+replace_header (RestProxy *proxy, int times)
+{
+  RestProxyCall *call;
+  char value[32];
+  gssize before, held;
+  int i;
+
+  call = rest_proxy_new_call (proxy);
+
+  before = live;
+  for (i = 0; i < times; i++) {
+    snprintf (value, sizeof (value), "value %d", i % 10);
+    rest_proxy_call_add_header (call, "X-Header", value);
+  }
+  held = live - before;
+
+  g_object_unref (call);
+
+  return held;
+}
+
+/*
+ * Sign a call with @credentials.  Nothing listens on the proxy's port, so the
+ * call fails once it has been signed.
+ */
+static void
+sign_call (RestProxy *proxy, OAuthCredentials *credentials)
+{
+  RestProxyCall *call;
+
+  call = rest_proxy_new_call (proxy);
+  oauth_proxy_call_set_credentials (OAUTH_PROXY_CALL (call), credentials);
+  rest_proxy_call_sync (call, NULL);
+  g_object_unref (call);
+}
+
+/*
+ * Record the bytes held by a tenant's new credentials, and by the same
+ * credentials once they have signed a call.
+ */
+static void
+measure_credentials (RestProxy *proxy, gssize *created, gssize *signed_)
+{
+  OAuthCredentials *credentials;
+  gssize before;
+
+  before = live;
+  credentials = oauth_proxy_new_credentials (OAUTH_PROXY (proxy),
+                                             "nnch734d00sl2jdk",
+                                             "pfkkdhi9sl3r4s00");
+  *created = live - before;
+
+  sign_call (proxy, credentials);
+  *signed_ = live - before;
+
+  oauth_credentials_unref (credentials);
+}
+
+int
+main (int argc, char **argv)
+{
+  RestProxy *proxy;
+  gpointer mem;
+  int base, headers, params;
+  gssize once, replaced, created, signed_;
+
+  /* So that slices are counted too, with versions of GLib that have a slice
+   * allocator of their own */
+  setenv ("G_SLICE", "always-malloc", TRUE);
+
+  /* Check that GLib really calls the malloc() above */
+  allocs = 0;
+  mem = g_malloc (1);
+  g_free (mem);
+  if (allocs == 0) {
+    g_print ("Allocations cannot be counted, skipping\n");
+    return 77;
+  }
+
+  g_type_init ();
+
+  proxy = rest_proxy_new ("http://www.example.com/", FALSE);
+
+  /* Once first so that the type and class setup is not counted */
+  build_call (proxy, HEADERS, PARAMS);
+
+  allocs = 0;
+  build_call (proxy, 0, 0);
+  base = allocs;
+
+  allocs = 0;
+  build_call (proxy, HEADERS, 0);
+  headers = allocs - base;
+
+  allocs = 0;
+  build_call (proxy, 0, PARAMS);
+  params = allocs - base;
+
+  once = replace_header (proxy, 1);
+  replaced = replace_header (proxy, REPLACEMENTS);
+
+  g_object_unref (proxy);
+
+  proxy = oauth_proxy_new_with_token ("dpf43f3p2l4k3l03", "kd94hf93k423kf44",
+                                      "nnch734d00sl2jdk", "pfkkdhi9sl3r4s00",
+                                      "http://127.0.0.1:1/", FALSE);
+
+  /* Once first so that the session and the type setup are not counted */
+  measure_credentials (proxy, &created, &signed_);
+  measure_credentials (proxy, &created, &signed_);
+
+  g_object_unref (proxy);
+
+  g_print ("%d allocations for a call, %d more for %d headers "
+           "and %d more for %d parameters\n",
+           base, headers, HEADERS, params, PARAMS);
+  g_print ("%" G_GSSIZE_FORMAT " bytes held for a header set once, "
+           "%" G_GSSIZE_FORMAT " for one set %d times\n",
+           once, replaced, REPLACEMENTS);
+  g_print ("%" G_GSSIZE_FORMAT " bytes held for new credentials, "
+           "%" G_GSSIZE_FORMAT " once they have signed a call\n",
+           created, signed_);
+
+  /* A header name and value are copied each, plus a few as the table grows */
+  if (headers >= 3 * HEADERS) {
+    g_printerr ("Too many allocations for headers\n");
+    return 1;
+  }
+
+  /* Replaced headers must be freed, not kept until the call is */
+  if (replaced > once) {
+    g_printerr ("Replaced headers are not freed\n");
+    return 1;
+  }
+
+  /* Each parameter should be one allocation rather than three, plus a few
+   * as the array and its index grow */
+  if (params >= 2 * PARAMS) {
+    g_printerr ("Too many allocations for parameters\n");
+    return 1;
+  }
+
+  /* Credentials are kept for every tenant, so the keyed HMAC state they
+   * gain on the first signature must stay small */
+  if (signed_ >= CREDENTIALS_BYTES) {
+    g_printerr ("Credentials hold too much memory once they have signed\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Measures what request body compression costs in CPU time and saves in bytes
+ * sent, by posting form bodies of various sizes to a local server.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <time.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+
+#define ITERATIONS 20
+
+static goffset wire_bytes;
+
+static void
+server_callback (SoupServer *server, SoupMessage *msg,
+                 const char *path, GHashTable *query,
+                 SoupClientContext *client, gpointer user_data)
+{
+  wire_bytes += msg->request_body->length;
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+}
+
+/* Something resembling a JSON document, compressible but not trivially so */
+static char *
+make_body (gsize size)
+{
+  GString *s;
+  GRand *rand;
+
+  rand = g_rand_new_with_seed (42);
+  s = g_string_sized_new (size + 128);
+
+  g_string_append_c (s, '[');
+  while (s->len < size) {
+    g_string_append_printf (s,
+                            "{\"id\":%u,\"name\":\"item-%u\",\"price\":%u.%02u,"
+                            "\"tags\":[\"rest\",\"http\"]},",
+                            g_rand_int (rand),
+                            g_rand_int_range (rand, 0, 10000),
+                            g_rand_int_range (rand, 0, 1000),
+                            g_rand_int_range (rand, 0, 100));
+  }
+  g_string_truncate (s, size - 1);
+  g_string_append_c (s, ']');
+
+  g_rand_free (rand);
+
+  return g_string_free (s, FALSE);
+}
+
+static void
+run (RestProxy *proxy, RestContentCoding coding, const char *body, gsize size)
+{
+  GTimer *timer;
+  clock_t cpu;
+  GError *error = NULL;
+  int i;
+
+  wire_bytes = 0;
+  timer = g_timer_new ();
+  cpu = clock ();
+
+  for (i = 0; i < ITERATIONS; i++) {
+    RestProxyCall *call;
+
+    call = rest_proxy_new_call (proxy);
+    rest_proxy_call_set_function (call, "upload");
+    rest_proxy_call_set_method (call, "POST");
+    rest_proxy_call_add_param (call, "data", body);
+    rest_proxy_call_set_request_compression (call, coding, 0);
+
+    if (!rest_proxy_call_run (call, NULL, &error)) {
+      g_printerr ("Call failed: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+    g_object_unref (call);
+  }
+
+  g_print ("%-8s %9" G_GSIZE_FORMAT " %12.3f %12.3f %11" G_GOFFSET_FORMAT " %6.1f%%\n",
+           coding == REST_CONTENT_CODING_GZIP ? "gzip" :
+           coding == REST_CONTENT_CODING_DEFLATE ? "deflate" : "identity",
+           size,
+           g_timer_elapsed (timer, NULL) * 1000 / ITERATIONS,
+           (double)(clock () - cpu) * 1000 / CLOCKS_PER_SEC / ITERATIONS,
+           wire_bytes / ITERATIONS,
+           100.0 * wire_bytes / ITERATIONS / size);
+
+  g_timer_destroy (timer);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const gsize sizes[] = { 1024, 16 * 1024, 256 * 1024, 4 * 1024 * 1024 };
+  static const RestContentCoding codings[] = {
+    REST_CONTENT_CODING_IDENTITY,
+    REST_CONTENT_CODING_GZIP,
+    REST_CONTENT_CODING_DEFLATE
+  };
+  SoupServer *server;
+  RestProxy *proxy;
+  char *url;
+  guint i, j;
+
+  g_type_init ();
+
+  server = soup_server_new (NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = rest_proxy_new (url, FALSE);
+  g_free (url);
+
+  g_print ("%-8s %9s %12s %12s %11s %7s\n",
+           "coding", "size", "wall ms", "cpu ms", "wire bytes", "ratio");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    char *body = make_body (sizes[i]);
+
+    for (j = 0; j < G_N_ELEMENTS (codings); j++)
+      run (proxy, codings[j], body, sizes[i]);
+
+    g_free (body);
+  }
+
+  g_object_unref (proxy);
+  g_object_unref (server);
+
+  return 0;
+}
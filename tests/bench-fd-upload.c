@@ -0,0 +1,169 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Compares the CPU time spent uploading a file as a stream parameter, which
+ * is read into a buffer a block at a time, with uploading it as a file
+ * descriptor parameter, which is mapped and written without being copied.  The
+ * server is in the same process and discards the body as it arrives, so its
+ * share of the time is the same for both.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+
+#define FILE_SIZE (64 * 1024 * 1024)
+#define ITERATIONS 4
+
+static void
+request_started_cb (SoupServer *server, SoupMessage *msg,
+                    SoupClientContext *client, gpointer user_data)
+{
+  soup_message_body_set_accumulate (msg->request_body, FALSE);
+}
+
+static void
+server_callback (SoupServer *server, SoupMessage *msg,
+                 const char *path, GHashTable *query,
+                 SoupClientContext *client, gpointer user_data)
+{
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+}
+
+static double
+cpu_time (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void
+run (RestProxy *proxy, const char *filename, int fd, gboolean use_fd)
+{
+  RestProxyCall *call;
+  RestParam *param;
+  GFileInputStream *stream = NULL;
+  GFile *file;
+  GError *error = NULL;
+  GTimer *timer;
+  double cpu, gb;
+  int i;
+
+  timer = g_timer_new ();
+  cpu = cpu_time ();
+
+  for (i = 0; i < ITERATIONS; i++) {
+    if (use_fd) {
+      param = rest_param_new_with_fd ("file", fd, 0, FILE_SIZE,
+                                      "application/octet-stream", "data");
+    } else {
+      file = g_file_new_for_path (filename);
+      stream = g_file_read (file, NULL, NULL);
+      g_object_unref (file);
+      g_assert (stream);
+
+      param = rest_param_new_with_stream ("file", G_INPUT_STREAM (stream),
+                                          FILE_SIZE,
+                                          "application/octet-stream", "data");
+    }
+
+    call = rest_proxy_new_call (proxy);
+    rest_proxy_call_set_function (call, "upload");
+    rest_proxy_call_set_method (call, "POST");
+    rest_proxy_call_add_param_full (call, param);
+
+    if (!rest_proxy_call_run (call, NULL, &error)) {
+      g_printerr ("Upload failed: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+    g_object_unref (call);
+    if (stream) {
+      g_object_unref (stream);
+      stream = NULL;
+    }
+  }
+
+  cpu = cpu_time () - cpu;
+  gb = (double)FILE_SIZE * ITERATIONS / (1024 * 1024 * 1024);
+
+  g_print ("%-8s %10.0f %10.0f %12.0f\n",
+           use_fd ? "fd" : "stream",
+           g_timer_elapsed (timer, NULL) * 1000, cpu * 1000, cpu * 1000 / gb);
+
+  g_timer_destroy (timer);
+}
+
+int
+main (int argc, char **argv)
+{
+  SoupServer *server;
+  RestProxy *proxy;
+  char *url, *filename, *block;
+  int fd, i;
+
+  g_type_init ();
+
+  fd = g_file_open_tmp ("rest-bench-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+
+  block = g_malloc (1024 * 1024);
+  memset (block, 'x', 1024 * 1024);
+  for (i = 0; i < FILE_SIZE / (1024 * 1024); i++) {
+    if (write (fd, block, 1024 * 1024) != 1024 * 1024)
+      g_error ("Cannot write temporary file");
+  }
+  g_free (block);
+
+  server = soup_server_new (NULL);
+  g_signal_connect (server, "request-started",
+                    G_CALLBACK (request_started_cb), NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = rest_proxy_new (url, FALSE);
+  g_free (url);
+
+  g_print ("%-8s %10s %10s %12s\n", "param", "wall ms", "cpu ms", "cpu ms/GB");
+
+  /* Once first to warm the page cache */
+  run (proxy, filename, fd, FALSE);
+  run (proxy, filename, fd, FALSE);
+  run (proxy, filename, fd, TRUE);
+
+  g_object_unref (proxy);
+  g_object_unref (server);
+  close (fd);
+  g_unlink (filename);
+  g_free (filename);
+
+  return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Compares encoding string parameters as a form by way of a hash table and
+ * soup_form_encode_hash(), as calls used to, with encoding them straight from
+ * the RestParams.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <libsoup/soup.h>
+#include <rest/rest-params.h>
+#include <rest/rest-private.h>
+
+#define ENCODES 1000000
+
+static void
+run (int n_params)
+{
+  RestParams *params;
+  GHashTable *hash;
+  GString *form;
+  GTimer *timer;
+  char name[32], value[32];
+  double hashed, direct;
+  int i, n;
+
+  params = rest_params_new ();
+  for (i = 0; i < n_params; i++) {
+    snprintf (name, sizeof (name), "param%d", i);
+    snprintf (value, sizeof (value), "value %d/%d", i, n_params);
+    rest_params_add (params, rest_param_new_string (name, REST_MEMORY_COPY, value));
+  }
+
+  /* Keep the total work the same for each size */
+  n = ENCODES / n_params;
+
+  timer = g_timer_new ();
+  for (i = 0; i < n; i++) {
+    char *encoded;
+
+    hash = rest_params_as_string_hash_table (params);
+    encoded = soup_form_encode_hash (hash);
+    g_hash_table_unref (hash);
+    g_free (encoded);
+  }
+  hashed = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++) {
+    form = g_string_new (NULL);
+    _rest_params_append_form (params, form);
+    g_string_free (form, TRUE);
+  }
+  direct = g_timer_elapsed (timer, NULL);
+
+  g_print ("%6d %14.0f %14.0f\n", n_params,
+           hashed * 1e9 / n, direct * 1e9 / n);
+
+  g_timer_destroy (timer);
+  rest_params_free (params);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_type_init ();
+
+  g_print ("%6s %14s %14s\n", "params", "hash ns/form", "direct ns/form");
+
+  run (1);
+  run (10);
+  run (100);
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Compares HMAC signing from the key every time, as OAuthProxy used to, with
+ * signing from the keyed state it now keeps until the secrets change, for
+ * each SHA implementation this CPU supports.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib-object.h>
+#include <rest/sha1.h>
+
+#define SIGNATURES 500000
+
+/* The consumer secret & token secret, as sign_plaintext() makes them */
+#define KEY "kd94hf93k423kf44&pfkkdhi9sl3r4s00"
+
+static const char *impls[] = { "shani", "armv8", "scalar" };
+
+static void
+run (const char *impl, RestShaAlgorithm algorithm, int len)
+{
+  Hmac *hmac;
+  GTimer *timer;
+  char *message;
+  double fresh, cached;
+  int i;
+
+  message = g_strnfill (len, 'm');
+
+  timer = g_timer_new ();
+  for (i = 0; i < SIGNATURES; i++) {
+    hmac = hmac_new (algorithm, KEY);
+    g_free (hmac_sign (hmac, message));
+    hmac_free (hmac);
+  }
+  fresh = g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  hmac = hmac_new (algorithm, KEY);
+  for (i = 0; i < SIGNATURES; i++)
+    g_free (hmac_sign (hmac, message));
+  hmac_free (hmac);
+  cached = g_timer_elapsed (timer, NULL);
+
+  g_print ("%-8s %-8s %6d %14.0f %14.0f\n", impl,
+           algorithm == REST_SHA1 ? "sha1" : "sha256", len,
+           fresh * 1e9 / SIGNATURES, cached * 1e9 / SIGNATURES);
+
+  g_timer_destroy (timer);
+  g_free (message);
+}
+
+int
+main (int argc, char **argv)
+{
+  guint i;
+
+  g_type_init ();
+
+  g_print ("%-8s %-8s %6s %14s %14s\n",
+           "impl", "hash", "bytes", "keyed ns/sig", "cached ns/sig");
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    if (!_rest_sha_set_impl (impls[i]))
+      continue;
+
+    /* Base strings for a handful of parameters up to a large form */
+    run (impls[i], REST_SHA1, 128);
+    run (impls[i], REST_SHA1, 512);
+    run (impls[i], REST_SHA1, 2048);
+    run (impls[i], REST_SHA256, 128);
+    run (impls[i], REST_SHA256, 512);
+    run (impls[i], REST_SHA256, 2048);
+  }
+
+  _rest_sha_set_impl (NULL);
+
+  return 0;
+}
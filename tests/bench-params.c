@@ -0,0 +1,85 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Measures the cost of building and freeing calls with many short string
+ * parameters, as a paginated or filtered API request would have.  No requests
+ * are made.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <rest/rest-proxy.h>
+
+#define CALLS 100000
+#define PARAMS 12
+
+static char names[PARAMS][16];
+static char values[PARAMS][16];
+
+static void
+build_calls (RestProxy *proxy, int n_calls)
+{
+  RestProxyCall *call;
+  int i, j;
+
+  for (i = 0; i < n_calls; i++) {
+    call = rest_proxy_new_call (proxy);
+    rest_proxy_call_set_function (call, "search");
+
+    for (j = 0; j < PARAMS; j++)
+      rest_proxy_call_add_param (call, names[j], values[j]);
+
+    g_object_unref (call);
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  RestProxy *proxy;
+  GTimer *timer;
+  double elapsed;
+  int i;
+
+  g_type_init ();
+
+  for (i = 0; i < PARAMS; i++) {
+    snprintf (names[i], sizeof (names[i]), "field%d", i);
+    snprintf (values[i], sizeof (values[i]), "%d", i * 7);
+  }
+
+  proxy = rest_proxy_new ("http://www.example.com/", FALSE);
+
+  /* Warm up the type system and the slice allocator */
+  build_calls (proxy, CALLS / 10);
+
+  timer = g_timer_new ();
+  build_calls (proxy, CALLS);
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_print ("%d calls with %d parameters: %.0f ns per call, %.0f ns per parameter\n",
+           CALLS, PARAMS, elapsed * 1e9 / CALLS, elapsed * 1e9 / (CALLS * PARAMS));
+
+  g_timer_destroy (timer);
+  g_object_unref (proxy);
+
+  return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Compares downloading a file over one connection with downloading it as
+ * parallel ranges, from a local server which limits the rate of each
+ * connection the way many real servers and networks do.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+
+#define RESOURCE_SIZE (16 * 1024 * 1024)
+
+/* Each connection gets BLOCK_SIZE bytes every BLOCK_INTERVAL ms, 4MB/s */
+#define BLOCK_SIZE (40 * 1024)
+#define BLOCK_INTERVAL 10
+
+static GMainLoop *loop;
+static char *resource;
+
+typedef struct {
+  SoupServer *server;
+  SoupMessage *msg;
+  goffset offset;
+  goffset end;
+  guint source;
+} Throttle;
+
+static gboolean
+send_block (gpointer user_data)
+{
+  Throttle *throttle = user_data;
+  gsize len;
+
+  len = MIN (BLOCK_SIZE, throttle->end - throttle->offset + 1);
+  soup_message_body_append (throttle->msg->response_body, SOUP_MEMORY_STATIC,
+                            resource + throttle->offset, len);
+  throttle->offset += len;
+
+  if (throttle->offset > throttle->end) {
+    soup_message_body_complete (throttle->msg->response_body);
+    throttle->source = 0;
+  }
+
+  soup_server_unpause_message (throttle->server, throttle->msg);
+
+  return throttle->source != 0;
+}
+
+static void
+finished_cb (SoupMessage *msg, Throttle *throttle)
+{
+  if (throttle->source)
+    g_source_remove (throttle->source);
+  g_slice_free (Throttle, throttle);
+}
+
+static void
+server_callback (SoupServer *server, SoupMessage *msg,
+                 const char *path, GHashTable *query,
+                 SoupClientContext *client, gpointer user_data)
+{
+  Throttle *throttle;
+  SoupRange *ranges;
+  int n_ranges;
+
+  throttle = g_slice_new0 (Throttle);
+  throttle->server = server;
+  throttle->msg = msg;
+  throttle->end = RESOURCE_SIZE - 1;
+
+  if (soup_message_headers_get_ranges (msg->request_headers, RESOURCE_SIZE,
+                                       &ranges, &n_ranges)) {
+    throttle->offset = ranges[0].start;
+    throttle->end = ranges[0].end;
+    soup_message_headers_free_ranges (msg->request_headers, ranges);
+
+    soup_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+    soup_message_headers_set_content_range (msg->response_headers,
+                                            throttle->offset, throttle->end,
+                                            RESOURCE_SIZE);
+  } else {
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  }
+
+  soup_message_headers_set_encoding (msg->response_headers,
+                                     SOUP_ENCODING_CHUNKED);
+  soup_server_pause_message (server, msg);
+
+  throttle->source = g_timeout_add (BLOCK_INTERVAL, send_block, throttle);
+  g_signal_connect (msg, "finished", G_CALLBACK (finished_cb), throttle);
+}
+
+static void
+download_cb (GObject      *source,
+             GAsyncResult *result,
+             gpointer      user_data)
+{
+  GError *error = NULL;
+
+  if (!rest_proxy_call_download_finish (REST_PROXY_CALL (source), result, &error)) {
+    g_printerr ("Download failed: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  g_main_loop_quit (loop);
+}
+
+/* Download with @n_ranges ranges, or over a single connection if 0 */
+static void
+run (RestProxy *proxy, guint n_ranges)
+{
+  RestProxyCall *call;
+  GTimer *timer;
+  char *filename;
+  double elapsed;
+  int fd;
+
+  fd = g_file_open_tmp ("rest-bench-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "file");
+
+  timer = g_timer_new ();
+
+  if (n_ranges == 0)
+    rest_proxy_call_download_to_fd_async (call, fd, REST_DOWNLOAD_SYNC_NONE,
+                                          NULL, NULL, NULL, download_cb, NULL);
+  else
+    rest_proxy_call_download_ranges_to_fd_async (call, fd, n_ranges,
+                                                 REST_DOWNLOAD_SYNC_NONE,
+                                                 NULL, NULL, NULL,
+                                                 download_cb, NULL);
+  g_main_loop_run (loop);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_print ("%-8s %6u %10.0f %10.2f\n",
+           n_ranges ? "ranges" : "single", MAX (n_ranges, 1),
+           elapsed * 1000, RESOURCE_SIZE / elapsed / (1024 * 1024));
+
+  g_timer_destroy (timer);
+  g_object_unref (call);
+  close (fd);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const guint n_ranges[] = { 0, 1, 2, 4, 8 };
+  SoupServer *server;
+  RestProxy *proxy;
+  char *url;
+  guint i;
+
+  g_type_init ();
+  loop = g_main_loop_new (NULL, FALSE);
+
+  resource = g_malloc0 (RESOURCE_SIZE);
+
+  server = soup_server_new (NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = rest_proxy_new (url, FALSE);
+  g_object_set (proxy, "max-conns-per-host", 8, NULL);
+  g_free (url);
+
+  g_print ("%-8s %6s %10s %10s\n", "mode", "conns", "wall ms", "MB/s");
+
+  for (i = 0; i < G_N_ELEMENTS (n_ranges); i++)
+    run (proxy, n_ranges[i]);
+
+  g_object_unref (proxy);
+  g_object_unref (server);
+  g_free (resource);
+
+  return 0;
+}
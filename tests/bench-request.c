@@ -0,0 +1,190 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Compares the cost of making many small requests with a RestProxyCall and
+ * with a RestRequest.  The requests are made one after another against a
+ * server in the same process that answers with a short fixed body, so the
+ * difference is the per-request overhead of the two.
+ */
+
+#include <config.h>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+#include <rest/rest-request.h>
+
+#define REQUESTS 20000
+
+typedef struct {
+  GMainLoop *loop;
+  RestProxy *proxy;
+  int remaining;
+} Bench;
+
+static void
+server_callback (SoupServer *server, SoupMessage *msg,
+                 const char *path, GHashTable *query,
+                 SoupClientContext *client, gpointer user_data)
+{
+  soup_message_set_response (msg, "text/plain", SOUP_MEMORY_STATIC, "pong", 4);
+  soup_message_set_status (msg, SOUP_STATUS_OK);
+}
+
+static double
+cpu_time (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void start_call (Bench *bench);
+static void start_request (Bench *bench);
+
+static void
+call_done_cb (RestProxyCall *call,
+              const GError  *error,
+              GObject       *weak_object,
+              gpointer       user_data)
+{
+  Bench *bench = user_data;
+
+  if (error)
+    g_error ("Call failed: %s", error->message);
+
+  g_object_unref (call);
+  start_call (bench);
+}
+
+static void
+start_call (Bench *bench)
+{
+  RestProxyCall *call;
+
+  if (bench->remaining-- == 0) {
+    g_main_loop_quit (bench->loop);
+    return;
+  }
+
+  call = rest_proxy_new_call (bench->proxy);
+  rest_proxy_call_set_function (call, "ping");
+  rest_proxy_call_add_param (call, "id", "1234");
+  rest_proxy_call_add_header (call, "X-Client", "bench");
+
+  if (!rest_proxy_call_async (call, call_done_cb, NULL, bench, NULL))
+    g_error ("Cannot start call");
+}
+
+static void
+request_done_cb (RestRequest  *request,
+                 const GError *error,
+                 gpointer      user_data)
+{
+  Bench *bench = user_data;
+
+  if (error)
+    g_error ("Request failed: %s", error->message);
+
+  rest_request_free (request);
+  start_request (bench);
+}
+
+static void
+start_request (Bench *bench)
+{
+  RestRequest *request;
+
+  if (bench->remaining-- == 0) {
+    g_main_loop_quit (bench->loop);
+    return;
+  }
+
+  request = rest_request_new (bench->proxy, "GET", "ping");
+  rest_request_add_param (request, "id", "1234");
+  rest_request_add_header (request, "X-Client", "bench");
+  rest_request_run_async (request, request_done_cb, bench);
+}
+
+static void
+run (RestProxy *proxy, gboolean lightweight)
+{
+  Bench bench;
+  GTimer *timer;
+  double cpu, elapsed;
+
+  bench.loop = g_main_loop_new (NULL, FALSE);
+  bench.proxy = proxy;
+  bench.remaining = REQUESTS;
+
+  timer = g_timer_new ();
+  cpu = cpu_time ();
+
+  if (lightweight)
+    start_request (&bench);
+  else
+    start_call (&bench);
+  g_main_loop_run (bench.loop);
+
+  cpu = cpu_time () - cpu;
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_print ("%-12s %10.0f %12.1f %12.1f\n",
+           lightweight ? "RestRequest" : "RestProxyCall",
+           REQUESTS / elapsed,
+           elapsed * 1e6 / REQUESTS, cpu * 1e6 / REQUESTS);
+
+  g_timer_destroy (timer);
+  g_main_loop_unref (bench.loop);
+}
+
+int
+main (int argc, char **argv)
+{
+  SoupServer *server;
+  RestProxy *proxy;
+  char *url;
+
+  g_type_init ();
+
+  server = soup_server_new (NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = rest_proxy_new (url, FALSE);
+  g_free (url);
+
+  g_print ("%-12s %10s %12s %12s\n", "type", "req/s", "us/req", "cpu us/req");
+
+  /* Once first to open the connection and warm up */
+  run (proxy, FALSE);
+  run (proxy, FALSE);
+  run (proxy, TRUE);
+
+  g_object_unref (proxy);
+  g_object_unref (server);
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+/*
+ * Times the percent, base64 and hex encoders with each implementation this
+ * CPU supports, against libsoup and GLib doing the same work.  The input is
+ * mostly unreserved characters with the odd one that needs encoding, like a
+ * typical parameter value.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <libsoup/soup.h>
+#include <rest/rest-text-codec.h>
+
+/* Bytes encoded per size and function */
+#define TOTAL (64 * 1024 * 1024)
+
+static const char *impls[] = { "avx2", "ssse3", "sse2", "neon", "scalar" };
+static const int sizes[] = { 16, 256, 4096 };
+
+static char *input;
+static char *output;
+
+static double
+time_reference (int what, int len)
+{
+  GTimer *timer;
+  double elapsed;
+  char *s = NULL;
+  int i, j, n = TOTAL / len;
+
+  input[len] = '\0';
+
+  timer = g_timer_new ();
+  for (i = 0; i < n; i++) {
+    switch (what) {
+    case 0:
+      s = soup_uri_encode (input, "!$&'()*+,;=@");
+      break;
+    case 1:
+      s = g_base64_encode ((guchar *)input, len);
+      break;
+    case 2:
+      /* What g_checksum_get_string() does */
+      s = g_new (char, len * 2 + 1);
+      for (j = 0; j < len; j++) {
+        s[2 * j] = "0123456789abcdef"[(guchar)input[j] >> 4];
+        s[2 * j + 1] = "0123456789abcdef"[input[j] & 0xf];
+      }
+      s[2 * len] = '\0';
+      break;
+    }
+    g_free (s);
+  }
+
+  input[len] = 'x';
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return elapsed * 1e9 / n;
+}
+
+static double
+time_codec (int what, int len)
+{
+  GTimer *timer;
+  double elapsed;
+  int i, n = TOTAL / len;
+
+  timer = g_timer_new ();
+  for (i = 0; i < n; i++) {
+    switch (what) {
+    case 0:
+      _rest_percent_encode (output, input, len);
+      break;
+    case 1:
+      _rest_base64_encode (output, (guchar *)input, len);
+      break;
+    case 2:
+      _rest_hex_encode (output, (guchar *)input, len);
+      break;
+    }
+  }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return elapsed * 1e9 / n;
+}
+
+int
+main (int argc, char **argv)
+{
+  const int max = sizes[G_N_ELEMENTS (sizes) - 1];
+  guint i, j;
+  int k;
+
+  g_type_init ();
+
+  input = g_malloc (max + 1);
+  output = g_malloc (REST_PERCENT_ENCODED_MAX (max));
+  for (k = 0; k < max; k++)
+    input[k] = (k % 23 == 22) ? ' ' : "abcdefghijklmnopqrstuvwxyz-._~0123456789"[k % 40];
+
+  g_print ("best implementation: %s\n", _rest_text_codec_get_impl ());
+  g_print ("%-8s %6s %12s %12s %12s\n",
+           "impl", "bytes", "percent ns", "base64 ns", "hex ns");
+
+  for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+    g_print ("%-8s %6d %12.1f %12.1f %12.1f\n", "glib", sizes[j],
+             time_reference (0, sizes[j]),
+             time_reference (1, sizes[j]),
+             time_reference (2, sizes[j]));
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+    if (!_rest_text_codec_set_impl (impls[i]))
+      continue;
+
+    for (j = 0; j < G_N_ELEMENTS (sizes); j++) {
+      g_print ("%-8s %6d %12.1f %12.1f %12.1f\n", impls[i], sizes[j],
+               time_codec (0, sizes[j]),
+               time_codec (1, sizes[j]),
+               time_codec (2, sizes[j]));
+    }
+  }
+
+  _rest_text_codec_set_impl (NULL);
+
+  g_free (input);
+  g_free (output);
+
+  return 0;
+}
@@ -72,8 +72,8 @@ access_token_cb (OAuthProxy   *proxy,
   OAuthProxyPrivate *priv = PROXY_GET_PRIVATE (proxy);
   g_assert_no_error ((GError *)error);
 
-  g_assert_cmpstr (priv->token, ==, "accesskey");
-  g_assert_cmpstr (priv->token_secret, ==, "accesssecret");
+  g_assert_cmpstr (priv->credentials->token, ==, "accesskey");
+  g_assert_cmpstr (priv->credentials->token_secret, ==, "accesssecret");
 
   make_calls (proxy);
 }
@@ -89,8 +89,8 @@ request_token_cb (OAuthProxy   *proxy,
 
   g_assert_no_error ((GError *)error);
 
-  g_assert_cmpstr (priv->token, ==, "requestkey");
-  g_assert_cmpstr (priv->token_secret, ==, "requestsecret");
+  g_assert_cmpstr (priv->credentials->token, ==, "requestkey");
+  g_assert_cmpstr (priv->credentials->token_secret, ==, "requestsecret");
 
   /* Second stage authentication, this gets an access token */
   oauth_proxy_access_token_async (proxy, "access_token.php", NULL,
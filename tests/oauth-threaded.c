@@ -0,0 +1,333 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+
+/*
+ * Signs calls on one OAuthProxy from many threads while another keeps
+ * fetching new access tokens.  Every other call is signed with the
+ * credentials of a tenant of its own instead.  The server checks every
+ * signature against the secret that goes with the token sent, so a call
+ * signed with a token from one response and a secret from another fails.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <libsoup/soup.h>
+#include <rest/oauth-proxy.h>
+#include <rest/oauth-proxy-call.h>
+#include <rest/rest-request.h>
+#include <rest/sha1.h>
+
+#define THREADS 8
+#define CALLS 200
+#define ROTATIONS 100
+/* Tokens from here on belong to tenants, not to the proxy */
+#define FIRST_TENANT 1000
+
+static volatile int errors = 0;
+/* Only used by the server thread */
+static int next_token = 1;
+
+/* Encode @s as OAuth does */
+static char *
+encode (const char *s)
+{
+  return soup_uri_encode (s, "!$&'()*+,;=@");
+}
+
+/*
+ * Check the HMAC-SHA1 signature in the Authorization header of @msg, with the
+ * secret for the token it names.  The parameters of a form in the body are
+ * signed too.
+ */
+static gboolean
+check_signature (SoupMessage *msg)
+{
+  const char *header;
+  GHashTable *params;
+  GList *keys, *l;
+  GString *base, *normalized;
+  char **fields, *signature, *key, *expected, *s;
+  const char *token;
+  gboolean valid;
+  int i;
+
+  header = soup_message_headers_get_one (msg->request_headers, "Authorization");
+  if (header == NULL || !g_str_has_prefix (header, "OAuth "))
+    return FALSE;
+
+  params = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  fields = g_strsplit (header + strlen ("OAuth "), ", ", 0);
+  for (i = 0; fields[i]; i++) {
+    char *eq = strchr (fields[i], '=');
+    gsize len;
+
+    if (eq == NULL)
+      continue;
+    *eq++ = '\0';
+    len = strlen (eq);
+    if (len < 2 || eq[0] != '"' || eq[len - 1] != '"')
+      continue;
+    eq[len - 1] = '\0';
+
+    if (strcmp (fields[i], "realm") != 0)
+      g_hash_table_insert (params, g_strdup (fields[i]), soup_uri_decode (eq + 1));
+  }
+  g_strfreev (fields);
+
+  if (g_strcmp0 (soup_message_headers_get_content_type (msg->request_headers, NULL),
+                 SOUP_FORM_MIME_TYPE_URLENCODED) == 0) {
+    GHashTable *form;
+    GHashTableIter iter;
+    gpointer name, value;
+
+    form = soup_form_decode (msg->request_body->data);
+    g_hash_table_iter_init (&iter, form);
+    while (g_hash_table_iter_next (&iter, &name, &value))
+      g_hash_table_insert (params, g_strdup (name), g_strdup (value));
+    g_hash_table_destroy (form);
+  }
+
+  token = g_hash_table_lookup (params, "oauth_token");
+  signature = g_strdup (g_hash_table_lookup (params, "oauth_signature"));
+  g_hash_table_remove (params, "oauth_signature");
+  if (token == NULL || signature == NULL ||
+      !g_str_has_prefix (token, "token")) {
+    g_hash_table_destroy (params);
+    g_free (signature);
+    return FALSE;
+  }
+
+  normalized = g_string_new (NULL);
+  keys = g_list_sort (g_hash_table_get_keys (params), (GCompareFunc)strcmp);
+  for (l = keys; l; l = l->next) {
+    if (normalized->len)
+      g_string_append_c (normalized, '&');
+    s = encode (l->data);
+    g_string_append_printf (normalized, "%s=", s);
+    g_free (s);
+    s = encode (g_hash_table_lookup (params, l->data));
+    g_string_append (normalized, s);
+    g_free (s);
+  }
+  g_list_free (keys);
+
+  base = g_string_new (msg->method);
+  g_string_append_c (base, '&');
+  s = soup_uri_to_string (soup_message_get_uri (msg), FALSE);
+  expected = encode (s);
+  g_string_append (base, expected);
+  g_free (expected);
+  g_free (s);
+  g_string_append_c (base, '&');
+  s = encode (normalized->str);
+  g_string_append (base, s);
+  g_free (s);
+
+  key = g_strdup_printf ("consumer&secret%s", token + strlen ("token"));
+  expected = hmac_sha1 (key, base->str);
+  valid = strcmp (expected, signature) == 0;
+
+  g_free (expected);
+  g_free (key);
+  g_free (signature);
+  g_string_free (base, TRUE);
+  g_string_free (normalized, TRUE);
+  g_hash_table_destroy (params);
+
+  return valid;
+}
+
+static void
+server_callback (SoupServer *server, SoupMessage *msg,
+                 const char *path, GHashTable *query,
+                 SoupClientContext *client, gpointer user_data)
+{
+  char *body;
+
+  if (!check_signature (msg)) {
+    soup_message_set_status (msg, SOUP_STATUS_UNAUTHORIZED);
+    return;
+  }
+
+  if (g_str_equal (path, "/ping")) {
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  } else if (g_str_equal (path, "/echo")) {
+    GHashTable *form;
+    const char *value;
+
+    form = soup_form_decode (msg->request_body->data);
+    value = g_hash_table_lookup (form, "value");
+    soup_message_set_status (msg, value ? SOUP_STATUS_OK : SOUP_STATUS_BAD_REQUEST);
+    if (value)
+      soup_message_set_response (msg, "text/plain", SOUP_MEMORY_COPY,
+                                 value, strlen (value));
+    g_hash_table_destroy (form);
+  } else if (g_str_equal (path, "/access_token")) {
+    body = g_strdup_printf ("oauth_token=token%d&oauth_token_secret=secret%d",
+                            next_token, next_token);
+    next_token++;
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+    soup_message_set_response (msg, "application/x-www-form-urlencoded",
+                               SOUP_MEMORY_TAKE, body, strlen (body));
+  } else {
+    soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
+  }
+}
+
+typedef struct {
+  RestProxy *proxy;
+  int tenant;
+} ThreadData;
+
+static gpointer
+func (gpointer user_data)
+{
+  ThreadData *data = user_data;
+  OAuthCredentials *credentials;
+  RestProxyCall *call;
+  GError *error = NULL;
+  char *token, *secret;
+  int i;
+
+  token = g_strdup_printf ("token%d", data->tenant);
+  secret = g_strdup_printf ("secret%d", data->tenant);
+  credentials = oauth_proxy_new_credentials (OAUTH_PROXY (data->proxy),
+                                             token, secret);
+  g_free (token);
+  g_free (secret);
+
+  for (i = 0; i < CALLS; i++) {
+    call = rest_proxy_new_call (data->proxy);
+    rest_proxy_call_set_function (call, "ping");
+    if (i % 2)
+      oauth_proxy_call_set_credentials (OAUTH_PROXY_CALL (call), credentials);
+
+    if (!rest_proxy_call_sync (call, &error)) {
+      g_printerr ("Call failed: %s\n", error->message);
+      g_clear_error (&error);
+      g_atomic_int_add (&errors, 1);
+    } else if (rest_proxy_call_get_status_code (call) != SOUP_STATUS_OK) {
+      g_printerr ("Wrong response code, got %d\n", rest_proxy_call_get_status_code (call));
+      g_atomic_int_add (&errors, 1);
+    }
+
+    g_object_unref (call);
+
+    /* The token is being rotated by the main thread */
+    token = oauth_proxy_dup_token (OAUTH_PROXY (data->proxy));
+    if (token == NULL || !g_str_has_prefix (token, "token")) {
+      g_printerr ("Wrong token %s\n", token);
+      g_atomic_int_add (&errors, 1);
+    }
+    g_free (token);
+  }
+
+  oauth_credentials_unref (credentials);
+
+  return NULL;
+}
+
+/*
+ * A #RestRequest is signed with the proxy's credentials just as a call is,
+ * including the parameters of a POST.
+ */
+static void
+request_test (RestProxy *proxy)
+{
+  RestRequest *request;
+  GError *error = NULL;
+
+  request = rest_request_new (proxy, "POST", "echo");
+  if (request == NULL) {
+    g_printerr ("No request made with an OAuthProxy\n");
+    g_atomic_int_add (&errors, 1);
+    return;
+  }
+
+  rest_request_add_param (request, "value", "signed");
+
+  if (!rest_request_run (request, &error)) {
+    g_printerr ("Signed request failed: %s\n", error->message);
+    g_clear_error (&error);
+    g_atomic_int_add (&errors, 1);
+  } else if (g_strcmp0 (rest_request_get_payload (request), "signed") != 0) {
+    g_printerr ("Wrong response to signed request\n");
+    g_atomic_int_add (&errors, 1);
+  }
+
+  rest_request_free (request);
+}
+
+int
+main (int argc, char **argv)
+{
+  SoupServer *server;
+  RestProxy *proxy;
+  GThread *threads[THREADS];
+  ThreadData data[THREADS];
+  GError *error = NULL;
+  char *url, *token;
+  int i;
+
+  g_type_init ();
+
+  server = soup_server_new (NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  g_thread_create ((GThreadFunc)soup_server_run, server, FALSE, NULL);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = oauth_proxy_new_with_token ("key", "consumer", "token0", "secret0",
+                                      url, FALSE);
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++) {
+    data[i].proxy = proxy;
+    data[i].tenant = FIRST_TENANT + i;
+    threads[i] = g_thread_create (func, &data[i], TRUE, NULL);
+  }
+
+  /* Keep refreshing the token while the calls are being signed */
+  for (i = 0; i < ROTATIONS; i++) {
+    if (!oauth_proxy_access_token (OAUTH_PROXY (proxy), "access_token", NULL, &error)) {
+      g_printerr ("Refresh failed: %s\n", error->message);
+      g_clear_error (&error);
+      g_atomic_int_add (&errors, 1);
+    }
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (threads); i++)
+    g_thread_join (threads[i]);
+
+  request_test (proxy);
+
+  token = oauth_proxy_dup_token (OAUTH_PROXY (proxy));
+  if (g_strcmp0 (token, "token" G_STRINGIFY (ROTATIONS)) != 0) {
+    g_printerr ("Wrong final token %s\n", token);
+    g_atomic_int_add (&errors, 1);
+  }
+  g_free (token);
+
+  soup_server_quit (server);
+  g_object_unref (proxy);
+  g_free (url);
+
+  return errors != 0;
+}
@@ -46,15 +46,15 @@ main (int argc, char **argv)
   /* First stage authentication, this gets a request token */
   oauth_proxy_request_token (oproxy, "request_token.php", NULL, &error);
   g_assert_no_error (error);
-  g_assert_cmpstr (priv->token, ==, "requestkey");
-  g_assert_cmpstr (priv->token_secret, ==, "requestsecret");
+  g_assert_cmpstr (priv->credentials->token, ==, "requestkey");
+  g_assert_cmpstr (priv->credentials->token_secret, ==, "requestsecret");
 
   /* Second stage authentication, this gets an access token */
   oauth_proxy_access_token (OAUTH_PROXY (proxy), "access_token.php", NULL, &error);
   g_assert_no_error (error);
 
-  g_assert_cmpstr (priv->token, ==, "accesskey");
-  g_assert_cmpstr (priv->token_secret, ==, "accesssecret");
+  g_assert_cmpstr (priv->credentials->token, ==, "accesskey");
+  g_assert_cmpstr (priv->credentials->token_secret, ==, "accesssecret");
 
   /* Make some test calls */
 
@@ -33,11 +33,45 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <libsoup/soup.h>
 #include <rest/rest-proxy.h>
+#include <rest/rest-request.h>
+#include <rest/oauth2-proxy.h>
 
 static int errors = 0;
 
+#define COMPRESSIBLE_TEXT "compress me, compress me, compress me, compress me. "
+
+/* What the server has of the resumable upload */
+static GString *resumable_data;
+static gboolean resumable_failed;
+
+/* The parts of the part based upload, by number */
+static GHashTable *upload_parts;
+static gboolean upload_part_failed;
+
+static void
+expect_got_headers_cb (SoupMessage *msg, gpointer user_data)
+{
+  /* Setting a final status now answers "Expect: 100-continue" with it, so
+   * that the body is never sent */
+  if (g_str_equal (soup_message_get_uri (msg)->path, "/expect") &&
+      soup_message_headers_get_one (msg->request_headers, "X-Refuse"))
+    soup_message_set_status (msg, SOUP_STATUS_FORBIDDEN);
+}
+
+static void
+request_started_cb (SoupServer *server, SoupMessage *msg,
+                    SoupClientContext *client, gpointer user_data)
+{
+  g_signal_connect (msg, "got-headers",
+                    G_CALLBACK (expect_got_headers_cb), NULL);
+}
+
 static void
 server_callback (SoupServer *server, SoupMessage *msg,
                  const char *path, GHashTable *query,
@@ -54,6 +88,19 @@ server_callback (SoupServer *server, SoupMessage *msg,
                                value, strlen (value));
     soup_message_set_status (msg, SOUP_STATUS_OK);
   }
+  else if (g_str_equal (path, "/access-token")) {
+    const char *value;
+
+    /* Answers with the token an OAuth2Proxy added */
+    value = query ? g_hash_table_lookup (query, "access_token") : NULL;
+    if (value) {
+      soup_message_set_response (msg, "text/plain", SOUP_MEMORY_COPY,
+                                 value, strlen (value));
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+    } else {
+      soup_message_set_status (msg, SOUP_STATUS_UNAUTHORIZED);
+    }
+  }
   else if (g_str_equal (path, "/reverse")) {
     char *value;
 
@@ -76,6 +123,262 @@ server_callback (SoupServer *server, SoupMessage *msg,
       soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
     }
   }
+  else if (g_str_equal (path, "/gzip")) {
+    const char *accept, *format, *coding;
+    GConverter *compressor;
+    GZlibCompressorFormat zlib_format;
+    GString *text;
+    guchar out[1024];
+    gsize bytes_read, bytes_written;
+    int i;
+
+    /* "deflate" is sent as zlib data, or as raw deflate data the way some
+     * servers do */
+    format = query ? g_hash_table_lookup (query, "format") : NULL;
+    if (g_strcmp0 (format, "zlib") == 0) {
+      zlib_format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
+      coding = "deflate";
+    } else if (g_strcmp0 (format, "raw") == 0) {
+      zlib_format = G_ZLIB_COMPRESSOR_FORMAT_RAW;
+      coding = "deflate";
+    } else {
+      zlib_format = G_ZLIB_COMPRESSOR_FORMAT_GZIP;
+      coding = "gzip";
+    }
+
+    accept = soup_message_headers_get_list (msg->request_headers, "Accept-Encoding");
+    if (accept == NULL || !soup_header_contains (accept, coding)) {
+      soup_message_set_status (msg, SOUP_STATUS_EXPECTATION_FAILED);
+      return;
+    }
+
+    text = g_string_new (NULL);
+    for (i = 0; i < 20; i++)
+      g_string_append (text, COMPRESSIBLE_TEXT);
+
+    compressor = G_CONVERTER (g_zlib_compressor_new (zlib_format, -1));
+    g_converter_convert (compressor, text->str, text->len, out, sizeof (out),
+                         G_CONVERTER_INPUT_AT_END,
+                         &bytes_read, &bytes_written, NULL);
+    g_object_unref (compressor);
+    g_string_free (text, TRUE);
+
+    /* Cut the stream short, losing its end and trailer */
+    if (query && g_hash_table_lookup (query, "truncate"))
+      bytes_written /= 2;
+
+    soup_message_headers_append (msg->response_headers, "Content-Encoding", coding);
+    soup_message_set_response (msg, "text/plain", SOUP_MEMORY_COPY,
+                               (const char *)out, bytes_written);
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  }
+  else if (g_str_equal (path, "/gunzip")) {
+    const char *coding;
+    GConverter *decompressor;
+    GHashTable *form;
+    char out[16384];
+    gsize bytes_read, bytes_written;
+    GString *expected;
+    int i;
+
+    coding = soup_message_headers_get_one (msg->request_headers, "Content-Encoding");
+    if (g_strcmp0 (coding, "gzip") != 0) {
+      soup_message_set_status (msg, SOUP_STATUS_EXPECTATION_FAILED);
+      return;
+    }
+
+    decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+    g_converter_convert (decompressor,
+                         msg->request_body->data, msg->request_body->length,
+                         out, sizeof (out) - 1,
+                         G_CONVERTER_INPUT_AT_END,
+                         &bytes_read, &bytes_written, NULL);
+    g_object_unref (decompressor);
+    out[bytes_written] = '\0';
+
+    expected = g_string_new (NULL);
+    for (i = 0; i < 100; i++)
+      g_string_append (expected, COMPRESSIBLE_TEXT);
+
+    form = soup_form_decode (out);
+    if (msg->request_body->length < expected->len &&
+        g_strcmp0 (g_hash_table_lookup (form, "value"), expected->str) == 0) {
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+    } else {
+      soup_message_set_status (msg, SOUP_STATUS_EXPECTATION_FAILED);
+    }
+
+    g_hash_table_destroy (form);
+    g_string_free (expected, TRUE);
+  }
+  else if (g_str_equal (path, "/expect")) {
+    /* Refused requests are answered from expect_got_headers_cb() */
+    if (soup_message_headers_get_expectations (msg->request_headers) &
+        SOUP_EXPECTATION_CONTINUE &&
+        msg->request_body->length > 10000 * strlen (COMPRESSIBLE_TEXT)) {
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+    } else {
+      soup_message_set_status (msg, SOUP_STATUS_EXPECTATION_FAILED);
+    }
+  }
+  else if (g_str_equal (path, "/multipart")) {
+    GHashTable *form;
+    char *filename = NULL, *content_type = NULL;
+    SoupBuffer *file = NULL;
+    GString *expected;
+    int i;
+
+    expected = g_string_new (NULL);
+    for (i = 0; i < 10000; i++)
+      g_string_append (expected, COMPRESSIBLE_TEXT);
+
+    form = soup_form_decode_multipart (msg, "file",
+                                       &filename, &content_type, &file);
+    if (form &&
+        g_strcmp0 (g_hash_table_lookup (form, "name"), "value") == 0 &&
+        g_strcmp0 (filename, "test.txt") == 0 &&
+        g_strcmp0 (content_type, "application/octet-stream") == 0 &&
+        file && file->length == expected->len &&
+        memcmp (file->data, expected->str, expected->len) == 0) {
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+    } else {
+      soup_message_set_status (msg, SOUP_STATUS_EXPECTATION_FAILED);
+    }
+
+    if (form)
+      g_hash_table_destroy (form);
+    if (file)
+      soup_buffer_free (file);
+    g_free (filename);
+    g_free (content_type);
+    g_string_free (expected, TRUE);
+  }
+  else if (g_str_equal (path, "/large")) {
+    const char *value;
+    GString *text;
+    int i, count = 20000;
+
+    value = query ? g_hash_table_lookup (query, "count") : NULL;
+    if (value)
+      count = atoi (value);
+
+    text = g_string_new (NULL);
+    for (i = 0; i < count; i++)
+      g_string_append (text, COMPRESSIBLE_TEXT);
+
+    soup_message_set_response (msg, "text/plain", SOUP_MEMORY_TAKE,
+                               text->str, text->len);
+    g_string_free (text, FALSE);
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  }
+  else if (g_str_equal (path, "/resumable")) {
+    resumable_data = g_string_new (NULL);
+    resumable_failed = FALSE;
+    soup_message_headers_replace (msg->response_headers, "Location",
+                                  "/resumable/session");
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  }
+  else if (g_str_equal (path, "/resumable/session")) {
+    const char *range;
+    gint64 start = 0, total;
+    gsize length;
+    char *value;
+
+    range = soup_message_headers_get_one (msg->request_headers, "Content-Range");
+    length = msg->request_body->length;
+
+    if (range && sscanf (range, "bytes */%" G_GINT64_FORMAT, &total) == 1) {
+      /* A status query */
+    } else if (range &&
+               sscanf (range, "bytes %" G_GINT64_FORMAT "-%*d/%" G_GINT64_FORMAT,
+                       &start, &total) == 2 &&
+               start == (gint64)resumable_data->len) {
+      /* Take half of the second chunk and then fail, once */
+      if (start > 0 && !resumable_failed) {
+        resumable_failed = TRUE;
+        g_string_append_len (resumable_data, msg->request_body->data, length / 2);
+        soup_message_set_status (msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+        return;
+      }
+      g_string_append_len (resumable_data, msg->request_body->data, length);
+    } else {
+      soup_message_set_status (msg, SOUP_STATUS_BAD_REQUEST);
+      return;
+    }
+
+    if ((gint64)resumable_data->len == total) {
+      soup_message_set_response (msg, "text/plain", SOUP_MEMORY_STATIC, "done", 4);
+      soup_message_set_status (msg, SOUP_STATUS_CREATED);
+    } else {
+      if (resumable_data->len > 0) {
+        value = g_strdup_printf ("bytes=0-%" G_GSIZE_FORMAT, resumable_data->len - 1);
+        soup_message_headers_replace (msg->response_headers, "Range", value);
+        g_free (value);
+      }
+      soup_message_set_status_full (msg, 308, "Resume Incomplete");
+    }
+  }
+  else if (g_str_equal (path, "/parts/part")) {
+    const char *n;
+    char *etag;
+
+    n = query ? g_hash_table_lookup (query, "n") : NULL;
+    if (n == NULL || msg->method != SOUP_METHOD_PUT) {
+      soup_message_set_status (msg, SOUP_STATUS_BAD_REQUEST);
+      return;
+    }
+
+    /* Fail the second part once, to check that it is sent again */
+    if (atoi (n) == 2 && !upload_part_failed) {
+      upload_part_failed = TRUE;
+      soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+      return;
+    }
+
+    g_hash_table_insert (upload_parts, GINT_TO_POINTER (atoi (n)),
+                         g_string_new_len (msg->request_body->data,
+                                           msg->request_body->length));
+
+    etag = g_strdup_printf ("\"part-%s\"", n);
+    soup_message_headers_replace (msg->response_headers, "ETag", etag);
+    g_free (etag);
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+  }
+  else if (g_str_equal (path, "/parts/complete")) {
+    GHashTable *form;
+    GString *object, *expected;
+    char **ids;
+    int i;
+
+    form = soup_form_decode (msg->request_body->data);
+    ids = g_strsplit (g_hash_table_lookup (form, "ids"), ",", 0);
+
+    object = g_string_new (NULL);
+    for (i = 0; ids[i]; i++) {
+      GString *part;
+      char *id;
+
+      id = g_strdup_printf ("\"part-%d\"", i + 1);
+      part = g_hash_table_lookup (upload_parts, GINT_TO_POINTER (i + 1));
+      if (part && g_str_equal (id, ids[i]))
+        g_string_append_len (object, part->str, part->len);
+      g_free (id);
+    }
+
+    expected = g_string_new (NULL);
+    for (i = 0; i < 10000; i++)
+      g_string_append (expected, COMPRESSIBLE_TEXT);
+
+    if (g_string_equal (object, expected))
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+    else
+      soup_message_set_status (msg, SOUP_STATUS_BAD_REQUEST);
+
+    g_string_free (object, TRUE);
+    g_string_free (expected, TRUE);
+    g_strfreev (ids);
+    g_hash_table_destroy (form);
+  }
   else if (g_str_equal (path, "/useragent/none")) {
     if (soup_message_headers_get (msg->request_headers, "User-Agent") == NULL) {
       soup_message_set_status (msg, SOUP_STATUS_OK);
@@ -161,6 +464,80 @@ echo_test (RestProxy *proxy)
   }
 }
 
+static void
+request_done_cb (RestRequest  *request,
+                 const GError *error,
+                 gpointer      user_data)
+{
+  if (error) {
+    g_printerr ("Request failed: %s\n", error->message);
+    errors++;
+  }
+
+  g_main_loop_quit (user_data);
+}
+
+static void
+request_test (RestProxy *proxy)
+{
+  RestRequest *request;
+  GMainLoop *loop;
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  request = rest_request_new (proxy, "GET", "echo");
+  rest_request_add_param (request, "value", "echo me");
+  rest_request_add_header (request, "X-Test", "yes");
+  rest_request_run_async (request, request_done_cb, loop);
+  g_main_loop_run (loop);
+
+  if (rest_request_get_status_code (request) != SOUP_STATUS_OK) {
+    g_printerr ("wrong response code\n");
+    errors++;
+  } else if (rest_request_get_payload_length (request) != 7 ||
+             g_strcmp0 (rest_request_get_payload (request), "echo me") != 0) {
+    g_printerr ("wrong string returned\n");
+    errors++;
+  } else if (g_strcmp0 (rest_request_lookup_response_header (request, "Content-Type"),
+                        "text/plain") != 0) {
+    g_printerr ("wrong content type returned\n");
+    errors++;
+  }
+
+  rest_request_free (request);
+  g_main_loop_unref (loop);
+}
+
+/* A request made with a proxy that changes its calls is changed the same way */
+static void
+signed_request_test (RestProxy *proxy)
+{
+  RestProxy *oauth2_proxy;
+  RestRequest *request;
+  GError *error = NULL;
+  char *url;
+
+  g_object_get (proxy, "url-format", &url, NULL);
+  oauth2_proxy = oauth2_proxy_new_with_token ("client", "token",
+                                              "http://example.com/auth",
+                                              url, FALSE);
+  g_free (url);
+
+  request = rest_request_new (oauth2_proxy, "GET", "access-token");
+
+  if (!rest_request_run (request, &error)) {
+    g_printerr ("Request failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  } else if (g_strcmp0 (rest_request_get_payload (request), "token") != 0) {
+    g_printerr ("wrong access token sent\n");
+    errors++;
+  }
+
+  rest_request_free (request);
+  g_object_unref (oauth2_proxy);
+}
+
 static void
 reverse_test (RestProxy *proxy)
 {
@@ -275,38 +652,1143 @@ test_status_ok (RestProxy *proxy, const char *function)
   g_object_unref (call);
 }
 
-int
-main (int argc, char **argv)
+/* @format is the "format" the server compresses with, or %NULL for gzip */
+static void
+gzip_test (RestProxy *proxy, const char *format)
 {
-  SoupSession *session;
-  SoupServer *server;
-  char *url;
-  RestProxy *proxy;
+  RestProxyCall *call;
+  RestProxyStats *stats;
+  GError *error = NULL;
+  gsize expected_length;
 
-  g_type_init ();
+  expected_length = strlen (COMPRESSIBLE_TEXT) * 20;
 
-  session = soup_session_async_new ();
+  g_object_set (proxy, "decode-content", TRUE, NULL);
+  rest_proxy_reset_stats (proxy);
 
-  server = soup_server_new (NULL);
-  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
-  soup_server_run_async (server);
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "gzip");
+  if (format)
+    rest_proxy_call_add_param (call, "format", format);
 
-  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
-  proxy = rest_proxy_new (url, FALSE);
-  g_free (url);
+  if (!rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+    goto done;
+  }
 
-  ping_test (proxy);
-  echo_test (proxy);
-  reverse_test (proxy);
-  status_ok_test (proxy, SOUP_STATUS_OK);
-  status_ok_test (proxy, SOUP_STATUS_NO_CONTENT);
-  /* status_ok_test (proxy, SOUP_STATUS_MULTIPLE_CHOICES); */
-  status_error_test (proxy, SOUP_STATUS_BAD_REQUEST);
-  status_error_test (proxy, SOUP_STATUS_NOT_IMPLEMENTED);
+  if (rest_proxy_call_get_payload_length (call) != expected_length) {
+    g_printerr ("wrong decoded length returned\n");
+    errors++;
+    goto done;
+  }
+  if (!g_str_has_prefix (rest_proxy_call_get_payload (call), COMPRESSIBLE_TEXT)) {
+    g_printerr ("wrong string returned\n");
+    errors++;
+    goto done;
+  }
 
-  test_status_ok (proxy, "useragent/none");
-  rest_proxy_set_user_agent (proxy, "TestSuite-1.0");
-  test_status_ok (proxy, "useragent/testsuite");
+  stats = rest_proxy_get_stats (proxy);
+  if (stats->requests != 1 ||
+      stats->bytes_received != expected_length ||
+      stats->wire_bytes_received >= stats->bytes_received) {
+    g_printerr ("wrong statistics\n");
+    errors++;
+  }
+  rest_proxy_stats_free (stats);
+
+ done:
+  g_object_unref (call);
+  g_object_set (proxy, "decode-content", FALSE, NULL);
+}
+
+static void
+truncated_gzip_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  GError *error = NULL;
+
+  g_object_set (proxy, "decode-content", TRUE, NULL);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "gzip");
+  rest_proxy_call_add_param (call, "truncate", "1");
+
+  if (rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Truncated gzip body was accepted\n");
+    errors++;
+  } else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT)) {
+    g_printerr ("Wrong error for truncated gzip body: %s\n", error->message);
+    errors++;
+  }
+  g_clear_error (&error);
+
+  g_object_unref (call);
+  g_object_set (proxy, "decode-content", FALSE, NULL);
+}
+
+static void
+spill_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  GError *error = NULL;
+  GBytes *bytes = NULL;
+  const gchar *payload;
+  gsize length, i;
+
+  g_object_set (proxy, "response-spill-threshold", (gint64)4096, NULL);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "large");
+
+  if (!rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+    goto done;
+  }
+
+  length = strlen (COMPRESSIBLE_TEXT);
+  payload = rest_proxy_call_get_payload (call);
+
+  if (rest_proxy_call_get_payload_length (call) != length * 20000 ||
+      payload[length * 20000] != '\0') {
+    g_printerr ("wrong spilled length returned\n");
+    errors++;
+    goto done;
+  }
+
+  for (i = 0; i < 20000; i++) {
+    if (memcmp (payload + i * length, COMPRESSIBLE_TEXT, length) != 0) {
+      g_printerr ("wrong spilled payload returned\n");
+      errors++;
+      break;
+    }
+  }
+
+  /* The mapping outlives the call while the bytes hold it */
+  bytes = rest_proxy_call_get_payload_bytes (call);
+  g_object_unref (call);
+  call = NULL;
+
+  if (bytes == NULL ||
+      g_bytes_get_data (bytes, NULL) != payload ||
+      g_bytes_get_size (bytes) != length * 20000 ||
+      memcmp (payload + length * 19999, COMPRESSIBLE_TEXT, length) != 0) {
+    g_printerr ("wrong spilled payload bytes returned\n");
+    errors++;
+  }
+
+ done:
+  if (bytes)
+    g_bytes_unref (bytes);
+  if (call)
+    g_object_unref (call);
+  g_object_set (proxy, "response-spill-threshold", (gint64)-1, NULL);
+}
+
+static void
+max_response_size_test (RestProxy *proxy, const char *function, gint64 max,
+                        gboolean decode, gboolean lift)
+{
+  RestProxyCall *call;
+  RestProxyStats *stats;
+  GError *error = NULL;
+  gboolean ret;
+
+  g_object_set (proxy, "max-response-size", max, "decode-content", decode, NULL);
+  rest_proxy_reset_stats (proxy);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, function);
+  if (lift)
+    g_object_set (call, "max-response-size", G_MAXINT64, NULL);
+
+  ret = rest_proxy_call_run (call, NULL, &error);
+
+  if (lift) {
+    if (!ret) {
+      g_printerr ("Call failed: %s\n", error->message);
+      errors++;
+    }
+  } else if (ret || !g_error_matches (error, REST_PROXY_ERROR,
+                                      REST_PROXY_ERROR_RESPONSE_TOO_LARGE) ||
+             rest_proxy_call_get_payload_length (call) != 0) {
+    g_printerr ("Oversized response from %s was accepted\n", function);
+    errors++;
+  } else if (decode) {
+    /* The decoded body went over, so some of it was read */
+    stats = rest_proxy_get_stats (proxy);
+    if (stats->bytes_discarded == 0) {
+      g_printerr ("Discarded bytes were not counted\n");
+      errors++;
+    }
+    rest_proxy_stats_free (stats);
+  }
+
+  g_clear_error (&error);
+  g_object_unref (call);
+  g_object_set (proxy, "max-response-size", (gint64)-1, "decode-content", FALSE, NULL);
+}
+
+static void
+buffer_pool_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  RestProxyStats *stats;
+  GError *error = NULL;
+  GBytes *bytes;
+  int i;
+
+  rest_proxy_reset_stats (proxy);
+
+  /* Each payload goes back to the pool when its call is freed, for the next
+   * call to reuse */
+  for (i = 0; i < 20; i++) {
+    call = rest_proxy_new_call (proxy);
+    rest_proxy_call_set_function (call, "echo");
+    rest_proxy_call_add_param (call, "value", "polling");
+
+    if (!rest_proxy_call_run (call, NULL, &error)) {
+      g_printerr ("Call failed: %s\n", error->message);
+      g_error_free (error);
+      errors++;
+      g_object_unref (call);
+      return;
+    }
+
+    g_object_unref (call);
+  }
+
+  stats = rest_proxy_get_stats (proxy);
+  if (stats->pool_hits < 19 || stats->pool_misses > 1 ||
+      stats->pool_resident_bytes == 0) {
+    g_printerr ("Response buffers were not reused\n");
+    errors++;
+  }
+  rest_proxy_stats_free (stats);
+
+  /* A payload kept as bytes only goes back to the pool with them */
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "echo");
+  rest_proxy_call_add_param (call, "value", "polling");
+
+  if (!rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+    g_object_unref (call);
+    return;
+  }
+
+  bytes = rest_proxy_call_get_payload_bytes (call);
+  g_object_unref (call);
+
+  if (bytes == NULL || g_bytes_get_size (bytes) != strlen ("polling") ||
+      memcmp (g_bytes_get_data (bytes, NULL), "polling", strlen ("polling")) != 0) {
+    g_printerr ("wrong payload bytes returned\n");
+    errors++;
+  }
+
+  if (bytes)
+    g_bytes_unref (bytes);
+}
+
+static void
+compress_request_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  GString *value;
+  GError *error = NULL;
+  int i;
+
+  value = g_string_new (NULL);
+  for (i = 0; i < 100; i++)
+    g_string_append (value, COMPRESSIBLE_TEXT);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "gunzip");
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_add_param (call, "value", value->str);
+  rest_proxy_call_set_request_compression (call, REST_CONTENT_CODING_GZIP, 1024);
+
+  if (!rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  }
+
+  g_object_unref (call);
+  g_string_free (value, TRUE);
+}
+
+static void
+stream_upload_test (RestProxy *proxy, gboolean known_length)
+{
+  RestProxyCall *call;
+  GInputStream *stream;
+  GString *data;
+  GError *error = NULL;
+  int i;
+
+  data = g_string_new (NULL);
+  for (i = 0; i < 10000; i++)
+    g_string_append (data, COMPRESSIBLE_TEXT);
+
+  stream = g_memory_input_stream_new_from_data (data->str, data->len, NULL);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "multipart");
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_add_param (call, "name", "value");
+  rest_proxy_call_add_param_full (call,
+                                  rest_param_new_with_stream ("file", stream,
+                                                              known_length ? (goffset)data->len : -1,
+                                                              "application/octet-stream",
+                                                              "test.txt"));
+
+  if (!rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  }
+
+  g_object_unref (call);
+  g_object_unref (stream);
+  g_string_free (data, TRUE);
+}
+
+static void
+fd_upload_test (RestProxy *proxy, gboolean known_length)
+{
+  RestProxyCall *call;
+  GString *data;
+  GError *error = NULL;
+  gchar *path = NULL;
+  int fd, i;
+
+  /* Put the value after some junk, so that it starts part way into a page */
+  data = g_string_new ("junk junk junk");
+  for (i = 0; i < 10000; i++)
+    g_string_append (data, COMPRESSIBLE_TEXT);
+
+  fd = g_file_open_tmp ("rest-proxy-XXXXXX", &path, &error);
+  if (fd < 0 ||
+      write (fd, data->str, data->len) != (gssize)data->len) {
+    g_printerr ("Cannot write temporary file: %s\n",
+                error ? error->message : g_strerror (errno));
+    g_clear_error (&error);
+    errors++;
+    goto done;
+  }
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "multipart");
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_add_param (call, "name", "value");
+  rest_proxy_call_add_param_full (call,
+                                  rest_param_new_with_fd ("file", fd, 14,
+                                                          known_length ? (goffset)data->len - 14 : -1,
+                                                          "application/octet-stream",
+                                                          "test.txt"));
+
+  if (!rest_proxy_call_run (call, NULL, &error)) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  }
+
+  g_object_unref (call);
+
+ done:
+  if (fd >= 0) {
+    close (fd);
+    g_unlink (path);
+  }
+  g_free (path);
+  g_string_free (data, TRUE);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  int pending;
+} SharedData;
+
+static void
+shared_param_cb (RestProxyCall *call,
+                 const GError  *error,
+                 GObject       *weak_object,
+                 gpointer       user_data)
+{
+  SharedData *data = user_data;
+
+  if (error) {
+    g_printerr ("Call failed: %s\n", error->message);
+    errors++;
+  }
+
+  g_object_unref (call);
+
+  if (--data->pending == 0)
+    g_main_loop_quit (data->loop);
+}
+
+/* One mapped file parameter sent by several calls at once */
+static void
+shared_param_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  RestParam *param;
+  SharedData data;
+  GString *contents;
+  GError *error = NULL;
+  gchar *path = NULL;
+  int fd, i;
+
+  contents = g_string_new (NULL);
+  for (i = 0; i < 10000; i++)
+    g_string_append (contents, COMPRESSIBLE_TEXT);
+
+  fd = g_file_open_tmp ("rest-proxy-XXXXXX", &path, &error);
+  if (fd < 0 ||
+      write (fd, contents->str, contents->len) != (gssize)contents->len) {
+    g_printerr ("Cannot write temporary file: %s\n",
+                error ? error->message : g_strerror (errno));
+    g_clear_error (&error);
+    errors++;
+    goto done;
+  }
+
+  param = rest_param_new_from_file ("file", path, "application/octet-stream",
+                                    "test.txt", &error);
+  if (param == NULL) {
+    g_printerr ("Cannot map temporary file: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+    goto done;
+  }
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.pending = 0;
+
+  for (i = 0; i < 3; i++) {
+    call = rest_proxy_new_call (proxy);
+    rest_proxy_call_set_function (call, "multipart");
+    rest_proxy_call_set_method (call, "POST");
+    rest_proxy_call_add_param (call, "name", "value");
+    rest_proxy_call_add_param_full (call, rest_param_ref (param));
+
+    if (!rest_proxy_call_async (call, shared_param_cb, NULL, &data, &error)) {
+      g_printerr ("Call failed: %s\n", error->message);
+      g_clear_error (&error);
+      g_object_unref (call);
+      errors++;
+      continue;
+    }
+    data.pending++;
+  }
+
+  if (data.pending)
+    g_main_loop_run (data.loop);
+
+  rest_param_unref (param);
+  g_main_loop_unref (data.loop);
+
+ done:
+  if (fd >= 0) {
+    close (fd);
+    g_unlink (path);
+  }
+  g_free (path);
+  g_string_free (contents, TRUE);
+}
+
+static void
+expect_continue_test (RestProxy *proxy, gboolean refuse)
+{
+  RestProxyCall *call;
+  GInputStream *stream;
+  GString *data;
+  GError *error = NULL;
+  gboolean ret;
+  int i;
+
+  data = g_string_new (NULL);
+  for (i = 0; i < 10000; i++)
+    g_string_append (data, COMPRESSIBLE_TEXT);
+
+  stream = g_memory_input_stream_new_from_data (data->str, data->len, NULL);
+
+  g_object_set (proxy, "expect-continue-threshold", (gint64)1024, NULL);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "expect");
+  rest_proxy_call_set_method (call, "POST");
+  if (refuse)
+    rest_proxy_call_add_header (call, "X-Refuse", "yes");
+  rest_proxy_call_add_param_full (call,
+                                  rest_param_new_with_stream ("file", stream,
+                                                              data->len,
+                                                              "application/octet-stream",
+                                                              "test.txt"));
+
+  ret = rest_proxy_call_run (call, NULL, &error);
+
+  if (refuse) {
+    if (ret || rest_proxy_call_get_status_code (call) != SOUP_STATUS_FORBIDDEN) {
+      g_printerr ("Refused call did not fail\n");
+      errors++;
+    }
+    /* Nothing should have been read from the body */
+    if (g_seekable_tell (G_SEEKABLE (stream)) != 0) {
+      g_printerr ("Body of refused call was read\n");
+      errors++;
+    }
+    g_clear_error (&error);
+  } else if (!ret) {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  }
+
+  g_object_set (proxy, "expect-continue-threshold", (gint64)-1, NULL);
+
+  g_object_unref (call);
+  g_object_unref (stream);
+  g_string_free (data, TRUE);
+}
+
+static void
+expect_continue_upload_cb (RestProxyCall *call,
+                           gsize          total,
+                           gsize          uploaded,
+                           const GError  *error,
+                           GObject       *weak_object,
+                           gpointer       user_data)
+{
+  GMainLoop *loop = user_data;
+
+  if (error) {
+    g_printerr ("Upload failed: %s\n", error->message);
+    errors++;
+    g_main_loop_quit (loop);
+  } else if (uploaded == total) {
+    /* Only the end of the call may look finished */
+    if (rest_proxy_call_get_status_code (call) != SOUP_STATUS_OK) {
+      g_printerr ("Upload of unknown length reported as done too soon\n");
+      errors++;
+    }
+    g_main_loop_quit (loop);
+  }
+}
+
+/* The server agreeing to a body of unknown length doesn't finish the upload */
+static void
+expect_continue_upload_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  GInputStream *stream;
+  GMainLoop *loop;
+  GString *data;
+  GError *error = NULL;
+  int i;
+
+  data = g_string_new (NULL);
+  for (i = 0; i < 10000; i++)
+    g_string_append (data, COMPRESSIBLE_TEXT);
+
+  stream = g_memory_input_stream_new_from_data (data->str, data->len, NULL);
+  loop = g_main_loop_new (NULL, FALSE);
+
+  g_object_set (proxy, "expect-continue-threshold", (gint64)1024, NULL);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "expect");
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_add_param_full (call,
+                                  rest_param_new_with_stream ("file", stream, -1,
+                                                              "application/octet-stream",
+                                                              "test.txt"));
+
+  if (rest_proxy_call_upload (call, expect_continue_upload_cb, NULL, loop,
+                              &error)) {
+    g_main_loop_run (loop);
+  } else {
+    g_printerr ("Call failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  }
+
+  g_object_set (proxy, "expect-continue-threshold", (gint64)-1, NULL);
+
+  g_object_unref (call);
+  g_object_unref (stream);
+  g_main_loop_unref (loop);
+  g_string_free (data, TRUE);
+}
+
+/* A memory stream that counts how often it is flushed */
+typedef struct {
+  GMemoryOutputStream parent;
+  guint flushes;
+} FlushCountingStream;
+
+typedef struct {
+  GMemoryOutputStreamClass parent_class;
+} FlushCountingStreamClass;
+
+G_DEFINE_TYPE (FlushCountingStream, flush_counting_stream, G_TYPE_MEMORY_OUTPUT_STREAM)
+
+static gboolean
+flush_counting_stream_flush (GOutputStream *stream,
+                             GCancellable  *cancellable,
+                             GError       **error)
+{
+  ((FlushCountingStream *)stream)->flushes++;
+  return TRUE;
+}
+
+static void
+flush_counting_stream_class_init (FlushCountingStreamClass *klass)
+{
+  G_OUTPUT_STREAM_CLASS (klass)->flush = flush_counting_stream_flush;
+}
+
+static void
+flush_counting_stream_init (FlushCountingStream *stream)
+{
+}
+
+typedef struct {
+  GMainLoop *loop;
+  goffset received;
+  goffset total;
+  gboolean monotonic;
+  gboolean success;
+} DownloadData;
+
+static void
+download_progress_cb (RestProxyCall *call,
+                      goffset        received,
+                      goffset        total,
+                      gpointer       user_data)
+{
+  DownloadData *data = user_data;
+
+  if (received < data->received ||
+      (data->received && total != data->total))
+    data->monotonic = FALSE;
+
+  data->received = received;
+  data->total = total;
+}
+
+static void
+download_done_cb (GObject      *source,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  DownloadData *data = user_data;
+  GError *error = NULL;
+
+  data->success = rest_proxy_call_download_finish (REST_PROXY_CALL (source),
+                                                   result, &error);
+  if (error) {
+    g_printerr ("Download failed: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  g_main_loop_quit (data->loop);
+}
+
+/*
+ * Download to a stream or, if @use_fd, to a temporary file.  Periodic syncs
+ * happen every 4MB, so that policy gets a body big enough for at least one
+ * before the final sync.
+ */
+static void
+download_test (RestProxy              *proxy,
+               RestDownloadSyncPolicy  sync,
+               gboolean                use_fd)
+{
+  RestProxyCall *call;
+  GOutputStream *stream = NULL;
+  DownloadData data = { NULL, };
+  GError *error = NULL;
+  char *filename = NULL, *contents = NULL;
+  gsize expected_length, length = 0;
+  guint count, flushes;
+  int fd = -1;
+
+  count = sync == REST_DOWNLOAD_SYNC_PERIODIC ? 100000 : 20000;
+  expected_length = strlen (COMPRESSIBLE_TEXT) * count;
+
+  if (use_fd) {
+    fd = g_file_open_tmp ("rest-download-XXXXXX", &filename, &error);
+    if (fd < 0) {
+      g_printerr ("Cannot open temporary file: %s\n", error->message);
+      g_error_free (error);
+      errors++;
+      return;
+    }
+  } else {
+    stream = g_object_new (flush_counting_stream_get_type (),
+                           "realloc-function", g_realloc,
+                           "destroy-function", g_free,
+                           NULL);
+  }
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.monotonic = TRUE;
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "large");
+  if (count != 20000) {
+    char *value = g_strdup_printf ("%u", count);
+    rest_proxy_call_add_param (call, "count", value);
+    g_free (value);
+  }
+
+  if (use_fd)
+    rest_proxy_call_download_to_fd_async (call, fd, sync, NULL,
+                                          download_progress_cb, &data,
+                                          download_done_cb, &data);
+  else
+    rest_proxy_call_download_to_stream_async (call, stream, sync, NULL,
+                                              download_progress_cb, &data,
+                                              download_done_cb, &data);
+  g_main_loop_run (data.loop);
+
+  if (!data.success) {
+    errors++;
+    goto done;
+  }
+
+  if (use_fd) {
+    if (!g_file_get_contents (filename, &contents, &length, &error)) {
+      g_printerr ("Cannot read download: %s\n", error->message);
+      g_error_free (error);
+      errors++;
+      goto done;
+    }
+  } else {
+    length = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (stream));
+    contents = g_strndup (g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (stream)),
+                          length);
+  }
+
+  if (length != expected_length || !g_str_has_prefix (contents, COMPRESSIBLE_TEXT)) {
+    g_printerr ("wrong data downloaded\n");
+    errors++;
+  } else if (!data.monotonic) {
+    g_printerr ("download progress went backwards\n");
+    errors++;
+  } else if (data.received != expected_length || data.total != expected_length) {
+    g_printerr ("wrong download progress\n");
+    errors++;
+  } else if (rest_proxy_call_get_payload (call) != NULL) {
+    g_printerr ("download was also stored in the payload\n");
+    errors++;
+  }
+
+  /* An fsync() can't be seen from here, but the flushes of a stream can */
+  if (stream) {
+    flushes = ((FlushCountingStream *)stream)->flushes;
+    if ((sync == REST_DOWNLOAD_SYNC_NONE && flushes != 0) ||
+        (sync == REST_DOWNLOAD_SYNC_ON_COMPLETE && flushes != 1) ||
+        (sync == REST_DOWNLOAD_SYNC_PERIODIC && flushes < 2)) {
+      g_printerr ("wrong number of flushes for sync policy %d: %u\n",
+                  sync, flushes);
+      errors++;
+    }
+  }
+
+ done:
+  if (use_fd) {
+    close (fd);
+    g_unlink (filename);
+    g_free (filename);
+  } else {
+    g_object_unref (stream);
+  }
+  g_free (contents);
+  g_object_unref (call);
+  g_main_loop_unref (data.loop);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  gsize uploaded;
+  gboolean success;
+} ResumableData;
+
+static void
+resumable_upload_cb (RestProxyCall *call,
+                     gsize          total,
+                     gsize          uploaded,
+                     const GError  *error,
+                     GObject       *weak_object,
+                     gpointer       user_data)
+{
+  ResumableData *data = user_data;
+
+  data->uploaded = uploaded;
+
+  if (error) {
+    g_printerr ("Resumable upload failed: %s\n", error->message);
+    g_main_loop_quit (data->loop);
+  } else if (uploaded == total) {
+    data->success = TRUE;
+    g_main_loop_quit (data->loop);
+  }
+}
+
+static void
+resumable_upload_test (RestProxy *proxy)
+{
+  RestProxyCall *call;
+  GInputStream *stream;
+  GString *data;
+  ResumableData result = { NULL, };
+  GError *error = NULL;
+  int i;
+
+  data = g_string_new (NULL);
+  for (i = 0; i < 10000; i++)
+    g_string_append (data, COMPRESSIBLE_TEXT);
+
+  stream = g_memory_input_stream_new_from_data (data->str, data->len, NULL);
+  result.loop = g_main_loop_new (NULL, FALSE);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "resumable");
+  rest_proxy_call_set_method (call, "POST");
+
+  if (!rest_proxy_call_upload_resumable (call, stream, data->len, NULL,
+                                         128 * 1024, resumable_upload_cb,
+                                         NULL, &result, &error)) {
+    g_printerr ("Resumable upload failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+    goto done;
+  }
+
+  g_main_loop_run (result.loop);
+
+  if (!result.success || result.uploaded != data->len) {
+    g_printerr ("Resumable upload did not complete\n");
+    errors++;
+  } else if (!resumable_failed ||
+             resumable_data->len != data->len ||
+             memcmp (resumable_data->str, data->str, data->len) != 0) {
+    g_printerr ("Resumable upload sent the wrong data\n");
+    errors++;
+  } else if (g_strcmp0 (rest_proxy_call_get_payload (call), "done") != 0) {
+    g_printerr ("Resumable upload has the wrong payload\n");
+    errors++;
+  }
+
+ done:
+  g_object_unref (call);
+  g_object_unref (stream);
+  g_main_loop_unref (result.loop);
+  g_string_free (data, TRUE);
+}
+
+static RestProxyCall *
+new_part_call (RestProxy *proxy, guint part_number, gpointer user_data)
+{
+  RestProxyCall *call;
+  char *n;
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "parts/part");
+  rest_proxy_call_set_method (call, "PUT");
+  n = g_strdup_printf ("%u", part_number);
+  rest_proxy_call_add_param (call, "n", n);
+  g_free (n);
+
+  /* Something that can't go in the query string */
+  if (user_data)
+    rest_proxy_call_add_param_full (call,
+                                    rest_param_new_full ("blob", REST_MEMORY_STATIC,
+                                                         "\0\1", 2,
+                                                         "application/octet-stream",
+                                                         NULL));
+
+  return call;
+}
+
+static RestProxyCall *
+new_complete_call (RestProxy          *proxy,
+                   const gchar * const *part_ids,
+                   guint               n_parts,
+                   gpointer            user_data)
+{
+  RestProxyCall *call;
+  char *ids;
+
+  ids = g_strjoinv (",", (char **)part_ids);
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "parts/complete");
+  rest_proxy_call_set_method (call, "POST");
+  rest_proxy_call_add_param (call, "ids", ids);
+  g_free (ids);
+
+  return call;
+}
+
+static void
+parts_progress_cb (RestProxy *proxy,
+                   goffset    uploaded,
+                   goffset    total,
+                   gpointer   user_data)
+{
+  ResumableData *data = user_data;
+
+  data->uploaded = uploaded;
+}
+
+static void
+parts_done_cb (GObject      *source,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+  ResumableData *data = user_data;
+  RestProxyCall *call;
+  GError *error = NULL;
+
+  call = rest_proxy_upload_parts_finish (REST_PROXY (source), result, &error);
+  if (call) {
+    data->success = rest_proxy_call_get_status_code (call) == SOUP_STATUS_OK;
+    g_object_unref (call);
+  } else {
+    g_printerr ("Part upload failed: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  g_main_loop_quit (data->loop);
+}
+
+static void
+parts_upload_test (RestProxy *proxy)
+{
+  static const RestProxyPartUploadFuncs funcs = {
+    new_part_call,
+    NULL,
+    new_complete_call
+  };
+  GInputStream *stream;
+  GString *data;
+  ResumableData result = { NULL, };
+  int i;
+
+  data = g_string_new (NULL);
+  for (i = 0; i < 10000; i++)
+    g_string_append (data, COMPRESSIBLE_TEXT);
+
+  upload_parts = g_hash_table_new_full (NULL, NULL, NULL,
+                                        (GDestroyNotify)g_string_free);
+  upload_part_failed = FALSE;
+
+  stream = g_memory_input_stream_new_from_data (data->str, data->len, NULL);
+  result.loop = g_main_loop_new (NULL, FALSE);
+
+  rest_proxy_upload_parts_async (proxy, stream, -1, 64 * 1024, 3,
+                                 &funcs, NULL,
+                                 parts_progress_cb, &result,
+                                 NULL, parts_done_cb, &result);
+  g_main_loop_run (result.loop);
+
+  if (!result.success || !upload_part_failed) {
+    g_printerr ("Part upload did not complete\n");
+    errors++;
+  } else if (result.uploaded != (goffset)data->len) {
+    g_printerr ("Part upload progress ended at %" G_GSIZE_FORMAT "\n",
+                result.uploaded);
+    errors++;
+  }
+
+  g_hash_table_destroy (upload_parts);
+  g_object_unref (stream);
+  g_main_loop_unref (result.loop);
+  g_string_free (data, TRUE);
+}
+
+/* A part call with a parameter that can't be sent fails the upload */
+static void
+parts_binary_param_test (RestProxy *proxy)
+{
+  static const RestProxyPartUploadFuncs funcs = {
+    new_part_call,
+    NULL,
+    new_complete_call
+  };
+  GInputStream *stream;
+  ResumableData result = { NULL, };
+
+  upload_parts = g_hash_table_new_full (NULL, NULL, NULL,
+                                        (GDestroyNotify)g_string_free);
+
+  stream = g_memory_input_stream_new_from_data (COMPRESSIBLE_TEXT,
+                                                strlen (COMPRESSIBLE_TEXT), NULL);
+  result.loop = g_main_loop_new (NULL, FALSE);
+
+  rest_proxy_upload_parts_async (proxy, stream, -1, 64 * 1024, 3,
+                                 &funcs, GINT_TO_POINTER (TRUE),
+                                 NULL, NULL,
+                                 NULL, parts_done_cb, &result);
+  g_main_loop_run (result.loop);
+
+  if (result.success || g_hash_table_size (upload_parts) != 0) {
+    g_printerr ("Part with a binary parameter was uploaded\n");
+    errors++;
+  }
+
+  g_hash_table_destroy (upload_parts);
+  g_object_unref (stream);
+  g_main_loop_unref (result.loop);
+}
+
+typedef struct {
+  GMainLoop *loop;
+  gboolean returned;
+  gboolean cancelled;
+} CancelledData;
+
+static void
+parts_cancelled_cb (GObject      *source,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  CancelledData *data = user_data;
+  RestProxyCall *call;
+  GError *error = NULL;
+
+  if (!data->returned) {
+    g_printerr ("Part upload completed before it returned\n");
+    errors++;
+  }
+
+  call = rest_proxy_upload_parts_finish (REST_PROXY (source), result, &error);
+  if (call) {
+    g_object_unref (call);
+  } else {
+    data->cancelled = g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+    g_error_free (error);
+  }
+
+  g_main_loop_quit (data->loop);
+}
+
+/* An upload started with a cancelled cancellable fails, but only from idle */
+static void
+parts_cancelled_test (RestProxy *proxy)
+{
+  static const RestProxyPartUploadFuncs funcs = {
+    new_part_call,
+    NULL,
+    new_complete_call
+  };
+  GInputStream *stream;
+  GCancellable *cancellable;
+  CancelledData data = { NULL, };
+
+  upload_parts = g_hash_table_new_full (NULL, NULL, NULL,
+                                        (GDestroyNotify)g_string_free);
+
+  stream = g_memory_input_stream_new_from_data (COMPRESSIBLE_TEXT,
+                                                strlen (COMPRESSIBLE_TEXT), NULL);
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  data.loop = g_main_loop_new (NULL, FALSE);
+
+  rest_proxy_upload_parts_async (proxy, stream, -1, 64 * 1024, 3,
+                                 &funcs, NULL,
+                                 NULL, NULL,
+                                 cancellable, parts_cancelled_cb, &data);
+  data.returned = TRUE;
+  g_main_loop_run (data.loop);
+
+  if (!data.cancelled || g_hash_table_size (upload_parts) != 0) {
+    g_printerr ("Cancelled part upload was not cancelled\n");
+    errors++;
+  }
+
+  g_hash_table_destroy (upload_parts);
+  g_object_unref (cancellable);
+  g_object_unref (stream);
+  g_main_loop_unref (data.loop);
+}
+
+int
+main (int argc, char **argv)
+{
+  SoupSession *session;
+  SoupServer *server;
+  char *url;
+  RestProxy *proxy;
+
+  g_type_init ();
+
+  session = soup_session_async_new ();
+
+  server = soup_server_new (NULL);
+  g_signal_connect (server, "request-started",
+                    G_CALLBACK (request_started_cb), NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = rest_proxy_new (url, FALSE);
+  g_free (url);
+
+  ping_test (proxy);
+  echo_test (proxy);
+  request_test (proxy);
+  signed_request_test (proxy);
+  reverse_test (proxy);
+  status_ok_test (proxy, SOUP_STATUS_OK);
+  status_ok_test (proxy, SOUP_STATUS_NO_CONTENT);
+  /* status_ok_test (proxy, SOUP_STATUS_MULTIPLE_CHOICES); */
+  status_error_test (proxy, SOUP_STATUS_BAD_REQUEST);
+  status_error_test (proxy, SOUP_STATUS_NOT_IMPLEMENTED);
+
+  test_status_ok (proxy, "useragent/none");
+  rest_proxy_set_user_agent (proxy, "TestSuite-1.0");
+  test_status_ok (proxy, "useragent/testsuite");
+
+  gzip_test (proxy, NULL);
+  gzip_test (proxy, "zlib");
+  gzip_test (proxy, "raw");
+  truncated_gzip_test (proxy);
+  spill_test (proxy);
+  buffer_pool_test (proxy);
+  max_response_size_test (proxy, "large", 1024, FALSE, FALSE);
+  max_response_size_test (proxy, "large", 1024, FALSE, TRUE);
+  max_response_size_test (proxy, "gzip", 512, TRUE, FALSE);
+  compress_request_test (proxy);
+  stream_upload_test (proxy, TRUE);
+  stream_upload_test (proxy, FALSE);
+  fd_upload_test (proxy, TRUE);
+  fd_upload_test (proxy, FALSE);
+  shared_param_test (proxy);
+  expect_continue_test (proxy, FALSE);
+  expect_continue_test (proxy, TRUE);
+  expect_continue_upload_test (proxy);
+  download_test (proxy, REST_DOWNLOAD_SYNC_NONE, FALSE);
+  download_test (proxy, REST_DOWNLOAD_SYNC_ON_COMPLETE, FALSE);
+  download_test (proxy, REST_DOWNLOAD_SYNC_PERIODIC, FALSE);
+  download_test (proxy, REST_DOWNLOAD_SYNC_NONE, TRUE);
+  download_test (proxy, REST_DOWNLOAD_SYNC_ON_COMPLETE, TRUE);
+  download_test (proxy, REST_DOWNLOAD_SYNC_PERIODIC, TRUE);
+  resumable_upload_test (proxy);
+  g_object_set (proxy, "max-conns-per-host", 3, NULL);
+  parts_upload_test (proxy);
+  parts_binary_param_test (proxy);
+  parts_cancelled_test (proxy);
 
   return errors != 0;
 }
@@ -0,0 +1,260 @@
+/*
+ * librest - RESTful web services access
+ * Copyright (c) 2009 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <rest/rest-proxy.h>
+#include <rest/oauth-proxy.h>
+
+#define RESOURCE_SIZE (5 * 1024 * 1024 + 123)
+
+static int errors = 0;
+static GMainLoop *loop = NULL;
+static char *resource;
+static int requests;
+static gboolean failed_once;
+
+static void
+server_callback (SoupServer *server, SoupMessage *msg,
+                 const char *path, GHashTable *query,
+                 SoupClientContext *client, gpointer user_data)
+{
+  SoupRange *ranges;
+  int n_ranges;
+  goffset start, end;
+
+  requests++;
+
+  if (g_str_equal (path, "/norange")) {
+    /* Stop the server from answering the range itself */
+    soup_message_headers_remove (msg->request_headers, "Range");
+    soup_message_set_status (msg, SOUP_STATUS_OK);
+    soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
+                              resource, RESOURCE_SIZE);
+    return;
+  }
+
+  if (!soup_message_headers_get_ranges (msg->request_headers, RESOURCE_SIZE,
+                                        &ranges, &n_ranges)) {
+    soup_message_set_status (msg, SOUP_STATUS_BAD_REQUEST);
+    return;
+  }
+
+  start = ranges[0].start;
+  end = ranges[0].end;
+  soup_message_headers_free_ranges (msg->request_headers, ranges);
+
+  /* Fail the first range after the probe once, to check it is retried */
+  if (g_str_equal (path, "/flaky") && start > 0 && !failed_once) {
+    failed_once = TRUE;
+    soup_message_set_status (msg, SOUP_STATUS_SERVICE_UNAVAILABLE);
+    return;
+  }
+
+  soup_message_set_status (msg, SOUP_STATUS_PARTIAL_CONTENT);
+  soup_message_headers_set_content_range (msg->response_headers,
+                                          start, end, RESOURCE_SIZE);
+  soup_message_body_append (msg->response_body, SOUP_MEMORY_STATIC,
+                            resource + start, end - start + 1);
+}
+
+static void
+progress_cb (RestProxyCall *call,
+             goffset        received,
+             goffset        total,
+             gpointer       user_data)
+{
+  goffset *last = user_data;
+
+  if (received < *last || received > RESOURCE_SIZE) {
+    g_printerr ("unexpected progress %" G_GOFFSET_FORMAT "\n", received);
+    errors++;
+  }
+  *last = received;
+}
+
+static void
+download_cb (GObject      *source,
+             GAsyncResult *result,
+             gpointer      user_data)
+{
+  GError *error = NULL;
+
+  if (!rest_proxy_call_download_finish (REST_PROXY_CALL (source), result, &error)) {
+    g_printerr ("download failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  }
+
+  g_main_loop_quit (loop);
+}
+
+static void
+download_test (RestProxy *proxy, const char *function, int expected_requests)
+{
+  RestProxyCall *call;
+  char *filename, *contents, *junk;
+  gsize length;
+  goffset received = 0;
+  int fd;
+
+  fd = g_file_open_tmp ("rest-ranged-XXXXXX", &filename, NULL);
+  g_assert (fd >= 0);
+
+  /* Start with a longer file, none of which should be left afterwards */
+  junk = g_malloc0 (RESOURCE_SIZE + 4096);
+  if (write (fd, junk, RESOURCE_SIZE + 4096) != RESOURCE_SIZE + 4096)
+    errors++;
+  g_free (junk);
+
+  requests = 0;
+  failed_once = FALSE;
+
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, function);
+  rest_proxy_call_download_ranges_to_fd_async (call, fd, 4,
+                                               REST_DOWNLOAD_SYNC_ON_COMPLETE,
+                                               NULL, progress_cb, &received,
+                                               download_cb, NULL);
+  g_main_loop_run (loop);
+  g_object_unref (call);
+  close (fd);
+
+  if (received != RESOURCE_SIZE) {
+    g_printerr ("%s: progress ended at %" G_GOFFSET_FORMAT "\n", function, received);
+    errors++;
+  }
+
+  if (requests != expected_requests) {
+    g_printerr ("%s: expected %d requests, got %d\n",
+                function, expected_requests, requests);
+    errors++;
+  }
+
+  if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+    errors++;
+  } else {
+    if (length != RESOURCE_SIZE || memcmp (contents, resource, length) != 0) {
+      g_printerr ("%s: downloaded file is wrong\n", function);
+      errors++;
+    }
+    g_free (contents);
+  }
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+signed_download_cb (GObject      *source,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  GError *error = NULL;
+
+  if (rest_proxy_call_download_finish (REST_PROXY_CALL (source), result, &error)) {
+    g_printerr ("signed call was downloaded in ranges\n");
+    errors++;
+  } else {
+    if (!g_error_matches (error, REST_PROXY_CALL_ERROR, REST_PROXY_CALL_FAILED)) {
+      g_printerr ("unexpected error: %s\n", error->message);
+      errors++;
+    }
+    g_error_free (error);
+  }
+
+  g_main_loop_quit (loop);
+}
+
+/* Copies of a signed request would all carry the same signature */
+static void
+signed_test (const char *url)
+{
+  RestProxy *proxy;
+  RestProxyCall *call;
+  int fd;
+
+  fd = open ("/dev/null", O_WRONLY);
+  g_assert (fd >= 0);
+
+  requests = 0;
+
+  proxy = oauth_proxy_new ("key", "secret", url, FALSE);
+  call = rest_proxy_new_call (proxy);
+  rest_proxy_call_set_function (call, "ranges");
+  rest_proxy_call_download_ranges_to_fd_async (call, fd, 4,
+                                               REST_DOWNLOAD_SYNC_NONE,
+                                               NULL, NULL, NULL,
+                                               signed_download_cb, NULL);
+  g_main_loop_run (loop);
+
+  if (requests != 0) {
+    g_printerr ("signed call made %d requests\n", requests);
+    errors++;
+  }
+
+  g_object_unref (call);
+  g_object_unref (proxy);
+  close (fd);
+}
+
+int
+main (int argc, char **argv)
+{
+  SoupServer *server;
+  RestProxy *proxy;
+  char *url;
+  int i;
+
+  g_type_init ();
+  loop = g_main_loop_new (NULL, FALSE);
+
+  resource = g_malloc (RESOURCE_SIZE);
+  for (i = 0; i < RESOURCE_SIZE; i++)
+    resource[i] = (i * 7 + i / 4096) & 0xff;
+
+  server = soup_server_new (NULL);
+  soup_server_add_handler (server, NULL, server_callback, NULL, NULL);
+  soup_server_run_async (server);
+
+  url = g_strdup_printf ("http://127.0.0.1:%d/", soup_server_get_port (server));
+  proxy = rest_proxy_new (url, FALSE);
+  g_object_set (proxy, "max-conns-per-host", 4, NULL);
+
+  /* The probe, then four ranges */
+  download_test (proxy, "ranges", 5);
+  /* As above, with one range failing once */
+  download_test (proxy, "flaky", 6);
+  /* Everything comes back in answer to the probe */
+  download_test (proxy, "norange", 1);
+
+  signed_test (url);
+  g_free (url);
+
+  g_object_unref (proxy);
+  g_free (resource);
+
+  return errors != 0;
+}
@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <libsoup/soup.h>
 #include <rest/rest-proxy.h>
+#include <rest/rest-request.h>
 
 static volatile int errors = 0;
 static const gboolean verbose = FALSE;
@@ -37,6 +38,20 @@ server_callback (SoupServer *server, SoupMessage *msg,
 {
   if (g_str_equal (path, "/ping")) {
     soup_message_set_status (msg, SOUP_STATUS_OK);
+  } else if (g_str_equal (path, "/echo") && msg->method == SOUP_METHOD_POST) {
+    GHashTable *form;
+    const char *value;
+
+    form = soup_form_decode (msg->request_body->data);
+    value = g_hash_table_lookup (form, "value");
+    if (value) {
+      soup_message_set_response (msg, "text/plain", SOUP_MEMORY_COPY,
+                                 value, strlen (value));
+      soup_message_set_status (msg, SOUP_STATUS_OK);
+    } else {
+      soup_message_set_status (msg, SOUP_STATUS_BAD_REQUEST);
+    }
+    g_hash_table_destroy (form);
   } else {
     soup_message_set_status (msg, SOUP_STATUS_NOT_IMPLEMENTED);
   }
@@ -76,6 +91,32 @@ func (gpointer data)
   return NULL;
 }
 
+/* A blocking POST with a #RestRequest sends its parameters in the body */
+static void
+request_test (const char *url)
+{
+  RestProxy *proxy;
+  RestRequest *request;
+  GError *error = NULL;
+
+  proxy = rest_proxy_new (url, FALSE);
+  request = rest_request_new (proxy, "POST", "echo");
+  rest_request_add_param (request, "value", "echo me");
+
+  if (!rest_request_run (request, &error)) {
+    g_printerr ("Request failed: %s\n", error->message);
+    g_error_free (error);
+    errors++;
+  } else if (rest_request_get_status_code (request) != SOUP_STATUS_OK ||
+             g_strcmp0 (rest_request_get_payload (request), "echo me") != 0) {
+    g_printerr ("Wrong response to request\n");
+    errors++;
+  }
+
+  rest_request_free (request);
+  g_object_unref (proxy);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -105,6 +146,8 @@ main (int argc, char **argv)
     g_thread_join (threads[i]);
   }
 
+  request_test (url);
+
   soup_server_quit (server);
   g_free (url);
 